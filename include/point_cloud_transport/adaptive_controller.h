@@ -0,0 +1,141 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Controller adapting the encoder configs of a Publisher to a bandwidth target and CPU budget.
+ */
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <ros/node_handle.h>
+#include <ros/publisher.h>
+#include <ros/time.h>
+#include <ros/wall_timer.h>
+
+#include <point_cloud_transport/AdaptiveControllerState.h>
+#include <point_cloud_transport/publisher.h>
+
+namespace point_cloud_transport
+{
+
+//! \brief One encoder parameter moved by the AdaptiveController.
+struct AdaptiveParameter
+{
+  //! \brief How the parameter influences the encoding.
+  enum class Kind
+  {
+    //! \brief Higher values give larger output and usually take more CPU (e.g. quantization bits).
+    QUALITY,
+    //! \brief Higher values give smaller output and take more CPU (e.g. compression level).
+    COMPRESSION,
+    //! \brief Higher values give larger output and take less CPU (e.g. encoder speed).
+    SPEED,
+  };
+
+  //! \brief Name of the transport. Key `transport`.
+  std::string transport;
+
+  //! \brief Name of the int or double dynamic reconfigure parameter of the transport's publisher. Key `name`.
+  std::string name;
+
+  //! \brief How the parameter influences the encoding. Key `kind` (`quality`, `compression` or `speed`).
+  Kind kind {Kind::QUALITY};
+
+  //! \brief The lowest value the controller may set. Key `min`.
+  double min {0.0};
+
+  //! \brief The highest value the controller may set. Key `max`.
+  double max {0.0};
+
+  //! \brief Change of the value in one control step. Int parameters move by at least 1. Key `step`.
+  double step {1.0};
+};
+
+struct AdaptiveControllerOptions
+{
+  //! \brief Target output rate of all transports together in bytes per second. Zero means unlimited.
+  //!        Parameter `target_bandwidth` (double).
+  double target_bandwidth {0.0};
+
+  //! \brief Maximum encoding time of all transports together per second of wall time (1.0 is one full CPU core).
+  //!        Zero means unlimited. Parameter `cpu_budget` (double).
+  double cpu_budget {0.0};
+
+  //! \brief Rate of the control steps (Hz). Parameter `rate` (double).
+  double rate {1.0};
+
+  //! \brief Relative dead band around the targets. The load is over a target if it exceeds it by more than this
+  //!        fraction, and the quality is raised only when it is below all targets by more than this fraction.
+  //!        Parameter `tolerance` (double).
+  double tolerance {0.1};
+
+  //! \brief The controlled parameters. Parameter `parameters` (list of dicts with the keys of AdaptiveParameter).
+  std::vector<AdaptiveParameter> parameters;
+};
+
+/**
+ * \brief Moves quality and compression parameters of the transports of a Publisher within operator-set bounds so that
+ *        the encoded output fits a bandwidth target and the encoding fits a CPU budget.
+ *
+ * Each control step compares the encoding statistics of the publisher (Publisher::getStatistics()) with the previous
+ * step to get the output rate and the encoding time per second. If the output rate is over the target, compression is
+ * raised first (if the CPU budget allows) and quality is lowered when compression hits its bounds. If the encoding
+ * time is over the budget, compression is lowered first, then quality. When both are well below their targets, the
+ * quality is slowly raised again. Steps in which nothing was encoded change nothing.
+ *
+ * The parameters are changed via Publisher::setTransportConfig(), so the current values are visible in
+ * rqt_reconfigure, and the controller continues from values changed there by the operator. The output rate counts
+ * each encoded message once, so it corresponds to the link load with one subscriber per transport.
+ *
+ * Each step publishes its decision on topic `<base_topic>/adaptive_controller` (AdaptiveControllerState).
+ *
+ * Publisher starts a controller by itself if parameter `<base_topic>/adaptive/parameters` is set.
+ */
+class AdaptiveController : boost::noncopyable
+{
+public:
+  /**
+   * \brief Start controlling the publisher.
+   * \param[in] nh Node handle used for the timer, the state topic and for reading the parameters. The parameters are
+   *               read from `<base_topic>/adaptive/<name>`, and `options` are their defaults.
+   * \param[in] publisher The controlled publisher.
+   * \param[in] options Default options.
+   */
+  AdaptiveController(ros::NodeHandle& nh, const Publisher& publisher, const AdaptiveControllerOptions& options = {});
+
+  //! \brief Get the options in effect (after reading the parameters).
+  const AdaptiveControllerOptions& getOptions() const;
+
+  /**
+   * \brief Run one control step now (this is normally done by the timer).
+   * \return The decision (it is also published).
+   */
+  AdaptiveControllerState step();
+
+  //! \brief Stop the control steps. The parameters keep their last values.
+  void shutdown();
+
+private:
+  //! \brief Move all parameters of the given kind in the given direction.
+  //! \return Whether some parameter was changed.
+  bool move(AdaptiveParameter::Kind kind, double direction);
+
+  Publisher publisher_;
+  AdaptiveControllerOptions options_;
+  ros::Publisher state_pub_;
+  ros::WallTimer timer_;
+
+  //! \brief Cumulative output bytes and encoding time of each transport at the previous step.
+  std::map<std::string, std::pair<uint64_t, double>> last_totals_;
+  ros::WallTime last_step_;
+};
+
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Base class for publisher plugins that send each cloud as a series of independently encoded chunks.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <ros/console.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudChunk.h>
+#include <point_cloud_transport/simple_publisher_plugin.h>
+#include <point_cloud_transport/transport_statistics.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Base class for plugins to Publisher that split each cloud into chunks which are encoded and published one by
+ *        one.
+ *
+ * Each chunk is published as soon as it is encoded, so sending the first chunks overlaps with encoding the next ones,
+ * and the subscriber can decode them while the rest is still on the way. Only one encoded chunk is held in memory at a
+ * time. The matching subscriber should be derived from ChunkedSubscriberPlugin.
+ *
+ * The chunks hold consecutive ranges of points; chunks of organized clouds hold whole rows. The size of a chunk is
+ * given by parameter `<transport topic>/chunk_size` (bytes of raw data, default 4 MiB). A cloud that fits into one
+ * chunk is encoded without copying it.
+ *
+ * A subclass needs to implement getTransportName() and encodeChunk(). encode() (e.g. via PointCloudCodec) encodes the
+ * whole cloud into a single chunk. Encoding times and sizes are recorded in the statistics for each chunk.
+ *
+ * \tparam Config Type of the publisher dynamic configuration.
+ */
+template<class Config = point_cloud_transport::NoConfigConfig>
+class ChunkedPublisherPlugin : public SimplePublisherPlugin<PointCloudChunk, Config>
+{
+public:
+  typedef SimplePublisherPlugin<PointCloudChunk, Config> Base;
+  typedef typename Base::TypedEncodeResult TypedEncodeResult;
+  typedef typename Base::PublishFn PublishFn;
+  typedef typename Base::PublishPtrFn PublishPtrFn;
+
+  /**
+   * \brief Encode the points of one chunk.
+   *
+   * Only the data of the returned message need to be filled; the rest is filled by this class.
+   *
+   * \param[in] chunk The points of the chunk as a standalone cloud with the header of the whole cloud.
+   * \param[in] config Config of the compression.
+   * \return The chunk message, empty value, or an error message.
+   */
+  virtual TypedEncodeResult encodeChunk(const sensor_msgs::PointCloud2& chunk, const Config& config) const = 0;
+
+  TypedEncodeResult encodeTyped(const sensor_msgs::PointCloud2& raw, const Config& config) const override
+  {
+    auto res = this->encodeChunk(raw, config);
+    if (res && res.value())
+      this->fillChunkInfo(res.value().value(), raw, next_cloud_id_++, 0, 1, 0, raw.height * raw.width);
+    return res;
+  }
+
+  //! \brief Size of the raw data of one chunk (in bytes).
+  size_t getChunkSize() const
+  {
+    return chunk_size_;
+  }
+
+  /**
+   * \brief Split a cloud into chunks.
+   * \param[in] height Height of the cloud.
+   * \param[in] width Width of the cloud.
+   * \param[in] point_step Size of one point.
+   * \param[in] chunk_size Maximum size of the raw data of one chunk (chunks have at least one point or one row).
+   * \return Pairs of the index of the first point and the number of points of each chunk. There is always at least one
+   *         chunk (possibly with no points).
+   */
+  static std::vector<std::pair<uint32_t, uint32_t>> getChunkRanges(
+      uint32_t height, uint32_t width, uint32_t point_step, size_t chunk_size)
+  {
+    const size_t num_points = static_cast<size_t>(height) * width;
+    if (num_points == 0)
+      return {{0, 0}};
+
+    size_t points_per_chunk = std::max<size_t>(1, chunk_size / std::max<uint32_t>(1, point_step));
+    if (height > 1)
+      points_per_chunk = std::max<size_t>(1, points_per_chunk / width) * width;
+
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    for (size_t first = 0; first < num_points; first += points_per_chunk)
+      ranges.emplace_back(first, std::min(points_per_chunk, num_points - first));
+    return ranges;
+  }
+
+protected:
+  void initializeEncoder() override
+  {
+    Base::initializeEncoder();
+    int chunk_size;
+    this->nh().param("chunk_size", chunk_size, static_cast<int>(chunk_size_));
+    chunk_size_ = static_cast<size_t>(std::max(1, chunk_size));
+  }
+
+  void publish(const sensor_msgs::PointCloud2& message, const PublishFn& publish_fn) const override
+  {
+    this->publishChunks(message, [&publish_fn](const boost::shared_ptr<const PointCloudChunk>& chunk)
+    {
+      publish_fn(*chunk);
+    });
+  }
+
+  void publishPtr(const sensor_msgs::PointCloud2ConstPtr& message, const PublishPtrFn& publish_fn) const override
+  {
+    this->publishChunks(*message, publish_fn);
+  }
+
+  /**
+   * \brief Encode and publish the chunks of the cloud one by one. If a chunk fails to encode, the rest of the cloud is
+   *        not published, because the subscriber could not assemble it anyway.
+   */
+  void publishChunks(const sensor_msgs::PointCloud2& raw, const PublishPtrFn& publish_fn) const
+  {
+    const uint32_t cloud_id = next_cloud_id_++;
+    const auto ranges = getChunkRanges(raw.height, raw.width, raw.point_step, chunk_size_);
+    const auto config = this->getCurrentConfig();
+    sensor_msgs::PointCloud2 chunk_storage;
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+      const auto& range = ranges[i];
+      if (ranges.size() > 1)
+        extractChunk(raw, range.first, range.second, chunk_storage);
+      const auto& chunk = ranges.size() > 1 ? chunk_storage : raw;
+
+      const auto start = TransportStatisticsCollector::Clock::now();
+      auto res = this->encodeChunk(chunk, config);
+      const auto duration = TransportStatisticsCollector::Clock::now() - start;
+      if (!res || !res.value())
+      {
+        this->recordEncoding(duration, chunk, nullptr);
+        if (!res)
+          ROS_ERROR("Error encoding chunk %zu/%zu by transport %s: %s.", i + 1, ranges.size(),
+                    this->getTransportName().c_str(), res.error().c_str());
+        return;
+      }
+
+      auto msg = boost::make_shared<PointCloudChunk>(std::move(res.value().value()));
+      this->fillChunkInfo(*msg, raw, cloud_id, i, ranges.size(), range.first, range.second);
+      this->recordEncoding(duration, chunk, msg.get());
+      publish_fn(msg);
+    }
+  }
+
+  //! \brief Copy the given range of points (whole rows for organized clouds) into a standalone cloud.
+  static void extractChunk(const sensor_msgs::PointCloud2& raw, uint32_t first_point, uint32_t num_points,
+                           sensor_msgs::PointCloud2& chunk)
+  {
+    chunk.header = raw.header;
+    chunk.fields = raw.fields;
+    chunk.is_bigendian = raw.is_bigendian;
+    chunk.point_step = raw.point_step;
+    chunk.is_dense = raw.is_dense;
+    size_t offset, length;
+    if (raw.height > 1)
+    {
+      chunk.height = num_points / raw.width;
+      chunk.width = raw.width;
+      chunk.row_step = raw.row_step;
+      offset = static_cast<size_t>(first_point / raw.width) * raw.row_step;
+      length = static_cast<size_t>(chunk.height) * raw.row_step;
+    }
+    else
+    {
+      chunk.height = 1;
+      chunk.width = num_points;
+      chunk.row_step = num_points * raw.point_step;
+      offset = static_cast<size_t>(first_point) * raw.point_step;
+      length = chunk.row_step;
+    }
+    // Do not read past the end of a malformed cloud.
+    offset = std::min(offset, raw.data.size());
+    length = std::min(length, raw.data.size() - offset);
+    chunk.data.resize(length);
+    if (length > 0)
+      memcpy(chunk.data.data(), raw.data.data() + offset, length);
+  }
+
+  static void fillChunkInfo(PointCloudChunk& msg, const sensor_msgs::PointCloud2& raw, uint32_t cloud_id,
+                            uint32_t chunk_index, uint32_t num_chunks, uint32_t first_point, uint32_t num_points)
+  {
+    msg.header = raw.header;
+    msg.cloud_id = cloud_id;
+    msg.chunk_index = chunk_index;
+    msg.num_chunks = num_chunks;
+    msg.height = raw.height;
+    msg.width = raw.width;
+    msg.first_point = first_point;
+    msg.num_points = num_points;
+  }
+
+private:
+  size_t chunk_size_ {4 * 1024 * 1024};
+  mutable std::atomic<uint32_t> next_cloud_id_ {0};
+};
+
+}
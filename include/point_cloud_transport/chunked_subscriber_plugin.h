@@ -0,0 +1,215 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Base class for subscriber plugins that receive each cloud as a series of independently encoded chunks.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ros/console.h>
+#include <ros/node_handle.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudChunk.h>
+#include <point_cloud_transport/simple_subscriber_plugin.h>
+#include <point_cloud_transport/transport_hints.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Base class for plugins to Subscriber that receive clouds split into chunks by a ChunkedPublisherPlugin.
+ *
+ * Each chunk is decoded as soon as it arrives and copied into the whole cloud, which is passed to the subscriber
+ * callback once all its chunks are received. The chunks can also be processed one by one via
+ * TransportHints::chunkCallback(). The whole clouds are allocated via allocateCloud(), so they can come from the pool
+ * configured by TransportHints::outputPoolSize().
+ *
+ * Clouds whose chunks are lost are dropped once chunks of more than `<transport>/max_incomplete_clouds` (default 2)
+ * newer clouds arrive. Chunks that do not complete a cloud are counted as messages without output in the statistics.
+ *
+ * The latest-only mode (TransportHints::latestOnly()) is not supported, because it would drop chunks of every cloud.
+ *
+ * A subclass needs to implement getTransportName() and decodeChunk(). decode() (e.g. via PointCloudCodec) returns the
+ * points of the single decoded chunk.
+ *
+ * \tparam Config Type of the subscriber dynamic configuration.
+ */
+template<class Config = point_cloud_transport::NoConfigConfig>
+class ChunkedSubscriberPlugin : public SimpleSubscriberPlugin<PointCloudChunk, Config>
+{
+public:
+  typedef SimpleSubscriberPlugin<PointCloudChunk, Config> Base;
+  typedef typename Base::Callback Callback;
+  typedef typename Base::DecodeResult DecodeResult;
+
+  /**
+   * \brief Decode the points of one chunk.
+   * \param[in] chunk The chunk message.
+   * \param[in] config Config of the decompression.
+   * \return The points of the chunk as a standalone cloud with the header of the message, or an error message.
+   */
+  virtual DecodeResult decodeChunk(const PointCloudChunk& chunk, const Config& config) const = 0;
+
+  DecodeResult decodeTyped(const PointCloudChunk& compressed, const Config& config) const override
+  {
+    return this->decodeChunk(compressed, config);
+  }
+
+protected:
+  bool needsAllMessages() const override
+  {
+    return true;
+  }
+
+  void subscribeImpl(ros::NodeHandle& nh, const std::string& base_topic, uint32_t queue_size,
+                     const Callback& callback, const ros::VoidPtr& tracked_object,
+                     const point_cloud_transport::TransportHints& transport_hints,
+                     bool allow_concurrent_callbacks) override
+  {
+    chunk_callback_ = transport_hints.getChunkCallback();
+    ros::NodeHandle param_nh(transport_hints.getParameterNH(), this->getTransportName());
+    int max_incomplete_clouds;
+    param_nh.param("max_incomplete_clouds", max_incomplete_clouds, static_cast<int>(max_incomplete_clouds_));
+    max_incomplete_clouds_ = static_cast<size_t>(std::max(1, max_incomplete_clouds));
+
+    Base::subscribeImpl(nh, base_topic, queue_size, callback, tracked_object, transport_hints,
+                        allow_concurrent_callbacks);
+  }
+
+  void callback(const PointCloudChunk::ConstPtr& message, const Callback& user_cb) override
+  {
+    const auto res = this->decodeChunk(*message, this->getCurrentConfig());
+    if (!res)
+    {
+      ROS_ERROR("Error decoding chunk %u/%u by transport %s: %s.", message->chunk_index + 1, message->num_chunks,
+                this->getTransportName().c_str(), res.error().c_str());
+      return;
+    }
+    if (!res.value())
+      return;
+
+    const auto& chunk = res.value().value();
+    if (chunk_callback_)
+    {
+      CloudChunk info;
+      info.cloud = chunk;
+      info.chunk_index = message->chunk_index;
+      info.num_chunks = message->num_chunks;
+      info.first_point = message->first_point;
+      info.cloud_height = message->height;
+      info.cloud_width = message->width;
+      chunk_callback_(info);
+    }
+
+    if (message->num_chunks == 1)
+    {
+      user_cb(chunk);
+      return;
+    }
+
+    const auto cloud = this->addChunk(*message, *chunk);
+    if (cloud)
+      user_cb(cloud);
+  }
+
+  /**
+   * \brief Copy the decoded chunk into its cloud.
+   * \return The cloud if this was its last missing chunk, otherwise null.
+   */
+  sensor_msgs::PointCloud2ConstPtr addChunk(const PointCloudChunk& msg, const sensor_msgs::PointCloud2& chunk)
+  {
+    const bool organized = msg.height > 1;
+    if (chunk.height * chunk.width != msg.num_points || (organized && chunk.width != msg.width) ||
+        msg.chunk_index >= msg.num_chunks)
+    {
+      ROS_ERROR("Transport %s received chunk %u/%u with inconsistent dimensions.", this->getTransportName().c_str(),
+                msg.chunk_index + 1, msg.num_chunks);
+      return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = std::find_if(incomplete_.begin(), incomplete_.end(), [&msg](const IncompleteCloud& c)
+    {
+      return c.cloud_id == msg.cloud_id && c.cloud->header.stamp == msg.header.stamp &&
+          c.cloud->height == msg.height && c.cloud->width == msg.width;
+    });
+    if (it == incomplete_.end())
+    {
+      IncompleteCloud c;
+      c.cloud_id = msg.cloud_id;
+      // Organized chunks keep the row padding of the whole cloud.
+      const auto row_step = organized ? chunk.row_step : msg.width * chunk.point_step;
+      c.cloud = this->allocateCloud(static_cast<size_t>(msg.height) * row_step);
+      c.cloud->header = msg.header;
+      c.cloud->height = msg.height;
+      c.cloud->width = msg.width;
+      c.cloud->fields = chunk.fields;
+      c.cloud->is_bigendian = chunk.is_bigendian;
+      c.cloud->point_step = chunk.point_step;
+      c.cloud->row_step = row_step;
+      c.cloud->is_dense = true;
+      c.received.resize(msg.num_chunks, false);
+      incomplete_.push_back(std::move(c));
+      while (incomplete_.size() > max_incomplete_clouds_)
+        incomplete_.pop_front();
+      it = incomplete_.end() - 1;
+    }
+
+    auto& c = *it;
+    const size_t offset = organized ? static_cast<size_t>(msg.first_point / msg.width) * c.cloud->row_step :
+        static_cast<size_t>(msg.first_point) * c.cloud->point_step;
+    if (chunk.point_step != c.cloud->point_step || c.received.size() != msg.num_chunks ||
+        offset + chunk.data.size() > c.cloud->data.size())
+    {
+      ROS_ERROR("Transport %s received chunk %u/%u that does not match the previous chunks of the cloud.",
+                this->getTransportName().c_str(), msg.chunk_index + 1, msg.num_chunks);
+      incomplete_.erase(it);
+      return nullptr;
+    }
+
+    if (!chunk.data.empty())
+      memcpy(c.cloud->data.data() + offset, chunk.data.data(), chunk.data.size());
+    c.cloud->is_dense = c.cloud->is_dense && chunk.is_dense;
+    if (!c.received[msg.chunk_index])
+    {
+      c.received[msg.chunk_index] = true;
+      ++c.num_received;
+    }
+    if (c.num_received < c.received.size())
+      return nullptr;
+
+    sensor_msgs::PointCloud2ConstPtr cloud = c.cloud;
+    incomplete_.erase(it);
+    return cloud;
+  }
+
+private:
+  struct IncompleteCloud
+  {
+    uint32_t cloud_id {0};
+    sensor_msgs::PointCloud2Ptr cloud;
+    std::vector<bool> received;
+    size_t num_received {0};
+  };
+
+  ChunkCallback chunk_callback_;
+  size_t max_incomplete_clouds_ {2};
+  //! \brief Clouds waiting for more chunks (the oldest first). Chunks can be decoded in parallel (decode_threads).
+  std::deque<IncompleteCloud> incomplete_;
+  std::mutex mutex_;
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin sending keyframes and deltas of consecutive clouds.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ros/single_subscriber_publisher.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/DeltaPublisherConfig.h>
+#include <point_cloud_transport/PointCloudDelta.h>
+#include <point_cloud_transport/simple_publisher_plugin.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Publishes periodic keyframes and, in between them, only the points that changed since the previous cloud
+ *        (transport `delta`).
+ *
+ * This suits static sensors watching mostly static scenes. The points of consecutive clouds are matched by their
+ * index. A keyframe is sent every `keyframe_interval` clouds, when the layout of the cloud changes, when too many
+ * points changed, and (optionally) when a new subscriber connects. See cfg/DeltaPublisher.cfg for the configuration.
+ *
+ * The encoder is stateful: each delta refers to the cloud encoded before it. Publishing the same cloud pointer
+ * repeatedly (e.g. for a newly connected subscriber) is served by the encode cache (enabled by default for stateful
+ * encoders) and does not break the chain of deltas.
+ */
+class DeltaPublisher : public point_cloud_transport::SimplePublisherPlugin<PointCloudDelta, DeltaPublisherConfig>
+{
+public:
+  std::string getTransportName() const override;
+
+  TypedEncodeResult encodeTyped(const sensor_msgs::PointCloud2& raw, const DeltaPublisherConfig& config) const override;
+
+  bool isStateful() const override;
+
+protected:
+  void connectCallback(const ros::SingleSubscriberPublisher& pub) override;
+
+private:
+  //! \brief Whether the cloud can be encoded as a delta against the reference.
+  bool hasSameLayout(const sensor_msgs::PointCloud2& raw) const;
+
+  //! \brief Encode the cloud as a keyframe and make it the new reference.
+  PointCloudDelta encodeKeyframe(const sensor_msgs::PointCloud2& raw) const;
+
+  //! \brief Mutex protecting the state of the encoder.
+  mutable std::mutex mutex_;
+  //! \brief The cloud as reconstructed by the subscribers from the messages sent so far.
+  mutable sensor_msgs::PointCloud2 reference_;
+  //! \brief Whether reference_ holds a cloud.
+  mutable bool has_reference_ {false};
+  //! \brief Sequence of the last encoded cloud.
+  mutable uint32_t sequence_ {0};
+  //! \brief Number of deltas sent since the last keyframe.
+  mutable uint32_t num_deltas_ {0};
+  //! \brief A new subscriber asked for a keyframe.
+  mutable std::atomic<bool> keyframe_requested_ {false};
+};
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin reconstructing clouds from keyframes and deltas.
+ */
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudDelta.h>
+#include <point_cloud_transport/simple_subscriber_plugin.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Reconstructs the clouds sent by DeltaPublisher (transport `delta`).
+ *
+ * Each delta is applied to the previously reconstructed cloud. Until the first keyframe arrives (e.g. after
+ * subscribing, or after a lost message), the messages produce no clouds. Repeated messages are ignored. The messages
+ * depend on each other, so they are always decoded one by one in the order they came (`decode_threads` and
+ * `latest_only` are ignored).
+ */
+class DeltaSubscriber : public point_cloud_transport::SimpleSubscriberPlugin<PointCloudDelta>
+{
+public:
+  std::string getTransportName() const override;
+
+  DecodeResult decodeTyped(const PointCloudDelta& compressed, const NoConfigConfig& config) const override;
+
+  bool isStateful() const override;
+
+private:
+  //! \brief Mutex protecting the state of the decoder.
+  mutable std::mutex mutex_;
+  //! \brief The last reconstructed cloud. Null until a keyframe arrives.
+  mutable sensor_msgs::PointCloud2ConstPtr reference_;
+  //! \brief Sequence of reference_.
+  mutable uint32_t sequence_ {0};
+};
+
+}
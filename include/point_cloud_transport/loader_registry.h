@@ -0,0 +1,120 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Process-wide plugin loaders and a persistent cache of the descriptions of the declared transports.
+ */
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <point_cloud_transport/loader_fwds.h>
+
+namespace point_cloud_transport
+{
+
+//! \brief Description of a declared publisher or subscriber plugin.
+struct TransportPluginInfo
+{
+  //! \brief Pluginlib lookup name (e.g. `point_cloud_transport/raw_pub`).
+  std::string lookup_name;
+
+  //! \brief Lookup name without the `_pub` or `_sub` suffix (e.g. `point_cloud_transport/raw`).
+  std::string transport;
+
+  //! \brief The name returned by getTransportName() (e.g. `raw`). Empty if the plugin is not loadable.
+  std::string name;
+
+  //! \brief Whether an instance of the plugin could be created.
+  bool loadable {false};
+
+  //! \brief Whether it is a SingleTopicPublisherPlugin or SingleTopicSubscriberPlugin. The following fields are only
+  //!        valid for such plugins.
+  bool single_topic {false};
+
+  //! \brief Whether the transport topic is the base topic with topic_suffix appended. If not, the topic has to be
+  //!        computed by an instance of the plugin.
+  bool topic_has_suffix {false};
+
+  //! \brief Suffix appended to the base topic to get the transport topic (e.g. `/draco`).
+  std::string topic_suffix;
+
+  //! \brief Type of the messages on the transport topic.
+  std::string data_type;
+
+  //! \brief Type of the dynamic reconfigure config of the plugin (empty if it has none).
+  std::string config_data_type;
+};
+
+/**
+ * \brief The pluginlib loaders shared by all users in the process, and a cache of the descriptions of the plugins.
+ *
+ * Building a pluginlib ClassLoader means crawling the packages and parsing their plugin descriptions, and describing
+ * the plugins means loading all their libraries. The registry builds the loaders only once per process (and only when a
+ * plugin really has to be instantiated), and stores the descriptions in a cache file, so that other processes can
+ * answer queries about the declared transports without loading anything.
+ *
+ * The cache file is `$ROS_HOME/point_cloud_transport_plugins_cache` (`~/.ros/...` if ROS_HOME is not set), or the path
+ * given by environment variable `POINT_CLOUD_TRANSPORT_PLUGIN_CACHE` (set it to an empty string to disable the cache).
+ * The cache is rebuilt when ROS_PACKAGE_PATH, the set of plugin description files exported by the packages or the
+ * contents of any of these files change, or when a plugin library appears, disappears, or changes its modification
+ * time or size. So a plugin that failed to load is probed again once its library is rebuilt.
+ *
+ * All functions except the loaders themselves are thread-safe (see lockLoaders()).
+ */
+class LoaderRegistry : boost::noncopyable
+{
+public:
+  //! \brief The process-wide registry.
+  static LoaderRegistry& instance();
+
+  //! \brief The shared loader of publisher plugins. It is created on the first call.
+  PubLoaderPtr getPublisherLoader();
+
+  //! \brief The shared loader of subscriber plugins. It is created on the first call.
+  SubLoaderPtr getSubscriberLoader();
+
+  /**
+   * \brief Lock the shared loaders. pluginlib loaders are not thread-safe, so this lock has to be held while creating
+   *        plugin instances with them.
+   */
+  std::unique_lock<std::mutex> lockLoaders();
+
+  /**
+   * \brief Lookup names of the classes declared to one of the shared loaders, listed under lockLoaders().
+   * \param[in] loader The loader.
+   * \return The lookup names.
+   */
+  template<typename Loader>
+  std::vector<std::string> getDeclaredClasses(Loader& loader)
+  {
+    const auto lock = this->lockLoaders();
+    return loader.getDeclaredClasses();
+  }
+
+  //! \brief Descriptions of all declared publisher plugins (loadable or not).
+  std::vector<TransportPluginInfo> getPublisherPlugins();
+
+  //! \brief Descriptions of all declared subscriber plugins (loadable or not).
+  std::vector<TransportPluginInfo> getSubscriberPlugins();
+
+  //! \brief Forget the cached descriptions and delete the cache file. They will be rebuilt on the next query.
+  void clearCache();
+
+  ~LoaderRegistry();
+
+private:
+  LoaderRegistry();
+
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
@@ -51,11 +51,14 @@
 #include <boost/weak_ptr.hpp>
 
 #include <cras_cpp_common/c_api.h>
+#include <cras_cpp_common/expected.hpp>
 #include <cras_cpp_common/log_utils.h>
 #include <cras_cpp_common/log_utils/node.h>
 #include <ros/forwards.h>
+#include <ros/message_traits.h>
 #include <ros/node_handle.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <topic_tools/shape_shifter.h>
 
 #include <point_cloud_transport/publisher_plugin.h>
 #include <point_cloud_transport/subscriber_plugin.h>
@@ -76,6 +79,9 @@ public:
   //! Constructor
   explicit PointCloudCodec(const cras::LogHelperPtr& log = std::make_shared<cras::NodeLogHelper>());
 
+  // The plugin instances are created on the first request and then shared by all subsequent requests for the same
+  // transport (also from different threads). The lookups are thread-safe.
+
   boost::shared_ptr<point_cloud_transport::PublisherPlugin> getEncoderByName(const std::string& name) const;
 
   boost::shared_ptr<point_cloud_transport::PublisherPlugin> getEncoderByTopic(
@@ -86,7 +92,122 @@ public:
   boost::shared_ptr<point_cloud_transport::SubscriberPlugin> getDecoderByTopic(
       const std::string& topic, const std::string& datatype) const;
 
+  //! \brief Create instances of all available encoders and decoders so that later lookups do no loader work.
+  void warmUp() const;
+
+  /**
+   * \brief Create the encoders and decoders of the given transports so that later lookups do no loader work.
+   * \param[in] names Names of the transports (as accepted by getEncoderByName()).
+   * \return Whether an encoder or decoder was found for each of the names.
+   */
+  bool preload(const std::vector<std::string>& names) const;
+
+  /**
+   * \brief Encode the given clouds with the same encoder and config, spreading the work over multiple threads.
+   * \param[in] name Name of the encoder (as accepted by getEncoderByName()).
+   * \param[in] raw The raw clouds to encode.
+   * \param[in] config Config of the encoder.
+   * \param[in] num_threads Number of worker threads. Zero means the number of CPU cores.
+   * \return The encoding results of the clouds (in the same order as raw), or an error if no such encoder exists.
+   * \note All threads share one encoder instance, so its encode() has to be safe to call concurrently. Stateful
+   *       encoders (see PublisherPlugin::isStateful()) encode the clouds in order in one thread, and their batches do
+   *       not run concurrently.
+   */
+  cras::expected<std::vector<PublisherPlugin::EncodeResult>, std::string> encodeBatch(
+      const std::string& name, const std::vector<sensor_msgs::PointCloud2ConstPtr>& raw,
+      const dynamic_reconfigure::Config& config = {}, size_t num_threads = 0) const;
+
+  /**
+   * \brief Decode the given clouds with the same decoder and config, spreading the work over multiple threads.
+   * \param[in] topicOrCodec Topic the clouds come from or name of the decoder. The decoder is selected by the type of
+   *                         the first cloud.
+   * \param[in] compressed The compressed clouds to decode.
+   * \param[in] config Config of the decoder.
+   * \param[in] num_threads Number of worker threads. Zero means the number of CPU cores.
+   * \return The decoding results of the clouds (in the same order as compressed), or an error if no suitable decoder
+   *         exists.
+   * \note All threads share one decoder instance, so its decode() has to be safe to call concurrently. Stateful
+   *       decoders (see SubscriberPlugin::isStateful()) decode the clouds in order in one thread, and their batches do
+   *       not run concurrently.
+   */
+  cras::expected<std::vector<SubscriberPlugin::DecodeResult>, std::string> decodeBatch(
+      const std::string& topicOrCodec, const std::vector<topic_tools::ShapeShifter::ConstPtr>& compressed,
+      const dynamic_reconfigure::Config& config = {}, size_t num_threads = 0) const;
+
+  /**
+   * \brief Convert a compressed cloud to a different transport.
+   *
+   * If the decoder and encoder are the same transport and no encoder config is given, the message is returned as it
+   * is without decoding it. Otherwise, the cloud is decoded into a buffer recycled by all transcode() calls of this
+   * codec, so converting many clouds does not allocate a new intermediate cloud for each of them.
+   *
+   * \note Each message is converted whole. A message of a chunked transport (e.g. raw_chunked) holds one chunk, so it
+   *       is converted into a message with the points of just this chunk. Messages of the other transports are not
+   *       split into chunks, because the plugins can only exchange whole clouds.
+   *
+   * \param[in] compressed The compressed cloud.
+   * \param[in] topicOrCodec Topic the cloud comes from or name of the decoder (as accepted by decodeBatch()).
+   * \param[in] name Name of the encoder (as accepted by getEncoderByName()).
+   * \param[in] config Config of the encoder.
+   * \param[in] decoderConfig Config of the decoder.
+   * \return The cloud encoded by the encoder, nothing if the decoder or encoder returned nothing (e.g. a decoder
+   *         waiting for more messages), or an error.
+   */
+  PublisherPlugin::EncodeResult transcode(
+      const topic_tools::ShapeShifter& compressed, const std::string& topicOrCodec, const std::string& name,
+      const dynamic_reconfigure::Config& config = {}, const dynamic_reconfigure::Config& decoderConfig = {}) const;
+
+  /**
+   * \brief Encode the given cloud into a message of type M.
+   *
+   * Encoders implementing TypedEncoder<M> (all based on SimplePublisherPlugin) return the message directly. Other
+   * encoders pass it through a ShapeShifter, which costs one more serialization and deserialization.
+   *
+   * \tparam M Type of the messages of the encoder.
+   * \param[in] name Name of the encoder (as accepted by getEncoderByName()).
+   * \param[in] raw The raw cloud to encode.
+   * \param[in] config Config of the encoder.
+   * \return The encoded message, nothing if the encoder returned nothing, or an error (e.g. if the encoder produces a
+   *         different type of messages).
+   */
+  template<class M>
+  cras::expected<cras::optional<M>, std::string> encode(const std::string& name, const sensor_msgs::PointCloud2& raw,
+                                                        const dynamic_reconfigure::Config& config = {}) const
+  {
+    const auto encoder = getEncoderByName(name);
+    if (!encoder)
+      return cras::make_unexpected("Could not find encoder for " + name);
+
+    const auto typed_encoder = dynamic_cast<const TypedEncoder<M>*>(encoder.get());
+    if (typed_encoder != nullptr)
+      return typed_encoder->encodeMessage(raw, config);
+
+    const auto res = encoder->encode(raw, config);
+    if (!res)
+      return cras::make_unexpected(res.error());
+    if (!res.value())
+      return cras::nullopt;
+    if (res.value()->getDataType() != ros::message_traits::DataType<M>::value())
+    {
+      return cras::make_unexpected("Encoder " + name + " produces messages of type " + res.value()->getDataType() +
+                                   ", not " + ros::message_traits::DataType<M>::value() + ".");
+    }
+    return *res.value()->template instantiate<M>();
+  }
+
+  /**
+   * \brief Whether transcoding with the given decoder, encoder and encoder config would just reproduce the input.
+   */
+  static bool isPassThrough(const SubscriberPlugin& decoder, const PublisherPlugin& encoder,
+                            const dynamic_reconfigure::Config& config);
+
 private:
+  boost::shared_ptr<point_cloud_transport::PublisherPlugin> getEncoderByLookupName(
+      const std::string& lookup_name) const;
+
+  boost::shared_ptr<point_cloud_transport::SubscriberPlugin> getDecoderByLookupName(
+      const std::string& lookup_name) const;
+
   struct Impl;
   typedef boost::shared_ptr<Impl> ImplPtr;
   typedef boost::weak_ptr<Impl> ImplWPtr;
@@ -94,6 +215,9 @@ private:
   ImplPtr impl_;
 };
 
+//! \brief Opaque state of a codec used via the pointCloudTransportCodecsContext*() C API functions.
+struct CodecContext;
+
 }
 
 extern "C" bool pointCloudTransportCodecsEncode(
@@ -120,6 +244,95 @@ extern "C" bool pointCloudTransportCodecsEncode(
     cras::allocator_t logMessagesAllocator
 );
 
+/**
+ * \brief Encode the given raw cloud into the caller-provided buffer.
+ *
+ * This works like pointCloudTransportCodecsEncode(), but the serialized compressed message is written directly into
+ * compressedData instead of being passed through an allocator. If compressedDataCapacity is too small,
+ * compressedDataLength is set to the required size, nothing is written, and the encoded message is retained until
+ * the next call from the same thread. It can be fetched with pointCloudTransportCodecsGetLastEncodedData() without
+ * encoding it again.
+ *
+ * \param[out] compressedDataLength Length of the serialized compressed message (zero if the encoder returned nothing).
+ * \return Whether the encoding succeeded.
+ */
+extern "C" bool pointCloudTransportCodecsEncodeInto(
+    const char* codec,
+    sensor_msgs::PointCloud2::_height_type rawHeight,
+    sensor_msgs::PointCloud2::_width_type rawWidth,
+    size_t rawNumFields,
+    const char* rawFieldNames[],
+    sensor_msgs::PointField::_offset_type rawFieldOffsets[],
+    sensor_msgs::PointField::_datatype_type rawFieldDatatypes[],
+    sensor_msgs::PointField::_count_type rawFieldCounts[],
+    sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigendian,
+    sensor_msgs::PointCloud2::_point_step_type rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type rawRowStep,
+    size_t rawDataLength,
+    const uint8_t rawData[],
+    sensor_msgs::PointCloud2::_is_dense_type rawIsDense,
+    cras::allocator_t compressedTypeAllocator,
+    cras::allocator_t compressedMd5SumAllocator,
+    size_t compressedDataCapacity,
+    uint8_t compressedData[],
+    size_t& compressedDataLength,
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+);
+
+/**
+ * \brief Encode multiple raw clouds with the same codec and config, spreading the work over multiple threads.
+ *
+ * The arguments describing the raw clouds are arrays with numClouds items. The field arrays contain the fields of all
+ * clouds one after another (the sum of rawNumFields items).
+ *
+ * The output allocators are called once for each cloud in the order of the clouds (with empty values for clouds that
+ * failed to encode or for which the encoder returned nothing). errorStringAllocator is called for each cloud, too
+ * (with empty string for clouds encoded successfully), unless the whole call fails.
+ *
+ * Stateful codecs (see PublisherPlugin::isStateful()) encode the whole batch in order with the encoder of the calling
+ * thread, so the batch continues the stream of its pointCloudTransportCodecsEncode() calls. numThreads is ignored.
+ *
+ * \param[out] success Array with numClouds items. Whether each of the clouds was encoded successfully.
+ * \param[in] numThreads Number of worker threads. Zero means the number of CPU cores.
+ * \return False if the whole batch failed (invalid config or unknown codec). The error is passed to
+ *         errorStringAllocator.
+ */
+extern "C" bool pointCloudTransportCodecsEncodeBatch(
+    const char* codec,
+    size_t numClouds,
+    const sensor_msgs::PointCloud2::_height_type rawHeight[],
+    const sensor_msgs::PointCloud2::_width_type rawWidth[],
+    const size_t rawNumFields[],
+    const char* rawFieldNames[],
+    const sensor_msgs::PointField::_offset_type rawFieldOffsets[],
+    const sensor_msgs::PointField::_datatype_type rawFieldDatatypes[],
+    const sensor_msgs::PointField::_count_type rawFieldCounts[],
+    const sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigendian[],
+    const sensor_msgs::PointCloud2::_point_step_type rawPointStep[],
+    const sensor_msgs::PointCloud2::_row_step_type rawRowStep[],
+    const size_t rawDataLength[],
+    const uint8_t* rawData[],
+    const sensor_msgs::PointCloud2::_is_dense_type rawIsDense[],
+    cras::allocator_t compressedTypeAllocator,
+    cras::allocator_t compressedMd5SumAllocator,
+    cras::allocator_t compressedDataAllocator,
+    bool success[],
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    size_t numThreads,
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+);
+
+/**
+ * \brief Copy the message retained by the last pointCloudTransportCodecsEncodeInto() call in this thread.
+ * \return False if there is no retained message or it does not fit into the buffer.
+ */
+extern "C" bool pointCloudTransportCodecsGetLastEncodedData(size_t compressedDataCapacity, uint8_t compressedData[]);
+
 extern "C" bool pointCloudTransportCodecsDecode(
     const char* topicOrCodec,
     const char* compressedType,
@@ -143,3 +356,223 @@ extern "C" bool pointCloudTransportCodecsDecode(
     cras::allocator_t errorStringAllocator,
     cras::allocator_t logMessagesAllocator
 );
+
+/**
+ * \brief Decode the given compressed cloud and write its data into the caller-provided buffer.
+ *
+ * This works like pointCloudTransportCodecsDecode(), but the raw cloud data are written directly into rawData instead
+ * of being passed through an allocator. If rawDataCapacity is too small, rawDataLength is set to the required size,
+ * the data are not written, and the decoded cloud is retained until the next call from the same thread. Its data can
+ * be fetched with pointCloudTransportCodecsGetLastDecodedData() without decoding the cloud again.
+ *
+ * \param[out] rawDataLength Length of the raw cloud data (zero if the decoder returned nothing).
+ * \return Whether the decoding succeeded.
+ */
+extern "C" bool pointCloudTransportCodecsDecodeInto(
+    const char* topicOrCodec,
+    const char* compressedType,
+    const char* compressedMd5sum,
+    size_t compressedDataLength,
+    const uint8_t compressedData[],
+    sensor_msgs::PointCloud2::_height_type& rawHeight,
+    sensor_msgs::PointCloud2::_width_type& rawWidth,
+    uint32_t& rawNumFields,
+    cras::allocator_t rawFieldNamesAllocator,
+    cras::allocator_t rawFieldOffsetsAllocator,
+    cras::allocator_t rawFieldDatatypesAllocator,
+    cras::allocator_t rawFieldCountsAllocator,
+    sensor_msgs::PointCloud2::_is_bigendian_type& rawIsBigEndian,
+    sensor_msgs::PointCloud2::_point_step_type& rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type& rawRowStep,
+    size_t rawDataCapacity,
+    uint8_t rawData[],
+    size_t& rawDataLength,
+    sensor_msgs::PointCloud2::_is_dense_type& rawIsDense,
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+);
+
+/**
+ * \brief Copy the data of the cloud retained by the last pointCloudTransportCodecsDecodeInto() call in this thread.
+ * \return False if there is no retained cloud or its data do not fit into the buffer.
+ */
+extern "C" bool pointCloudTransportCodecsGetLastDecodedData(size_t rawDataCapacity, uint8_t rawData[]);
+
+/**
+ * \brief Decode multiple compressed clouds with the same codec and config, spreading the work over multiple threads.
+ *
+ * The arguments describing the compressed clouds and the raw output scalars are arrays with numClouds items.
+ *
+ * The field allocators are called for all fields of all clouds one after another. rawDataAllocator and
+ * errorStringAllocator are called once for each cloud in the order of the clouds (with empty values for clouds that
+ * failed to decode or for which the decoder returned nothing), unless the whole call fails.
+ *
+ * Stateful codecs (see SubscriberPlugin::isStateful()) decode the whole batch in order with the decoder of the calling
+ * thread, so the batch continues the stream of its pointCloudTransportCodecsDecode() calls. numThreads is ignored.
+ *
+ * \param[out] success Array with numClouds items. Whether each of the clouds was decoded successfully.
+ * \param[in] numThreads Number of worker threads. Zero means the number of CPU cores.
+ * \return False if the whole batch failed (invalid config or unknown codec). The error is passed to
+ *         errorStringAllocator.
+ */
+extern "C" bool pointCloudTransportCodecsDecodeBatch(
+    const char* topicOrCodec,
+    size_t numClouds,
+    const char* compressedType[],
+    const char* compressedMd5sum[],
+    const size_t compressedDataLength[],
+    const uint8_t* compressedData[],
+    sensor_msgs::PointCloud2::_height_type rawHeight[],
+    sensor_msgs::PointCloud2::_width_type rawWidth[],
+    uint32_t rawNumFields[],
+    cras::allocator_t rawFieldNamesAllocator,
+    cras::allocator_t rawFieldOffsetsAllocator,
+    cras::allocator_t rawFieldDatatypesAllocator,
+    cras::allocator_t rawFieldCountsAllocator,
+    sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigEndian[],
+    sensor_msgs::PointCloud2::_point_step_type rawPointStep[],
+    sensor_msgs::PointCloud2::_row_step_type rawRowStep[],
+    cras::allocator_t rawDataAllocator,
+    sensor_msgs::PointCloud2::_is_dense_type rawIsDense[],
+    bool success[],
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    size_t numThreads,
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+);
+
+/**
+ * \brief Convert a compressed cloud to a different transport (see PointCloudCodec::transcode()).
+ * The intermediate raw cloud is never passed to the caller, and if the input and output transports are the same and
+ * serializedEncoderConfigLength is zero, the input is passed to the output allocators without decoding it.
+ * \param[in] topicOrCodec Topic the compressed cloud comes from or name of its decoder.
+ * \param[in] codec Name of the encoder.
+ * \return Whether the transcoding succeeded. If the decoder or encoder returned nothing, the output allocators are not
+ *         called.
+ */
+extern "C" bool pointCloudTransportCodecsTranscode(
+    const char* topicOrCodec,
+    const char* compressedType,
+    const char* compressedMd5sum,
+    size_t compressedDataLength,
+    const uint8_t compressedData[],
+    const char* codec,
+    cras::allocator_t transcodedTypeAllocator,
+    cras::allocator_t transcodedMd5SumAllocator,
+    cras::allocator_t transcodedDataAllocator,
+    size_t serializedEncoderConfigLength,
+    const uint8_t serializedEncoderConfig[],
+    size_t serializedDecoderConfigLength,
+    const uint8_t serializedDecoderConfig[],
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+);
+
+/**
+ * \brief Create a codec context for repeated encoding or decoding with one codec.
+ *
+ * The context owns its own plugin instances, the parsed config, a log buffer and the buffers reused between the calls,
+ * so the per-call overhead of pointCloudTransportCodecsEncode() and pointCloudTransportCodecsDecode() (looking up the
+ * plugin, deserializing the config, reallocating the buffers) is paid only once. The calls with one context are
+ * serialized, so e.g. the config can be changed from another thread while a cloud is being encoded.
+ *
+ * \param[in] topicOrCodec Name of the codec, or of the topic the decoded clouds come from.
+ * \return The context, or null if topicOrCodec is not a topic name (it has no slash) and there is no such codec. Free
+ *         it with pointCloudTransportCodecsDestroyContext().
+ */
+extern "C" point_cloud_transport::CodecContext* pointCloudTransportCodecsCreateContext(const char* topicOrCodec);
+
+//! \brief Free a context created by pointCloudTransportCodecsCreateContext().
+extern "C" void pointCloudTransportCodecsDestroyContext(point_cloud_transport::CodecContext* context);
+
+/**
+ * \brief Set the config used by all following encodings and decodings with the context.
+ * \param[in] serializedConfigLength Length of serializedConfig. Zero means the default config.
+ * \param[in] serializedConfig Serialized dynamic_reconfigure::Config message.
+ * \return Whether the config could be deserialized. If not, the error is passed to errorStringAllocator and the
+ *         previous config is kept.
+ */
+extern "C" bool pointCloudTransportCodecsContextSetConfig(
+    point_cloud_transport::CodecContext* context,
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    cras::allocator_t errorStringAllocator
+);
+
+/**
+ * \brief Encode the given raw cloud with the codec and config of the context.
+ *
+ * This works like pointCloudTransportCodecsEncodeInto(). A message that does not fit into compressedData is retained
+ * by the context until its next encoding and can be fetched with pointCloudTransportCodecsContextGetLastEncodedData().
+ */
+extern "C" bool pointCloudTransportCodecsContextEncodeInto(
+    point_cloud_transport::CodecContext* context,
+    sensor_msgs::PointCloud2::_height_type rawHeight,
+    sensor_msgs::PointCloud2::_width_type rawWidth,
+    size_t rawNumFields,
+    const char* rawFieldNames[],
+    sensor_msgs::PointField::_offset_type rawFieldOffsets[],
+    sensor_msgs::PointField::_datatype_type rawFieldDatatypes[],
+    sensor_msgs::PointField::_count_type rawFieldCounts[],
+    sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigendian,
+    sensor_msgs::PointCloud2::_point_step_type rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type rawRowStep,
+    size_t rawDataLength,
+    const uint8_t rawData[],
+    sensor_msgs::PointCloud2::_is_dense_type rawIsDense,
+    cras::allocator_t compressedTypeAllocator,
+    cras::allocator_t compressedMd5SumAllocator,
+    size_t compressedDataCapacity,
+    uint8_t compressedData[],
+    size_t& compressedDataLength,
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+);
+
+/**
+ * \brief Copy the message retained by the last pointCloudTransportCodecsContextEncodeInto() call with the context.
+ * \return False if there is no retained message or it does not fit into the buffer.
+ */
+extern "C" bool pointCloudTransportCodecsContextGetLastEncodedData(
+    point_cloud_transport::CodecContext* context, size_t compressedDataCapacity, uint8_t compressedData[]);
+
+/**
+ * \brief Decode the given compressed cloud with the codec and config of the context.
+ *
+ * This works like pointCloudTransportCodecsDecodeInto(). Cloud data that do not fit into rawData are retained by the
+ * context until its next decoding and can be fetched with pointCloudTransportCodecsContextGetLastDecodedData().
+ */
+extern "C" bool pointCloudTransportCodecsContextDecodeInto(
+    point_cloud_transport::CodecContext* context,
+    const char* compressedType,
+    const char* compressedMd5sum,
+    size_t compressedDataLength,
+    const uint8_t compressedData[],
+    sensor_msgs::PointCloud2::_height_type& rawHeight,
+    sensor_msgs::PointCloud2::_width_type& rawWidth,
+    uint32_t& rawNumFields,
+    cras::allocator_t rawFieldNamesAllocator,
+    cras::allocator_t rawFieldOffsetsAllocator,
+    cras::allocator_t rawFieldDatatypesAllocator,
+    cras::allocator_t rawFieldCountsAllocator,
+    sensor_msgs::PointCloud2::_is_bigendian_type& rawIsBigEndian,
+    sensor_msgs::PointCloud2::_point_step_type& rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type& rawRowStep,
+    size_t rawDataCapacity,
+    uint8_t rawData[],
+    size_t& rawDataLength,
+    sensor_msgs::PointCloud2::_is_dense_type& rawIsDense,
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+);
+
+/**
+ * \brief Copy the data of the cloud retained by the last pointCloudTransportCodecsContextDecodeInto() call with the
+ *        context.
+ * \return False if there is no retained cloud or its data do not fit into the buffer.
+ */
+extern "C" bool pointCloudTransportCodecsContextGetLastDecodedData(
+    point_cloud_transport::CodecContext* context, size_t rawDataCapacity, uint8_t rawData[]);
@@ -0,0 +1,66 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Cropping of point clouds to a box and voxel downsampling.
+ */
+
+#include <string>
+
+#include <cras_cpp_common/expected.hpp>
+#include <cras_cpp_common/optional.hpp>
+#include <sensor_msgs/PointCloud2.h>
+
+namespace point_cloud_transport
+{
+
+class PointCloudPool;
+
+//! \brief Axis-aligned box in the frame of the cloud. Points on its boundary are inside.
+struct CropBox
+{
+  double min_x {0.0};
+  double min_y {0.0};
+  double min_z {0.0};
+  double max_x {0.0};
+  double max_y {0.0};
+  double max_z {0.0};
+};
+
+//! \brief What filterCloud() does with the points.
+struct CloudFilterOptions
+{
+  //! \brief Keep only the points inside this box. Nothing means no cropping.
+  cras::optional<CropBox> crop_box;
+
+  //! \brief Keep only one point in each cube of this edge length (m). Zero means no downsampling.
+  double voxel_size {0.0};
+
+  //! \brief Whether the filter changes the clouds at all.
+  bool isEnabled() const
+  {
+    return crop_box.has_value() || voxel_size > 0.0;
+  }
+};
+
+/**
+ * \brief Copy the points of the cloud that pass the filter into a new cloud.
+ *
+ * The points are read in a single pass over the data and copied whole, so all fields are kept. The voxel filter keeps
+ * the first point that falls into each voxel instead of averaging them, so the kept points are original measurements.
+ * Voxels whose indices differ by a multiple of 2^21 on all axes are treated as the same voxel. Points with non-finite
+ * coordinates are dropped.
+ *
+ * \param[in] cloud The input cloud. It needs FLOAT32 fields x, y and z.
+ * \param[in] options What to do with the points.
+ * \param[in] pool If not null, the output cloud is acquired from this pool.
+ * \return The filtered cloud (unorganized and dense), or an error message if the cloud has no coordinates or it is
+ *         malformed.
+ */
+cras::expected<sensor_msgs::PointCloud2Ptr, std::string> filterCloud(
+  const sensor_msgs::PointCloud2& cloud, const CloudFilterOptions& options, PointCloudPool* pool = nullptr);
+
+}
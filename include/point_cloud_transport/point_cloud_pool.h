@@ -0,0 +1,85 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Pool of recycled PointCloud2 messages for decoders.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <sensor_msgs/PointCloud2.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Pool of PointCloud2 messages whose data buffers are reused for multiple clouds.
+ *
+ * A decoder acquires an output cloud from the pool instead of allocating a new one. When the last reference to the
+ * cloud is dropped (usually after the subscriber callback returns), the cloud goes back to the pool with its data
+ * buffer, so decoding the next cloud of a similar size does not allocate (and page-fault) a new buffer.
+ *
+ * Clouds that are still referenced when the pool is destroyed are freed normally when their last reference is dropped.
+ * All functions are thread-safe.
+ */
+class PointCloudPool : boost::noncopyable
+{
+public:
+  /**
+   * \brief Create the pool.
+   * \param[in] max_size Maximum number of unused clouds kept in the pool. Clouds returned to a full pool are freed.
+   */
+  explicit PointCloudPool(size_t max_size = 4);
+
+  ~PointCloudPool();
+
+  /**
+   * \brief Get a cloud whose data have the given size.
+   *
+   * The pooled cloud with the smallest sufficient buffer is used. If there is none, the largest one is grown, and if
+   * the pool is empty, a new cloud is allocated. The values of the data are unspecified (they are not zeroed). All
+   * other fields of the cloud are reset to their default values.
+   *
+   * \param[in] data_size Size of the data buffer.
+   * \return The cloud. It returns to the pool when its last reference is dropped.
+   */
+  sensor_msgs::PointCloud2Ptr acquire(size_t data_size = 0);
+
+  /**
+   * \brief Get a cloud with the given dimensions.
+   *
+   * This works like acquire(size_t), but it also fills the dimensions, point step and row step of the cloud and sizes
+   * its data accordingly.
+   *
+   * \param[in] height Height of the cloud.
+   * \param[in] width Width of the cloud.
+   * \param[in] point_step Size of one point in bytes.
+   * \return The cloud. It returns to the pool when its last reference is dropped.
+   */
+  sensor_msgs::PointCloud2Ptr acquire(uint32_t height, uint32_t width, uint32_t point_step);
+
+  //! \brief Number of unused clouds currently held by the pool.
+  size_t getNumFree() const;
+
+  //! \brief Number of acquire() calls served by a pooled cloud.
+  size_t getNumReused() const;
+
+  //! \brief Number of acquire() calls that had to allocate a new cloud.
+  size_t getNumAllocated() const;
+
+private:
+  struct State;
+  struct ReturnToPool;
+  std::shared_ptr<State> state_;
+};
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Projection of point clouds to a subset of their fields.
+ */
+
+#include <string>
+#include <vector>
+
+#include <cras_cpp_common/expected.hpp>
+#include <sensor_msgs/PointCloud2.h>
+
+namespace point_cloud_transport
+{
+
+class PointCloudPool;
+
+/**
+ * \brief Copy the given fields of all points into a new cloud.
+ *
+ * The output fields are in the given order and they are packed without padding (the output point step is the sum of the
+ * field sizes). Runs of fields that are adjacent in the input are copied at once.
+ *
+ * \param[in] cloud The input cloud.
+ * \param[in] fields Names of the fields to keep.
+ * \param[in] pool If not null, the output cloud is acquired from this pool.
+ * \return The projected cloud, or an error message if some of the fields is missing or the cloud is malformed.
+ */
+cras::expected<sensor_msgs::PointCloud2Ptr, std::string> projectFields(
+  const sensor_msgs::PointCloud2& cloud, const std::vector<std::string>& fields, PointCloudPool* pool = nullptr);
+
+/**
+ * \brief Get the name of the topic namespace under which clouds projected to the given fields are published.
+ * \param[in] fields Names of the fields.
+ * \return E.g. `fields_x_y_z`. Characters not allowed in ROS names are replaced by underscores.
+ */
+std::string getProjectionName(const std::vector<std::string>& fields);
+
+}
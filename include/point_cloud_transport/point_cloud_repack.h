@@ -0,0 +1,131 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Vectorized kernels for repacking the data of PointCloud2 messages, shared by the transport plugins.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <cras_cpp_common/expected.hpp>
+#include <sensor_msgs/PointCloud2.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Instruction set used by the repacking kernels.
+ *
+ * The kernels are compiled for all instruction sets supported by the compiler on the target architecture, and the best
+ * one supported by the CPU is selected at runtime. Kernels that have no implementation for the selected instruction
+ * set use the best lower one.
+ */
+enum class SimdLevel
+{
+  //! \brief Plain C++ loops.
+  SCALAR,
+  //! \brief x86 SSE2.
+  SSE2,
+  //! \brief x86 AVX2.
+  AVX2,
+  //! \brief ARM NEON.
+  NEON,
+};
+
+//! \brief Get the instruction set currently used by the repacking kernels.
+SimdLevel getSimdLevel();
+
+/**
+ * \brief Select the instruction set used by the repacking kernels (e.g. to compare them in benchmarks).
+ * \param[in] level The instruction set. If it is not supported by the CPU, the best supported one is used instead.
+ * \return The selected instruction set.
+ */
+SimdLevel setSimdLevel(SimdLevel level);
+
+//! \brief Name of the instruction set (e.g. `avx2`).
+std::string toString(SimdLevel level);
+
+/**
+ * \brief Copy one field of consecutive points into a contiguous array (AoS to SoA).
+ * \param[in] points Pointer to the field in the first point.
+ * \param[in] num_points Number of points.
+ * \param[in] point_step Distance between the points in bytes.
+ * \param[in] value_size Size of the field in bytes.
+ * \param[out] values Output array of `num_points * value_size` bytes.
+ */
+void gatherField(const uint8_t* points, size_t num_points, size_t point_step, size_t value_size, uint8_t* values);
+
+/**
+ * \brief Copy a contiguous array into one field of consecutive points (SoA to AoS).
+ * \param[in] values Input array of `num_points * value_size` bytes.
+ * \param[in] num_points Number of points.
+ * \param[in] value_size Size of the field in bytes.
+ * \param[in] point_step Distance between the points in bytes.
+ * \param[out] points Pointer to the field in the first point.
+ */
+void scatterField(const uint8_t* values, size_t num_points, size_t value_size, size_t point_step, uint8_t* points);
+
+/**
+ * \brief Reverse the byte order of each value of a contiguous array in place.
+ * \param[in,out] data The values.
+ * \param[in] num_values Number of values.
+ * \param[in] value_size Size of one value in bytes (1, 2, 4 or 8; 1 does nothing).
+ */
+void swapBytes(uint8_t* data, size_t num_values, size_t value_size);
+
+/**
+ * \brief Quantize floats to integers: `quantized[i] = round(values[i] * scale)`, rounding half to even.
+ *
+ * The scaled values have to fit into int32. NaNs and values out of range give an unspecified result.
+ *
+ * \param[in] values The floats.
+ * \param[in] num_values Number of values.
+ * \param[in] scale The multiplier (the inverse of the quantization step).
+ * \param[out] quantized The integers.
+ */
+void quantizeFloats(const float* values, size_t num_values, float scale, int32_t* quantized);
+
+/**
+ * \brief Reconstruct floats from integers: `values[i] = quantized[i] * step`.
+ * \param[in] quantized The integers.
+ * \param[in] num_values Number of values.
+ * \param[in] step The quantization step.
+ * \param[out] values The floats.
+ */
+void dequantizeFloats(const int32_t* quantized, size_t num_values, float step, float* values);
+
+/**
+ * \brief Copy the points whose three consecutive float coordinates are all finite.
+ * \param[in] points The first point.
+ * \param[in] num_points Number of points.
+ * \param[in] point_step Size of one point (distance of the input points, and size of the output points).
+ * \param[in] xyz_offset Offset of the three float coordinates in the point.
+ * \param[out] output The finite points, packed. Room for `num_points * point_step` bytes is needed.
+ * \return Number of the copied points.
+ */
+size_t copyFinitePoints(const uint8_t* points, size_t num_points, size_t point_step, size_t xyz_offset,
+                        uint8_t* output);
+
+/**
+ * \brief Extract a FLOAT32 field of all points into an array, converted to the byte order of this computer.
+ * \param[in] cloud The cloud.
+ * \param[in] name Name of the field.
+ * \return The values of the field, or an error message.
+ */
+cras::expected<std::vector<float>, std::string> extractFloatField(const sensor_msgs::PointCloud2& cloud,
+                                                                  const std::string& name);
+
+/**
+ * \brief Remove the points with non-finite coordinates from the cloud.
+ * \param[in] cloud The cloud. It needs consecutive FLOAT32 fields `x`, `y` and `z` in the byte order of this computer.
+ * \return The dense (and unorganized) cloud, or an error message.
+ */
+cras::expected<sensor_msgs::PointCloud2Ptr, std::string> removeNonFinitePoints(const sensor_msgs::PointCloud2& cloud);
+
+}
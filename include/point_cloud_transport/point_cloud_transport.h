@@ -57,6 +57,7 @@
 #include <sensor_msgs/PointCloud2.h>
 
 #include <point_cloud_transport/publisher.h>
+#include <point_cloud_transport/publisher_options.h>
 #include <point_cloud_transport/single_subscriber_publisher.h>
 #include <point_cloud_transport/subscriber.h>
 #include <point_cloud_transport/transport_hints.h>
@@ -120,6 +121,13 @@ public:
                                              const point_cloud_transport::SubscriberStatusCallback& disconnect_cb = {},
                                              const ros::VoidPtr& tracked_object = {}, bool latch = false);
 
+  //! Advertise an PointCloud2 topic with publisher options and subscriber status callbacks.
+  point_cloud_transport::Publisher advertise(const std::string& base_topic, uint32_t queue_size,
+                                             const point_cloud_transport::PublisherOptions& options,
+                                             const point_cloud_transport::SubscriberStatusCallback& connect_cb = {},
+                                             const point_cloud_transport::SubscriberStatusCallback& disconnect_cb = {},
+                                             const ros::VoidPtr& tracked_object = {}, bool latch = false);
+
   //! Subscribe to a point cloud topic, version for arbitrary boost::function object.
   point_cloud_transport::Subscriber subscribe(
       const std::string& base_topic, uint32_t queue_size,
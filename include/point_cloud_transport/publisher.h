@@ -41,16 +41,21 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 
+#include <cras_cpp_common/optional.hpp>
+#include <dynamic_reconfigure/Config.h>
 #include <ros/forwards.h>
 #include <ros/node_handle.h>
 #include <sensor_msgs/PointCloud2.h>
 
 #include <point_cloud_transport/loader_fwds.h>
+#include <point_cloud_transport/publisher_options.h>
 #include <point_cloud_transport/single_subscriber_publisher.h>
+#include <point_cloud_transport/TransportStatistics.h>
 
 namespace point_cloud_transport
 {
@@ -73,6 +78,30 @@ public:
   //! Publish a point cloud on the topics associated with this Publisher.
   void publish(const sensor_msgs::PointCloud2ConstPtr& message) const;
 
+  //! Get the number of clouds that were not published by any transport because its encoding queue was full.
+  //! This can only happen with async_encode.
+  size_t getNumDroppedClouds() const;
+
+  //! Get the number of clouds that were not published by the given transport because its encoding queue was full.
+  size_t getNumDroppedClouds(const std::string& transport) const;
+
+  //! Get the encoding statistics of all transports (the same data as published on the statistics topics).
+  std::vector<point_cloud_transport::TransportStatistics> getStatistics() const;
+
+  //! \brief Get the encoder config of the given transport. Nothing if the transport is not loaded or has no config.
+  cras::optional<dynamic_reconfigure::Config> getTransportConfig(const std::string& transport) const;
+
+  /**
+   * \brief Change the encoder config of the given transport at runtime (see PublisherPlugin::setConfig()).
+   *
+   * The config is also applied to the transport of all field projections of this publisher.
+   *
+   * \param[in] transport Name of the transport.
+   * \param[in] config The parameters to change.
+   * \return Whether the transport is loaded and it accepted the config.
+   */
+  bool setTransportConfig(const std::string& transport, const dynamic_reconfigure::Config& config);
+
   //! Shutdown the advertisements associated with this Publisher.
   void shutdown();
 
@@ -98,7 +127,8 @@ private:
             const point_cloud_transport::SubscriberStatusCallback& connect_cb,
             const point_cloud_transport::SubscriberStatusCallback& disconnect_cb,
             const ros::VoidPtr& tracked_object, bool latch,
-            const point_cloud_transport::PubLoaderPtr& loader);
+            const point_cloud_transport::PubLoaderPtr& loader,
+            const point_cloud_transport::PublisherOptions& options = {});
 
   struct Impl;
   typedef boost::shared_ptr<Impl> ImplPtr;
@@ -106,12 +136,12 @@ private:
 
   ImplPtr impl_;
 
-  static void weakSubscriberCb(const ImplWPtr& impl_wptr,
+  static void weakSubscriberCb(const ImplWPtr& impl_wptr, size_t transport_index, bool connected,
                                const point_cloud_transport::SingleSubscriberPublisher& plugin_pub,
                                const point_cloud_transport::SubscriberStatusCallback& user_cb);
 
   point_cloud_transport::SubscriberStatusCallback rebindCB(
-      const point_cloud_transport::SubscriberStatusCallback& user_cb);
+      const point_cloud_transport::SubscriberStatusCallback& user_cb, size_t transport_index, bool connected);
 
   friend class PointCloudTransport;
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Options of a point_cloud_transport::Publisher.
+ */
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <point_cloud_transport/thread_pool.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Limits of the rate at which one transport encodes and publishes the clouds.
+ *
+ * Each limit can be overridden by a parameter `<base_topic>/<transport>/<limit_name>` read when the Publisher is
+ * created.
+ */
+struct TransportRateLimit
+{
+  //! \brief Maximum publishing rate (Hz). Zero means unlimited. Parameter `<transport>/max_rate` (double).
+  double max_rate {0.0};
+
+  //! \brief Publish only every n-th cloud. Parameter `<transport>/publish_every_n` (int).
+  size_t publish_every_n {1};
+};
+
+/**
+ * \brief Options configuring how a Publisher encodes and publishes the clouds.
+ *
+ * Each option can be overridden by a parameter `<base_topic>/<option_name>` read when the Publisher is created.
+ */
+struct PublisherOptions
+{
+  //! \brief Run the encoders of all transports with subscribers in parallel in a pool of worker threads.
+  //!        Parameter `parallel_encode` (bool).
+  bool parallel_encode {false};
+
+  //! \brief Maximum number of worker threads used for parallel encoding. Zero means as many as there are transports
+  //!        (limited by the number of CPU cores). Parameter `parallel_encode_threads` (int).
+  size_t parallel_encode_threads {0};
+
+  //! \brief If true, publish() returns after all transports have published the cloud. If false, it returns
+  //!        immediately and the encoding continues in the background (each transport still publishes the clouds in
+  //!        the order they were passed to publish()). Parameter `parallel_encode_wait` (bool).
+  bool parallel_encode_wait {true};
+
+  //! \brief Hand the clouds over to a separate encoding thread of each transport and return from publish() right
+  //!        away. A slow transport then never blocks the publishing thread or the other transports.
+  //!        Parameter `async_encode` (bool).
+  bool async_encode {false};
+
+  //! \brief Maximum number of clouds waiting for encoding in each transport. Zero means unbounded.
+  //!        Parameter `async_encode_queue_size` (int).
+  size_t async_encode_queue_size {1};
+
+  //! \brief What to do with a new cloud when the encoding queue of a transport is full. Parameter
+  //!        `async_encode_overflow_policy` (string `drop_oldest`, `drop_newest` or `block`).
+  QueueOverflowPolicy async_encode_overflow_policy {QueueOverflowPolicy::DROP_OLDEST};
+
+  //! \brief Rate (Hz) of publishing the encoding statistics of each transport on topic
+  //!        `<base_topic>/<transport>/statistics`. Zero disables the publishing (the statistics are still available
+  //!        via Publisher::getStatistics()). Parameter `statistics_rate` (double).
+  double statistics_rate {0.0};
+
+  //! \brief Initialize the encoders (e.g. start their dynamic reconfigure servers) only when the first subscriber of
+  //!        each transport connects. This saves startup time and memory when most transports are never subscribed.
+  //!        Parameter `lazy_init` (bool).
+  bool lazy_init {false};
+
+  //! \brief Field subsets the clouds are also published with. For each list of fields (e.g. `[x, y, z]`), the clouds
+  //!        projected to these fields are published by all transports under base topic
+  //!        `<base_topic>/fields_x_y_z` (see getProjectionName()). Each projection is computed and encoded only when it
+  //!        has subscribers. Subscribers select a projection via TransportHints::fields(). Parameter `projections`
+  //!        (list of lists of strings, or list of comma-separated strings).
+  std::vector<std::vector<std::string>> projections;
+
+  //! \brief Rate limits of the transports (keys are transport names, e.g. `draco`). The clouds skipped by the limits
+  //!        are dropped before encoding. Transports that are not listed publish every cloud. Subscribers can ask for
+  //!        a lower rate via TransportHints::maxRate(), and each transport is then limited to the highest rate asked
+  //!        for by its subscribers. Parameters `<transport>/max_rate` and `<transport>/publish_every_n`.
+  std::map<std::string, TransportRateLimit> rate_limits;
+};
+
+/**
+ * \brief Name of the parameter by which a subscriber node asks the publisher of a transport for a lower rate.
+ *
+ * The subscriber sets the parameter before it subscribes, and the publisher reads it when the subscriber connects.
+ *
+ * \param[in] base_topic The resolved base topic.
+ * \param[in] transport Name of the transport.
+ * \param[in] subscriber Name of the subscriber node.
+ * \return `<base_topic>/<transport>/requested_rates/<subscriber>`.
+ */
+inline std::string getRequestedRateParamName(const std::string& base_topic, const std::string& transport,
+                                             const std::string& subscriber)
+{
+  const auto separator = (!subscriber.empty() && subscriber[0] == '/') ? "" : "/";
+  return base_topic + "/" + transport + "/requested_rates" + separator + subscriber;
+}
+
+}
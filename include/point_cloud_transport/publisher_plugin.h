@@ -42,6 +42,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <boost/noncopyable.hpp>
 
@@ -57,6 +58,7 @@
 #include <XmlRpcValue.h>
 
 #include <point_cloud_transport/single_subscriber_publisher.h>
+#include <point_cloud_transport/TransportStatistics.h>
 
 namespace point_cloud_transport
 {
@@ -123,6 +125,29 @@ public:
     return this->encode(raw, configMsg);
   }
 
+  /**
+   * \brief Encode the given raw pointclouds using the same configuration.
+   *
+   * The default implementation calls encode() for each cloud. Subclasses can override it to parse the configuration
+   * and set up the encoder only once for the whole batch.
+   *
+   * \param[in] raw The input raw pointclouds.
+   * \param[in] config Config of the compression (if it has any parameters).
+   * \return The encoding results of the clouds (in the same order as raw).
+   */
+  virtual std::vector<EncodeResult> encodeBatch(const std::vector<sensor_msgs::PointCloud2ConstPtr>& raw,
+                                                const dynamic_reconfigure::Config& config) const;
+
+  /**
+   * \brief Whether the encoding of a cloud depends on the previously encoded clouds (e.g. it is a difference to the
+   *        previous cloud). Such encoders get the clouds one by one in the order of publishing. The default
+   *        implementation returns false.
+   */
+  virtual bool isStateful() const
+  {
+    return false;
+  }
+
   //! Advertise a topic, simple version.
   void advertise(ros::NodeHandle& nh, const std::string& base_topic, uint32_t queue_size, bool latch = true);
 
@@ -147,15 +172,48 @@ public:
   //! Shutdown any advertisements associated with this PublisherPlugin.
   virtual void shutdown() = 0;
 
+  //! \brief Get the encoding statistics of this transport. The default implementation only fills the transport name.
+  virtual TransportStatistics getStatistics() const;
+
+  /**
+   * \brief Get the configuration the encoder currently uses for publishing.
+   * \return The config, or nothing if the transport has no configuration options. The default implementation returns
+   *         nothing.
+   */
+  virtual cras::optional<dynamic_reconfigure::Config> getConfig() const;
+
+  /**
+   * \brief Change the configuration the encoder uses for publishing, as if it came from dynamic reconfigure.
+   * \param[in] config The parameters to change. Parameters that are not mentioned keep their current values, and the
+   *                   values are clamped to their allowed ranges.
+   * \return Whether the config was applied. The default implementation does not support reconfiguration.
+   */
+  virtual bool setConfig(const dynamic_reconfigure::Config& config);
+
   //! Return the lookup name of the PublisherPlugin associated with a specific transport identifier.
   static std::string getLookupName(const std::string& transport_name);
 
+  //! \brief Defer the initialization of the encoder (e.g. starting its dynamic reconfigure server) until the first
+  //!        subscriber connects. Has to be called before advertise(). Plugins that do not support it ignore it.
+  void setLazyInit(bool lazy_init)
+  {
+    lazy_init_ = lazy_init;
+  }
+
+  //! \brief Whether the initialization of the encoder is deferred until the first subscriber connects.
+  bool isLazyInit() const
+  {
+    return lazy_init_;
+  }
+
 protected:
   //! Advertise a topic. Must be implemented by the subclass.
   virtual void advertiseImpl(ros::NodeHandle& nh, const std::string& base_topic, uint32_t queue_size,
                              const point_cloud_transport::SubscriberStatusCallback& connect_cb,
                              const point_cloud_transport::SubscriberStatusCallback& disconnect_cb,
                              const ros::VoidPtr& tracked_object, bool latch) = 0;
+
+  bool lazy_init_ {false};
 };
 
 class SingleTopicPublisherPlugin : public PublisherPlugin
@@ -181,4 +239,28 @@ public:
   virtual std::string getConfigDataType() const = 0;
 };
 
+/**
+ * \brief Interface of encoders whose messages have type M. It gives access to the encoded messages without serializing
+ *        them into a ShapeShifter (see PointCloudCodec::encode<M>()).
+ * \tparam M Type of the encoded messages.
+ */
+template<class M>
+class TypedEncoder
+{
+public:
+  //! \brief Result of cloud encoding. Either the compressed cloud message, empty value, or error message.
+  typedef cras::expected<cras::optional<M>, std::string> TypedEncodeResult;
+
+  virtual ~TypedEncoder() = default;
+
+  /**
+   * \brief Encode the given raw pointcloud into a compressed message.
+   * \param[in] raw The input raw pointcloud.
+   * \param[in] config Config of the compression (if it has any parameters).
+   * \return The compressed cloud message (if encoding succeeds), or an error message.
+   */
+  virtual TypedEncodeResult encodeMessage(const sensor_msgs::PointCloud2& raw,
+                                          const dynamic_reconfigure::Config& config) const = 0;
+};
+
 }
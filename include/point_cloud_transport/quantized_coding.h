@@ -0,0 +1,95 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Layout of the points and quantization of planes shared by the quantized publisher and subscriber.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <cras_cpp_common/optional.hpp>
+#include <sensor_msgs/PointField.h>
+
+namespace point_cloud_transport
+{
+namespace quantized
+{
+
+//! \brief Quantized value of invalid points (matches PointCloudQuantized::INVALID).
+constexpr int16_t INVALID_VALUE = INT16_MIN;
+
+//! \brief A contiguous range of bytes of each point stored exactly.
+struct ByteRun
+{
+  uint32_t offset;
+  uint32_t length;
+};
+
+//! \brief Where the quantized and the exactly stored values are in the points.
+struct PointLayout
+{
+  //! \brief Offsets of the FLOAT32 fields x, y and z.
+  uint32_t xyz[3];
+  //! \brief Offset of the FLOAT32 field intensity if it is quantized.
+  cras::optional<uint32_t> intensity;
+  //! \brief The bytes of the other fields, in the order of their offsets. Adjacent fields are merged.
+  std::vector<ByteRun> other;
+  //! \brief Sum of the lengths of the other runs.
+  size_t other_size {0};
+  //! \brief Whether some bytes of the points belong to no field.
+  bool has_padding {false};
+};
+
+/**
+ * \brief Get the layout of points with the given fields.
+ * \param[in] fields The fields of the cloud.
+ * \param[in] point_step Size of a point.
+ * \param[in] quantize_intensity Whether the FLOAT32 field intensity (if there is one) is quantized.
+ * \return The layout, or nothing if the cloud has no FLOAT32 fields x, y and z or some field is invalid.
+ */
+cras::optional<PointLayout> getPointLayout(const std::vector<sensor_msgs::PointField>& fields, uint32_t point_step,
+                                           bool quantize_intensity);
+
+/**
+ * \brief Get the quantization step that keeps the values decoded by dequantizePlane() within the given error.
+ *
+ * The step is somewhat smaller than twice the error, because the decoded values are rounded to floats, whose spacing
+ * grows with the distance from zero (about 0.5 mm at 5 km), and because the values relative to the origin are
+ * quantized in float.
+ *
+ * \param[in] max_error Maximum error of the decoded values.
+ * \param[in] max_abs Maximum absolute value of the valid values.
+ * \return The step, or zero if values this far from zero can not be decoded with this error.
+ */
+float getResolution(double max_error, double max_abs);
+
+/**
+ * \brief Quantize a plane of values relative to the middle of their range.
+ * \param[in,out] values The values. The invalid ones may be anything. All values are overwritten.
+ * \param[in] num_values Number of the values.
+ * \param[in] valid Whether each value is valid. Invalid values are stored as INVALID_VALUE.
+ * \param[in] resolution The quantization step.
+ * \param[out] origin The middle of the range of the valid values in multiples of the resolution.
+ * \param[out] quantized The quantized values (as many as the values).
+ * \return Whether the range of the valid values fits into the 16-bit integers.
+ */
+bool quantizePlane(float* values, size_t num_values, const std::vector<uint8_t>& valid, double resolution,
+                   int32_t& origin, int16_t* quantized);
+
+/**
+ * \brief Reconstruct a plane quantized by quantizePlane(). Invalid values are NaN.
+ * \param[in] quantized The quantized values.
+ * \param[in] num_values Number of the values.
+ * \param[in] origin The origin in multiples of the resolution.
+ * \param[in] resolution The quantization step.
+ * \param[out] values The values.
+ */
+void dequantizePlane(const int16_t* quantized, size_t num_values, int32_t origin, float resolution, float* values);
+
+}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin sending the coordinates as 16-bit fixed point numbers.
+ */
+
+#include <string>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/PointCloudQuantized.h>
+#include <point_cloud_transport/QuantizedPublisherConfig.h>
+#include <point_cloud_transport/simple_publisher_plugin.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Publishes clouds with the coordinates quantized to 16-bit integers with a bounded error (transport
+ *        `quantized`).
+ *
+ * The step of the quantization is twice `max_error`, and the integers are relative to the middle of the bounding box
+ * of the cloud, so a cloud can span 65534 steps on each axis. Float field `intensity` is quantized the same way if
+ * `intensity_resolution` is set. The other fields are sent exactly. The quantization and the field repacking use the
+ * vectorized kernels of point_cloud_repack.h, so the encoding costs about as much as copying the cloud. Clouds that do
+ * not fit into the 16-bit range, that have no float fields x, y and z, or that are not in the byte order of this
+ * computer are sent whole.
+ */
+class QuantizedPublisher : public point_cloud_transport::SimplePublisherPlugin<PointCloudQuantized,
+                                                                               QuantizedPublisherConfig>
+{
+public:
+  std::string getTransportName() const override;
+
+  TypedEncodeResult encodeTyped(const sensor_msgs::PointCloud2& raw,
+                                const QuantizedPublisherConfig& config) const override;
+};
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin decoding clouds with quantized coordinates.
+ */
+
+#include <string>
+
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudQuantized.h>
+#include <point_cloud_transport/simple_subscriber_plugin.h>
+
+namespace point_cloud_transport
+{
+
+//! \brief Decodes the clouds sent by QuantizedPublisher (transport `quantized`).
+class QuantizedSubscriber : public point_cloud_transport::SimpleSubscriberPlugin<PointCloudQuantized>
+{
+public:
+  std::string getTransportName() const override;
+
+  DecodeResult decodeTyped(const PointCloudQuantized& compressed, const NoConfigConfig& config) const override;
+};
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Coding of the planes of range images shared by the range_image publisher and subscriber.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+namespace point_cloud_transport
+{
+namespace range_image
+{
+
+//! \brief How the plane of a field is stored in PointCloudRangeImage::data.
+enum class PlaneCoding
+{
+  //! \brief Integers coded as differences of consecutive values.
+  DELTA,
+  //! \brief Floats quantized by PointCloudRangeImage::intensity_resolution and coded like DELTA.
+  QUANTIZED,
+  //! \brief The bytes of the values as they are.
+  RAW,
+};
+
+//! \brief Value of quantized coordinates of invalid points.
+constexpr int64_t INVALID_VALUE = INT64_MIN;
+
+//! \brief Whether the field is one of the coordinates x, y and z (which are stored in the geometry).
+bool isCoordinate(const sensor_msgs::PointField& field);
+
+//! \brief Size of one value of the field (including its count) in bytes. Zero for unknown datatypes.
+size_t getFieldSize(const sensor_msgs::PointField& field);
+
+//! \brief How the plane of the given field is stored.
+PlaneCoding getPlaneCoding(const sensor_msgs::PointField& field, float intensity_resolution);
+
+//! \brief Append the values coded as zigzag variable-length differences of consecutive values.
+void encodeDeltas(const std::vector<int64_t>& values, std::vector<uint8_t>& out);
+
+/**
+ * \brief Decode values coded by encodeDeltas().
+ * \param[in,out] data Start of the coded values. Moved past them.
+ * \param[in] end End of the buffer.
+ * \param[out] values The decoded values. Its size gives the number of values to decode.
+ * \return Whether the buffer held enough valid data.
+ */
+bool decodeDeltas(const uint8_t*& data, const uint8_t* end, std::vector<int64_t>& values);
+
+//! \brief Read an integer value of the given datatype.
+int64_t readInteger(const uint8_t* data, uint8_t datatype);
+
+//! \brief Write an integer value of the given datatype.
+void writeInteger(uint8_t* data, uint8_t datatype, int64_t value);
+
+//! \brief Copy the values of a field of all points of an organized cloud into a plane (using gatherField()).
+void gatherPlane(const sensor_msgs::PointCloud2& cloud, size_t offset, size_t value_size, uint8_t* plane);
+
+//! \brief Copy a plane into a field of all points of an organized cloud (using scatterField()).
+void scatterPlane(const uint8_t* plane, size_t offset, size_t value_size, sensor_msgs::PointCloud2& cloud);
+
+}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin sending organized clouds as range images.
+ */
+
+#include <string>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/PointCloudRangeImage.h>
+#include <point_cloud_transport/RangeImagePublisherConfig.h>
+#include <point_cloud_transport/simple_publisher_plugin.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Publishes organized clouds (e.g. from spinning lidars) as range images (transport `range_image`).
+ *
+ * The beam geometry is estimated from each cloud: an elevation and an azimuth offset for each row and an azimuth for
+ * each column. If all points lie within `geometry_tolerance` of the directions given by this geometry, only the
+ * quantized ranges are sent, and the decoded points are at most `geometry_tolerance + range_resolution / 2` from the
+ * original ones. Otherwise, the quantized coordinates are sent, with error at most `range_resolution / 2` on each axis.
+ * The ranges (coordinates) and all integer fields are coded as differences of neighboring values, which are small for
+ * the smooth images produced by lidars.
+ * The coordinates are quantized by `range_resolution`, the other fields are stored exactly (except float field
+ * `intensity` if `intensity_resolution` is set). Unorganized clouds, clouds without float fields x, y and z, and clouds
+ * with values of more than 2^31 quantization steps are sent as they are.
+ */
+class RangeImagePublisher : public point_cloud_transport::SimplePublisherPlugin<PointCloudRangeImage,
+                                                                                RangeImagePublisherConfig>
+{
+public:
+  std::string getTransportName() const override;
+
+  TypedEncodeResult encodeTyped(const sensor_msgs::PointCloud2& raw,
+                                const RangeImagePublisherConfig& config) const override;
+};
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin decoding clouds sent as range images.
+ */
+
+#include <string>
+
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudRangeImage.h>
+#include <point_cloud_transport/simple_subscriber_plugin.h>
+
+namespace point_cloud_transport
+{
+
+//! \brief Decodes the range images sent by RangeImagePublisher (transport `range_image`).
+class RangeImageSubscriber : public point_cloud_transport::SimpleSubscriberPlugin<PointCloudRangeImage>
+{
+public:
+  std::string getTransportName() const override;
+
+  DecodeResult decodeTyped(const PointCloudRangeImage& compressed, const NoConfigConfig& config) const override;
+};
+
+}
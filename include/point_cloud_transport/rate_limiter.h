@@ -0,0 +1,74 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Rate limiting of the clouds published by one transport.
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include <point_cloud_transport/publisher_options.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Decides which clouds one transport publishes so that it stays within its rate limits.
+ *
+ * The rate is the highest rate requested by the connected subscribers (a subscriber without a request wants all
+ * clouds), capped by the configured maximum rate.
+ */
+class RateLimiter : boost::noncopyable
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * \brief Create the limiter.
+   * \param[in] limit The configured limits of the transport.
+   */
+  explicit RateLimiter(const TransportRateLimit& limit);
+
+  //! \brief Record a connected subscriber and the rate it requested (zero means all clouds).
+  void addSubscriber(const std::string& subscriber, double requested_rate);
+
+  //! \brief Set the rate requested by all connections of a subscriber (zero means all clouds).
+  void setRequestedRate(const std::string& subscriber, double requested_rate);
+
+  //! \brief Forget one connection of the subscriber.
+  void removeSubscriber(const std::string& subscriber);
+
+  //! \brief Decide whether the next cloud should be published.
+  bool accept();
+
+  /**
+   * \brief Decide whether the next cloud should be published.
+   * \param[in] now The current time.
+   * \return Whether to publish the cloud.
+   */
+  bool accept(Clock::time_point now);
+
+  //! \brief The rate the clouds should be published with. Zero means all clouds.
+  double getRate() const;
+
+private:
+  double getRateLocked() const;
+
+  const TransportRateLimit limit_;
+  mutable std::mutex mutex_;
+  size_t counter_ {0};
+  Clock::time_point next_;
+  //! \brief Subscriber name -> requested rate. One entry per connection.
+  std::multimap<std::string, double> requested_rates_;
+};
+
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin sending the raw clouds in chunks.
+ */
+
+#include <string>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/chunked_publisher_plugin.h>
+#include <point_cloud_transport/NoConfigConfig.h>
+
+namespace point_cloud_transport
+{
+
+//! \brief Publishes the clouds uncompressed, split into chunks (transport `chunked`).
+class RawChunkedPublisher : public point_cloud_transport::ChunkedPublisherPlugin<>
+{
+public:
+  std::string getTransportName() const override;
+
+  TypedEncodeResult encodeChunk(
+      const sensor_msgs::PointCloud2& chunk, const point_cloud_transport::NoConfigConfig& config) const override;
+};
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin receiving the raw clouds in chunks.
+ */
+
+#include <string>
+
+#include <point_cloud_transport/chunked_subscriber_plugin.h>
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudChunk.h>
+
+namespace point_cloud_transport
+{
+
+//! \brief Receives uncompressed clouds split into chunks by RawChunkedPublisher (transport `chunked`).
+class RawChunkedSubscriber : public point_cloud_transport::ChunkedSubscriberPlugin<>
+{
+public:
+  std::string getTransportName() const override;
+
+  DecodeResult decodeChunk(
+      const PointCloudChunk& chunk, const point_cloud_transport::NoConfigConfig& config) const override;
+};
+
+}
@@ -60,15 +60,15 @@ public:
   TypedEncodeResult encodeTyped(
       const sensor_msgs::PointCloud2& raw, const point_cloud_transport::NoConfigConfig& config) const override;
 
-  // Override the default implementation because publishing the message pointer allows
-  // the no-copy intraprocess optimization.
-  void publish(const sensor_msgs::PointCloud2ConstPtr& message) const override;
-
   bool matchesTopic(const std::string& topic, const std::string& datatype) const override;
 
 protected:
   void publish(const sensor_msgs::PointCloud2& message, const PublishFn& publish_fn) const override;
 
+  // Override the default implementation because publishing the message pointer allows
+  // the no-copy intraprocess optimization.
+  void publishPtr(const sensor_msgs::PointCloud2ConstPtr& message, const PublishPtrFn& publish_fn) const override;
+
   std::string getTopicToAdvertise(const std::string& base_topic) const override;
 };
 
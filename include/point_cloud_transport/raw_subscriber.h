@@ -40,6 +40,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 #include <sensor_msgs/PointCloud2.h>
@@ -69,6 +70,9 @@ public:
 protected:
   void callback(const sensor_msgs::PointCloud2ConstPtr& message, const Callback& user_cb) override;
 
+  //! \brief Deserialize the cloud directly into a cloud from the pool (if one is set).
+  DecodeResult decodeSerializedTyped(const uint8_t* data, size_t size, const NoConfigConfig& config) const override;
+
   std::string getTopicToSubscribe(const std::string& base_topic) const override;
 };
 
@@ -9,16 +9,20 @@
  * \author Martin Pecka
  */
 
+#include <cstddef>
 #include <memory>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 
 #include <cras_cpp_common/nodelet_utils.hpp>
+#include <XmlRpcValue.h>
 
 #include <point_cloud_transport/point_cloud_transport.h>
 #include <point_cloud_transport/publisher.h>
 #include <point_cloud_transport/publisher_plugin.h>
 #include <point_cloud_transport/subscriber.h>
+#include <point_cloud_transport/thread_pool.h>
 
 
 namespace point_cloud_transport
@@ -28,18 +32,39 @@ namespace point_cloud_transport
 //!
 //! Usage: republish in_transport in:=<in_base_topic> [out_transport] out:=<out_base_topic>
 //!
+//! Or, to republish multiple topics: republish _topics:=<list of pairs>
+//!
 //! Parameters:
 //! - `~in_queue_size` (int, default 10): Input queue size.
 //! - `~out_queue_size` (int, default `in_queue_size`): Output queue size.
+//! - `~topics` (list of dicts): If set, the arguments are ignored and each item of the list describes one republished
+//!   topic: `in` (input base topic), `out` (output base topic), `in_transport` (default `raw`) and `out_transport`
+//!   (if not set, all transports are published). The clouds are decoded and encoded by a worker pool shared by all
+//!   topics, each topic keeping the order of its clouds. An input is subscribed only while its output has subscribers.
+//!   If `in_transport` and `out_transport` are the same, the messages are relayed without decoding them.
+//! - `~num_worker_threads` (int, default 0 = number of CPU cores): Size of the worker pool of the multi-topic mode.
+//! - `~worker_queue_size` (int, default `in_queue_size`): Maximum number of clouds of one topic waiting for the
+//!   workers. The oldest cloud is dropped when the queue is full.
 class RepublishNodelet : public cras::Nodelet
 {
 protected:
   void onInit() override;
 
+  //! \brief One republished topic of the multi-topic mode.
+  struct Pair;
+
+  //! \brief Set up the multi-topic mode.
+  void initPairs(XmlRpc::XmlRpcValue& topics, size_t in_queue_size, size_t out_queue_size);
+
   std::unique_ptr<point_cloud_transport::PointCloudTransport> pct;
   point_cloud_transport::Subscriber sub;
   boost::shared_ptr<point_cloud_transport::Publisher> pub;
   boost::shared_ptr<point_cloud_transport::PublisherPlugin> pubPlugin;
+
+  //! \brief Worker pool of the multi-topic mode.
+  std::unique_ptr<point_cloud_transport::ThreadPool> pool;
+  //! \brief Topics of the multi-topic mode. They are destroyed before the pool.
+  std::vector<boost::shared_ptr<Pair>> pairs;
 };
 
 }
@@ -0,0 +1,55 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin passing the cloud data to same-host subscribers via shared memory.
+ */
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <sys/types.h>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/PointCloudShm.h>
+#include <point_cloud_transport/shm_segment.h>
+#include <point_cloud_transport/ShmPublisherConfig.h>
+#include <point_cloud_transport/simple_publisher_plugin.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Writes the data of the clouds into a ring of slots in a shared memory segment and publishes only their
+ *        location (transport `shm`).
+ *
+ * This saves the serialization and the copying through the loopback socket for subscribers in other processes on the
+ * same host. Subscribers on other hosts can't use this transport. A slot is reused after `num_slots` newer clouds
+ * (slots that are being read are skipped), so subscribers that receive the message later than that drop the cloud. The
+ * segment grows (i.e. is replaced by a larger one) when a cloud does not fit its slots. If all slots are being read,
+ * the data are sent in the message. See cfg/ShmPublisher.cfg for the configuration.
+ */
+class ShmPublisher : public point_cloud_transport::SimplePublisherPlugin<PointCloudShm, ShmPublisherConfig>
+{
+public:
+  std::string getTransportName() const override;
+
+  TypedEncodeResult encodeTyped(const sensor_msgs::PointCloud2& raw, const ShmPublisherConfig& config) const override;
+
+  void shutdown() override;
+
+private:
+  //! \brief Mutex protecting the segment.
+  mutable std::mutex mutex_;
+  //! \brief The segment the clouds are written to. Null until the first cloud is encoded.
+  mutable std::unique_ptr<ShmSegment> segment_;
+  //! \brief Permissions of segment_.
+  mutable mode_t segment_mode_ {0};
+};
+
+}
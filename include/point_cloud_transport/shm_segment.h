@@ -0,0 +1,126 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Ring of slots in a POSIX shared memory segment, used by the shm transport.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+
+#include <cras_cpp_common/expected.hpp>
+#include <cras_cpp_common/optional.hpp>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief A POSIX shared memory segment divided into equally sized slots.
+ *
+ * One process (the publisher) creates the segment and writes to it, any number of processes on the same host open it
+ * and read from it. Each slot has a state word counting its active readers, with a flag set while the slot is being
+ * written. The writer only takes slots that nobody reads, and readers only read slots that are not being written and
+ * still hold the generation (number of the write) they were told about. So a slot can be reused as soon as nobody
+ * reads it, and a reader either gets the data it asked for or fails.
+ *
+ * A reader that dies while reading never releases its slot, so the writer takes back slots whose last reader started
+ * reading more than a second ago. Readers check the generation again after copying, so a slow reader whose slot was
+ * taken fails instead of returning torn data.
+ */
+class ShmSegment
+{
+public:
+  /**
+   * \brief Location of data written to the segment.
+   */
+  struct Location
+  {
+    uint32_t slot;
+    uint64_t generation;
+  };
+
+  /**
+   * \brief Create a new segment. It is removed from the system when the returned object is destroyed (processes that
+   *        have it open can still read it).
+   * \param[in] name Name of the segment (e.g. `/point_cloud_transport_123_0`).
+   * \param[in] num_slots Number of slots.
+   * \param[in] slot_size Size of each slot in bytes.
+   * \param[in] mode Permissions of the segment (the umask does not apply). Readers need read and write access.
+   * \return The segment, or an error message.
+   */
+  static cras::expected<std::unique_ptr<ShmSegment>, std::string> create(
+    const std::string& name, uint32_t num_slots, uint64_t slot_size, mode_t mode = 0600);
+
+  /**
+   * \brief Open an existing segment for reading.
+   * \param[in] name Name of the segment.
+   * \return The segment, or an error message.
+   */
+  static cras::expected<std::unique_ptr<ShmSegment>, std::string> open(const std::string& name);
+
+  ~ShmSegment();
+
+  /**
+   * \brief Remove the segments left behind by processes that did not exit cleanly.
+   * \param[in] prefix Prefix of the segment names (without the leading slash), which is followed by the PID of the
+   *                   process that created the segment and `_`. Segments of processes that still exist are kept.
+   * \return Number of the removed segments.
+   */
+  static size_t removeStaleSegments(const std::string& prefix);
+
+  //! \brief Name of this host. Segments can only be shared by processes on the same host.
+  static std::string getHostName();
+
+  const std::string& getName() const;
+
+  uint32_t getNumSlots() const;
+
+  uint64_t getSlotSize() const;
+
+  /**
+   * \brief Write the data into the next slot that nobody reads. Only the creator of the segment may write.
+   * \param[in] data The data.
+   * \param[in] size Size of the data. It has to fit into a slot.
+   * \return Where the data were written, or nothing if all slots are being read.
+   */
+  cras::optional<Location> write(const uint8_t* data, size_t size);
+
+  /**
+   * \brief Copy data out of a slot.
+   * \param[in] location Where the data were written.
+   * \param[out] data Output buffer.
+   * \param[in] size Size of the data.
+   * \return Whether the slot still held the requested data and they were copied.
+   */
+  bool read(const Location& location, uint8_t* data, size_t size);
+
+private:
+  struct SlotHeader;
+
+  ShmSegment(const std::string& name, int fd, uint8_t* memory, size_t memory_size, bool owner);
+
+  SlotHeader& getSlot(uint32_t slot);
+
+  uint8_t* getSlotData(uint32_t slot);
+
+  std::string name_;
+  int fd_;
+  uint8_t* memory_;
+  size_t memory_size_;
+  //! \brief Whether this process created the segment (and removes it).
+  bool owner_;
+  uint32_t num_slots_ {0};
+  uint64_t slot_size_ {0};
+  //! \brief The slot where the search for a free slot starts (the writer uses the slots round-robin).
+  uint32_t next_slot_ {0};
+  uint64_t next_generation_ {1};
+};
+
+}
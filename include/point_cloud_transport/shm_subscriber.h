@@ -0,0 +1,44 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin reading the cloud data from shared memory.
+ */
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudShm.h>
+#include <point_cloud_transport/shm_segment.h>
+#include <point_cloud_transport/simple_subscriber_plugin.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Reads the clouds sent by ShmPublisher from shared memory (transport `shm`).
+ *
+ * The data are copied once from the shared memory slot into the output cloud. ROS messages own their data buffers,
+ * so the cloud can't keep pointing into the slot, which the publisher reuses. Set `output_pool_size` to reuse the
+ * buffers of the output clouds, too. Clouds whose slot was already reused when the message arrived are dropped.
+ */
+class ShmSubscriber : public point_cloud_transport::SimpleSubscriberPlugin<PointCloudShm>
+{
+public:
+  std::string getTransportName() const override;
+
+  DecodeResult decodeTyped(const PointCloudShm& msg, const NoConfigConfig& config) const override;
+
+private:
+  //! \brief Mutex protecting the segment.
+  mutable std::mutex mutex_;
+  //! \brief The last opened segment.
+  mutable std::unique_ptr<ShmSegment> segment_;
+};
+
+}
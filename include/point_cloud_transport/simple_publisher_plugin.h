@@ -40,13 +40,21 @@
 
 #pragma once
 
+#include <algorithm>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <boost/bind.hpp>
 #include <boost/bind/placeholders.hpp>
 #include <boost/function.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 
 #include <cras_cpp_common/expected.hpp>
 #include <cras_cpp_common/optional.hpp>
@@ -59,6 +67,7 @@
 #include <ros/forwards.h>
 #include <ros/node_handle.h>
 #include <ros/publisher.h>
+#include <ros/serialization.h>
 #include <ros/single_subscriber_publisher.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <topic_tools/shape_shifter.h>
@@ -66,6 +75,7 @@
 #include <point_cloud_transport/publisher_plugin.h>
 #include <point_cloud_transport/NoConfigConfig.h>
 #include <point_cloud_transport/single_subscriber_publisher.h>
+#include <point_cloud_transport/transport_statistics.h>
 
 namespace point_cloud_transport
 {
@@ -88,15 +98,27 @@ namespace point_cloud_transport
  * getTopicToAdvertise() controls the name of the internal communication topic.
  * It defaults to \<base topic\>/\<transport name\>.
  *
+ * The last few encoded messages can be cached, so publishing the same cloud both to all subscribers and to a single
+ * subscriber (e.g. from the connect callback) only encodes it once. Only clouds published as shared pointers are
+ * cached. A cloud is identified by the object its pointer points to (the cache holds only weak pointers, so it does
+ * not keep the clouds alive and a new cloud allocated at the same address is never mistaken for the old one); the
+ * cache is invalidated by a change of the configuration. The cache size is given by parameter
+ * `<transport topic>/encode_cache_size` (default 0, which disables the cache, or 1 for stateful encoders, see
+ * isStateful()). Do not enable the cache if you modify published clouds in place.
+ *
+ * Encoding times and message sizes are recorded and available via getStatistics(). Cache hits are not recorded because
+ * no encoding happens.
+ *
  * \tparam M Type of the published messages.
  * \tparam Config Type of the publisher dynamic configuration.
  */
 template<class M, class Config = point_cloud_transport::NoConfigConfig>
-class SimplePublisherPlugin : public point_cloud_transport::SingleTopicPublisherPlugin
+class SimplePublisherPlugin : public point_cloud_transport::SingleTopicPublisherPlugin,
+                              public point_cloud_transport::TypedEncoder<M>
 {
 public:
   //! \brief Result of cloud encoding. Either the compressed cloud message, empty value, or error message.
-  typedef cras::expected<cras::optional<M>, std::string> TypedEncodeResult;
+  typedef typename TypedEncoder<M>::TypedEncodeResult TypedEncodeResult;
 
   ~SimplePublisherPlugin() override
   {
@@ -134,7 +156,18 @@ public:
       return;
     }
 
-    publish(message, bindInternalPublisher(simple_impl_->pub_));
+    publish(message, simple_impl_->publish_fn_);
+  }
+
+  void publish(const sensor_msgs::PointCloud2ConstPtr& message) const override
+  {
+    if (!simple_impl_ || !simple_impl_->pub_)
+    {
+      ROS_ASSERT_MSG(false, "Call to publish() on an invalid point_cloud_transport::SimplePublisherPlugin");
+      return;
+    }
+
+    publishPtr(message, simple_impl_->publish_ptr_fn_);
   }
 
   void shutdown() override
@@ -145,6 +178,15 @@ public:
     }
   }
 
+  TransportStatistics getStatistics() const override
+  {
+    if (simple_impl_)
+    {
+      return simple_impl_->statistics_.getStatistics();
+    }
+    return PublisherPlugin::getStatistics();
+  }
+
   /**
    * \brief Encode the given raw pointcloud into a compressed message.
    * \param[in] raw The input raw pointcloud.
@@ -164,7 +206,8 @@ public:
     return this->encodeTyped(raw, Config::__getDefault__());
   }
 
-  EncodeResult encode(const sensor_msgs::PointCloud2& raw, const dynamic_reconfigure::Config& configMsg) const override
+  TypedEncodeResult encodeMessage(const sensor_msgs::PointCloud2& raw,
+                                  const dynamic_reconfigure::Config& configMsg) const override
   {
     Config config = Config::__getDefault__();
     // dynamic_reconfigure has a bug and generates __fromMessage__ with non-const message arg, although it is only read
@@ -174,7 +217,46 @@ public:
           std::string("Wrong configuration options given to " + this->getTransportName() + " transport encoder."));
     }
 
-    auto res = this->encodeTyped(raw, config);
+    return this->encodeTyped(raw, config);
+  }
+
+  EncodeResult encode(const sensor_msgs::PointCloud2& raw, const dynamic_reconfigure::Config& configMsg) const override
+  {
+    return toEncodeResult(this->encodeMessage(raw, configMsg));
+  }
+
+  std::vector<EncodeResult> encodeBatch(const std::vector<sensor_msgs::PointCloud2ConstPtr>& raw,
+                                        const dynamic_reconfigure::Config& configMsg) const override
+  {
+    // Parse the config only once for the whole batch.
+    Config config = Config::__getDefault__();
+    if (!config.__fromMessage__(const_cast<dynamic_reconfigure::Config&>(configMsg)))
+    {
+      return std::vector<EncodeResult>(raw.size(), cras::make_unexpected(
+          std::string("Wrong configuration options given to " + this->getTransportName() + " transport encoder.")));
+    }
+
+    std::vector<EncodeResult> results;
+    results.reserve(raw.size());
+    for (const auto& cloud : raw)
+      results.push_back(toEncodeResult(this->encodeTyped(*cloud, config)));
+    return results;
+  }
+
+  cras::optional<dynamic_reconfigure::Config> getConfig() const override
+  {
+    return this->_getConfig<Config>();
+  }
+
+  bool setConfig(const dynamic_reconfigure::Config& configMsg) override
+  {
+    return this->_setConfig<Config>(configMsg);
+  }
+
+protected:
+  //! \brief Convert the result of encodeTyped() to the result of encode().
+  static EncodeResult toEncodeResult(const TypedEncodeResult& res)
+  {
     if (!res)
     {
       return cras::make_unexpected(res.error());
@@ -189,17 +271,118 @@ public:
     return shifter;
   }
 
-protected:
   std::string base_topic_;
   typedef dynamic_reconfigure::Server<Config> ReconfigureServer;
   boost::shared_ptr<ReconfigureServer> reconfigure_server_;
+  //! \brief The current config. Guarded by config_mutex_, because it is changed while other threads encode.
   Config config_{Config::__getDefault__()};
+  //! \brief Locked while configCb() is called. Read config_ only via getCurrentConfig().
+  mutable std::mutex config_mutex_;
+  //! \brief Whether the config was changed by setConfig() before the reconfigure server was started.
+  bool config_set_ {false};
 
+  //! \brief Called with config_mutex_ locked, so it must not call getCurrentConfig().
   virtual void configCb(Config& config, uint32_t level)
   {
     config_ = config;
   }
 
+  //! \brief Get a copy of config_ that is safe to use while the config is being changed.
+  Config getCurrentConfig() const
+  {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    return config_;
+  }
+
+  /**
+   * \brief Encode the message using the current config_ and record the encoding in the statistics.
+   * \param[in] message The raw cloud to encode.
+   * \return The encoded message, or null if the encoder returned no message or failed (the error is logged).
+   */
+  boost::shared_ptr<const M> encodeRecorded(const sensor_msgs::PointCloud2& message) const
+  {
+    const auto start = TransportStatisticsCollector::Clock::now();
+    auto res = this->encodeTyped(message, this->getCurrentConfig());
+    const auto duration = TransportStatisticsCollector::Clock::now() - start;
+    if (!res)
+    {
+      this->recordEncoding(duration, message, nullptr);
+      ROS_ERROR("Error encoding message by transport %s: %s.", this->getTransportName().c_str(), res.error().c_str());
+      return nullptr;
+    }
+    if (!res.value())
+    {
+      this->recordEncoding(duration, message, nullptr);
+      return nullptr;
+    }
+
+    const auto encoded = boost::make_shared<const M>(std::move(res.value().value()));
+    this->recordEncoding(duration, message, encoded.get());
+    return encoded;
+  }
+
+  /**
+   * \brief Encode the message using the current config_, or return the cached result of a previous encoding.
+   * \param[in] message The raw cloud to encode.
+   * \return The encoded message, or null if the encoder returned no message or failed (the error is logged).
+   */
+  boost::shared_ptr<const M> encodeCached(const sensor_msgs::PointCloud2ConstPtr& message) const
+  {
+    if (!simple_impl_ || simple_impl_->encode_cache_size_ == 0)
+      return this->encodeRecorded(*message);
+
+    EncodeCacheKey key;
+    key.cloud = message;
+    {
+      std::lock_guard<std::mutex> lock(simple_impl_->encode_cache_mutex_);
+      key.config_revision = simple_impl_->config_revision_;
+      auto& cache = simple_impl_->encode_cache_;
+      for (auto it = cache.begin(); it != cache.end(); ++it)
+      {
+        if (it->first.matches(message, key.config_revision))
+        {
+          cache.splice(cache.begin(), cache, it);
+          return cache.front().second;
+        }
+      }
+    }
+
+    const auto encoded = this->encodeRecorded(*message);
+    if (encoded)
+    {
+      std::lock_guard<std::mutex> lock(simple_impl_->encode_cache_mutex_);
+      // Do not store results of encoding with an outdated config.
+      if (key.config_revision == simple_impl_->config_revision_)
+      {
+        auto& cache = simple_impl_->encode_cache_;
+        cache.emplace_front(key, encoded);
+        while (cache.size() > simple_impl_->encode_cache_size_)
+          cache.pop_back();
+      }
+    }
+    return encoded;
+  }
+
+  /**
+   * \brief Record an encoding in the statistics of this transport.
+   * \param[in] duration How long the encoding took.
+   * \param[in] raw The encoded cloud.
+   * \param[in] encoded The encoded message. Null if the encoding did not produce any.
+   */
+  void recordEncoding(const TransportStatisticsCollector::Clock::duration& duration,
+                      const sensor_msgs::PointCloud2& raw, const M* encoded) const
+  {
+    if (!simple_impl_)
+      return;
+    if (encoded == nullptr)
+    {
+      simple_impl_->statistics_.addFailed(duration);
+      return;
+    }
+    simple_impl_->statistics_.addProcessed(duration, ros::serialization::serializationLength(raw),
+                                           ros::serialization::serializationLength(*encoded));
+  }
+
   template<typename C, std::enable_if_t<!std::is_same<C, NoConfigConfig>::value, int> = 0>
   void _startDynamicReconfigureServer()
   {
@@ -212,12 +395,73 @@ protected:
     // Do not start reconfigure server if there are no configuration options.
   }
 
+  template<typename C, std::enable_if_t<!std::is_same<C, NoConfigConfig>::value, int> = 0>
+  cras::optional<dynamic_reconfigure::Config> _getConfig() const
+  {
+    dynamic_reconfigure::Config configMsg;
+    this->getCurrentConfig().__toMessage__(configMsg);
+    return configMsg;
+  }
+
+  template<typename C, std::enable_if_t<std::is_same<C, NoConfigConfig>::value, int> = 0>
+  cras::optional<dynamic_reconfigure::Config> _getConfig() const
+  {
+    return cras::nullopt;
+  }
+
+  template<typename C, std::enable_if_t<!std::is_same<C, NoConfigConfig>::value, int> = 0>
+  bool _setConfig(const dynamic_reconfigure::Config& configMsg)
+  {
+    Config config = this->getCurrentConfig();
+    if (!config.__fromMessage__(const_cast<dynamic_reconfigure::Config&>(configMsg)))
+      return false;
+    config.__clamp__();
+
+    // Let the reconfigure server publish the new values so that rqt_reconfigure and the parameter server see them.
+    if (reconfigure_server_)
+      reconfigure_server_->updateConfig(config);
+    else
+      config_set_ = true;
+    this->configCbInternal(config, ~0u);
+    return true;
+  }
+
+  template<typename C, std::enable_if_t<std::is_same<C, NoConfigConfig>::value, int> = 0>
+  bool _setConfig(const dynamic_reconfigure::Config& configMsg)
+  {
+    return false;
+  }
+
+  /**
+   * \brief Initialize the encoder. Called once, either from advertise(), or when the first subscriber connects if
+   *        lazy initialization is enabled (see setLazyInit()).
+   *
+   * The default implementation starts the dynamic reconfigure server. Subclasses that need to allocate expensive
+   * encoder state can do it here (and call the base implementation).
+   */
+  virtual void initializeEncoder()
+  {
+    this->_startDynamicReconfigureServer<Config>();
+  }
+
   virtual void startDynamicReconfigureServer()
   {
+    // The server calls the callback with the values from the parameter server. If the config was changed by
+    // setConfig() before (e.g. with lazy initialization), the changed config is restored afterwards.
+    const auto config = this->getCurrentConfig();
+
     // Set up reconfigure server for this topic
     reconfigure_server_ = boost::make_shared<ReconfigureServer>(this->nh());
-    typename ReconfigureServer::CallbackType f = boost::bind(&SimplePublisherPlugin<M, Config>::configCb, this, _1, _2);
+    typename ReconfigureServer::CallbackType f =
+      boost::bind(&SimplePublisherPlugin<M, Config>::configCbInternal, this, _1, _2);
     reconfigure_server_->setCallback(f);
+
+    if (config_set_)
+    {
+      auto restored = config;
+      reconfigure_server_->updateConfig(restored);
+      this->configCbInternal(restored, ~0u);
+    }
   }
 
   void advertiseImpl(ros::NodeHandle& nh, const std::string& base_topic, uint32_t queue_size,
@@ -228,18 +472,29 @@ protected:
     base_topic_ = base_topic;
     std::string transport_topic = getTopicToAdvertise(base_topic);
     ros::NodeHandle param_nh(transport_topic);
-    simple_impl_ = std::make_unique<SimplePublisherPluginImpl>(param_nh);
+    simple_impl_ = std::make_unique<SimplePublisherPluginImpl>(param_nh, getTransportName());
+    int encode_cache_size;
+    // Encoding a cloud again would advance the state of a stateful encoder, so they remember the last cloud.
+    param_nh.param("encode_cache_size", encode_cache_size, this->isStateful() ? 1 : 0);
+    simple_impl_->encode_cache_size_ = static_cast<size_t>(std::max(0, encode_cache_size));
     simple_impl_->pub_ = nh.advertise<M>(transport_topic, queue_size,
-                                         bindCB(user_connect_cb, &SimplePublisherPlugin::connectCallback),
+                                         bindCB(user_connect_cb, &SimplePublisherPlugin::connectCallbackInternal),
                                          bindCB(user_disconnect_cb, &SimplePublisherPlugin::disconnectCallback),
                                          tracked_object, latch);
+    // Bind the publish functions once, so that publishing a cloud does not allocate new function objects.
+    simple_impl_->publish_fn_ = bindInternalPublisher(simple_impl_->pub_);
+    simple_impl_->publish_ptr_fn_ = bindInternalPtrPublisher(simple_impl_->pub_);
 
-    this->_startDynamicReconfigureServer<Config>();
+    if (!this->isLazyInit())
+      this->ensureEncoderInitialized();
   }
 
   //! Generic function for publishing the internal message type.
   typedef boost::function<void(const M&)> PublishFn;
 
+  //! Generic function for publishing a shared pointer to the internal message type.
+  typedef boost::function<void(const boost::shared_ptr<const M>&)> PublishPtrFn;
+
   /**
    * Publish a point cloud using the specified publish function. Must be implemented by
    * the subclass.
@@ -250,15 +505,24 @@ protected:
    */
   virtual void publish(const sensor_msgs::PointCloud2& message, const PublishFn& publish_fn) const
   {
-    const auto res = this->encodeTyped(message, config_);
-    if (!res)
-    {
-      ROS_ERROR("Error encoding message by transport %s: %s.", this->getTransportName().c_str(), res.error().c_str());
-    }
-    else if (res.value())
-    {
-      publish_fn(res.value().value());
-    }
+    const auto encoded = this->encodeRecorded(message);
+    if (encoded)
+      publish_fn(*encoded);
+  }
+
+  /**
+   * Publish a point cloud using the specified function publishing shared pointers to the encoded messages. This way,
+   * roscpp can pass the encoded messages to intra-process subscribers (e.g. nodelets) without serializing them.
+   *
+   * Subclasses that can pass the raw message directly (like the raw transport) can override this to keep the whole
+   * publishing path free of copies. Subclasses overriding publish(message, publish_fn) should override this function,
+   * too.
+   */
+  virtual void publishPtr(const sensor_msgs::PointCloud2ConstPtr& message, const PublishPtrFn& publish_fn) const
+  {
+    const auto encoded = this->encodeCached(message);
+    if (encoded)
+      publish_fn(encoded);
   }
 
   std::string getTopicToAdvertise(const std::string& base_topic) const override
@@ -326,17 +590,68 @@ protected:
   }
 
 private:
+  //! \brief Identification of a raw cloud and the configuration it was encoded with.
+  struct EncodeCacheKey
+  {
+    //! \brief The cloud. The weak pointer keeps its control block alive, so no other cloud can share it.
+    boost::weak_ptr<const sensor_msgs::PointCloud2> cloud;
+    size_t config_revision {0};
+
+    bool matches(const sensor_msgs::PointCloud2ConstPtr& other, size_t other_config_revision) const
+    {
+      return config_revision == other_config_revision && !cloud.owner_before(other) && !other.owner_before(cloud) &&
+        cloud.lock().get() == other.get();
+    }
+  };
+
   struct SimplePublisherPluginImpl
   {
-    explicit SimplePublisherPluginImpl(const ros::NodeHandle& nh)
-        : param_nh_(nh)
+    SimplePublisherPluginImpl(const ros::NodeHandle& nh, const std::string& transport)
+        : param_nh_(nh), statistics_(transport, TransportStatistics::ENCODER)
     {
     }
 
     const ros::NodeHandle param_nh_;
     ros::Publisher pub_;
+    //! \brief Publish functions of pub_.
+    PublishFn publish_fn_;
+    PublishPtrFn publish_ptr_fn_;
+    TransportStatisticsCollector statistics_;
+
+    size_t encode_cache_size_ {0};
+    size_t config_revision_ {0};
+    //! \brief The most recently used entries are at the front.
+    std::list<std::pair<EncodeCacheKey, boost::shared_ptr<const M>>> encode_cache_;
+    std::mutex encode_cache_mutex_;
+
+    std::once_flag encoder_initialized_;
   };
 
+  void ensureEncoderInitialized()
+  {
+    std::call_once(simple_impl_->encoder_initialized_, [this] { this->initializeEncoder(); });
+  }
+
+  //! \brief Initialize the encoder if it was deferred and pass the connection to connectCallback().
+  void connectCallbackInternal(const ros::SingleSubscriberPublisher& pub)
+  {
+    this->ensureEncoderInitialized();
+    this->connectCallback(pub);
+  }
+
+  //! \brief Invalidate the encode cache and pass the config to configCb().
+  void configCbInternal(Config& config, uint32_t level)
+  {
+    if (simple_impl_)
+    {
+      std::lock_guard<std::mutex> lock(simple_impl_->encode_cache_mutex_);
+      ++simple_impl_->config_revision_;
+      simple_impl_->encode_cache_.clear();
+    }
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    this->configCb(config, level);
+  }
+
   std::unique_ptr<SimplePublisherPluginImpl> simple_impl_;
 
   typedef void (SimplePublisherPlugin::*SubscriberStatusMemFn)(const ros::SingleSubscriberPublisher& pub);
@@ -378,9 +693,15 @@ private:
     PublishMemFn pub_mem_fn = &SimplePublisherPlugin::publish;
     PointCloud2PublishFn point_cloud_publish_fn = boost::bind(pub_mem_fn, this, _1, bindInternalPublisher(ros_ssp));
 
+    typedef void (SimplePublisherPlugin::*PublishPtrMemFn)(
+      const sensor_msgs::PointCloud2ConstPtr&, const PublishPtrFn&) const;
+    PublishPtrMemFn pub_ptr_mem_fn = &SimplePublisherPlugin::publishPtr;
+    SingleSubscriberPublisher::PublishPtrFn point_cloud_publish_ptr_fn =
+      boost::bind(pub_ptr_mem_fn, this, _1, bindInternalPtrPublisher(ros_ssp));
+
     SingleSubscriberPublisher ssp(ros_ssp.getSubscriberName(), getTopic(),
                                   boost::bind(&SimplePublisherPlugin::getNumSubscribers, this),
-                                  point_cloud_publish_fn);
+                                  point_cloud_publish_fn, point_cloud_publish_ptr_fn);
     user_cb(ssp);
   }
 
@@ -400,6 +721,19 @@ private:
     InternalPublishMemFn internal_pub_mem_fn = &PubT::publish;
     return boost::bind(internal_pub_mem_fn, &pub, _1);
   }
+
+  /**
+   * Returns a function object for publishing shared pointers to the transport-specific message type
+   * through some ROS publisher type.
+   *
+   * @param pub An object with method void publish(const boost::shared_ptr<const M>&)
+   */
+  template<class PubT>
+  PublishPtrFn bindInternalPtrPublisher(const PubT& pub) const
+  {
+    const PubT* pub_ptr = &pub;
+    return [pub_ptr](const boost::shared_ptr<const M>& message) { pub_ptr->publish(message); };
+  }
 };
 
 }
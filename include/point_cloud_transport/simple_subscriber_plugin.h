@@ -40,23 +40,36 @@
 
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <boost/bind.hpp>
 #include <boost/bind/placeholders.hpp>
+#include <boost/make_shared.hpp>
 
 #include <cras_cpp_common/string_utils.hpp>
 #include <cras_cpp_common/type_utils.hpp>
+#include <cras_topic_tools/shape_shifter.h>
 #include <dynamic_reconfigure/Config.h>
 #include <dynamic_reconfigure/server.h>
 #include <ros/forwards.h>
 #include <ros/node_handle.h>
+#include <ros/serialization.h>
 #include <ros/subscriber.h>
 
 #include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/point_cloud_pool.h>
 #include <point_cloud_transport/subscriber_plugin.h>
+#include <point_cloud_transport/thread_pool.h>
+#include <point_cloud_transport/transport_statistics.h>
 
 namespace point_cloud_transport
 {
@@ -78,6 +91,9 @@ namespace point_cloud_transport
  *
  * getTopicToSubscribe() controls the name of the internal communication topic. It
  * defaults to \<base topic\>/\<transport name\>.
+ *
+ * The time spent in callback() (without the user callback) and the message sizes are recorded and available via
+ * getStatistics().
  */
 template<class M, class Config = point_cloud_transport::NoConfigConfig>
 class SimpleSubscriberPlugin : public SingleTopicSubscriberPlugin
@@ -117,9 +133,53 @@ public:
     if (simple_impl_)
     {
       simple_impl_->sub_.shutdown();
+      // Wait for the messages already being decoded (except the one calling this). The waiting ones are dropped.
+      const bool in_latest_thread = simple_impl_->latest_pool_ && simple_impl_->latest_pool_->isWorkerThread();
+      simple_impl_->decode_state_->stop(in_latest_thread);
+      if (simple_impl_->decode_executor_ && simple_impl_->decode_executor_->isWorkerThread())
+      {
+        // Called from the user callback. The executor can not join the thread running this call, so it is destroyed
+        // by another thread after the callback returns. The user callback is not called again.
+        std::thread([](std::unique_ptr<OrderedExecutor>) {}, std::move(simple_impl_->decode_executor_)).detach();
+      }
+      // Finish the delivery of the decoded clouds, so that no user callback is called after shutdown() returns.
+      simple_impl_->decode_executor_.reset();
+      if (in_latest_thread)
+      {
+        // Called from the user callback. The strand would wait for the task running this call, so it is destroyed
+        // with its pool by another thread after the callback returns.
+        std::thread([](std::unique_ptr<Strand> strand, std::unique_ptr<ThreadPool> pool)
+        {
+          strand.reset();
+          pool.reset();
+        }, std::move(simple_impl_->latest_strand_), std::move(simple_impl_->latest_pool_)).detach();
+      }
+      // The strand drops the waiting message and waits for the running one. It has to go before its pool.
+      simple_impl_->latest_strand_.reset();
+      simple_impl_->latest_pool_.reset();
     }
   }
 
+  TransportStatistics getStatistics() const override
+  {
+    if (!simple_impl_)
+    {
+      return SubscriberPlugin::getStatistics();
+    }
+
+    auto stats = simple_impl_->statistics_.getStatistics();
+    if (simple_impl_->latest_strand_)
+    {
+      stats.queue_depth = simple_impl_->latest_strand_->getQueueSize();
+      stats.num_dropped = simple_impl_->latest_strand_->getNumDropped();
+    }
+    else if (simple_impl_->decode_executor_)
+    {
+      stats.queue_depth = simple_impl_->decode_executor_->getNumInFlight();
+    }
+    return stats;
+  }
+
   /**
    * \brief Decode the given compressed pointcloud into a raw message.
    * \param[in] compressed The input compressed pointcloud.
@@ -161,30 +221,120 @@ public:
           std::string("Wrong configuration options given to " + this->getTransportName() + " transport decoder."));
     }
 
-    typename M::ConstPtr msg;
+    return decodeShapeShifter(compressed, config);
+  }
+
+  std::vector<DecodeResult> decodeBatch(const std::vector<topic_tools::ShapeShifter::ConstPtr>& compressed,
+                                        const dynamic_reconfigure::Config& configMsg) const override
+  {
+    // Parse the config only once for the whole batch.
+    Config config = Config::__getDefault__();
+    if (!config.__fromMessage__(const_cast<dynamic_reconfigure::Config&>(configMsg)))
+    {
+      return std::vector<DecodeResult>(compressed.size(), cras::make_unexpected(
+          std::string("Wrong configuration options given to " + this->getTransportName() + " transport decoder.")));
+    }
+
+    std::vector<DecodeResult> results;
+    results.reserve(compressed.size());
+    for (const auto& cloud : compressed)
+      results.push_back(decodeShapeShifter(*cloud, config));
+    return results;
+  }
+
+  DecodeResult decodeSerialized(const std::string& dataType, const std::string& md5sum, const uint8_t* data,
+                                size_t size, const dynamic_reconfigure::Config& configMsg) const override
+  {
+    if (!isMessageType(dataType, md5sum))
+      return SubscriberPlugin::decodeSerialized(dataType, md5sum, data, size, configMsg);
+
+    Config config = Config::__getDefault__();
+    if (!config.__fromMessage__(const_cast<dynamic_reconfigure::Config&>(configMsg)))
+    {
+      return cras::make_unexpected(
+          std::string("Wrong configuration options given to " + this->getTransportName() + " transport decoder."));
+    }
+
+    return this->decodeSerializedTyped(data, size, config);
+  }
+
+protected:
+  //! \brief Decode the compressed message held by the shapeshifter.
+  DecodeResult decodeShapeShifter(const topic_tools::ShapeShifter& compressed, const Config& config) const
+  {
+    if (!isMessageType(compressed.getDataType(), compressed.getMD5Sum()))
+    {
+      return cras::make_unexpected(cras::format(
+        "Invalid shapeshifter passed to transport decoder: expected message of type %s, got %s.",
+        ros::message_traits::DataType<M>::value(), compressed.getDataType().c_str()));
+    }
+
+    return this->decodeSerializedTyped(cras::getBuffer(compressed), compressed.size(), config);
+  }
+
+  /**
+   * \brief Deserialize the compressed message from the buffer and decode it.
+   *
+   * Subclasses whose messages are little more than a header and a byte array can override it to read the payload
+   * directly from the buffer instead of deserializing it into a new message first.
+   *
+   * \param[in] data The serialized compressed message of type M. It is only read during the call.
+   * \param[in] size Size of the serialized message in bytes.
+   * \param[in] config Config of the decompression.
+   * \return The raw cloud message (if decoding succeeds), or an error message.
+   */
+  virtual DecodeResult decodeSerializedTyped(const uint8_t* data, size_t size, const Config& config) const
+  {
+    auto msg = boost::make_shared<M>();
     try
     {
-      msg = compressed.instantiate<M>();
+      // IStream only reads from the buffer, it just does not have a const constructor.
+      ros::serialization::IStream stream(const_cast<uint8_t*>(data), static_cast<uint32_t>(size));
+      ros::serialization::deserialize(stream, *msg);
     }
     catch (const ros::Exception& e)
     {
-      return cras::make_unexpected(cras::format("Invalid shapeshifter passed to transport decoder: %s.", e.what()));
+      return cras::make_unexpected(cras::format("Invalid message passed to transport decoder: %s.", e.what()));
     }
 
-    return this->decodeTyped(msg, config);
+    return this->decodeTyped(typename M::ConstPtr(msg), config);
+  }
+
+  //! \brief Whether the given datatype and MD5 sum (or `*`) describe message type M.
+  static bool isMessageType(const std::string& dataType, const std::string& md5sum)
+  {
+    return dataType == ros::message_traits::DataType<M>::value() &&
+        (md5sum == "*" || md5sum == ros::message_traits::MD5Sum<M>::value());
   }
 
-protected:
   std::string base_topic_;
   typedef dynamic_reconfigure::Server<Config> ReconfigureServer;
   boost::shared_ptr<ReconfigureServer> reconfigure_server_;
+  //! \brief The current config. Guarded by config_mutex_, because it is changed while other threads decode.
   Config config_{Config::__getDefault__()};
+  //! \brief Locked while configCb() is called. Read config_ only via getCurrentConfig().
+  mutable std::mutex config_mutex_;
 
+  //! \brief Called with config_mutex_ locked, so it must not call getCurrentConfig().
   virtual void configCb(Config& config, uint32_t level)
   {
     config_ = config;
   }
 
+  //! \brief Get a copy of config_ that is safe to use while the config is being changed.
+  Config getCurrentConfig() const
+  {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    return config_;
+  }
+
+  //! \brief Pass the config to configCb() with config_mutex_ locked.
+  void configCbInternal(Config& config, uint32_t level)
+  {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    this->configCb(config, level);
+  }
+
   template<typename C, std::enable_if_t<!std::is_same<C, NoConfigConfig>::value, int> = 0>
   void _startDynamicReconfigureServer()
   {
@@ -202,7 +352,7 @@ protected:
     // Set up reconfigure server for this topic
     reconfigure_server_ = boost::make_shared<ReconfigureServer>(this->nh());
     typename ReconfigureServer::CallbackType f =
-        boost::bind(&SimpleSubscriberPlugin<M, Config>::configCb, this, _1, _2);
+        boost::bind(&SimpleSubscriberPlugin<M, Config>::configCbInternal, this, _1, _2);
     reconfigure_server_->setCallback(f);
   }
 
@@ -211,7 +361,7 @@ protected:
    */
   virtual void callback(const typename M::ConstPtr& message, const Callback& user_cb)
   {
-    DecodeResult res = this->decodeTyped(message, config_);
+    DecodeResult res = this->decodeTyped(message, this->getCurrentConfig());
     if (!res)
       ROS_ERROR("Error decoding message by transport %s: %s.", this->getTransportName().c_str(), res.error().c_str());
     else if (res.value())
@@ -220,6 +370,15 @@ protected:
     }
   }
 
+  /**
+   * Whether a cloud can be decoded only from several consecutive messages (e.g. its chunks), so the latest-only mode
+   * must not drop any of them.
+   */
+  virtual bool needsAllMessages() const
+  {
+    return false;
+  }
+
   std::string getTopicToSubscribe(const std::string& base_topic) const override
   {
     return base_topic + "/" + getTransportName();
@@ -254,11 +413,62 @@ protected:
   {
     // Push each group of transport-specific parameters into a separate sub-namespace
     ros::NodeHandle param_nh(transport_hints.getParameterNH(), getTransportName());
-    simple_impl_ = std::make_unique<SimpleSubscriberPluginImpl>(param_nh);
+    simple_impl_ = std::make_unique<SimpleSubscriberPluginImpl>(param_nh, getTransportName());
+
+    int decode_threads;
+    param_nh.param("decode_threads", decode_threads, static_cast<int>(transport_hints.getDecodeThreads()));
+    int max_decode_in_flight;
+    param_nh.param("max_decode_in_flight", max_decode_in_flight,
+                   static_cast<int>(transport_hints.getMaxDecodeInFlight()));
+    bool latest_only;
+    param_nh.param("latest_only", latest_only, transport_hints.isLatestOnly());
+    int output_pool_size;
+    param_nh.param("output_pool_size", output_pool_size, static_cast<int>(transport_hints.getOutputPoolSize()));
+    if (output_pool_size > 0)
+      this->setPointCloudPool(std::make_shared<PointCloudPool>(static_cast<size_t>(output_pool_size)));
+    if (this->isStateful() && (latest_only || decode_threads > 0))
+    {
+      // Dropped or reordered messages would break the decoding of all the messages depending on them.
+      ROS_WARN("Transport %s decodes each message using the previous ones, so it ignores parameters latest_only and "
+               "decode_threads.", getTransportName().c_str());
+      latest_only = false;
+      decode_threads = 0;
+    }
+    if (latest_only && this->needsAllMessages())
+    {
+      ROS_WARN("Transport %s needs all the messages to assemble a cloud, so it ignores parameter latest_only.",
+               getTransportName().c_str());
+      latest_only = false;
+    }
+    if (latest_only)
+    {
+      // A single decoding thread with a queue of length 1. A newer message replaces the one waiting for decoding.
+      simple_impl_->latest_pool_ = std::make_unique<ThreadPool>(1);
+      simple_impl_->latest_strand_ = std::make_unique<Strand>(
+        *simple_impl_->latest_pool_, 1, QueueOverflowPolicy::DROP_OLDEST);
+    }
+    else if (decode_threads > 0)
+    {
+      simple_impl_->decode_executor_ = std::make_unique<OrderedExecutor>(
+        static_cast<size_t>(decode_threads), static_cast<size_t>(std::max(0, max_decode_in_flight)));
+    }
 
     ros::SubscribeOptions ops;
-    ops.init<M>(getTopicToSubscribe(base_topic), queue_size,
-                boost::bind(&SimpleSubscriberPlugin::callback, this, _1, callback));
+    if (simple_impl_->latest_strand_)
+    {
+      ops.init<M>(getTopicToSubscribe(base_topic), queue_size,
+                  boost::bind(&SimpleSubscriberPlugin::latestOnlyCallback, this, _1, callback));
+    }
+    else if (simple_impl_->decode_executor_)
+    {
+      ops.init<M>(getTopicToSubscribe(base_topic), queue_size,
+                  boost::bind(&SimpleSubscriberPlugin::parallelCallback, this, _1, callback));
+    }
+    else
+    {
+      ops.init<M>(getTopicToSubscribe(base_topic), queue_size,
+                  boost::bind(&SimpleSubscriberPlugin::timedCallback, this, _1, callback));
+    }
     ops.tracked_object = tracked_object;
     ops.transport_hints = transport_hints.getRosHints();
     ops.allow_concurrent_callbacks = allow_concurrent_callbacks;
@@ -268,6 +478,83 @@ protected:
     this->_startDynamicReconfigureServer<Config>();
   }
 
+  /**
+   * Process a message in the decoding thread pool. callback() is called from one of the pool threads, and the clouds
+   * it passes to the user callback are delivered in the order the messages were received.
+   */
+  void parallelCallback(const typename M::ConstPtr& message, const Callback& user_cb)
+  {
+    // The jobs and completions can outlive the plugin if it is shut down from the user callback, so they hold the
+    // state and do not touch the plugin after the shutdown.
+    const auto state = simple_impl_->decode_state_;
+    simple_impl_->decode_executor_->post([this, message, user_cb, state]()
+    {
+      auto decoded = std::make_shared<std::vector<sensor_msgs::PointCloud2ConstPtr>>();
+      {
+        const typename DecodeState::Job job(*state);
+        if (!job.isRunning())
+          return ThreadPool::Task();
+        this->timedCallback(message, [decoded](const sensor_msgs::PointCloud2ConstPtr& cloud)
+        {
+          decoded->push_back(cloud);
+        });
+      }
+      return ThreadPool::Task([decoded, user_cb, state]
+      {
+        for (const auto& cloud : *decoded)
+        {
+          if (state->isStopped())
+            return;
+          user_cb(cloud);
+        }
+      });
+    });
+  }
+
+  /**
+   * Process a message in the latest-only mode. The message waits for the decoding thread, and if a newer message
+   * arrives meanwhile, this one is dropped without being decoded.
+   */
+  void latestOnlyCallback(const typename M::ConstPtr& message, const Callback& user_cb)
+  {
+    // As in parallelCallback(), the dropped task may be destroyed after the plugin.
+    const auto state = simple_impl_->decode_state_;
+    simple_impl_->latest_strand_->post([this, message, user_cb, state]()
+    {
+      const typename DecodeState::Job job(*state);
+      if (!job.isRunning())
+        return;
+      this->timedCallback(message, [&user_cb, &state](const sensor_msgs::PointCloud2ConstPtr& cloud)
+      {
+        if (!state->isStopped())
+          user_cb(cloud);
+      });
+    });
+  }
+
+  /**
+   * Call callback() and record the time it took and the message sizes in the statistics. The time spent in the user
+   * callback is not counted.
+   */
+  void timedCallback(const typename M::ConstPtr& message, const Callback& user_cb)
+  {
+    const size_t input_bytes = ros::serialization::serializationLength(*message);
+    bool produced = false;
+    auto start = TransportStatisticsCollector::Clock::now();
+    this->callback(message, [&](const sensor_msgs::PointCloud2ConstPtr& cloud)
+    {
+      // If a message is decoded into multiple clouds, its size is counted only with the first one.
+      simple_impl_->statistics_.addProcessed(TransportStatisticsCollector::Clock::now() - start,
+                                             produced ? 0 : input_bytes,
+                                             ros::serialization::serializationLength(*cloud));
+      produced = true;
+      user_cb(cloud);
+      start = TransportStatisticsCollector::Clock::now();
+    });
+    if (!produced)
+      simple_impl_->statistics_.addFailed(TransportStatisticsCollector::Clock::now() - start);
+  }
+
   /**
    * Returns the ros::NodeHandle to be used for parameter lookup.
    */
@@ -277,15 +564,82 @@ protected:
   }
 
 private:
+  //! \brief Tracks the decoding jobs running in the worker threads, so that shutdown() can wait for them.
+  struct DecodeState
+  {
+    //! \brief A decoding job. It runs only if the plugin has not been shut down.
+    class Job
+    {
+    public:
+      explicit Job(DecodeState& state) : state_(state)
+      {
+        std::lock_guard<std::mutex> lock(state_.mutex_);
+        running_ = !state_.stopped_;
+        if (running_)
+          ++state_.num_running_;
+      }
+
+      ~Job()
+      {
+        if (!running_)
+          return;
+        std::lock_guard<std::mutex> lock(state_.mutex_);
+        --state_.num_running_;
+        state_.cv_.notify_all();
+      }
+
+      bool isRunning() const
+      {
+        return running_;
+      }
+
+    private:
+      DecodeState& state_;
+      bool running_ {false};
+    };
+
+    /**
+     * \brief Prevent new jobs from running and wait until the running ones finish.
+     * \param[in] from_job Whether this is called from a running job, which is then not waited for.
+     */
+    void stop(bool from_job)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stopped_ = true;
+      cv_.wait(lock, [this, from_job] { return num_running_ == (from_job ? 1 : 0); });
+    }
+
+    bool isStopped() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return stopped_;
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopped_ {false};
+    size_t num_running_ {0};
+  };
+
   struct SimpleSubscriberPluginImpl
   {
-    explicit SimpleSubscriberPluginImpl(const ros::NodeHandle& nh)
-        : param_nh_(nh)
+    SimpleSubscriberPluginImpl(const ros::NodeHandle& nh, const std::string& transport)
+        : param_nh_(nh), statistics_(transport, TransportStatistics::DECODER)
     {
     }
 
     const ros::NodeHandle param_nh_;
     ros::Subscriber sub_;
+    TransportStatisticsCollector statistics_;
+    //! \brief State of the decoding jobs of decode_executor_ or latest_strand_, shared with them.
+    const std::shared_ptr<DecodeState> decode_state_ {std::make_shared<DecodeState>()};
+    //! \brief Pool of decoding threads. Null if the messages are decoded directly in the ROS callback.
+    std::unique_ptr<OrderedExecutor> decode_executor_;
+    //! \brief The decoding thread in the latest-only mode. Null if not in this mode.
+    std::unique_ptr<ThreadPool> latest_pool_;
+    //! \brief Holds the newest message waiting for decoding in the latest-only mode. Destroyed before latest_pool_.
+    std::unique_ptr<Strand> latest_strand_;
   };
 
   std::unique_ptr<SimpleSubscriberPluginImpl> simple_impl_;
@@ -56,10 +56,15 @@ class SingleSubscriberPublisher : boost::noncopyable
 public:
   typedef boost::function<uint32_t()> GetNumSubscribersFn;
   typedef boost::function<void(const sensor_msgs::PointCloud2&)> PublishFn;
+  typedef boost::function<void(const sensor_msgs::PointCloud2ConstPtr&)> PublishPtrFn;
 
+  /**
+   * \param publish_ptr_fn If set, it is used for publishing shared pointers, which allows the transport to pass them
+   *                       to roscpp without copying. If not set, publish_fn is used for shared pointers, too.
+   */
   SingleSubscriberPublisher(const std::string& caller_id, const std::string& topic,
                             const GetNumSubscribersFn& num_subscribers_fn,
-                            const PublishFn& publish_fn);
+                            const PublishFn& publish_fn, const PublishPtrFn& publish_ptr_fn = {});
 
   std::string getSubscriberName() const;
 
@@ -75,8 +80,9 @@ private:
   std::string topic_;
   GetNumSubscribersFn num_subscribers_fn_;
   PublishFn publish_fn_;
+  PublishPtrFn publish_ptr_fn_;
 
-  friend class Publisher;  // to get publish_fn_ directly
+  friend class Publisher;  // to get publish_fn_ and publish_ptr_fn_ directly
 };
 
 typedef boost::function<void(const SingleSubscriberPublisher&)> SubscriberStatusCallback;
@@ -52,6 +52,7 @@
 
 #include <point_cloud_transport/loader_fwds.h>
 #include <point_cloud_transport/transport_hints.h>
+#include <point_cloud_transport/TransportStatistics.h>
 
 namespace point_cloud_transport {
 
@@ -93,6 +94,11 @@ public:
    */
   std::string getTransport() const;
 
+  /**
+   * Returns the decoding statistics of the transport (the same data as published on the statistics topic).
+   */
+  point_cloud_transport::TransportStatistics getStatistics() const;
+
   /**
    * Unsubscribe the callback associated with this Subscriber.
    */
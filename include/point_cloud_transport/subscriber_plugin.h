@@ -40,13 +40,17 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <list>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <boost/bind.hpp>
 #include <boost/bind/placeholders.hpp>
 #include <boost/function.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/noncopyable.hpp>
 
 #include <cras_cpp_common/expected.hpp>
@@ -55,6 +59,7 @@
 #include <cras_cpp_common/optional.hpp>
 #include <cras_cpp_common/string_utils.hpp>
 #include <cras_cpp_common/xmlrpc_value_utils.hpp>
+#include <cras_topic_tools/shape_shifter.h>
 #include <dynamic_reconfigure/Config.h>
 #include <ros/forwards.h>
 #include <ros/node_handle.h>
@@ -62,7 +67,9 @@
 #include <topic_tools/shape_shifter.h>
 #include <XmlRpcValue.h>
 
+#include <point_cloud_transport/point_cloud_pool.h>
 #include <point_cloud_transport/transport_hints.h>
+#include <point_cloud_transport/TransportStatistics.h>
 
 namespace point_cloud_transport
 {
@@ -149,6 +156,50 @@ public:
     return this->decode(compressed, configMsg);
   }
 
+  /**
+   * \brief Decode the given compressed pointclouds using the same configuration.
+   *
+   * The default implementation calls decode() for each cloud. Subclasses can override it to parse the configuration
+   * and set up the decoder only once for the whole batch.
+   *
+   * \param[in] compressed The shapeshifters of the compressed pointclouds to be decoded.
+   * \param[in] config Config of the decompression (if it has any parameters).
+   * \return The decoding results of the clouds (in the same order as compressed).
+   */
+  virtual std::vector<DecodeResult> decodeBatch(const std::vector<topic_tools::ShapeShifter::ConstPtr>& compressed,
+                                                const dynamic_reconfigure::Config& config) const
+  {
+    std::vector<DecodeResult> results;
+    results.reserve(compressed.size());
+    for (const auto& cloud : compressed)
+      results.push_back(this->decode(*cloud, config));
+    return results;
+  }
+
+  /**
+   * \brief Decode the given serialized compressed pointcloud into a raw cloud.
+   *
+   * The default implementation copies the bytes into a shapeshifter and calls decode(). Subclasses can override it to
+   * read the compressed message directly from the given buffer.
+   *
+   * \param[in] dataType Datatype of the compressed message.
+   * \param[in] md5sum MD5 sum of the compressed message type.
+   * \param[in] data The serialized compressed message. It is only read during the call.
+   * \param[in] size Size of the serialized message in bytes.
+   * \param[in] config Config of the decompression (if it has any parameters).
+   * \return The decoded raw pointcloud (if decoding succeeds), or an error message.
+   */
+  virtual DecodeResult decodeSerialized(const std::string& dataType, const std::string& md5sum, const uint8_t* data,
+                                        size_t size, const dynamic_reconfigure::Config& config) const
+  {
+    topic_tools::ShapeShifter compressed;
+    compressed.morph(md5sum, dataType, "", "");
+    cras::resizeBuffer(compressed, size);
+    if (size > 0)
+      memcpy(cras::getBuffer(compressed), data, size);
+    return this->decode(compressed, config);
+  }
+
   /**
    * Subscribe to a point cloud topic, version for arbitrary boost::function object.
    */
@@ -216,6 +267,51 @@ public:
    */
   virtual void shutdown() = 0;
 
+  /**
+   * Get the decoding statistics of this transport. The default implementation only fills the transport name.
+   */
+  virtual TransportStatistics getStatistics() const
+  {
+    TransportStatistics stats;
+    stats.transport = getTransportName();
+    stats.direction = TransportStatistics::DECODER;
+    return stats;
+  }
+
+  /**
+   * Whether the decoder drops the points outside TransportHints::getCloudFilter() crop box itself while decoding. If it
+   * does, Subscriber does not crop the decoded clouds again. Decoders that return true read the box from the transport
+   * hints in subscribeImpl(). The default implementation returns false.
+   */
+  virtual bool cropsWhileDecoding() const
+  {
+    return false;
+  }
+
+  /**
+   * Whether the decoding of a message depends on the previously decoded messages (e.g. it is a difference to the
+   * previous cloud). Such decoders get the messages one by one in the order they were received, so parameters
+   * `decode_threads` and `latest_only` are ignored for them. The default implementation returns false.
+   */
+  virtual bool isStateful() const
+  {
+    return false;
+  }
+
+  /**
+   * Take the decoded clouds from the given pool (see allocateCloud()). Null means allocating a new cloud for each
+   * decoded message. Set the pool before decoding the first message.
+   */
+  void setPointCloudPool(const std::shared_ptr<PointCloudPool>& pool)
+  {
+    pool_ = pool;
+  }
+
+  const std::shared_ptr<PointCloudPool>& getPointCloudPool() const
+  {
+    return pool_;
+  }
+
   /**
    * Return the lookup name of the SubscriberPlugin associated with a specific
    * transport identifier.
@@ -226,6 +322,35 @@ public:
   }
 
 protected:
+  /**
+   * Get a new cloud to decode a message into. Decoders should call this instead of allocating the output clouds
+   * themselves, so that the clouds are taken from the pool set by setPointCloudPool() (if any). The values of the data
+   * are unspecified.
+   */
+  sensor_msgs::PointCloud2Ptr allocateCloud(size_t data_size = 0) const
+  {
+    if (pool_)
+      return pool_->acquire(data_size);
+    auto cloud = boost::make_shared<sensor_msgs::PointCloud2>();
+    cloud->data.resize(data_size);
+    return cloud;
+  }
+
+  /**
+   * Get a new cloud with the given dimensions (and data size) to decode a message into. See allocateCloud(size_t).
+   */
+  sensor_msgs::PointCloud2Ptr allocateCloud(uint32_t height, uint32_t width, uint32_t point_step) const
+  {
+    if (pool_)
+      return pool_->acquire(height, width, point_step);
+    auto cloud = this->allocateCloud(static_cast<size_t>(height) * width * point_step);
+    cloud->height = height;
+    cloud->width = width;
+    cloud->point_step = point_step;
+    cloud->row_step = width * point_step;
+    return cloud;
+  }
+
   /**
    * Subscribe to a point cloud transport topic. Must be implemented by the subclass.
    */
@@ -233,6 +358,9 @@ protected:
                              const Callback& callback, const ros::VoidPtr& tracked_object,
                              const point_cloud_transport::TransportHints& transport_hints,
                              bool allow_concurrent_callbacks) = 0;
+
+private:
+  std::shared_ptr<PointCloudPool> pool_;
 };
 
 class SingleTopicSubscriberPlugin : public SubscriberPlugin
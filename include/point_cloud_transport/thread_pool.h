@@ -0,0 +1,190 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Simple worker pools used for running encoders and decoders outside of the caller's thread.
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief A fixed-size pool of worker threads executing the posted tasks in FIFO order.
+ *
+ * When the pool is shut down (or destroyed), the tasks that were already posted are still finished.
+ */
+class ThreadPool : boost::noncopyable
+{
+public:
+  typedef std::function<void()> Task;
+
+  /**
+   * \brief Start the worker threads.
+   * \param[in] num_threads Number of worker threads. Zero means the number of CPU cores.
+   */
+  explicit ThreadPool(size_t num_threads = 0);
+
+  //! \brief Finish all posted tasks and join the worker threads.
+  ~ThreadPool();
+
+  /**
+   * \brief Queue the task for execution by one of the worker threads.
+   * \param[in] task The task to run. Exceptions thrown by the task are logged and otherwise ignored.
+   * \return Whether the task was queued. It is not queued if the pool is shutting down.
+   */
+  bool post(const Task& task);
+
+  //! \brief Number of worker threads of the pool.
+  size_t getNumThreads() const;
+
+  //! \brief Whether the calling thread is one of the worker threads of the pool.
+  bool isWorkerThread() const;
+
+  //! \brief Finish all posted tasks and join the worker threads. Tasks posted after this call are ignored.
+  void shutdown();
+
+private:
+  void run();
+
+  std::vector<std::thread> threads_;
+  //! \brief IDs of threads_, which can be read while the threads are being joined.
+  std::vector<std::thread::id> thread_ids_;
+  std::deque<Task> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ {false};
+};
+
+//! \brief What to do when a task is posted to a Strand whose queue is full.
+enum class QueueOverflowPolicy
+{
+  DROP_OLDEST,  //!< Drop the oldest task waiting in the queue and queue the new one.
+  DROP_NEWEST,  //!< Drop the new task.
+  BLOCK,  //!< Block the posting thread until there is a free place in the queue.
+};
+
+/**
+ * \brief Executes the posted tasks one after another in the order of posting, using threads of a ThreadPool.
+ *
+ * Tasks posted to different strands sharing one pool run in parallel, while tasks posted to a single strand never
+ * run concurrently.
+ *
+ * The queue of tasks waiting for execution can be bounded. The task that is currently running does not count into the
+ * queue size.
+ *
+ * Tasks that are dropped (because the queue is full, the pool shuts down or the strand is destroyed) are destroyed
+ * without running. Callers that wait for a task can signal its end from the destructor of an object captured by it.
+ *
+ * \note The pool has to outlive the strand.
+ */
+class Strand : boost::noncopyable
+{
+public:
+  /**
+   * \brief Create the strand.
+   * \param[in] pool The pool whose threads will execute the tasks.
+   * \param[in] capacity Maximum number of tasks waiting for execution. Zero means unbounded.
+   * \param[in] policy What to do when a task is posted and the queue is full.
+   */
+  explicit Strand(ThreadPool& pool, size_t capacity = 0,
+                  QueueOverflowPolicy policy = QueueOverflowPolicy::DROP_OLDEST);
+
+  /**
+   * \brief Drop all tasks that have not started yet and wait until the currently running task finishes.
+   * \note Do not destroy the strand from within one of its tasks.
+   */
+  ~Strand();
+
+  /**
+   * \brief Queue the task for execution after all previously posted tasks finish.
+   * \param[in] task The task to run.
+   * \return Whether the task was queued. It is not queued if the queue is full and the policy is DROP_NEWEST, or if
+   *         the strand is being destroyed.
+   */
+  bool post(const ThreadPool::Task& task);
+
+  //! \brief Number of tasks waiting for execution.
+  size_t getQueueSize() const;
+
+  //! \brief Number of tasks dropped because the queue was full (or the pool was shutting down).
+  size_t getNumDropped() const;
+
+private:
+  struct State;
+  std::shared_ptr<State> state_;
+
+  static void runNext(const std::shared_ptr<State>& state);
+  static void finish(const std::shared_ptr<State>& state);
+};
+
+/**
+ * \brief Runs the posted jobs in parallel, but runs their completions one after another in the order of posting.
+ *
+ * Each job is run by one of the worker threads and returns a completion task. The completions are executed in the
+ * same order in which the jobs were posted (by the worker thread that finished the job which was waited for), and
+ * never concurrently.
+ */
+class OrderedExecutor : boost::noncopyable
+{
+public:
+  //! \brief A job running in parallel. It returns the completion that should be run in order (it may be empty).
+  typedef std::function<ThreadPool::Task()> Job;
+
+  /**
+   * \brief Start the worker threads.
+   * \param[in] num_threads Number of worker threads. Zero means the number of CPU cores.
+   * \param[in] max_in_flight Maximum number of posted jobs whose completion has not yet finished. Zero means twice
+   *                          the number of threads.
+   */
+  explicit OrderedExecutor(size_t num_threads = 0, size_t max_in_flight = 0);
+
+  //! \brief Finish all posted jobs and their completions and join the worker threads.
+  ~OrderedExecutor();
+
+  /**
+   * \brief Queue the job for execution. If there are already max_in_flight unfinished jobs, wait until one finishes.
+   * \param[in] job The job to run. Exceptions thrown by the job or its completion are logged and otherwise ignored.
+   * \note Do not call from within a job or completion of this executor, it could deadlock.
+   */
+  void post(const Job& job);
+
+  //! \brief Number of posted jobs whose completion has not yet finished.
+  size_t getNumInFlight() const;
+
+  //! \brief Whether the calling thread is one of the worker threads (e.g. a job or completion of this executor).
+  bool isWorkerThread() const;
+
+private:
+  void finish(uint64_t seq, ThreadPool::Task&& completion);
+
+  size_t max_in_flight_;
+  size_t in_flight_ {0};
+  uint64_t next_seq_ {0};
+  uint64_t next_to_complete_ {0};
+  //! \brief Completions of finished jobs waiting for the previous jobs to finish.
+  std::map<uint64_t, ThreadPool::Task> finished_;
+  bool completing_ {false};
+  bool stopping_ {false};
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  //! \brief Declared last so that it is destroyed first.
+  ThreadPool pool_;
+};
+
+}
@@ -40,14 +40,41 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
+
+#include <boost/function.hpp>
 
 #include <ros/node_handle.h>
 #include <ros/transport_hints.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/point_cloud_filter.h>
 
 namespace point_cloud_transport
 {
 
+//! A decoded part of a cloud received via a chunked transport.
+struct CloudChunk
+{
+  //! The points of the chunk as a standalone cloud.
+  sensor_msgs::PointCloud2ConstPtr cloud;
+  //! Index of the chunk.
+  uint32_t chunk_index {0};
+  //! Number of chunks of the whole cloud.
+  uint32_t num_chunks {0};
+  //! Index of the first point of the chunk in the whole cloud (row-major).
+  uint32_t first_point {0};
+  //! Height of the whole cloud.
+  uint32_t cloud_height {0};
+  //! Width of the whole cloud.
+  uint32_t cloud_width {0};
+};
+
+typedef boost::function<void(const CloudChunk&)> ChunkCallback;
+
 //! Stores transport settings for a point cloud topic subscription.
 class TransportHints
 {
@@ -85,10 +112,200 @@ public:
     return parameter_nh_;
   }
 
+  /**
+   * Decode the received messages in a pool of the given number of threads. The decoded clouds are still passed to the
+   * subscriber callback in the order the messages were received. Zero means decoding in the ROS callback thread.
+   *
+   * It can be overridden by parameter `<transport>/decode_threads` in the parameter namespace.
+   */
+  TransportHints& decodeThreads(size_t num_threads)
+  {
+    decode_threads_ = num_threads;
+    return *this;
+  }
+
+  size_t getDecodeThreads() const
+  {
+    return decode_threads_;
+  }
+
+  /**
+   * Maximum number of messages being decoded or waiting for the delivery of the previous clouds when using
+   * decodeThreads(). When reached, the ROS callback waits. Zero means twice the number of decoding threads.
+   *
+   * It can be overridden by parameter `<transport>/max_decode_in_flight` in the parameter namespace.
+   */
+  TransportHints& maxDecodeInFlight(size_t max_in_flight)
+  {
+    max_decode_in_flight_ = max_in_flight;
+    return *this;
+  }
+
+  size_t getMaxDecodeInFlight() const
+  {
+    return max_decode_in_flight_;
+  }
+
+  /**
+   * Decode only the newest received message. Messages that arrive while a previous message is being decoded replace
+   * each other, and only the last of them is decoded, so a slow consumer does not waste time decoding stale clouds.
+   * The decoding runs in a separate thread. This takes precedence over decodeThreads(). Transports that decode each
+   * message using the previous ones or split clouds into chunks ignore it.
+   *
+   * It can be overridden by parameter `<transport>/latest_only` in the parameter namespace.
+   */
+  TransportHints& latestOnly(bool latest_only = true)
+  {
+    latest_only_ = latest_only;
+    return *this;
+  }
+
+  bool isLatestOnly() const
+  {
+    return latest_only_;
+  }
+
+  /**
+   * Publish the decoding statistics on topic `<base_topic>/<transport>/statistics` with the given rate (Hz). Zero
+   * disables the publishing (the statistics are still available via Subscriber::getStatistics()).
+   *
+   * It can be overridden by parameter `<transport>/statistics_rate` in the parameter namespace.
+   */
+  TransportHints& statisticsRate(double rate)
+  {
+    statistics_rate_ = rate;
+    return *this;
+  }
+
+  double getStatisticsRate() const
+  {
+    return statistics_rate_;
+  }
+
+  /**
+   * Recycle the decoded clouds in a pool that keeps up to the given number of unused clouds, so that their data buffers
+   * are not reallocated for each message. Zero disables the pool. Only decoders that allocate their output clouds via
+   * SubscriberPlugin::allocateCloud() use the pool. Size the pool by the number of clouds the subscriber callback keeps
+   * referenced at once plus the number of decoding threads.
+   *
+   * It can be overridden by parameter `<transport>/output_pool_size` in the parameter namespace.
+   */
+  TransportHints& outputPoolSize(size_t size)
+  {
+    output_pool_size_ = size;
+    return *this;
+  }
+
+  size_t getOutputPoolSize() const
+  {
+    return output_pool_size_;
+  }
+
+  /**
+   * With chunked transports, call the given callback with each chunk of a cloud as soon as it is decoded, so that the
+   * processing can start before the whole cloud is received. The subscriber callback is still called with the whole
+   * cloud. The callback is called from the decoding thread. Other transports ignore it.
+   */
+  TransportHints& chunkCallback(const ChunkCallback& callback)
+  {
+    chunk_callback_ = callback;
+    return *this;
+  }
+
+  const ChunkCallback& getChunkCallback() const
+  {
+    return chunk_callback_;
+  }
+
+  /**
+   * Receive only the given fields of the points (in the given order, packed without padding). The projected clouds
+   * served by the publisher (see PublisherOptions::projections) are received, so the other fields cost no bandwidth
+   * and no decoding. While the projection is not served, the whole clouds are received and projected locally. Empty
+   * means all fields.
+   *
+   * It can be overridden by parameter `<transport>/fields` in the parameter namespace.
+   */
+  TransportHints& fields(const std::vector<std::string>& fields)
+  {
+    fields_ = fields;
+    return *this;
+  }
+
+  const std::vector<std::string>& getFields() const
+  {
+    return fields_;
+  }
+
+  /**
+   * Ask the publisher to publish the clouds of this transport with at most the given rate (Hz). The publisher serves
+   * the highest rate asked for by its subscribers (see PublisherOptions::rate_limits), so the callback can still be
+   * called more often. Zero asks for all clouds. The request is made per node, so subscribers of the same topic in one
+   * node should ask for the same rate.
+   *
+   * It can be overridden by parameter `<transport>/max_rate` in the parameter namespace.
+   */
+  TransportHints& maxRate(double rate)
+  {
+    max_rate_ = rate;
+    return *this;
+  }
+
+  double getMaxRate() const
+  {
+    return max_rate_;
+  }
+
+  /**
+   * Pass only the points inside the given box (in the frame of the cloud) to the subscriber callback. The cropped
+   * clouds are unorganized. Decoders that can skip the points outside the box while decoding do so (see
+   * SubscriberPlugin::cropsWhileDecoding()), the others' clouds are cropped after decoding.
+   *
+   * It can be overridden by parameter `<transport>/crop_box` (list of min x, y, z and max x, y, z) in the parameter
+   * namespace.
+   */
+  TransportHints& cropBox(const CropBox& box)
+  {
+    filter_.crop_box = box;
+    return *this;
+  }
+
+  /**
+   * Pass only one point in each cube of the given edge length (m) to the subscriber callback (after cropping). The
+   * downsampled clouds are unorganized. Zero disables the downsampling.
+   *
+   * It can be overridden by parameter `<transport>/voxel_size` in the parameter namespace.
+   */
+  TransportHints& voxelSize(double size)
+  {
+    filter_.voxel_size = size;
+    return *this;
+  }
+
+  //! Set the crop box and the voxel size at once.
+  TransportHints& cloudFilter(const CloudFilterOptions& filter)
+  {
+    filter_ = filter;
+    return *this;
+  }
+
+  const CloudFilterOptions& getCloudFilter() const
+  {
+    return filter_;
+  }
+
 private:
   std::string transport_;
   ros::TransportHints ros_hints_;
   ros::NodeHandle parameter_nh_;
+  size_t decode_threads_ {0};
+  size_t max_decode_in_flight_ {0};
+  bool latest_only_ {false};
+  double statistics_rate_ {0.0};
+  size_t output_pool_size_ {0};
+  ChunkCallback chunk_callback_;
+  std::vector<std::string> fields_;
+  double max_rate_ {0.0};
+  CloudFilterOptions filter_;
 };
 
 }
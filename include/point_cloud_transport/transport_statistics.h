@@ -0,0 +1,77 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Collection of encoding and decoding statistics of transports.
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <point_cloud_transport/TransportStatistics.h>
+
+namespace point_cloud_transport
+{
+
+/**
+ * \brief Thread-safe accumulator of the processing times and message sizes of a transport.
+ *
+ * The plugins record each processed message, and the Publisher and Subscriber read the accumulated values via
+ * getStatistics().
+ */
+class TransportStatisticsCollector
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * \brief Create the collector.
+   * \param[in] transport Name of the transport.
+   * \param[in] direction TransportStatistics::ENCODER or TransportStatistics::DECODER.
+   */
+  explicit TransportStatisticsCollector(const std::string& transport = "",
+                                        uint8_t direction = TransportStatistics::ENCODER);
+
+  /**
+   * \brief Record a message that was processed into an output message.
+   * \param[in] duration How long the processing took.
+   * \param[in] input_bytes Serialized size of the input message.
+   * \param[in] output_bytes Serialized size of the output message.
+   */
+  void addProcessed(const Clock::duration& duration, size_t input_bytes, size_t output_bytes);
+
+  /**
+   * \brief Record a message that did not produce any output message.
+   * \param[in] duration How long the processing took.
+   */
+  void addFailed(const Clock::duration& duration);
+
+  //! \brief Get the accumulated statistics. The header, node, topic, queue depth and drops are left for the caller.
+  TransportStatistics getStatistics() const;
+
+  //! \brief Upper bounds of the bins of the processing time histogram (in seconds).
+  static const std::vector<double>& getHistogramBounds();
+
+private:
+  void addTime(const Clock::duration& duration);
+
+  const std::string transport_;
+  const uint8_t direction_;
+  mutable std::mutex mutex_;
+  uint64_t num_processed_ {0};
+  uint64_t num_failed_ {0};
+  uint64_t input_bytes_ {0};
+  uint64_t output_bytes_ {0};
+  double total_time_ {0.0};
+  double max_time_ {0.0};
+  std::vector<uint64_t> histogram_;
+};
+
+}
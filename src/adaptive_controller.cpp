@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Controller adapting the encoder configs of a Publisher to a bandwidth target and CPU budget.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <cras_cpp_common/optional.hpp>
+#include <dynamic_reconfigure/Config.h>
+#include <ros/console.h>
+#include <ros/node_handle.h>
+#include <ros/time.h>
+#include <XmlRpcValue.h>
+
+#include <point_cloud_transport/adaptive_controller.h>
+#include <point_cloud_transport/AdaptiveControllerState.h>
+#include <point_cloud_transport/publisher.h>
+
+namespace point_cloud_transport
+{
+
+namespace
+{
+
+bool getNumber(XmlRpc::XmlRpcValue& value, double& number)
+{
+  if (value.getType() == XmlRpc::XmlRpcValue::TypeInt)
+    number = static_cast<int>(value);
+  else if (value.getType() == XmlRpc::XmlRpcValue::TypeDouble)
+    number = static_cast<double>(value);
+  else
+    return false;
+  return true;
+}
+
+//! \brief Parse the `parameters` parameter (list of dicts with keys transport, name, kind, min, max and step).
+bool parseParameters(XmlRpc::XmlRpcValue& param, std::vector<AdaptiveParameter>& parameters)
+{
+  if (param.getType() != XmlRpc::XmlRpcValue::TypeArray)
+    return false;
+
+  std::vector<AdaptiveParameter> result;
+  for (int i = 0; i < param.size(); ++i)
+  {
+    auto& item = param[i];
+    if (item.getType() != XmlRpc::XmlRpcValue::TypeStruct || !item.hasMember("transport") || !item.hasMember("name") ||
+        !item.hasMember("min") || !item.hasMember("max"))
+      return false;
+    if (item["transport"].getType() != XmlRpc::XmlRpcValue::TypeString ||
+        item["name"].getType() != XmlRpc::XmlRpcValue::TypeString)
+      return false;
+
+    AdaptiveParameter parameter;
+    parameter.transport = static_cast<std::string>(item["transport"]);
+    parameter.name = static_cast<std::string>(item["name"]);
+    if (!getNumber(item["min"], parameter.min) || !getNumber(item["max"], parameter.max) ||
+        parameter.min > parameter.max)
+      return false;
+    if (item.hasMember("step") && !getNumber(item["step"], parameter.step))
+      return false;
+
+    if (item.hasMember("kind"))
+    {
+      if (item["kind"].getType() != XmlRpc::XmlRpcValue::TypeString)
+        return false;
+      const auto kind = static_cast<std::string>(item["kind"]);
+      if (kind == "quality")
+        parameter.kind = AdaptiveParameter::Kind::QUALITY;
+      else if (kind == "compression")
+        parameter.kind = AdaptiveParameter::Kind::COMPRESSION;
+      else if (kind == "speed")
+        parameter.kind = AdaptiveParameter::Kind::SPEED;
+      else
+        return false;
+    }
+    result.push_back(parameter);
+  }
+  parameters = result;
+  return true;
+}
+
+//! \brief Find the value of an int or double parameter in the config.
+cras::optional<double> getValue(const dynamic_reconfigure::Config& config, const std::string& name, bool& is_int)
+{
+  for (const auto& p : config.ints)
+  {
+    if (p.name == name)
+    {
+      is_int = true;
+      return p.value;
+    }
+  }
+  for (const auto& p : config.doubles)
+  {
+    if (p.name == name)
+    {
+      is_int = false;
+      return p.value;
+    }
+  }
+  return cras::nullopt;
+}
+
+}
+
+AdaptiveController::AdaptiveController(ros::NodeHandle& nh, const Publisher& publisher,
+                                       const AdaptiveControllerOptions& options) :
+    publisher_(publisher), options_(options)
+{
+  const auto ns = publisher_.getTopic() + "/adaptive";
+  nh.param(ns + "/target_bandwidth", options_.target_bandwidth, options.target_bandwidth);
+  nh.param(ns + "/cpu_budget", options_.cpu_budget, options.cpu_budget);
+  nh.param(ns + "/rate", options_.rate, options.rate);
+  nh.param(ns + "/tolerance", options_.tolerance, options.tolerance);
+
+  XmlRpc::XmlRpcValue parameters;
+  if (nh.getParam(ns + "/parameters", parameters) && !parseParameters(parameters, options_.parameters))
+  {
+    ROS_ERROR("Invalid value of parameter %s/parameters. It should be a list of dicts with keys transport, name, "
+              "min, max and optionally kind and step.", ns.c_str());
+  }
+
+  state_pub_ = nh.advertise<AdaptiveControllerState>(publisher_.getTopic() + "/adaptive_controller", 10);
+  if (options_.rate > 0.0)
+  {
+    timer_ = nh.createWallTimer(ros::WallDuration(1.0 / options_.rate),
+                                [this](const ros::WallTimerEvent&) { this->step(); });
+  }
+}
+
+const AdaptiveControllerOptions& AdaptiveController::getOptions() const
+{
+  return options_;
+}
+
+AdaptiveControllerState AdaptiveController::step()
+{
+  AdaptiveControllerState state;
+  state.header.stamp = ros::Time::now();
+  state.topic = publisher_.getTopic();
+  state.target_bandwidth = options_.target_bandwidth;
+  state.cpu_budget = options_.cpu_budget;
+  state.action = AdaptiveControllerState::HOLD;
+
+  // The transports of the field projections share the parameters, so their load counts, too.
+  const auto now = ros::WallTime::now();
+  uint64_t output_bytes = 0;
+  double total_time = 0;
+  for (const auto& stats : publisher_.getStatistics())
+  {
+    const auto key = stats.topic + "/" + stats.transport;
+    const auto last = last_totals_.find(key);
+    if (last != last_totals_.end())
+    {
+      output_bytes += stats.output_bytes - last->second.first;
+      total_time += stats.total_time - last->second.second;
+    }
+    last_totals_[key] = {stats.output_bytes, stats.total_time};
+  }
+
+  const auto elapsed = last_step_.isZero() ? 0.0 : (now - last_step_).toSec();
+  last_step_ = now;
+  if (elapsed > 0.0)
+  {
+    state.output_rate = output_bytes / elapsed;
+    state.cpu_usage = total_time / elapsed;
+  }
+
+  if (elapsed > 0.0 && output_bytes > 0)
+  {
+    const auto upper = 1.0 + options_.tolerance;
+    const auto lower = 1.0 - options_.tolerance;
+    const auto bandwidth_over = options_.target_bandwidth > 0.0 &&
+        state.output_rate > options_.target_bandwidth * upper;
+    const auto cpu_over = options_.cpu_budget > 0.0 && state.cpu_usage > options_.cpu_budget * upper;
+    const auto bandwidth_free = options_.target_bandwidth <= 0.0 ||
+        state.output_rate < options_.target_bandwidth * lower;
+    const auto cpu_free = options_.cpu_budget <= 0.0 || state.cpu_usage < options_.cpu_budget * lower;
+
+    typedef AdaptiveParameter::Kind Kind;
+    if (bandwidth_over && cpu_over)
+    {
+      // Lower quality helps both, less compression at least saves the CPU.
+      state.action = AdaptiveControllerState::SAVE_BOTH;
+      state.changed = move(Kind::QUALITY, -1) || move(Kind::COMPRESSION, -1);
+    }
+    else if (bandwidth_over)
+    {
+      // Prefer spending the spare CPU on compression to lowering the quality.
+      state.action = AdaptiveControllerState::SAVE_BANDWIDTH;
+      state.changed = (cpu_free && move(Kind::COMPRESSION, 1)) || move(Kind::QUALITY, -1);
+    }
+    else if (cpu_over)
+    {
+      state.action = AdaptiveControllerState::SAVE_CPU;
+      state.changed = (bandwidth_free && move(Kind::COMPRESSION, -1)) || move(Kind::QUALITY, -1);
+    }
+    else if (bandwidth_free && cpu_free)
+    {
+      state.action = AdaptiveControllerState::RAISE_QUALITY;
+      state.changed = move(Kind::QUALITY, 1);
+    }
+  }
+
+  for (const auto& parameter : options_.parameters)
+  {
+    const auto config = publisher_.getTransportConfig(parameter.transport);
+    bool is_int {false};
+    const auto value = config ? getValue(*config, parameter.name, is_int) : cras::nullopt;
+    state.transports.push_back(parameter.transport);
+    state.parameters.push_back(parameter.name);
+    state.values.push_back(value ? *value : std::nan(""));
+  }
+
+  if (state.changed)
+  {
+    ROS_DEBUG("Adaptive controller of topic %s changed the encoder parameters (output %.0f B/s, CPU %.2f).",
+              state.topic.c_str(), state.output_rate, state.cpu_usage);
+  }
+
+  state_pub_.publish(state);
+  return state;
+}
+
+bool AdaptiveController::move(AdaptiveParameter::Kind kind, double direction)
+{
+  typedef AdaptiveParameter::Kind Kind;
+  bool changed = false;
+  for (const auto& parameter : options_.parameters)
+  {
+    double sign;
+    if (parameter.kind == kind)
+      sign = direction;
+    else if (kind == Kind::COMPRESSION && parameter.kind == Kind::SPEED)
+      sign = -direction;  // More speed means less compression.
+    else
+      continue;
+
+    const auto config = publisher_.getTransportConfig(parameter.transport);
+    bool is_int {false};
+    const auto current = config ? getValue(*config, parameter.name, is_int) : cras::nullopt;
+    if (!current)
+    {
+      ROS_WARN_THROTTLE(10.0, "Transport %s of topic %s has no int or double parameter %s to adapt.",
+                        parameter.transport.c_str(), publisher_.getTopic().c_str(), parameter.name.c_str());
+      continue;
+    }
+
+    auto value = *current + sign * parameter.step;
+    auto min = parameter.min;
+    auto max = parameter.max;
+    if (is_int)
+    {
+      // Round away from the current value, so that steps smaller than 1 still move the parameter.
+      value = sign > 0 ? std::ceil(value) : std::floor(value);
+      min = std::ceil(min);
+      max = std::floor(max);
+    }
+    value = std::min(max, std::max(min, value));
+    if (value == *current)
+      continue;
+
+    dynamic_reconfigure::Config change;
+    if (is_int)
+    {
+      change.ints.resize(1);
+      change.ints[0].name = parameter.name;
+      change.ints[0].value = static_cast<int>(value);
+    }
+    else
+    {
+      change.doubles.resize(1);
+      change.doubles[0].name = parameter.name;
+      change.doubles[0].value = value;
+    }
+    changed = publisher_.setTransportConfig(parameter.transport, change) || changed;
+  }
+  return changed;
+}
+
+void AdaptiveController::shutdown()
+{
+  timer_.stop();
+  state_pub_.shutdown();
+}
+
+}
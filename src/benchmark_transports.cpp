@@ -0,0 +1,500 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Measure the encoding and decoding cost of all available point cloud transports.
+ *
+ * Usage: benchmark_transports [-n ITERATIONS] [-t TRANSPORT]... [-c NAME=VALUE[,NAME=VALUE]...]... [-b BAG [-T TOPIC]]
+ *
+ * -n  Number of measured iterations per cloud (default 20). One more unmeasured iteration warms up the caches.
+ * -t  Benchmark only the given transport (can be repeated). All declared transports are benchmarked by default.
+ * -c  Benchmark the transports with the given config (can be repeated). Values are parsed as bool, int, double or
+ *     string (in this order). Parameters unknown to a transport are ignored by it. The default config is used if no
+ *     -c option is given.
+ * -b  Use the point clouds stored in the given bag file instead of the synthetic ones.
+ * -T  Read only the given topic from the bag file (can be repeated). All PointCloud2 topics are read by default.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string/erase.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cras_cpp_common/string_utils.hpp>
+#include <dynamic_reconfigure/Config.h>
+#include <pluginlib/class_loader.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/loader_registry.h>
+#include <point_cloud_transport/point_cloud_codec.h>
+#include <point_cloud_transport/publisher_plugin.h>
+#include <point_cloud_transport/subscriber_plugin.h>
+
+using namespace point_cloud_transport;
+
+namespace
+{
+
+struct Dataset
+{
+  std::string name;
+  std::vector<sensor_msgs::PointCloud2ConstPtr> clouds;
+};
+
+struct NamedConfig
+{
+  std::string name;
+  dynamic_reconfigure::Config config;
+};
+
+struct Stats
+{
+  size_t num_ok {0};
+  size_t num_failed {0};
+  size_t raw_bytes {0};
+  size_t compressed_bytes {0};
+  std::vector<double> encode_ms;
+  std::vector<double> decode_ms;
+  long peak_rss_kb {-1};
+};
+
+void addField(sensor_msgs::PointCloud2& cloud, const std::string& name, uint8_t datatype, uint32_t size)
+{
+  sensor_msgs::PointField field;
+  field.name = name;
+  field.offset = cloud.point_step;
+  field.datatype = datatype;
+  field.count = 1;
+  cloud.fields.push_back(field);
+  cloud.point_step += size;
+}
+
+/**
+ * \brief Generate a cloud resembling a scan of a rotating lidar (points on rings with a noisy range).
+ * \param[in] height Number of rings. If 1, the cloud is unorganized.
+ * \param[in] width Number of points in each ring.
+ * \param[in] layout One of "xyz", "xyzi" or "xyzrgb".
+ */
+sensor_msgs::PointCloud2ConstPtr generateCloud(uint32_t height, uint32_t width, const std::string& layout)
+{
+  const auto cloud = boost::make_shared<sensor_msgs::PointCloud2>();
+  cloud->header.frame_id = "benchmark";
+  cloud->height = height;
+  cloud->width = width;
+  addField(*cloud, "x", sensor_msgs::PointField::FLOAT32, 4);
+  addField(*cloud, "y", sensor_msgs::PointField::FLOAT32, 4);
+  addField(*cloud, "z", sensor_msgs::PointField::FLOAT32, 4);
+  if (layout == "xyzi")
+    addField(*cloud, "intensity", sensor_msgs::PointField::FLOAT32, 4);
+  else if (layout == "xyzrgb")
+    addField(*cloud, "rgb", sensor_msgs::PointField::FLOAT32, 4);
+  cloud->row_step = cloud->point_step * width;
+  cloud->is_dense = true;
+  cloud->data.resize(static_cast<size_t>(cloud->row_step) * height);
+
+  std::mt19937 gen(42);
+  std::normal_distribution<float> noise(0.0f, 0.02f);
+  std::uniform_real_distribution<float> range(2.0f, 30.0f);
+  std::uniform_int_distribution<uint32_t> color(0, 0xffffff);
+
+  float r = range(gen);
+  for (uint32_t row = 0; row < height; ++row)
+  {
+    const float elevation = height > 1 ? (-15.0f + 30.0f * row / (height - 1)) * M_PI / 180.0f : 0.0f;
+    for (uint32_t col = 0; col < width; ++col)
+    {
+      // Walls with occasional depth discontinuities, as in real scenes.
+      if (col % 64 == 0)
+        r = range(gen);
+      const float azimuth = 2.0f * M_PI * col / width;
+      const float dist = r + noise(gen);
+      float point[4];
+      point[0] = dist * std::cos(elevation) * std::cos(azimuth);
+      point[1] = dist * std::cos(elevation) * std::sin(azimuth);
+      point[2] = dist * std::sin(elevation);
+      if (layout == "xyzi")
+        point[3] = std::min(255.0f, std::max(0.0f, 100.0f / dist + 10.0f * noise(gen)));
+      else if (layout == "xyzrgb")
+      {
+        const uint32_t rgb = color(gen);
+        std::memcpy(&point[3], &rgb, sizeof(rgb));
+      }
+      std::memcpy(&cloud->data[row * cloud->row_step + col * cloud->point_step], point, cloud->point_step);
+    }
+  }
+  return cloud;
+}
+
+std::vector<Dataset> generateDatasets()
+{
+  struct Shape { const char* name; uint32_t height; uint32_t width; };
+  const std::vector<Shape> shapes = {
+    {"organized 16x1024", 16, 1024},
+    {"organized 64x2048", 64, 2048},
+    {"unorganized 10000", 1, 10000},
+    {"unorganized 500000", 1, 500000},
+  };
+
+  std::vector<Dataset> datasets;
+  for (const auto& layout : {"xyz", "xyzi", "xyzrgb"})
+  {
+    for (const auto& shape : shapes)
+    {
+      Dataset dataset;
+      dataset.name = std::string(shape.name) + " " + layout;
+      dataset.clouds.push_back(generateCloud(shape.height, shape.width, layout));
+      datasets.push_back(dataset);
+    }
+  }
+  return datasets;
+}
+
+std::vector<Dataset> readBag(const std::string& filename, const std::vector<std::string>& topics)
+{
+  rosbag::Bag bag(filename, rosbag::bagmode::Read);
+  rosbag::View view(bag);
+
+  std::map<std::string, Dataset> datasets;
+  for (const auto& m : view)
+  {
+    if (m.getDataType() != "sensor_msgs/PointCloud2")
+      continue;
+    if (!topics.empty() && std::find(topics.begin(), topics.end(), m.getTopic()) == topics.end())
+      continue;
+    const auto cloud = m.instantiate<sensor_msgs::PointCloud2>();
+    if (cloud == nullptr)
+      continue;
+    datasets[m.getTopic()].name = m.getTopic();
+    datasets[m.getTopic()].clouds.push_back(cloud);
+  }
+
+  std::vector<Dataset> result;
+  for (const auto& dataset : datasets)
+    result.push_back(dataset.second);
+  return result;
+}
+
+bool parseConfig(const std::string& text, NamedConfig& config)
+{
+  config.name = text;
+  for (const auto& item : cras::split(text, ","))
+  {
+    const auto parts = cras::split(item, "=", 1);
+    if (parts.size() != 2 || parts[0].empty())
+      return false;
+    const auto& name = parts[0];
+    const auto& value = parts[1];
+
+    if (value == "true" || value == "false")
+    {
+      dynamic_reconfigure::BoolParameter param;
+      param.name = name;
+      param.value = value == "true";
+      config.config.bools.push_back(param);
+      continue;
+    }
+
+    char* end;
+    const long int_value = std::strtol(value.c_str(), &end, 10);
+    if (!value.empty() && *end == '\0')
+    {
+      dynamic_reconfigure::IntParameter param;
+      param.name = name;
+      param.value = static_cast<int>(int_value);
+      config.config.ints.push_back(param);
+      continue;
+    }
+
+    const double double_value = std::strtod(value.c_str(), &end);
+    if (!value.empty() && *end == '\0')
+    {
+      dynamic_reconfigure::DoubleParameter param;
+      param.name = name;
+      param.value = double_value;
+      config.config.doubles.push_back(param);
+      continue;
+    }
+
+    dynamic_reconfigure::StrParameter param;
+    param.name = name;
+    param.value = value;
+    config.config.strs.push_back(param);
+  }
+  return true;
+}
+
+//! \brief Read a value (in kB) from /proc/self/status. Returns -1 if it is not available.
+long readProcStatus(const std::string& key)
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (cras::startsWith(line, key + ":"))
+      return std::strtol(line.c_str() + key.size() + 1, nullptr, 10);
+  }
+  return -1;
+}
+
+//! \brief Reset the peak resident set size (VmHWM) to the current one. Returns false if not supported.
+bool resetPeakRss()
+{
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  return clear_refs.good();
+}
+
+double percentile(std::vector<double> values, double p)
+{
+  if (values.empty())
+    return std::numeric_limits<double>::quiet_NaN();
+  std::sort(values.begin(), values.end());
+  const size_t idx = std::min(values.size() - 1, static_cast<size_t>(std::ceil(p / 100.0 * values.size())) - 1);
+  return values[idx];
+}
+
+double sum(const std::vector<double>& values)
+{
+  double result = 0.0;
+  for (const auto v : values)
+    result += v;
+  return result;
+}
+
+template<typename F>
+double measureMs(const F& fn)
+{
+  const auto start = std::chrono::steady_clock::now();
+  fn();
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+Stats benchmark(const boost::shared_ptr<PublisherPlugin>& encoder, const boost::shared_ptr<SubscriberPlugin>& decoder,
+                const Dataset& dataset, const dynamic_reconfigure::Config& config, size_t iterations)
+{
+  Stats stats;
+  const bool can_track_memory = resetPeakRss();
+  const long rss_before = readProcStatus("VmRSS");
+
+  for (const auto& cloud : dataset.clouds)
+  {
+    for (size_t i = 0; i < iterations + 1; ++i)
+    {
+      const bool measured = i > 0;
+
+      PublisherPlugin::EncodeResult encoded;
+      const double encode_ms = measureMs([&] { encoded = encoder->encode(*cloud, config); });
+      if (!encoded || !encoded.value())
+      {
+        if (measured)
+          ++stats.num_failed;
+        if (!encoded && i == 0)
+          fprintf(stderr, "Encoding with %s failed: %s\n", encoder->getTransportName().c_str(),
+                  encoded.error().c_str());
+        break;
+      }
+
+      SubscriberPlugin::DecodeResult decoded;
+      double decode_ms = 0.0;
+      if (decoder != nullptr)
+      {
+        decode_ms = measureMs([&] { decoded = decoder->decode(encoded.value().value(), config); });
+        if (!decoded || !decoded.value())
+        {
+          if (measured)
+            ++stats.num_failed;
+          if (!decoded && i == 0)
+            fprintf(stderr, "Decoding with %s failed: %s\n", decoder->getTransportName().c_str(),
+                    decoded.error().c_str());
+          break;
+        }
+      }
+
+      if (!measured)
+        continue;
+
+      ++stats.num_ok;
+      stats.raw_bytes += cloud->data.size();
+      stats.compressed_bytes += encoded.value()->size();
+      stats.encode_ms.push_back(encode_ms);
+      if (decoder != nullptr)
+        stats.decode_ms.push_back(decode_ms);
+    }
+  }
+
+  const long peak = readProcStatus("VmHWM");
+  if (can_track_memory && peak >= 0 && rss_before >= 0)
+    stats.peak_rss_kb = std::max(0L, peak - rss_before);
+  return stats;
+}
+
+void printHeader()
+{
+  printf("%-32s %-28s %-16s %7s %9s %9s %9s %9s %9s %9s %9s %9s %10s\n",
+         "transport", "dataset", "config", "ratio", "enc MB/s", "enc p50", "enc p90", "enc p99",
+         "dec MB/s", "dec p50", "dec p90", "dec p99", "peak kB");
+}
+
+void printStats(const std::string& transport, const std::string& dataset, const std::string& config,
+                const Stats& stats)
+{
+  if (stats.num_ok == 0)
+  {
+    printf("%-32s %-28s %-16s failed\n", transport.c_str(), dataset.c_str(), config.c_str());
+    return;
+  }
+
+  const double raw_mb = stats.raw_bytes / 1e6;
+  const double ratio = stats.compressed_bytes > 0 ? static_cast<double>(stats.raw_bytes) / stats.compressed_bytes : 0;
+  const double enc_throughput = raw_mb / (sum(stats.encode_ms) / 1e3);
+  const double dec_throughput = stats.decode_ms.empty() ?
+    std::numeric_limits<double>::quiet_NaN() : raw_mb / (sum(stats.decode_ms) / 1e3);
+
+  printf("%-32s %-28s %-16s %7.2f %9.1f %9.3f %9.3f %9.3f %9.1f %9.3f %9.3f %9.3f %10ld%s\n",
+         transport.c_str(), dataset.c_str(), config.c_str(), ratio,
+         enc_throughput, percentile(stats.encode_ms, 50), percentile(stats.encode_ms, 90),
+         percentile(stats.encode_ms, 99),
+         dec_throughput, percentile(stats.decode_ms, 50), percentile(stats.decode_ms, 90),
+         percentile(stats.decode_ms, 99),
+         stats.peak_rss_kb, stats.num_failed > 0 ? " (some iterations failed)" : "");
+}
+
+void printUsage(const char* program)
+{
+  fprintf(stderr, "Usage: %s [-n ITERATIONS] [-t TRANSPORT]... [-c NAME=VALUE[,NAME=VALUE]...]... "
+                  "[-b BAG [-T TOPIC]...]\n", program);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  size_t iterations = 20;
+  std::vector<std::string> transport_filter;
+  std::vector<NamedConfig> configs;
+  std::string bag_file;
+  std::vector<std::string> bag_topics;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help")
+    {
+      printUsage(argv[0]);
+      return 0;
+    }
+    if (i + 1 >= argc)
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+    const std::string value = argv[++i];
+    if (arg == "-n")
+    {
+      iterations = std::max(1l, std::strtol(value.c_str(), nullptr, 10));
+    }
+    else if (arg == "-t")
+    {
+      transport_filter.push_back(value);
+    }
+    else if (arg == "-c")
+    {
+      NamedConfig config;
+      if (!parseConfig(value, config))
+      {
+        fprintf(stderr, "Invalid config '%s'.\n", value.c_str());
+        return 1;
+      }
+      configs.push_back(config);
+    }
+    else if (arg == "-b")
+    {
+      bag_file = value;
+    }
+    else if (arg == "-T")
+    {
+      bag_topics.push_back(value);
+    }
+    else
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (configs.empty())
+    configs.push_back({"default", {}});
+
+  std::vector<Dataset> datasets;
+  try
+  {
+    datasets = bag_file.empty() ? generateDatasets() : readBag(bag_file, bag_topics);
+  }
+  catch (const rosbag::BagException& e)
+  {
+    fprintf(stderr, "Failed to read bag file %s: %s\n", bag_file.c_str(), e.what());
+    return 1;
+  }
+  if (datasets.empty())
+  {
+    fprintf(stderr, "No point clouds to benchmark.\n");
+    return 1;
+  }
+
+  PointCloudCodec codec;
+  printHeader();
+  auto& registry = LoaderRegistry::instance();
+  for (const auto& lookup_name : registry.getDeclaredClasses(*registry.getPublisherLoader()))
+  {
+    const std::string transport_name = boost::erase_last_copy(lookup_name, "_pub");
+    const auto encoder = codec.getEncoderByName(lookup_name);
+    if (encoder == nullptr)
+    {
+      fprintf(stderr, "Encoder %s could not be loaded.\n", lookup_name.c_str());
+      continue;
+    }
+    if (!transport_filter.empty() &&
+        std::find(transport_filter.begin(), transport_filter.end(), transport_name) == transport_filter.end() &&
+        std::find(transport_filter.begin(), transport_filter.end(), encoder->getTransportName()) ==
+          transport_filter.end())
+    {
+      continue;
+    }
+
+    const auto decoder = codec.getDecoderByName(transport_name);
+    if (decoder == nullptr)
+      fprintf(stderr, "Decoder for transport %s could not be loaded, measuring only encoding.\n",
+              transport_name.c_str());
+
+    for (const auto& config : configs)
+    {
+      for (const auto& dataset : datasets)
+      {
+        const auto stats = benchmark(encoder, decoder, dataset, config.config, iterations);
+        printStats(transport_name, dataset.name, config.name, stats);
+      }
+    }
+  }
+
+  printf("\nratio = raw data size / compressed message size, throughput in MB of raw data per second, "
+         "latencies in ms, peak kB = peak RSS growth during the run\n");
+
+  return 0;
+}
@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin sending keyframes and deltas of consecutive clouds.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include <ros/single_subscriber_publisher.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/delta_publisher.h>
+#include <point_cloud_transport/DeltaPublisherConfig.h>
+#include <point_cloud_transport/PointCloudDelta.h>
+
+namespace point_cloud_transport
+{
+
+namespace
+{
+
+//! \brief Offsets of the FLOAT32 x, y and z fields, if the cloud has them.
+bool getXYZOffsets(const sensor_msgs::PointCloud2& cloud, size_t offsets[3])
+{
+  const char* names[3] = {"x", "y", "z"};
+  for (size_t i = 0; i < 3; ++i)
+  {
+    bool found = false;
+    for (const auto& field : cloud.fields)
+    {
+      if (field.name == names[i] && field.datatype == sensor_msgs::PointField::FLOAT32 &&
+          field.offset + sizeof(float) <= cloud.point_step)
+      {
+        offsets[i] = field.offset;
+        found = true;
+        break;
+      }
+    }
+    if (!found)
+      return false;
+  }
+  return true;
+}
+
+float getFloat(const uint8_t* point, size_t offset)
+{
+  float value;
+  memcpy(&value, point + offset, sizeof(value));
+  return value;
+}
+
+}
+
+std::string DeltaPublisher::getTransportName() const
+{
+  return "delta";
+}
+
+bool DeltaPublisher::isStateful() const
+{
+  return true;
+}
+
+void DeltaPublisher::connectCallback(const ros::SingleSubscriberPublisher&)
+{
+  keyframe_requested_ = true;
+}
+
+bool DeltaPublisher::hasSameLayout(const sensor_msgs::PointCloud2& raw) const
+{
+  const auto& ref = reference_;
+  if (raw.height != ref.height || raw.width != ref.width || raw.point_step != ref.point_step ||
+      raw.row_step != ref.row_step || raw.is_bigendian != ref.is_bigendian || raw.data.size() != ref.data.size() ||
+      raw.fields.size() != ref.fields.size())
+    return false;
+
+  for (size_t i = 0; i < raw.fields.size(); ++i)
+  {
+    const auto& a = raw.fields[i];
+    const auto& b = ref.fields[i];
+    if (a.name != b.name || a.offset != b.offset || a.datatype != b.datatype || a.count != b.count)
+      return false;
+  }
+  return true;
+}
+
+PointCloudDelta DeltaPublisher::encodeKeyframe(const sensor_msgs::PointCloud2& raw) const
+{
+  reference_ = raw;
+  has_reference_ = true;
+  num_deltas_ = 0;
+
+  PointCloudDelta msg;
+  msg.header = raw.header;
+  msg.sequence = sequence_;
+  msg.reference = sequence_;
+  msg.keyframe = true;
+  msg.height = raw.height;
+  msg.width = raw.width;
+  msg.fields = raw.fields;
+  msg.is_bigendian = raw.is_bigendian;
+  msg.point_step = raw.point_step;
+  msg.row_step = raw.row_step;
+  msg.is_dense = raw.is_dense;
+  msg.data = raw.data;
+  return msg;
+}
+
+DeltaPublisher::TypedEncodeResult DeltaPublisher::encodeTyped(
+    const sensor_msgs::PointCloud2& raw, const DeltaPublisherConfig& config) const
+{
+  if (raw.height > 0 && raw.width > 0 &&
+      (raw.row_step < static_cast<size_t>(raw.width) * raw.point_step ||
+       raw.data.size() < static_cast<size_t>(raw.height - 1) * raw.row_step +
+                         static_cast<size_t>(raw.width) * raw.point_step))
+    return cras::make_unexpected(std::string("The cloud has less data than its dimensions require."));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const uint32_t previous = sequence_++;
+  const bool keyframe_requested = keyframe_requested_.exchange(false) && config.keyframe_on_subscribe;
+  if (!has_reference_ || keyframe_requested || num_deltas_ + 1 >= static_cast<uint32_t>(config.keyframe_interval) ||
+      !hasSameLayout(raw))
+    return this->encodeKeyframe(raw);
+
+  const size_t num_points = static_cast<size_t>(raw.height) * raw.width;
+  const auto max_changed = static_cast<size_t>(config.max_changed_ratio * num_points);
+  const size_t point_step = raw.point_step;
+
+  size_t xyz[3];
+  const bool use_threshold = config.change_threshold > 0 && getXYZOffsets(raw, xyz);
+  const auto threshold2 = static_cast<float>(config.change_threshold * config.change_threshold);
+
+  PointCloudDelta msg;
+  msg.changed.resize((num_points + 7) / 8, 0);
+  size_t num_changed = 0;
+  for (size_t row = 0; row < raw.height; ++row)
+  {
+    const auto src_row = raw.data.data() + row * raw.row_step;
+    const auto ref_row = reference_.data.data() + row * raw.row_step;
+    for (size_t col = 0; col < raw.width; ++col)
+    {
+      const auto src = src_row + col * point_step;
+      const auto ref = ref_row + col * point_step;
+      if (memcmp(src, ref, point_step) == 0)
+        continue;
+
+      if (use_threshold)
+      {
+        const auto dx = getFloat(src, xyz[0]) - getFloat(ref, xyz[0]);
+        const auto dy = getFloat(src, xyz[1]) - getFloat(ref, xyz[1]);
+        const auto dz = getFloat(src, xyz[2]) - getFloat(ref, xyz[2]);
+        // NaNs fail the comparison, so points becoming valid or invalid are always sent.
+        if (dx * dx + dy * dy + dz * dz <= threshold2)
+          continue;
+      }
+
+      if (++num_changed > max_changed)
+        return this->encodeKeyframe(raw);
+
+      const size_t index = row * raw.width + col;
+      msg.changed[index / 8] |= static_cast<uint8_t>(1u << (index % 8));
+      msg.data.insert(msg.data.end(), src, src + point_step);
+      // The subscribers will have the new values of this point.
+      memcpy(ref, src, point_step);
+    }
+  }
+
+  reference_.header = raw.header;
+  ++num_deltas_;
+
+  msg.header = raw.header;
+  msg.sequence = sequence_;
+  msg.reference = previous;
+  msg.keyframe = false;
+  msg.height = raw.height;
+  msg.width = raw.width;
+  msg.fields = raw.fields;
+  msg.is_bigendian = raw.is_bigendian;
+  msg.point_step = raw.point_step;
+  msg.row_step = raw.row_step;
+  msg.is_dense = raw.is_dense;
+  return msg;
+}
+
+}
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin reconstructing clouds from keyframes and deltas.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include <ros/console.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/delta_subscriber.h>
+#include <point_cloud_transport/PointCloudDelta.h>
+
+namespace point_cloud_transport
+{
+
+std::string DeltaSubscriber::getTransportName() const
+{
+  return "delta";
+}
+
+bool DeltaSubscriber::isStateful() const
+{
+  return true;
+}
+
+SubscriberPlugin::DecodeResult DeltaSubscriber::decodeTyped(const PointCloudDelta& msg, const NoConfigConfig&) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (reference_ && msg.sequence == sequence_)
+    return cras::nullopt;
+
+  const size_t num_points = static_cast<size_t>(msg.height) * msg.width;
+  const size_t point_step = msg.point_step;
+  if (num_points > 0 && msg.row_step < msg.width * point_step)
+    return cras::make_unexpected(std::string("Invalid row step."));
+
+  sensor_msgs::PointCloud2Ptr cloud;
+  if (msg.keyframe)
+  {
+    if (num_points > 0 &&
+        msg.data.size() < (msg.height - 1) * static_cast<size_t>(msg.row_step) + msg.width * point_step)
+      return cras::make_unexpected(std::string("The keyframe has less data than its dimensions require."));
+    cloud = this->allocateCloud(msg.data.size());
+    if (!msg.data.empty())
+      memcpy(cloud->data.data(), msg.data.data(), msg.data.size());
+  }
+  else
+  {
+    if (!reference_ || msg.reference != sequence_)
+    {
+      if (reference_)
+        ROS_INFO("Transport delta received a delta against cloud %u, but the last received cloud is %u. Waiting for "
+                 "the next keyframe.", msg.reference, sequence_);
+      else
+        ROS_DEBUG_THROTTLE(5.0, "Transport delta is waiting for a keyframe.");
+      reference_.reset();
+      return cras::nullopt;
+    }
+
+    const auto& ref = *reference_;
+    if (ref.height != msg.height || ref.width != msg.width || ref.point_step != msg.point_step ||
+        ref.row_step != msg.row_step || msg.changed.size() < (num_points + 7) / 8)
+    {
+      reference_.reset();
+      return cras::make_unexpected(std::string("The delta does not match the previous cloud."));
+    }
+
+    cloud = this->allocateCloud(ref.data.size());
+    if (!ref.data.empty())
+      memcpy(cloud->data.data(), ref.data.data(), ref.data.size());
+
+    size_t data_offset = 0;
+    for (size_t byte = 0; byte < (num_points + 7) / 8; ++byte)
+    {
+      // Most points of a static scene do not change, so skip the whole bytes of the mask at once.
+      const auto mask = msg.changed[byte];
+      if (mask == 0)
+        continue;
+      for (size_t bit = 0; bit < 8; ++bit)
+      {
+        if ((mask & (1u << bit)) == 0)
+          continue;
+        const size_t index = byte * 8 + bit;
+        if (index >= num_points || data_offset + point_step > msg.data.size())
+        {
+          reference_.reset();
+          return cras::make_unexpected(std::string("The delta has less data than its mask requires."));
+        }
+        const size_t offset = (index / msg.width) * msg.row_step + (index % msg.width) * point_step;
+        memcpy(cloud->data.data() + offset, msg.data.data() + data_offset, point_step);
+        data_offset += point_step;
+      }
+    }
+  }
+
+  cloud->header = msg.header;
+  cloud->height = msg.height;
+  cloud->width = msg.width;
+  cloud->fields = msg.fields;
+  cloud->is_bigendian = msg.is_bigendian;
+  cloud->point_step = msg.point_step;
+  cloud->row_step = msg.row_step;
+  cloud->is_dense = msg.is_dense;
+
+  reference_ = cloud;
+  sequence_ = msg.sequence;
+  return reference_;
+}
+
+}
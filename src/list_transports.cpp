@@ -47,6 +47,7 @@
 
 #include <pluginlib/class_loader.h>
 
+#include <point_cloud_transport/loader_registry.h>
 #include <point_cloud_transport/publisher_plugin.h>
 #include <point_cloud_transport/subscriber_plugin.h>
 
@@ -73,8 +74,10 @@ struct TransportDesc
 
 int main(int argc, char** argv)
 {
-  ClassLoader<PublisherPlugin> pub_loader("point_cloud_transport", "point_cloud_transport::PublisherPlugin");
-  ClassLoader<SubscriberPlugin> sub_loader("point_cloud_transport", "point_cloud_transport::SubscriberPlugin");
+  // This tool checks whether the plugins really load, so it uses the loaders directly instead of the cached
+  // descriptions.
+  ClassLoader<PublisherPlugin>& pub_loader = *LoaderRegistry::instance().getPublisherLoader();
+  ClassLoader<SubscriberPlugin>& sub_loader = *LoaderRegistry::instance().getSubscriberLoader();
   typedef std::map<std::string, TransportDesc> StatusMap;
   StatusMap transports;
 
@@ -0,0 +1,461 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Process-wide plugin loaders and a persistent cache of the descriptions of the declared transports.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string/erase.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/pointer_cast.hpp>
+
+#include <pluginlib/class_loader.h>
+#include <pluginlib/exceptions.hpp>
+#include <ros/console.h>
+#include <ros/package.h>
+
+#include <point_cloud_transport/loader_fwds.h>
+#include <point_cloud_transport/loader_registry.h>
+#include <point_cloud_transport/publisher_plugin.h>
+#include <point_cloud_transport/subscriber_plugin.h>
+
+namespace point_cloud_transport
+{
+
+namespace
+{
+
+//! \brief Increase when the format of the cache file changes.
+const char* const CACHE_HEADER = "point_cloud_transport plugin cache v3";
+
+//! \brief Base topic used for finding out how the plugins derive their topics from the base topic.
+const char* const PLACEHOLDER_BASE_TOPIC = "/point_cloud_transport_base_topic";
+
+std::string getEnv(const char* name)
+{
+  const char* value = std::getenv(name);
+  return value != nullptr ? value : "";
+}
+
+std::string getCacheFile()
+{
+  const char* path = std::getenv("POINT_CLOUD_TRANSPORT_PLUGIN_CACHE");
+  if (path != nullptr)
+    return path;
+
+  auto ros_home = getEnv("ROS_HOME");
+  if (ros_home.empty())
+  {
+    const auto home = getEnv("HOME");
+    if (home.empty())
+      return "";
+    ros_home = home + "/.ros";
+  }
+  return ros_home + "/point_cloud_transport_plugins_cache";
+}
+
+/**
+ * \brief Modification time (in nanoseconds) and size of the given file, or `missing` if it does not exist. A plugin
+ *        library rebuilt in place changes its stamp, so the plugins it failed to provide are probed again.
+ */
+std::string fileStamp(const std::string& path)
+{
+  struct stat info {};
+  if (stat(path.c_str(), &info) != 0)
+    return "missing";
+  const auto mtime = static_cast<uint64_t>(info.st_mtim.tv_sec) * 1000000000ull +
+    static_cast<uint64_t>(info.st_mtim.tv_nsec);
+  return std::to_string(mtime) + ":" + std::to_string(info.st_size);
+}
+
+//! \brief FNV-1a hash of the contents of the given file, or `missing` if it can not be read.
+std::string hashFile(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in.good())
+    return "missing";
+  uint64_t hash = 14695981039346656037ull;
+  for (auto it = std::istreambuf_iterator<char>(in); it != std::istreambuf_iterator<char>(); ++it)
+  {
+    hash ^= static_cast<uint8_t>(*it);
+    hash *= 1099511628211ull;
+  }
+  return std::to_string(hash);
+}
+
+//! \brief The plugin description files exported by the packages, in the form pluginlib reads them.
+std::vector<std::string> getExportedPluginXmls()
+{
+  std::vector<std::string> paths;
+  ros::package::getPlugins("point_cloud_transport", "plugin", paths);
+  std::sort(paths.begin(), paths.end());
+  paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+  return paths;
+}
+
+std::vector<std::string> splitString(const std::string& str, char separator)
+{
+  std::vector<std::string> parts;
+  size_t start = 0;
+  while (true)
+  {
+    const auto end = str.find(separator, start);
+    parts.push_back(str.substr(start, end == std::string::npos ? std::string::npos : end - start));
+    if (end == std::string::npos)
+      return parts;
+    start = end + 1;
+  }
+}
+
+template<typename Plugin, typename SingleTopicPlugin, typename TopicFn>
+TransportPluginInfo describePlugin(pluginlib::ClassLoader<Plugin>& loader, std::mutex& loader_mutex,
+                                   const std::string& lookup_name, const std::string& suffix, const TopicFn& get_topic)
+{
+  TransportPluginInfo info;
+  info.lookup_name = lookup_name;
+  info.transport = boost::erase_last_copy(lookup_name, suffix);
+  try
+  {
+    boost::shared_ptr<Plugin> plugin;
+    {
+      std::lock_guard<std::mutex> lock(loader_mutex);
+      plugin = loader.createInstance(lookup_name);
+    }
+    info.loadable = true;
+    info.name = plugin->getTransportName();
+
+    const auto single_topic = boost::dynamic_pointer_cast<SingleTopicPlugin>(plugin);
+    if (single_topic != nullptr)
+    {
+      info.single_topic = true;
+      info.data_type = single_topic->getDataType();
+      info.config_data_type = single_topic->getConfigDataType();
+      const std::string base = PLACEHOLDER_BASE_TOPIC;
+      const std::string topic = get_topic(*single_topic, base);
+      info.topic_has_suffix = topic.compare(0, base.size(), base) == 0;
+      if (info.topic_has_suffix)
+        info.topic_suffix = topic.substr(base.size());
+    }
+  }
+  catch (const pluginlib::PluginlibException& e)
+  {
+    ROS_DEBUG("Plugin %s is not loadable: %s", lookup_name.c_str(), e.what());
+  }
+  return info;
+}
+
+std::string serialize(const char* kind, const TransportPluginInfo& info)
+{
+  return std::string(kind) + "\t" + info.lookup_name + "\t" + info.transport + "\t" + info.name + "\t" +
+    (info.loadable ? "1" : "0") + "\t" + (info.single_topic ? "1" : "0") + "\t" + (info.topic_has_suffix ? "1" : "0") +
+    "\t" + info.topic_suffix + "\t" + info.data_type + "\t" + info.config_data_type;
+}
+
+bool deserialize(const std::vector<std::string>& fields, TransportPluginInfo& info)
+{
+  if (fields.size() != 10)
+    return false;
+  info.lookup_name = fields[1];
+  info.transport = fields[2];
+  info.name = fields[3];
+  info.loadable = fields[4] == "1";
+  info.single_topic = fields[5] == "1";
+  info.topic_has_suffix = fields[6] == "1";
+  info.topic_suffix = fields[7];
+  info.data_type = fields[8];
+  info.config_data_type = fields[9];
+  return true;
+}
+
+}
+
+struct LoaderRegistry::Impl
+{
+  //! \brief Protects the loader pointers and the descriptions.
+  std::mutex mutex_;
+  //! \brief Protects the use of the loaders. Always locked after mutex_.
+  std::mutex loader_mutex_;
+  PubLoaderPtr pub_loader_;
+  SubLoaderPtr sub_loader_;
+
+  bool descriptions_valid_ {false};
+  std::vector<TransportPluginInfo> publishers_;
+  std::vector<TransportPluginInfo> subscribers_;
+
+  PubLoaderPtr getPublisherLoader()
+  {
+    if (pub_loader_ == nullptr)
+      pub_loader_ = boost::make_shared<PubLoader>("point_cloud_transport", "point_cloud_transport::PublisherPlugin");
+    return pub_loader_;
+  }
+
+  SubLoaderPtr getSubscriberLoader()
+  {
+    if (sub_loader_ == nullptr)
+      sub_loader_ = boost::make_shared<SubLoader>("point_cloud_transport", "point_cloud_transport::SubscriberPlugin");
+    return sub_loader_;
+  }
+
+  void ensureDescriptions()
+  {
+    if (descriptions_valid_)
+      return;
+
+    const auto cache_file = getCacheFile();
+    if (!cache_file.empty() && readCache(cache_file))
+    {
+      descriptions_valid_ = true;
+      return;
+    }
+
+    buildDescriptions();
+    descriptions_valid_ = true;
+    if (!cache_file.empty())
+      writeCache(cache_file);
+  }
+
+  void buildDescriptions()
+  {
+    publishers_.clear();
+    subscribers_.clear();
+
+    // describePlugin() locks the loaders by itself, so only the listing of the classes is done under the lock here.
+    std::vector<std::string> pub_classes;
+    std::vector<std::string> sub_classes;
+    const auto pub_loader = getPublisherLoader();
+    const auto sub_loader = getSubscriberLoader();
+    {
+      std::lock_guard<std::mutex> lock(loader_mutex_);
+      pub_classes = pub_loader->getDeclaredClasses();
+      sub_classes = sub_loader->getDeclaredClasses();
+    }
+
+    for (const auto& lookup_name : pub_classes)
+    {
+      publishers_.push_back(describePlugin<PublisherPlugin, SingleTopicPublisherPlugin>(
+        *pub_loader, loader_mutex_, lookup_name, "_pub",
+        [](const SingleTopicPublisherPlugin& p, const std::string& base) { return p.getTopicToAdvertise(base); }));
+    }
+
+    for (const auto& lookup_name : sub_classes)
+    {
+      subscribers_.push_back(describePlugin<SubscriberPlugin, SingleTopicSubscriberPlugin>(
+        *sub_loader, loader_mutex_, lookup_name, "_sub",
+        [](const SingleTopicSubscriberPlugin& p, const std::string& base) { return p.getTopicToSubscribe(base); }));
+    }
+  }
+
+  //! \brief The libraries of the described plugins.
+  std::vector<std::string> getLibraryPaths()
+  {
+    std::vector<std::string> files;
+    const auto pub_loader = getPublisherLoader();
+    const auto sub_loader = getSubscriberLoader();
+    std::lock_guard<std::mutex> lock(loader_mutex_);
+    for (const auto& info : publishers_)
+    {
+      try
+      {
+        files.push_back(pub_loader->getClassLibraryPath(info.lookup_name));
+      }
+      catch (const pluginlib::PluginlibException&)
+      {
+      }
+    }
+    for (const auto& info : subscribers_)
+    {
+      try
+      {
+        files.push_back(sub_loader->getClassLibraryPath(info.lookup_name));
+      }
+      catch (const pluginlib::PluginlibException&)
+      {
+      }
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+  }
+
+  bool readCache(const std::string& cache_file)
+  {
+    std::ifstream in(cache_file);
+    if (!in.good())
+      return false;
+
+    std::string line;
+    if (!std::getline(in, line) || line != CACHE_HEADER)
+      return false;
+
+    std::vector<TransportPluginInfo> publishers;
+    std::vector<TransportPluginInfo> subscribers;
+    std::vector<std::string> plugin_xmls;
+    bool has_package_path = false;
+    while (std::getline(in, line))
+    {
+      const auto fields = splitString(line, '\t');
+      if (fields[0] == "ros_package_path")
+      {
+        if (fields.size() != 2 || fields[1] != getEnv("ROS_PACKAGE_PATH"))
+          return false;
+        has_package_path = true;
+      }
+      else if (fields[0] == "xml")
+      {
+        if (fields.size() != 3)
+          return false;
+        if (hashFile(fields[2]) != fields[1])
+        {
+          ROS_DEBUG("Point cloud transport plugin cache %s is outdated.", cache_file.c_str());
+          return false;
+        }
+        plugin_xmls.push_back(fields[2]);
+      }
+      else if (fields[0] == "library")
+      {
+        if (fields.size() != 3)
+          return false;
+        if (fileStamp(fields[2]) != fields[1])
+        {
+          ROS_DEBUG("Point cloud transport plugin cache %s is outdated.", cache_file.c_str());
+          return false;
+        }
+      }
+      else if (fields[0] == "pub" || fields[0] == "sub")
+      {
+        TransportPluginInfo info;
+        if (!deserialize(fields, info))
+          return false;
+        (fields[0] == "pub" ? publishers : subscribers).push_back(info);
+      }
+      else
+      {
+        return false;
+      }
+    }
+
+    if (!has_package_path)
+      return false;
+
+    // A package that started or stopped exporting plugins changes the declared classes even if no file was modified.
+    if (plugin_xmls != getExportedPluginXmls())
+    {
+      ROS_DEBUG("Point cloud transport plugin cache %s is outdated.", cache_file.c_str());
+      return false;
+    }
+
+    publishers_ = std::move(publishers);
+    subscribers_ = std::move(subscribers);
+    return true;
+  }
+
+  void writeCache(const std::string& cache_file)
+  {
+    // Write to a temporary file and atomically replace the cache so that concurrent readers never see a partial file.
+    const auto tmp_file = cache_file + "." + std::to_string(getpid()) + ".tmp";
+    {
+      std::ofstream out(tmp_file);
+      if (!out.good())
+      {
+        ROS_DEBUG("Cannot write point cloud transport plugin cache %s.", tmp_file.c_str());
+        return;
+      }
+
+      out << CACHE_HEADER << "\n";
+      out << "ros_package_path\t" << getEnv("ROS_PACKAGE_PATH") << "\n";
+      for (const auto& file : getExportedPluginXmls())
+        out << "xml\t" << hashFile(file) << "\t" << file << "\n";
+      for (const auto& file : getLibraryPaths())
+        out << "library\t" << fileStamp(file) << "\t" << file << "\n";
+      for (const auto& info : publishers_)
+        out << serialize("pub", info) << "\n";
+      for (const auto& info : subscribers_)
+        out << serialize("sub", info) << "\n";
+
+      if (!out.good())
+      {
+        out.close();
+        std::remove(tmp_file.c_str());
+        return;
+      }
+    }
+
+    if (std::rename(tmp_file.c_str(), cache_file.c_str()) != 0)
+    {
+      ROS_DEBUG("Cannot write point cloud transport plugin cache %s.", cache_file.c_str());
+      std::remove(tmp_file.c_str());
+    }
+  }
+};
+
+LoaderRegistry::LoaderRegistry() : impl_(new Impl)
+{
+}
+
+LoaderRegistry::~LoaderRegistry() = default;
+
+LoaderRegistry& LoaderRegistry::instance()
+{
+  static LoaderRegistry registry;
+  return registry;
+}
+
+PubLoaderPtr LoaderRegistry::getPublisherLoader()
+{
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  return impl_->getPublisherLoader();
+}
+
+SubLoaderPtr LoaderRegistry::getSubscriberLoader()
+{
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  return impl_->getSubscriberLoader();
+}
+
+std::unique_lock<std::mutex> LoaderRegistry::lockLoaders()
+{
+  return std::unique_lock<std::mutex>(impl_->loader_mutex_);
+}
+
+std::vector<TransportPluginInfo> LoaderRegistry::getPublisherPlugins()
+{
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  impl_->ensureDescriptions();
+  return impl_->publishers_;
+}
+
+std::vector<TransportPluginInfo> LoaderRegistry::getSubscriberPlugins()
+{
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  impl_->ensureDescriptions();
+  return impl_->subscribers_;
+}
+
+void LoaderRegistry::clearCache()
+{
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  impl_->descriptions_valid_ = false;
+  impl_->publishers_.clear();
+  impl_->subscribers_.clear();
+  const auto cache_file = getCacheFile();
+  if (!cache_file.empty())
+    std::remove(cache_file.c_str());
+}
+
+}
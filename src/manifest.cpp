@@ -3,10 +3,30 @@
 
 #include <pluginlib/class_list_macros.h>
 
+#include <point_cloud_transport/delta_publisher.h>
+#include <point_cloud_transport/delta_subscriber.h>
 #include <point_cloud_transport/publisher_plugin.h>
+#include <point_cloud_transport/quantized_publisher.h>
+#include <point_cloud_transport/quantized_subscriber.h>
+#include <point_cloud_transport/range_image_publisher.h>
+#include <point_cloud_transport/range_image_subscriber.h>
+#include <point_cloud_transport/raw_chunked_publisher.h>
+#include <point_cloud_transport/raw_chunked_subscriber.h>
 #include <point_cloud_transport/raw_publisher.h>
 #include <point_cloud_transport/raw_subscriber.h>
+#include <point_cloud_transport/shm_publisher.h>
+#include <point_cloud_transport/shm_subscriber.h>
 #include <point_cloud_transport/subscriber_plugin.h>
 
 PLUGINLIB_EXPORT_CLASS(point_cloud_transport::RawPublisher, point_cloud_transport::PublisherPlugin)
 PLUGINLIB_EXPORT_CLASS(point_cloud_transport::RawSubscriber, point_cloud_transport::SubscriberPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::RawChunkedPublisher, point_cloud_transport::PublisherPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::RawChunkedSubscriber, point_cloud_transport::SubscriberPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::DeltaPublisher, point_cloud_transport::PublisherPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::DeltaSubscriber, point_cloud_transport::SubscriberPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::RangeImagePublisher, point_cloud_transport::PublisherPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::RangeImageSubscriber, point_cloud_transport::SubscriberPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::ShmPublisher, point_cloud_transport::PublisherPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::ShmSubscriber, point_cloud_transport::SubscriberPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::QuantizedPublisher, point_cloud_transport::PublisherPlugin)
+PLUGINLIB_EXPORT_CLASS(point_cloud_transport::QuantizedSubscriber, point_cloud_transport::SubscriberPlugin)
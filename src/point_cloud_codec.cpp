@@ -38,9 +38,18 @@
  *
  */
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <boost/make_shared.hpp>
@@ -48,28 +57,75 @@
 #include <cras_cpp_common/c_api.h>
 #include <cras_cpp_common/log_utils.h>
 #include <cras_cpp_common/log_utils/memory.h>
+#include <cras_cpp_common/string_utils.hpp>
 #include <pluginlib/class_loader.h>
+#include <pluginlib/exceptions.hpp>
 #include <ros/node_handle.h>
 #include <sensor_msgs/PointCloud2.h>
 
 #include <point_cloud_transport/loader_fwds.h>
+#include <point_cloud_transport/loader_registry.h>
 #include <point_cloud_transport/point_cloud_codec.h>
+#include <point_cloud_transport/point_cloud_pool.h>
 #include <point_cloud_transport/publisher_plugin.h>
 #include <point_cloud_transport/subscriber_plugin.h>
+#include <point_cloud_transport/thread_pool.h>
 
 namespace point_cloud_transport
 {
 
+namespace
+{
+
+//! \brief A lazily started ThreadPool shared by the batches, so that their threads are not started for each batch.
+class BatchPool
+{
+public:
+  /**
+   * \brief Get a pool with at least the given number of threads.
+   * \param[in] num_threads Number of threads.
+   * \return The pool. A pool with too few threads is replaced, but batches that use it keep it alive until they finish.
+   */
+  std::shared_ptr<ThreadPool> get(size_t num_threads)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pool_ || pool_->getNumThreads() < num_threads)
+      pool_ = std::make_shared<ThreadPool>(num_threads);
+    return pool_;
+  }
+
+private:
+  std::mutex mutex_;
+  std::shared_ptr<ThreadPool> pool_;
+};
+
+}
+
 struct PointCloudCodec::Impl
 {
   point_cloud_transport::PubLoaderPtr enc_loader_;
   point_cloud_transport::SubLoaderPtr dec_loader_;
+  //! \brief Lookup names of encoders for topic+datatype keys. Empty name means no encoder matches.
   std::unordered_map<std::string, std::string> encoders_for_topics_;
+  //! \brief Lookup names of decoders for topic+datatype keys. Empty name means no decoder matches.
   std::unordered_map<std::string, std::string> decoders_for_topics_;
+  //! \brief Created encoders by lookup name.
+  std::unordered_map<std::string, boost::shared_ptr<point_cloud_transport::PublisherPlugin>> encoders_;
+  //! \brief Created decoders by lookup name.
+  std::unordered_map<std::string, boost::shared_ptr<point_cloud_transport::SubscriberPlugin>> decoders_;
+  //! \brief Protects all the maps and the loaders.
+  std::recursive_mutex mutex_;
+  //! \brief Serializes the batches of stateful encoders and decoders, whose clouds have to be processed in order.
+  std::mutex stateful_mutex_;
+  //! \brief Pool of the decoders of this codec. When the intermediate cloud of transcode() is released, its buffer is
+  //!        reused by the next decoding.
+  const std::shared_ptr<PointCloudPool> pool_ {std::make_shared<PointCloudPool>(1)};
+  //! \brief Worker threads of encodeBatch() and decodeBatch().
+  mutable BatchPool batch_pool_;
 
   Impl() :
-      enc_loader_(boost::make_shared<PubLoader>("point_cloud_transport", "point_cloud_transport::PublisherPlugin")),
-      dec_loader_(boost::make_shared<SubLoader>("point_cloud_transport", "point_cloud_transport::SubscriberPlugin"))
+      enc_loader_(LoaderRegistry::instance().getPublisherLoader()),
+      dec_loader_(LoaderRegistry::instance().getSubscriberLoader())
   {
   }
 };
@@ -97,16 +153,86 @@ bool transportNameMatches(const std::string& lookup_name, const std::string& nam
   return false;
 }
 
+/**
+ * \brief Whether the plugin described by the registry can handle the given topic and data type.
+ *
+ * Only the plugins passing this check are instantiated when looking up a codec by topic. Plugins whose description
+ * does not tell how they derive their topic pass it and have to be asked by matchesTopic().
+ */
+bool descriptionMayMatchTopic(const TransportPluginInfo& info, const std::string& topic, const std::string& datatype)
+{
+  if (!info.loadable)
+  {
+    return false;
+  }
+  if (!info.single_topic)
+  {
+    return true;
+  }
+  return info.data_type == datatype && (!info.topic_has_suffix || cras::endsWith(topic, info.topic_suffix));
+}
+
+boost::shared_ptr<point_cloud_transport::PublisherPlugin> PointCloudCodec::getEncoderByLookupName(
+    const std::string& lookup_name) const
+{
+  std::lock_guard<std::recursive_mutex> lock(impl_->mutex_);
+  const auto it = impl_->encoders_.find(lookup_name);
+  if (it != impl_->encoders_.end())
+    return it->second;
+
+  boost::shared_ptr<point_cloud_transport::PublisherPlugin> encoder;
+  try
+  {
+    const auto loader_lock = LoaderRegistry::instance().lockLoaders();
+    encoder = impl_->enc_loader_->createInstance(lookup_name);
+  }
+  catch (const pluginlib::PluginlibException& e)
+  {
+    CRAS_ERROR("Failed to load encoder %s: %s", lookup_name.c_str(), e.what());
+  }
+  if (encoder)
+    encoder->setCrasLogger(this->log);
+  // Failures are cached, too, so that the loader is not asked again for each cloud.
+  impl_->encoders_[lookup_name] = encoder;
+  return encoder;
+}
+
+boost::shared_ptr<point_cloud_transport::SubscriberPlugin> PointCloudCodec::getDecoderByLookupName(
+    const std::string& lookup_name) const
+{
+  std::lock_guard<std::recursive_mutex> lock(impl_->mutex_);
+  const auto it = impl_->decoders_.find(lookup_name);
+  if (it != impl_->decoders_.end())
+    return it->second;
+
+  boost::shared_ptr<point_cloud_transport::SubscriberPlugin> decoder;
+  try
+  {
+    const auto loader_lock = LoaderRegistry::instance().lockLoaders();
+    decoder = impl_->dec_loader_->createInstance(lookup_name);
+  }
+  catch (const pluginlib::PluginlibException& e)
+  {
+    CRAS_ERROR("Failed to load decoder %s: %s", lookup_name.c_str(), e.what());
+  }
+  if (decoder)
+  {
+    decoder->setCrasLogger(this->log);
+    decoder->setPointCloudPool(impl_->pool_);
+  }
+  impl_->decoders_[lookup_name] = decoder;
+  return decoder;
+}
+
 boost::shared_ptr<point_cloud_transport::PublisherPlugin> PointCloudCodec::getEncoderByName(
     const std::string& name) const
 {
-  for (const auto& lookup_name : impl_->enc_loader_->getDeclaredClasses())
+  std::lock_guard<std::recursive_mutex> lock(impl_->mutex_);
+  for (const auto& lookup_name : LoaderRegistry::instance().getDeclaredClasses(*impl_->enc_loader_))
   {
     if (transportNameMatches(lookup_name, name, "_pub"))
     {
-      auto encoder = impl_->enc_loader_->createInstance(lookup_name);
-      encoder->setCrasLogger(this->log);
-      return encoder;
+      return getEncoderByLookupName(lookup_name);
     }
   }
 
@@ -117,28 +243,33 @@ boost::shared_ptr<point_cloud_transport::PublisherPlugin> PointCloudCodec::getEn
 boost::shared_ptr<point_cloud_transport::PublisherPlugin> PointCloudCodec::getEncoderByTopic(
     const std::string& topic, const std::string& datatype) const
 {
-  if (impl_->encoders_for_topics_.find(topic) != impl_->encoders_for_topics_.end())
+  std::lock_guard<std::recursive_mutex> lock(impl_->mutex_);
+  const auto key = topic + " " + datatype;
+  const auto it = impl_->encoders_for_topics_.find(key);
+  if (it != impl_->encoders_for_topics_.end())
   {
-    auto encoder = impl_->enc_loader_->createInstance(impl_->encoders_for_topics_[topic]);
-    encoder->setCrasLogger(this->log);
-    return encoder;
+    return it->second.empty() ? nullptr : getEncoderByLookupName(it->second);
   }
 
-  for (const auto& lookup_name : impl_->enc_loader_->getDeclaredClasses())
+  for (const auto& info : LoaderRegistry::instance().getPublisherPlugins())
   {
-    const auto& encoder = impl_->enc_loader_->createInstance(lookup_name);
+    if (!descriptionMayMatchTopic(info, topic, datatype))
+    {
+      continue;
+    }
+    const auto& encoder = getEncoderByLookupName(info.lookup_name);
     if (!encoder)
     {
       continue;
     }
     if (encoder->matchesTopic(topic, datatype))
     {
-      impl_->encoders_for_topics_[topic] = lookup_name;
-      encoder->setCrasLogger(this->log);
+      impl_->encoders_for_topics_[key] = info.lookup_name;
       return encoder;
     }
   }
 
+  impl_->encoders_for_topics_[key] = "";
   ROS_DEBUG("Failed to find encoder for topic %s with data type %s.", topic.c_str(), datatype.c_str());
   return nullptr;
 }
@@ -146,13 +277,12 @@ boost::shared_ptr<point_cloud_transport::PublisherPlugin> PointCloudCodec::getEn
 boost::shared_ptr<point_cloud_transport::SubscriberPlugin> PointCloudCodec::getDecoderByName(
     const std::string& name) const
 {
-  for (const auto& lookup_name : impl_->dec_loader_->getDeclaredClasses())
+  std::lock_guard<std::recursive_mutex> lock(impl_->mutex_);
+  for (const auto& lookup_name : LoaderRegistry::instance().getDeclaredClasses(*impl_->dec_loader_))
   {
     if (transportNameMatches(lookup_name, name, "_sub"))
     {
-      auto decoder = impl_->dec_loader_->createInstance(lookup_name);
-      decoder->setCrasLogger(this->log);
-      return decoder;
+      return getDecoderByLookupName(lookup_name);
     }
   }
 
@@ -163,109 +293,411 @@ boost::shared_ptr<point_cloud_transport::SubscriberPlugin> PointCloudCodec::getD
 boost::shared_ptr<point_cloud_transport::SubscriberPlugin> PointCloudCodec::getDecoderByTopic(
     const std::string& topic, const std::string& datatype) const
 {
-  if (impl_->decoders_for_topics_.find(topic) != impl_->decoders_for_topics_.end())
+  std::lock_guard<std::recursive_mutex> lock(impl_->mutex_);
+  const auto key = topic + " " + datatype;
+  const auto it = impl_->decoders_for_topics_.find(key);
+  if (it != impl_->decoders_for_topics_.end())
   {
-    auto decoder = impl_->dec_loader_->createInstance(impl_->decoders_for_topics_[topic]);
-    decoder->setCrasLogger(this->log);
-    return decoder;
+    return it->second.empty() ? nullptr : getDecoderByLookupName(it->second);
   }
 
-  for (const auto& lookup_name : impl_->dec_loader_->getDeclaredClasses())
+  for (const auto& info : LoaderRegistry::instance().getSubscriberPlugins())
   {
-    const auto& decoder = impl_->dec_loader_->createInstance(lookup_name);
+    if (!descriptionMayMatchTopic(info, topic, datatype))
+    {
+      continue;
+    }
+    const auto& decoder = getDecoderByLookupName(info.lookup_name);
     if (!decoder)
     {
       continue;
     }
     if (decoder->matchesTopic(topic, datatype))
     {
-      impl_->decoders_for_topics_[topic] = lookup_name;
-      decoder->setCrasLogger(this->log);
+      impl_->decoders_for_topics_[key] = info.lookup_name;
       return decoder;
     }
   }
 
+  impl_->decoders_for_topics_[key] = "";
   ROS_DEBUG("Failed to find decoder for topic %s with data type %s.", topic.c_str(), datatype.c_str());
   return nullptr;
 }
 
+void PointCloudCodec::warmUp() const
+{
+  std::lock_guard<std::recursive_mutex> lock(impl_->mutex_);
+  for (const auto& lookup_name : LoaderRegistry::instance().getDeclaredClasses(*impl_->enc_loader_))
+    getEncoderByLookupName(lookup_name);
+  for (const auto& lookup_name : LoaderRegistry::instance().getDeclaredClasses(*impl_->dec_loader_))
+    getDecoderByLookupName(lookup_name);
+}
+
+bool PointCloudCodec::preload(const std::vector<std::string>& names) const
+{
+  bool all_found = true;
+  for (const auto& name : names)
+  {
+    const auto encoder = getEncoderByName(name);
+    const auto decoder = getDecoderByName(name);
+    if (!encoder && !decoder)
+    {
+      CRAS_ERROR("Failed to preload transport %s.", name.c_str());
+      all_found = false;
+    }
+  }
+  return all_found;
+}
+
+namespace
+{
+
+/**
+ * \brief Split the range [0, count) into chunks and process them in parallel.
+ * \param[in] batch_pool The pool whose threads process the chunks.
+ * \param[in] count Number of items.
+ * \param[in] num_threads Number of threads. Zero means the number of CPU cores.
+ * \param[in] fn The function processing items [begin, end). It is called from the worker threads. If it throws, the
+ *               first exception is rethrown after all chunks finish.
+ */
+void parallelFor(BatchPool& batch_pool, size_t count, size_t num_threads,
+                 const std::function<void(size_t begin, size_t end)>& fn)
+{
+  if (count == 0)
+    return;
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  num_threads = std::min(num_threads, count);
+
+  // Use more chunks than threads so that one slow chunk does not hold back the whole batch.
+  const size_t num_chunks = std::min(count, 4 * num_threads);
+  const size_t chunk_size = (count + num_chunks - 1) / num_chunks;
+
+  // Other batches may share the pool, so this batch waits only for its own workers, which take the chunks in turn.
+  const auto pool = batch_pool.get(num_threads);
+  std::atomic<size_t> next_begin {0};
+  size_t num_running = num_threads;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable cv;
+  const auto worker = [&]
+  {
+    try
+    {
+      for (size_t begin = next_begin.fetch_add(chunk_size); begin < count; begin = next_begin.fetch_add(chunk_size))
+        fn(begin, std::min(count, begin + chunk_size));
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error)
+        error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--num_running == 0)
+      cv.notify_all();
+  };
+  for (size_t i = 0; i < num_threads; ++i)
+  {
+    if (!pool->post(worker))
+      worker();
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [&] { return num_running == 0; });
+  if (error)
+    std::rethrow_exception(error);
+}
+
+//! \brief The pool of the batches of the C API.
+BatchPool& getCApiBatchPool()
+{
+  static BatchPool pool;
+  return pool;
+}
+
+}
+
+cras::expected<std::vector<PublisherPlugin::EncodeResult>, std::string> PointCloudCodec::encodeBatch(
+    const std::string& name, const std::vector<sensor_msgs::PointCloud2ConstPtr>& raw,
+    const dynamic_reconfigure::Config& config, size_t num_threads) const
+{
+  const auto encoder = getEncoderByName(name);
+  if (!encoder)
+    return cras::make_unexpected("Could not find encoder for " + name);
+
+  std::unique_lock<std::mutex> stateful_lock(impl_->stateful_mutex_, std::defer_lock);
+  if (encoder->isStateful())
+  {
+    stateful_lock.lock();
+    num_threads = 1;
+  }
+
+  std::vector<PublisherPlugin::EncodeResult> results(raw.size());
+  parallelFor(impl_->batch_pool_, raw.size(), num_threads, [&](size_t begin, size_t end)
+  {
+    const std::vector<sensor_msgs::PointCloud2ConstPtr> chunk(raw.begin() + begin, raw.begin() + end);
+    auto chunk_results = encoder->encodeBatch(chunk, config);
+    std::move(chunk_results.begin(), chunk_results.end(), results.begin() + begin);
+  });
+  return results;
+}
+
+cras::expected<std::vector<SubscriberPlugin::DecodeResult>, std::string> PointCloudCodec::decodeBatch(
+    const std::string& topicOrCodec, const std::vector<topic_tools::ShapeShifter::ConstPtr>& compressed,
+    const dynamic_reconfigure::Config& config, size_t num_threads) const
+{
+  if (compressed.empty())
+    return std::vector<SubscriberPlugin::DecodeResult>();
+
+  auto decoder = getDecoderByTopic(topicOrCodec, compressed[0]->getDataType());
+  if (!decoder)
+    decoder = getDecoderByName(topicOrCodec);
+  if (!decoder)
+    return cras::make_unexpected("Could not find decoder for " + topicOrCodec);
+
+  std::unique_lock<std::mutex> stateful_lock(impl_->stateful_mutex_, std::defer_lock);
+  if (decoder->isStateful())
+  {
+    stateful_lock.lock();
+    num_threads = 1;
+  }
+
+  std::vector<SubscriberPlugin::DecodeResult> results(compressed.size());
+  parallelFor(impl_->batch_pool_, compressed.size(), num_threads, [&](size_t begin, size_t end)
+  {
+    const std::vector<topic_tools::ShapeShifter::ConstPtr> chunk(compressed.begin() + begin, compressed.begin() + end);
+    auto chunk_results = decoder->decodeBatch(chunk, config);
+    std::move(chunk_results.begin(), chunk_results.end(), results.begin() + begin);
+  });
+  return results;
+}
+
+PublisherPlugin::EncodeResult PointCloudCodec::transcode(
+    const topic_tools::ShapeShifter& compressed, const std::string& topicOrCodec, const std::string& name,
+    const dynamic_reconfigure::Config& config, const dynamic_reconfigure::Config& decoderConfig) const
+{
+  auto decoder = getDecoderByTopic(topicOrCodec, compressed.getDataType());
+  if (!decoder)
+    decoder = getDecoderByName(topicOrCodec);
+  if (!decoder)
+    return cras::make_unexpected("Could not find decoder for " + topicOrCodec);
+  const auto encoder = getEncoderByName(name);
+  if (!encoder)
+    return cras::make_unexpected("Could not find encoder for " + name);
+
+  if (isPassThrough(*decoder, *encoder, config))
+  {
+    cras::ShapeShifter result;
+    result.morph(compressed.getMD5Sum(), compressed.getDataType(), compressed.getMessageDefinition(), "");
+    cras::resizeBuffer(result, compressed.size());
+    memcpy(cras::getBuffer(result), cras::getBuffer(compressed), compressed.size());
+    return result;
+  }
+
+  auto raw = decoder->decode(compressed, decoderConfig);
+  if (!raw)
+    return cras::make_unexpected("Could not decode the cloud: " + raw.error());
+  if (!raw.value())
+    return cras::nullopt;
+  // The intermediate cloud is released (back to the pool) right after encoding.
+  return encoder->encode(*raw->value(), config);
+}
+
+bool PointCloudCodec::isPassThrough(const SubscriberPlugin& decoder, const PublisherPlugin& encoder,
+                                    const dynamic_reconfigure::Config& config)
+{
+  return decoder.getTransportName() == encoder.getTransportName() && config.bools.empty() && config.ints.empty() &&
+      config.strs.empty() && config.doubles.empty();
+}
+
 thread_local auto globalLogger = std::make_shared<cras::MemoryLogHelper>();
 thread_local PointCloudCodec point_cloud_transport_codec_instance(globalLogger);
 
+//! \brief Buffers reused by the C API calls in one thread to avoid reallocating them for every cloud.
+struct CodecBuffers
+{
+  //! \brief Raw cloud passed to the encoder.
+  sensor_msgs::PointCloud2 raw;
+  //! \brief Compressed cloud passed to the transcoder.
+  topic_tools::ShapeShifter compressed;
+  //! \brief Result of the last *Into() encoding whose data did not fit into the caller's buffer.
+  cras::optional<cras::ShapeShifter> lastEncoded;
+  //! \brief Result of the last *Into() decoding whose data did not fit into the caller's buffer.
+  sensor_msgs::PointCloud2ConstPtr lastDecoded;
+};
+
+thread_local CodecBuffers codecBuffers;
+
+struct CodecContext
+{
+  explicit CodecContext(const std::string& topicOrCodec) :
+      topicOrCodec(topicOrCodec), logger(std::make_shared<cras::MemoryLogHelper>()), codec(logger)
+  {
+  }
+
+  //! \brief Name of the codec, or of the topic the decoded clouds come from.
+  const std::string topicOrCodec;
+  //! \brief Log of the plugins created by this context.
+  const std::shared_ptr<cras::MemoryLogHelper> logger;
+  //! \brief Codec holding plugin instances private to this context.
+  PointCloudCodec codec;
+  //! \brief The encoder (looked up on the first encoding).
+  boost::shared_ptr<PublisherPlugin> encoder;
+  //! \brief The decoder of messages of type decoderType (looked up on the first decoding of such message).
+  boost::shared_ptr<SubscriberPlugin> decoder;
+  std::string decoderType;
+  //! \brief The config set by pointCloudTransportCodecsContextSetConfig().
+  dynamic_reconfigure::Config config;
+  CodecBuffers buffers;
+  //! \brief Pool of the clouds decoded with this context.
+  const std::shared_ptr<PointCloudPool> pool {std::make_shared<PointCloudPool>(2)};
+  //! \brief Serializes the calls with this context (e.g. a config change from a reconfigure callback and decoding).
+  std::mutex mutex;
+};
+
+namespace
+{
+
+bool deserializeConfig(size_t serializedConfigLength, const uint8_t serializedConfig[],
+                       dynamic_reconfigure::Config& config, const char* what, cras::allocator_t errorStringAllocator)
+{
+  if (serializedConfigLength == 0)
+    return true;
+
+  ros::serialization::IStream data(const_cast<uint8_t*>(serializedConfig), serializedConfigLength);
+  try
+  {
+    ros::serialization::deserialize(data, config);
+  }
+  catch (const ros::Exception& e)
+  {
+    cras::outputString(errorStringAllocator, cras::format("Could not deserialize %s config: %s.", what, e.what()));
+    return false;
+  }
+  return true;
 }
 
-bool pointCloudTransportCodecsEncode(
-    const char* codec,
+void fillRawCloud(
+    sensor_msgs::PointCloud2& raw,
     sensor_msgs::PointCloud2::_height_type rawHeight,
     sensor_msgs::PointCloud2::_width_type rawWidth,
     size_t rawNumFields,
     const char* rawFieldNames[],
-    sensor_msgs::PointField::_offset_type rawFieldOffsets[],
-    sensor_msgs::PointField::_datatype_type rawFieldDatatypes[],
-    sensor_msgs::PointField::_count_type rawFieldCounts[],
+    const sensor_msgs::PointField::_offset_type rawFieldOffsets[],
+    const sensor_msgs::PointField::_datatype_type rawFieldDatatypes[],
+    const sensor_msgs::PointField::_count_type rawFieldCounts[],
     sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigendian,
     sensor_msgs::PointCloud2::_point_step_type rawPointStep,
     sensor_msgs::PointCloud2::_row_step_type rawRowStep,
     size_t rawDataLength,
     const uint8_t rawData[],
-    sensor_msgs::PointCloud2::_is_dense_type rawIsDense,
-    cras::allocator_t compressedTypeAllocator,
-    cras::allocator_t compressedMd5SumAllocator,
-    cras::allocator_t compressedDataAllocator,
-    size_t serializedConfigLength,
-    const uint8_t serializedConfig[],
-    cras::allocator_t errorStringAllocator,
-    cras::allocator_t logMessagesAllocator
-)
+    sensor_msgs::PointCloud2::_is_dense_type rawIsDense)
 {
-  dynamic_reconfigure::Config config;
-  if (serializedConfigLength > 0)
-  {
-    ros::serialization::IStream data(const_cast<uint8_t*>(serializedConfig), serializedConfigLength);
-    try
-    {
-      ros::serialization::deserialize(data, config);
-    }
-    catch (const ros::Exception& e)
-    {
-      cras::outputString(errorStringAllocator, cras::format("Could not deserialize encoder config: %s.", e.what()));
-      return false;
-    }
-  }
-  sensor_msgs::PointCloud2 raw;
   raw.height = rawHeight;
   raw.width = rawWidth;
+  raw.fields.resize(rawNumFields);
   for (size_t i = 0; i < rawNumFields; ++i)
   {
-    sensor_msgs::PointField field;
-    field.name = rawFieldNames[i];
-    field.offset = rawFieldOffsets[i];
-    field.datatype = rawFieldDatatypes[i];
-    field.count = rawFieldCounts[i];
-    raw.fields.push_back(field);
+    raw.fields[i].name = rawFieldNames[i];
+    raw.fields[i].offset = rawFieldOffsets[i];
+    raw.fields[i].datatype = rawFieldDatatypes[i];
+    raw.fields[i].count = rawFieldCounts[i];
   }
   raw.is_bigendian = rawIsBigendian;
   raw.point_step = rawPointStep;
   raw.row_step = rawRowStep;
-  raw.data.resize(rawDataLength);
-  memcpy(raw.data.data(), rawData, rawDataLength);
+  // The data vector keeps its capacity between the calls, and assign() does not zero-fill it like resize() would.
+  // sensor_msgs::PointCloud2 can't reference foreign memory, so this one copy of the raw data is unavoidable.
+  raw.data.assign(rawData, rawData + rawDataLength);
   raw.is_dense = rawIsDense;
+}
 
-  point_cloud_transport::globalLogger->clear();
+PublisherPlugin::EncodeResult encodeCloud(const char* codec, const sensor_msgs::PointCloud2& raw,
+                                          const dynamic_reconfigure::Config& config,
+                                          cras::allocator_t logMessagesAllocator)
+{
+  globalLogger->clear();
 
-  auto encoder = point_cloud_transport::point_cloud_transport_codec_instance.getEncoderByName(codec);
+  auto encoder = point_cloud_transport_codec_instance.getEncoderByName(codec);
   if (!encoder)
+    return cras::make_unexpected(std::string("Could not find encoder for ") + codec);
+
+  auto compressed = encoder->encode(raw, config);
+
+  for (const auto& msg : globalLogger->getMessages())
+    cras::outputRosMessage(logMessagesAllocator, msg);
+  globalLogger->clear();
+
+  return compressed;
+}
+
+SubscriberPlugin::DecodeResult decodeCloud(const char* topicOrCodec, const char* compressedType,
+                                           const char* compressedMd5sum, size_t compressedDataLength,
+                                           const uint8_t compressedData[], const dynamic_reconfigure::Config& config,
+                                           cras::allocator_t logMessagesAllocator)
+{
+  globalLogger->clear();
+
+  auto decoder = point_cloud_transport_codec_instance.getDecoderByTopic(topicOrCodec, compressedType);
+  if (!decoder)
+    decoder = point_cloud_transport_codec_instance.getDecoderByName(topicOrCodec);
+  if (!decoder)
+    return cras::make_unexpected(std::string("Could not find decoder for ") + topicOrCodec);
+
+  // The decoder reads the serialized message directly from the caller's buffer, without copying it.
+  auto res = decoder->decodeSerialized(compressedType, compressedMd5sum, compressedData, compressedDataLength, config);
+
+  for (const auto& msg : globalLogger->getMessages())
+    cras::outputRosMessage(logMessagesAllocator, msg);
+  globalLogger->clear();
+
+  return res;
+}
+
+void outputRawMetadata(
+    const sensor_msgs::PointCloud2& raw,
+    sensor_msgs::PointCloud2::_height_type& rawHeight,
+    sensor_msgs::PointCloud2::_width_type& rawWidth,
+    uint32_t& rawNumFields,
+    cras::allocator_t rawFieldNamesAllocator,
+    cras::allocator_t rawFieldOffsetsAllocator,
+    cras::allocator_t rawFieldDatatypesAllocator,
+    cras::allocator_t rawFieldCountsAllocator,
+    sensor_msgs::PointCloud2::_is_bigendian_type& rawIsBigEndian,
+    sensor_msgs::PointCloud2::_point_step_type& rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type& rawRowStep,
+    sensor_msgs::PointCloud2::_is_dense_type& rawIsDense)
+{
+  rawHeight = raw.height;
+  rawWidth = raw.width;
+  rawNumFields = raw.fields.size();
+  for (size_t i = 0; i < rawNumFields; ++i)
   {
-    cras::outputString(errorStringAllocator, std::string("Could not find encoder for ") + codec);
-    return false;
+    cras::outputString(rawFieldNamesAllocator, raw.fields[i].name);
+    cras::outputByteBuffer(rawFieldOffsetsAllocator, reinterpret_cast<const uint8_t*>(&raw.fields[i].offset), 4);
+    cras::outputByteBuffer(rawFieldDatatypesAllocator, reinterpret_cast<const uint8_t*>(&raw.fields[i].datatype), 1);
+    cras::outputByteBuffer(rawFieldCountsAllocator, reinterpret_cast<const uint8_t*>(&raw.fields[i].count), 4);
   }
+  rawIsBigEndian = raw.is_bigendian;
+  rawPointStep = raw.point_step;
+  rawRowStep = raw.row_step;
+  rawIsDense = raw.is_dense;
+}
 
-  const auto compressed = encoder->encode(raw, config);
-
-  for (const auto& msg : point_cloud_transport::globalLogger->getMessages())
+void outputLogMessages(cras::MemoryLogHelper& logger, cras::allocator_t logMessagesAllocator)
+{
+  for (const auto& msg : logger.getMessages())
     cras::outputRosMessage(logMessagesAllocator, msg);
-  point_cloud_transport::globalLogger->clear();
+  logger.clear();
+}
 
+//! \brief Output the result of encoding by an *EncodeInto() function.
+bool outputEncodedInto(PublisherPlugin::EncodeResult& compressed, CodecBuffers& buffers,
+                       cras::allocator_t compressedTypeAllocator, cras::allocator_t compressedMd5SumAllocator,
+                       size_t compressedDataCapacity, uint8_t compressedData[], size_t& compressedDataLength,
+                       cras::allocator_t errorStringAllocator)
+{
   if (!compressed)
   {
     cras::outputString(errorStringAllocator, compressed.error());
@@ -278,16 +710,18 @@ bool pointCloudTransportCodecsEncode(
 
   cras::outputString(compressedTypeAllocator, compressed.value()->getDataType());
   cras::outputString(compressedMd5SumAllocator, compressed.value()->getMD5Sum());
-  cras::outputByteBuffer(compressedDataAllocator, cras::getBuffer(compressed->value()), compressed.value()->size());
+  compressedDataLength = compressed.value()->size();
+  if (compressedDataLength <= compressedDataCapacity)
+    memcpy(compressedData, cras::getBuffer(compressed->value()), compressedDataLength);
+  else
+    buffers.lastEncoded = std::move(compressed.value());
   return true;
 }
 
-bool pointCloudTransportCodecsDecode(
-    const char* topicOrCodec,
-    const char* compressedType,
-    const char* compressedMd5sum,
-    size_t compressedDataLength,
-    const uint8_t compressedData[],
+//! \brief Output the result of decoding by a *DecodeInto() function.
+bool outputDecodedInto(
+    const SubscriberPlugin::DecodeResult& res,
+    CodecBuffers& buffers,
     sensor_msgs::PointCloud2::_height_type& rawHeight,
     sensor_msgs::PointCloud2::_width_type& rawWidth,
     uint32_t& rawNumFields,
@@ -298,54 +732,12 @@ bool pointCloudTransportCodecsDecode(
     sensor_msgs::PointCloud2::_is_bigendian_type& rawIsBigEndian,
     sensor_msgs::PointCloud2::_point_step_type& rawPointStep,
     sensor_msgs::PointCloud2::_row_step_type& rawRowStep,
-    cras::allocator_t rawDataAllocator,
+    size_t rawDataCapacity,
+    uint8_t rawData[],
+    size_t& rawDataLength,
     sensor_msgs::PointCloud2::_is_dense_type& rawIsDense,
-    size_t serializedConfigLength,
-    const uint8_t serializedConfig[],
-    cras::allocator_t errorStringAllocator,
-    cras::allocator_t logMessagesAllocator
-)
+    cras::allocator_t errorStringAllocator)
 {
-  dynamic_reconfigure::Config config;
-  if (serializedConfigLength > 0)
-  {
-    ros::serialization::IStream data(const_cast<uint8_t*>(serializedConfig), serializedConfigLength);
-    try
-    {
-      ros::serialization::deserialize(data, config);
-    }
-    catch (const ros::Exception& e)
-    {
-      cras::outputString(errorStringAllocator, cras::format("Could not deserialize decoder config: %s.", e.what()));
-      return false;
-    }
-  }
-
-  topic_tools::ShapeShifter compressed;
-  compressed.morph(compressedMd5sum, compressedType, "", "");
-  cras::resizeBuffer(compressed, compressedDataLength);
-  memcpy(cras::getBuffer(compressed), compressedData, compressedDataLength);
-
-  point_cloud_transport::globalLogger->clear();
-
-  auto decoder = point_cloud_transport::point_cloud_transport_codec_instance.getDecoderByTopic(
-      topicOrCodec, compressedType);
-  if (!decoder)
-  {
-    decoder = point_cloud_transport::point_cloud_transport_codec_instance.getDecoderByName(topicOrCodec);
-  }
-  if (!decoder)
-  {
-    cras::outputString(errorStringAllocator, std::string("Could not find decoder for ") + topicOrCodec);
-    return false;
-  }
-
-  const auto res = decoder->decode(compressed, config);
-
-  for (const auto& msg : point_cloud_transport::globalLogger->getMessages())
-    cras::outputRosMessage(logMessagesAllocator, msg);
-  point_cloud_transport::globalLogger->clear();
-
   if (!res)
   {
     cras::outputString(errorStringAllocator, res.error());
@@ -359,20 +751,737 @@ bool pointCloudTransportCodecsDecode(
 
   const auto& raw = res->value();
 
-  rawHeight = raw->height;
-  rawWidth = raw->width;
-  rawNumFields = raw->fields.size();
-  for (size_t i = 0; i < rawNumFields; ++i)
-  {
-    cras::outputString(rawFieldNamesAllocator, raw->fields[i].name);
-    cras::outputByteBuffer(rawFieldOffsetsAllocator, reinterpret_cast<const uint8_t*>(&raw->fields[i].offset), 4);
-    cras::outputByteBuffer(rawFieldDatatypesAllocator, reinterpret_cast<const uint8_t*>(&raw->fields[i].datatype), 1);
-    cras::outputByteBuffer(rawFieldCountsAllocator, reinterpret_cast<const uint8_t*>(&raw->fields[i].count), 4);
-  }
-  rawIsBigEndian = raw->is_bigendian;
-  rawPointStep = raw->point_step;
-  rawRowStep = raw->row_step;
-  cras::outputByteBuffer(rawDataAllocator, raw->data);
-  rawIsDense = raw->is_dense;
+  outputRawMetadata(*raw, rawHeight, rawWidth, rawNumFields, rawFieldNamesAllocator, rawFieldOffsetsAllocator,
+    rawFieldDatatypesAllocator, rawFieldCountsAllocator, rawIsBigEndian, rawPointStep, rawRowStep, rawIsDense);
+  rawDataLength = raw->data.size();
+  if (rawDataLength <= rawDataCapacity)
+    memcpy(rawData, raw->data.data(), rawDataLength);
+  else
+    buffers.lastDecoded = raw;
+  return true;
+}
+
+}
+
+}
+
+bool pointCloudTransportCodecsEncode(
+    const char* codec,
+    sensor_msgs::PointCloud2::_height_type rawHeight,
+    sensor_msgs::PointCloud2::_width_type rawWidth,
+    size_t rawNumFields,
+    const char* rawFieldNames[],
+    sensor_msgs::PointField::_offset_type rawFieldOffsets[],
+    sensor_msgs::PointField::_datatype_type rawFieldDatatypes[],
+    sensor_msgs::PointField::_count_type rawFieldCounts[],
+    sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigendian,
+    sensor_msgs::PointCloud2::_point_step_type rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type rawRowStep,
+    size_t rawDataLength,
+    const uint8_t rawData[],
+    sensor_msgs::PointCloud2::_is_dense_type rawIsDense,
+    cras::allocator_t compressedTypeAllocator,
+    cras::allocator_t compressedMd5SumAllocator,
+    cras::allocator_t compressedDataAllocator,
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+)
+{
+  dynamic_reconfigure::Config config;
+  if (!point_cloud_transport::deserializeConfig(
+      serializedConfigLength, serializedConfig, config, "encoder", errorStringAllocator))
+    return false;
+
+  auto& raw = point_cloud_transport::codecBuffers.raw;
+  point_cloud_transport::fillRawCloud(raw, rawHeight, rawWidth, rawNumFields, rawFieldNames, rawFieldOffsets,
+    rawFieldDatatypes, rawFieldCounts, rawIsBigendian, rawPointStep, rawRowStep, rawDataLength, rawData, rawIsDense);
+
+  const auto compressed = point_cloud_transport::encodeCloud(codec, raw, config, logMessagesAllocator);
+
+  if (!compressed)
+  {
+    cras::outputString(errorStringAllocator, compressed.error());
+    return false;
+  }
+  if (!compressed.value())
+  {
+    return true;
+  }
+
+  cras::outputString(compressedTypeAllocator, compressed.value()->getDataType());
+  cras::outputString(compressedMd5SumAllocator, compressed.value()->getMD5Sum());
+  cras::outputByteBuffer(compressedDataAllocator, cras::getBuffer(compressed->value()), compressed.value()->size());
+  return true;
+}
+
+bool pointCloudTransportCodecsEncodeInto(
+    const char* codec,
+    sensor_msgs::PointCloud2::_height_type rawHeight,
+    sensor_msgs::PointCloud2::_width_type rawWidth,
+    size_t rawNumFields,
+    const char* rawFieldNames[],
+    sensor_msgs::PointField::_offset_type rawFieldOffsets[],
+    sensor_msgs::PointField::_datatype_type rawFieldDatatypes[],
+    sensor_msgs::PointField::_count_type rawFieldCounts[],
+    sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigendian,
+    sensor_msgs::PointCloud2::_point_step_type rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type rawRowStep,
+    size_t rawDataLength,
+    const uint8_t rawData[],
+    sensor_msgs::PointCloud2::_is_dense_type rawIsDense,
+    cras::allocator_t compressedTypeAllocator,
+    cras::allocator_t compressedMd5SumAllocator,
+    size_t compressedDataCapacity,
+    uint8_t compressedData[],
+    size_t& compressedDataLength,
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+)
+{
+  auto& buffers = point_cloud_transport::codecBuffers;
+  buffers.lastEncoded.reset();
+  compressedDataLength = 0;
+
+  dynamic_reconfigure::Config config;
+  if (!point_cloud_transport::deserializeConfig(
+      serializedConfigLength, serializedConfig, config, "encoder", errorStringAllocator))
+    return false;
+
+  auto& raw = point_cloud_transport::codecBuffers.raw;
+  point_cloud_transport::fillRawCloud(raw, rawHeight, rawWidth, rawNumFields, rawFieldNames, rawFieldOffsets,
+    rawFieldDatatypes, rawFieldCounts, rawIsBigendian, rawPointStep, rawRowStep, rawDataLength, rawData, rawIsDense);
+
+  auto compressed = point_cloud_transport::encodeCloud(codec, raw, config, logMessagesAllocator);
+
+  return point_cloud_transport::outputEncodedInto(compressed, buffers, compressedTypeAllocator,
+    compressedMd5SumAllocator, compressedDataCapacity, compressedData, compressedDataLength, errorStringAllocator);
+}
+
+bool pointCloudTransportCodecsGetLastEncodedData(size_t compressedDataCapacity, uint8_t compressedData[])
+{
+  auto& lastEncoded = point_cloud_transport::codecBuffers.lastEncoded;
+  if (!lastEncoded || lastEncoded->size() > compressedDataCapacity)
+    return false;
+
+  memcpy(compressedData, cras::getBuffer(*lastEncoded), lastEncoded->size());
+  lastEncoded.reset();
+  return true;
+}
+
+bool pointCloudTransportCodecsDecode(
+    const char* topicOrCodec,
+    const char* compressedType,
+    const char* compressedMd5sum,
+    size_t compressedDataLength,
+    const uint8_t compressedData[],
+    sensor_msgs::PointCloud2::_height_type& rawHeight,
+    sensor_msgs::PointCloud2::_width_type& rawWidth,
+    uint32_t& rawNumFields,
+    cras::allocator_t rawFieldNamesAllocator,
+    cras::allocator_t rawFieldOffsetsAllocator,
+    cras::allocator_t rawFieldDatatypesAllocator,
+    cras::allocator_t rawFieldCountsAllocator,
+    sensor_msgs::PointCloud2::_is_bigendian_type& rawIsBigEndian,
+    sensor_msgs::PointCloud2::_point_step_type& rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type& rawRowStep,
+    cras::allocator_t rawDataAllocator,
+    sensor_msgs::PointCloud2::_is_dense_type& rawIsDense,
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+)
+{
+  dynamic_reconfigure::Config config;
+  if (!point_cloud_transport::deserializeConfig(
+      serializedConfigLength, serializedConfig, config, "decoder", errorStringAllocator))
+    return false;
+
+  const auto res = point_cloud_transport::decodeCloud(topicOrCodec, compressedType, compressedMd5sum,
+    compressedDataLength, compressedData, config, logMessagesAllocator);
+
+  if (!res)
+  {
+    cras::outputString(errorStringAllocator, res.error());
+    return false;
+  }
+
+  if (!res.value())
+  {
+    return true;
+  }
+
+  const auto& raw = res->value();
+
+  point_cloud_transport::outputRawMetadata(*raw, rawHeight, rawWidth, rawNumFields, rawFieldNamesAllocator,
+    rawFieldOffsetsAllocator, rawFieldDatatypesAllocator, rawFieldCountsAllocator, rawIsBigEndian, rawPointStep,
+    rawRowStep, rawIsDense);
+  cras::outputByteBuffer(rawDataAllocator, raw->data);
+  return true;
+}
+
+bool pointCloudTransportCodecsDecodeInto(
+    const char* topicOrCodec,
+    const char* compressedType,
+    const char* compressedMd5sum,
+    size_t compressedDataLength,
+    const uint8_t compressedData[],
+    sensor_msgs::PointCloud2::_height_type& rawHeight,
+    sensor_msgs::PointCloud2::_width_type& rawWidth,
+    uint32_t& rawNumFields,
+    cras::allocator_t rawFieldNamesAllocator,
+    cras::allocator_t rawFieldOffsetsAllocator,
+    cras::allocator_t rawFieldDatatypesAllocator,
+    cras::allocator_t rawFieldCountsAllocator,
+    sensor_msgs::PointCloud2::_is_bigendian_type& rawIsBigEndian,
+    sensor_msgs::PointCloud2::_point_step_type& rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type& rawRowStep,
+    size_t rawDataCapacity,
+    uint8_t rawData[],
+    size_t& rawDataLength,
+    sensor_msgs::PointCloud2::_is_dense_type& rawIsDense,
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+)
+{
+  auto& buffers = point_cloud_transport::codecBuffers;
+  buffers.lastDecoded.reset();
+  rawDataLength = 0;
+
+  dynamic_reconfigure::Config config;
+  if (!point_cloud_transport::deserializeConfig(
+      serializedConfigLength, serializedConfig, config, "decoder", errorStringAllocator))
+    return false;
+
+  const auto res = point_cloud_transport::decodeCloud(topicOrCodec, compressedType, compressedMd5sum,
+    compressedDataLength, compressedData, config, logMessagesAllocator);
+
+  return point_cloud_transport::outputDecodedInto(res, buffers, rawHeight, rawWidth, rawNumFields,
+    rawFieldNamesAllocator, rawFieldOffsetsAllocator, rawFieldDatatypesAllocator, rawFieldCountsAllocator,
+    rawIsBigEndian, rawPointStep, rawRowStep, rawDataCapacity, rawData, rawDataLength, rawIsDense,
+    errorStringAllocator);
+}
+
+bool pointCloudTransportCodecsGetLastDecodedData(size_t rawDataCapacity, uint8_t rawData[])
+{
+  auto& lastDecoded = point_cloud_transport::codecBuffers.lastDecoded;
+  if (!lastDecoded || lastDecoded->data.size() > rawDataCapacity)
+    return false;
+
+  memcpy(rawData, lastDecoded->data.data(), lastDecoded->data.size());
+  lastDecoded.reset();
+  return true;
+}
+
+bool pointCloudTransportCodecsEncodeBatch(
+    const char* codec,
+    size_t numClouds,
+    const sensor_msgs::PointCloud2::_height_type rawHeight[],
+    const sensor_msgs::PointCloud2::_width_type rawWidth[],
+    const size_t rawNumFields[],
+    const char* rawFieldNames[],
+    const sensor_msgs::PointField::_offset_type rawFieldOffsets[],
+    const sensor_msgs::PointField::_datatype_type rawFieldDatatypes[],
+    const sensor_msgs::PointField::_count_type rawFieldCounts[],
+    const sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigendian[],
+    const sensor_msgs::PointCloud2::_point_step_type rawPointStep[],
+    const sensor_msgs::PointCloud2::_row_step_type rawRowStep[],
+    const size_t rawDataLength[],
+    const uint8_t* rawData[],
+    const sensor_msgs::PointCloud2::_is_dense_type rawIsDense[],
+    cras::allocator_t compressedTypeAllocator,
+    cras::allocator_t compressedMd5SumAllocator,
+    cras::allocator_t compressedDataAllocator,
+    bool success[],
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    size_t numThreads,
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+)
+{
+  // The config is parsed only once for the whole batch.
+  dynamic_reconfigure::Config config;
+  if (!point_cloud_transport::deserializeConfig(
+      serializedConfigLength, serializedConfig, config, "encoder", errorStringAllocator))
+    return false;
+
+  auto& codecInstance = point_cloud_transport::point_cloud_transport_codec_instance;
+  const auto foundEncoder = codecInstance.getEncoderByName(codec);
+  if (!foundEncoder)
+  {
+    cras::outputString(errorStringAllocator, std::string("Could not find encoder for ") + codec);
+    return false;
+  }
+
+  std::vector<size_t> fieldsStart(numClouds + 1, 0);
+  for (size_t i = 0; i < numClouds; ++i)
+    fieldsStart[i + 1] = fieldsStart[i] + rawNumFields[i];
+
+  const auto makeRawClouds = [&](size_t begin, size_t end)
+  {
+    std::vector<sensor_msgs::PointCloud2ConstPtr> raw;
+    raw.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i)
+    {
+      const auto cloud = boost::make_shared<sensor_msgs::PointCloud2>();
+      const auto f = fieldsStart[i];
+      point_cloud_transport::fillRawCloud(*cloud, rawHeight[i], rawWidth[i], rawNumFields[i], rawFieldNames + f,
+        rawFieldOffsets + f, rawFieldDatatypes + f, rawFieldCounts + f, rawIsBigendian[i], rawPointStep[i],
+        rawRowStep[i], rawDataLength[i], rawData[i], rawIsDense[i]);
+      raw.push_back(cloud);
+    }
+    return raw;
+  };
+
+  std::vector<point_cloud_transport::PublisherPlugin::EncodeResult> results(numClouds);
+  std::vector<std::vector<rosgraph_msgs::Log>> logs(numClouds);
+
+  if (foundEncoder->isStateful())
+  {
+    // Each cloud refers to the one encoded before it, so the whole batch is encoded in order by the codec of this
+    // thread (the one pointCloudTransportCodecsEncode() uses), which holds its lock for stateful encoders meanwhile.
+    auto& logger = point_cloud_transport::globalLogger;
+    logger->clear();
+    auto batchResults = codecInstance.encodeBatch(codec, makeRawClouds(0, numClouds), config);
+    if (!batchResults)
+    {
+      cras::outputString(errorStringAllocator, batchResults.error());
+      return false;
+    }
+    results = std::move(*batchResults);
+    if (numClouds > 0)
+      logs[0] = logger->getMessages();
+    logger->clear();
+  }
+  else
+  {
+    // Each worker thread uses its own thread-local codec (with its own plugin instances) and logger.
+    auto& batchPool = point_cloud_transport::getCApiBatchPool();
+    point_cloud_transport::parallelFor(batchPool, numClouds, numThreads, [&](size_t begin, size_t end)
+    {
+      auto& logger = point_cloud_transport::globalLogger;
+      logger->clear();
+
+      const auto raw = makeRawClouds(begin, end);
+
+      const auto encoder = point_cloud_transport::point_cloud_transport_codec_instance.getEncoderByName(codec);
+      if (!encoder)
+      {
+        for (size_t i = begin; i < end; ++i)
+          results[i] = cras::make_unexpected(std::string("Could not find encoder for ") + codec);
+        return;
+      }
+
+      auto chunkResults = encoder->encodeBatch(raw, config);
+      std::move(chunkResults.begin(), chunkResults.end(), results.begin() + begin);
+
+      logs[begin] = logger->getMessages();
+      logger->clear();
+    });
+  }
+
+  for (size_t i = 0; i < numClouds; ++i)
+  {
+    for (const auto& msg : logs[i])
+      cras::outputRosMessage(logMessagesAllocator, msg);
+
+    const auto& compressed = results[i];
+    success[i] = static_cast<bool>(compressed);
+    cras::outputString(errorStringAllocator, compressed ? std::string() : compressed.error());
+    if (compressed && compressed.value())
+    {
+      cras::outputString(compressedTypeAllocator, compressed.value()->getDataType());
+      cras::outputString(compressedMd5SumAllocator, compressed.value()->getMD5Sum());
+      cras::outputByteBuffer(compressedDataAllocator, cras::getBuffer(compressed->value()),
+                             compressed.value()->size());
+    }
+    else
+    {
+      cras::outputString(compressedTypeAllocator, "");
+      cras::outputString(compressedMd5SumAllocator, "");
+      cras::outputByteBuffer(compressedDataAllocator, nullptr, 0);
+    }
+  }
+  return true;
+}
+
+bool pointCloudTransportCodecsDecodeBatch(
+    const char* topicOrCodec,
+    size_t numClouds,
+    const char* compressedType[],
+    const char* compressedMd5sum[],
+    const size_t compressedDataLength[],
+    const uint8_t* compressedData[],
+    sensor_msgs::PointCloud2::_height_type rawHeight[],
+    sensor_msgs::PointCloud2::_width_type rawWidth[],
+    uint32_t rawNumFields[],
+    cras::allocator_t rawFieldNamesAllocator,
+    cras::allocator_t rawFieldOffsetsAllocator,
+    cras::allocator_t rawFieldDatatypesAllocator,
+    cras::allocator_t rawFieldCountsAllocator,
+    sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigEndian[],
+    sensor_msgs::PointCloud2::_point_step_type rawPointStep[],
+    sensor_msgs::PointCloud2::_row_step_type rawRowStep[],
+    cras::allocator_t rawDataAllocator,
+    sensor_msgs::PointCloud2::_is_dense_type rawIsDense[],
+    bool success[],
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    size_t numThreads,
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+)
+{
+  if (numClouds == 0)
+    return true;
+
+  dynamic_reconfigure::Config config;
+  if (!point_cloud_transport::deserializeConfig(
+      serializedConfigLength, serializedConfig, config, "decoder", errorStringAllocator))
+    return false;
+
+  // The decoder is selected by the type of the first cloud.
+  const auto findDecoder = [&]()
+  {
+    auto& codecInstance = point_cloud_transport::point_cloud_transport_codec_instance;
+    auto decoder = codecInstance.getDecoderByTopic(topicOrCodec, compressedType[0]);
+    if (!decoder)
+      decoder = codecInstance.getDecoderByName(topicOrCodec);
+    return decoder;
+  };
+
+  const auto foundDecoder = findDecoder();
+  if (!foundDecoder)
+  {
+    cras::outputString(errorStringAllocator, std::string("Could not find decoder for ") + topicOrCodec);
+    return false;
+  }
+
+  const auto makeCompressedClouds = [&](size_t begin, size_t end)
+  {
+    std::vector<topic_tools::ShapeShifter::ConstPtr> compressed;
+    compressed.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i)
+    {
+      const auto shifter = boost::make_shared<topic_tools::ShapeShifter>();
+      shifter->morph(compressedMd5sum[i], compressedType[i], "", "");
+      cras::resizeBuffer(*shifter, compressedDataLength[i]);
+      memcpy(cras::getBuffer(*shifter), compressedData[i], compressedDataLength[i]);
+      compressed.push_back(shifter);
+    }
+    return compressed;
+  };
+
+  std::vector<point_cloud_transport::SubscriberPlugin::DecodeResult> results(numClouds);
+  std::vector<std::vector<rosgraph_msgs::Log>> logs(numClouds);
+
+  if (foundDecoder->isStateful())
+  {
+    // Each cloud may refer to the one decoded before it, so the whole batch is decoded in order by the codec of this
+    // thread (the one pointCloudTransportCodecsDecode() uses), which holds its lock for stateful decoders meanwhile.
+    auto& logger = point_cloud_transport::globalLogger;
+    logger->clear();
+    auto batchResults = point_cloud_transport::point_cloud_transport_codec_instance.decodeBatch(
+      topicOrCodec, makeCompressedClouds(0, numClouds), config);
+    if (!batchResults)
+    {
+      cras::outputString(errorStringAllocator, batchResults.error());
+      return false;
+    }
+    results = std::move(*batchResults);
+    logs[0] = logger->getMessages();
+    logger->clear();
+  }
+  else
+  {
+    // Each worker thread uses its own thread-local codec (with its own plugin instances) and logger.
+    auto& batchPool = point_cloud_transport::getCApiBatchPool();
+    point_cloud_transport::parallelFor(batchPool, numClouds, numThreads, [&](size_t begin, size_t end)
+    {
+      auto& logger = point_cloud_transport::globalLogger;
+      logger->clear();
+
+      const auto compressed = makeCompressedClouds(begin, end);
+
+      const auto decoder = findDecoder();
+      if (!decoder)
+      {
+        for (size_t i = begin; i < end; ++i)
+          results[i] = cras::make_unexpected(std::string("Could not find decoder for ") + topicOrCodec);
+        return;
+      }
+
+      auto chunkResults = decoder->decodeBatch(compressed, config);
+      std::move(chunkResults.begin(), chunkResults.end(), results.begin() + begin);
+
+      logs[begin] = logger->getMessages();
+      logger->clear();
+    });
+  }
+
+  for (size_t i = 0; i < numClouds; ++i)
+  {
+    for (const auto& msg : logs[i])
+      cras::outputRosMessage(logMessagesAllocator, msg);
+
+    const auto& res = results[i];
+    success[i] = static_cast<bool>(res);
+    cras::outputString(errorStringAllocator, res ? std::string() : res.error());
+    if (res && res.value())
+    {
+      uint32_t numFields;
+      point_cloud_transport::outputRawMetadata(*res->value(), rawHeight[i], rawWidth[i], numFields,
+        rawFieldNamesAllocator, rawFieldOffsetsAllocator, rawFieldDatatypesAllocator, rawFieldCountsAllocator,
+        rawIsBigEndian[i], rawPointStep[i], rawRowStep[i], rawIsDense[i]);
+      rawNumFields[i] = numFields;
+      cras::outputByteBuffer(rawDataAllocator, res->value()->data);
+    }
+    else
+    {
+      rawHeight[i] = rawWidth[i] = rawNumFields[i] = rawPointStep[i] = rawRowStep[i] = 0;
+      rawIsBigEndian[i] = rawIsDense[i] = 0;
+      cras::outputByteBuffer(rawDataAllocator, nullptr, 0);
+    }
+  }
+  return true;
+}
+
+bool pointCloudTransportCodecsTranscode(
+    const char* topicOrCodec,
+    const char* compressedType,
+    const char* compressedMd5sum,
+    size_t compressedDataLength,
+    const uint8_t compressedData[],
+    const char* codec,
+    cras::allocator_t transcodedTypeAllocator,
+    cras::allocator_t transcodedMd5SumAllocator,
+    cras::allocator_t transcodedDataAllocator,
+    size_t serializedEncoderConfigLength,
+    const uint8_t serializedEncoderConfig[],
+    size_t serializedDecoderConfigLength,
+    const uint8_t serializedDecoderConfig[],
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+)
+{
+  dynamic_reconfigure::Config encoderConfig;
+  if (!point_cloud_transport::deserializeConfig(
+      serializedEncoderConfigLength, serializedEncoderConfig, encoderConfig, "encoder", errorStringAllocator))
+    return false;
+  dynamic_reconfigure::Config decoderConfig;
+  if (!point_cloud_transport::deserializeConfig(
+      serializedDecoderConfigLength, serializedDecoderConfig, decoderConfig, "decoder", errorStringAllocator))
+    return false;
+
+  auto& codecInstance = point_cloud_transport::point_cloud_transport_codec_instance;
+  auto& logger = *point_cloud_transport::globalLogger;
+  logger.clear();
+
+  // Pass the input through without even copying it into the shapeshifter when transcoding would not change it.
+  auto decoder = codecInstance.getDecoderByTopic(topicOrCodec, compressedType);
+  if (!decoder)
+    decoder = codecInstance.getDecoderByName(topicOrCodec);
+  const auto encoder = codecInstance.getEncoderByName(codec);
+  if (decoder && encoder && point_cloud_transport::PointCloudCodec::isPassThrough(*decoder, *encoder, encoderConfig))
+  {
+    point_cloud_transport::outputLogMessages(logger, logMessagesAllocator);
+    cras::outputString(transcodedTypeAllocator, compressedType);
+    cras::outputString(transcodedMd5SumAllocator, compressedMd5sum);
+    cras::outputByteBuffer(transcodedDataAllocator, compressedData, compressedDataLength);
+    return true;
+  }
+
+  auto& compressed = point_cloud_transport::codecBuffers.compressed;
+  compressed.morph(compressedMd5sum, compressedType, "", "");
+  cras::resizeBuffer(compressed, compressedDataLength);
+  memcpy(cras::getBuffer(compressed), compressedData, compressedDataLength);
+
+  const auto transcoded = codecInstance.transcode(compressed, topicOrCodec, codec, encoderConfig, decoderConfig);
+  point_cloud_transport::outputLogMessages(logger, logMessagesAllocator);
+
+  if (!transcoded)
+  {
+    cras::outputString(errorStringAllocator, transcoded.error());
+    return false;
+  }
+  if (!transcoded.value())
+  {
+    return true;
+  }
+
+  cras::outputString(transcodedTypeAllocator, transcoded.value()->getDataType());
+  cras::outputString(transcodedMd5SumAllocator, transcoded.value()->getMD5Sum());
+  cras::outputByteBuffer(transcodedDataAllocator, cras::getBuffer(transcoded->value()), transcoded.value()->size());
+  return true;
+}
+
+point_cloud_transport::CodecContext* pointCloudTransportCodecsCreateContext(const char* topicOrCodec)
+{
+  auto context = std::make_unique<point_cloud_transport::CodecContext>(topicOrCodec);
+  // Names with a slash may be topics whose decoder can only be found by the type of the messages.
+  const std::string name = topicOrCodec;
+  context->encoder = context->codec.getEncoderByName(name);
+  if (!context->encoder && !context->codec.getDecoderByName(name) && name.find('/') == std::string::npos)
+    return nullptr;
+  return context.release();
+}
+
+void pointCloudTransportCodecsDestroyContext(point_cloud_transport::CodecContext* context)
+{
+  delete context;
+}
+
+bool pointCloudTransportCodecsContextSetConfig(
+    point_cloud_transport::CodecContext* context,
+    size_t serializedConfigLength,
+    const uint8_t serializedConfig[],
+    cras::allocator_t errorStringAllocator
+)
+{
+  std::lock_guard<std::mutex> lock(context->mutex);
+  dynamic_reconfigure::Config config;
+  if (!point_cloud_transport::deserializeConfig(
+      serializedConfigLength, serializedConfig, config, "codec", errorStringAllocator))
+    return false;
+
+  context->config = std::move(config);
+  return true;
+}
+
+bool pointCloudTransportCodecsContextEncodeInto(
+    point_cloud_transport::CodecContext* context,
+    sensor_msgs::PointCloud2::_height_type rawHeight,
+    sensor_msgs::PointCloud2::_width_type rawWidth,
+    size_t rawNumFields,
+    const char* rawFieldNames[],
+    sensor_msgs::PointField::_offset_type rawFieldOffsets[],
+    sensor_msgs::PointField::_datatype_type rawFieldDatatypes[],
+    sensor_msgs::PointField::_count_type rawFieldCounts[],
+    sensor_msgs::PointCloud2::_is_bigendian_type rawIsBigendian,
+    sensor_msgs::PointCloud2::_point_step_type rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type rawRowStep,
+    size_t rawDataLength,
+    const uint8_t rawData[],
+    sensor_msgs::PointCloud2::_is_dense_type rawIsDense,
+    cras::allocator_t compressedTypeAllocator,
+    cras::allocator_t compressedMd5SumAllocator,
+    size_t compressedDataCapacity,
+    uint8_t compressedData[],
+    size_t& compressedDataLength,
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+)
+{
+  std::lock_guard<std::mutex> lock(context->mutex);
+  auto& buffers = context->buffers;
+  buffers.lastEncoded.reset();
+  compressedDataLength = 0;
+
+  if (!context->encoder)
+    context->encoder = context->codec.getEncoderByName(context->topicOrCodec);
+  if (!context->encoder)
+  {
+    point_cloud_transport::outputLogMessages(*context->logger, logMessagesAllocator);
+    cras::outputString(errorStringAllocator, "Could not find encoder for " + context->topicOrCodec);
+    return false;
+  }
+
+  point_cloud_transport::fillRawCloud(buffers.raw, rawHeight, rawWidth, rawNumFields, rawFieldNames, rawFieldOffsets,
+    rawFieldDatatypes, rawFieldCounts, rawIsBigendian, rawPointStep, rawRowStep, rawDataLength, rawData, rawIsDense);
+
+  auto compressed = context->encoder->encode(buffers.raw, context->config);
+  point_cloud_transport::outputLogMessages(*context->logger, logMessagesAllocator);
+
+  return point_cloud_transport::outputEncodedInto(compressed, buffers, compressedTypeAllocator,
+    compressedMd5SumAllocator, compressedDataCapacity, compressedData, compressedDataLength, errorStringAllocator);
+}
+
+bool pointCloudTransportCodecsContextGetLastEncodedData(
+    point_cloud_transport::CodecContext* context, size_t compressedDataCapacity, uint8_t compressedData[])
+{
+  std::lock_guard<std::mutex> lock(context->mutex);
+  auto& lastEncoded = context->buffers.lastEncoded;
+  if (!lastEncoded || lastEncoded->size() > compressedDataCapacity)
+    return false;
+
+  memcpy(compressedData, cras::getBuffer(*lastEncoded), lastEncoded->size());
+  lastEncoded.reset();
+  return true;
+}
+
+bool pointCloudTransportCodecsContextDecodeInto(
+    point_cloud_transport::CodecContext* context,
+    const char* compressedType,
+    const char* compressedMd5sum,
+    size_t compressedDataLength,
+    const uint8_t compressedData[],
+    sensor_msgs::PointCloud2::_height_type& rawHeight,
+    sensor_msgs::PointCloud2::_width_type& rawWidth,
+    uint32_t& rawNumFields,
+    cras::allocator_t rawFieldNamesAllocator,
+    cras::allocator_t rawFieldOffsetsAllocator,
+    cras::allocator_t rawFieldDatatypesAllocator,
+    cras::allocator_t rawFieldCountsAllocator,
+    sensor_msgs::PointCloud2::_is_bigendian_type& rawIsBigEndian,
+    sensor_msgs::PointCloud2::_point_step_type& rawPointStep,
+    sensor_msgs::PointCloud2::_row_step_type& rawRowStep,
+    size_t rawDataCapacity,
+    uint8_t rawData[],
+    size_t& rawDataLength,
+    sensor_msgs::PointCloud2::_is_dense_type& rawIsDense,
+    cras::allocator_t errorStringAllocator,
+    cras::allocator_t logMessagesAllocator
+)
+{
+  std::lock_guard<std::mutex> lock(context->mutex);
+  auto& buffers = context->buffers;
+  buffers.lastDecoded.reset();
+  rawDataLength = 0;
+
+  if (!context->decoder || context->decoderType != compressedType)
+  {
+    context->decoderType = compressedType;
+    context->decoder = context->codec.getDecoderByTopic(context->topicOrCodec, compressedType);
+    if (!context->decoder)
+      context->decoder = context->codec.getDecoderByName(context->topicOrCodec);
+    // The decoded cloud is released right after copying it out (or after the next call if it did not fit), so two
+    // pooled clouds are enough to never reallocate the output buffers.
+    if (context->decoder)
+      context->decoder->setPointCloudPool(context->pool);
+  }
+  if (!context->decoder)
+  {
+    point_cloud_transport::outputLogMessages(*context->logger, logMessagesAllocator);
+    cras::outputString(errorStringAllocator, "Could not find decoder for " + context->topicOrCodec);
+    return false;
+  }
+
+  const auto res = context->decoder->decodeSerialized(
+    compressedType, compressedMd5sum, compressedData, compressedDataLength, context->config);
+  point_cloud_transport::outputLogMessages(*context->logger, logMessagesAllocator);
+
+  return point_cloud_transport::outputDecodedInto(res, buffers, rawHeight, rawWidth, rawNumFields,
+    rawFieldNamesAllocator, rawFieldOffsetsAllocator, rawFieldDatatypesAllocator, rawFieldCountsAllocator,
+    rawIsBigEndian, rawPointStep, rawRowStep, rawDataCapacity, rawData, rawDataLength, rawIsDense,
+    errorStringAllocator);
+}
+
+bool pointCloudTransportCodecsContextGetLastDecodedData(
+    point_cloud_transport::CodecContext* context, size_t rawDataCapacity, uint8_t rawData[])
+{
+  std::lock_guard<std::mutex> lock(context->mutex);
+  auto& lastDecoded = context->buffers.lastDecoded;
+  if (!lastDecoded || lastDecoded->data.size() > rawDataCapacity)
+    return false;
+
+  memcpy(rawData, lastDecoded->data.data(), lastDecoded->data.size());
+  lastDecoded.reset();
   return true;
 }
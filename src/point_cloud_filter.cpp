@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Cropping of point clouds to a box and voxel downsampling.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+
+#include <cras_cpp_common/expected.hpp>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_filter.h>
+#include <point_cloud_transport/point_cloud_pool.h>
+
+namespace point_cloud_transport
+{
+
+namespace
+{
+
+//! \brief Find the offset of a FLOAT32 field with the given name.
+bool getFloatField(const sensor_msgs::PointCloud2& cloud, const std::string& name, uint32_t& offset)
+{
+  for (const auto& f : cloud.fields)
+  {
+    if (f.name == name && f.datatype == sensor_msgs::PointField::FLOAT32 && f.count == 1 &&
+        f.offset + sizeof(float) <= cloud.point_step)
+    {
+      offset = f.offset;
+      return true;
+    }
+  }
+  return false;
+}
+
+float readFloat(const uint8_t* data)
+{
+  float value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+//! \brief Index of the voxel containing the coordinate. Indices not representable by int64_t are clamped, as converting
+//!        them would be undefined.
+int64_t voxelIndex(float coord, double inv_size)
+{
+  // 2^52 - 1, so that the clamped indices of both signs differ in the packed bits.
+  const double limit = 4503599627370495.0;
+  return static_cast<int64_t>(std::floor(std::max(-limit, std::min(limit, coord * inv_size))));
+}
+
+//! \brief Pack the lowest 21 bits of the voxel indices into one 64-bit key.
+uint64_t voxelKey(float x, float y, float z, double inv_size)
+{
+  const auto ix = static_cast<uint64_t>(voxelIndex(x, inv_size));
+  const auto iy = static_cast<uint64_t>(voxelIndex(y, inv_size));
+  const auto iz = static_cast<uint64_t>(voxelIndex(z, inv_size));
+  const uint64_t mask = (1ull << 21) - 1;
+  return ((ix & mask) << 42) | ((iy & mask) << 21) | (iz & mask);
+}
+
+}
+
+cras::expected<sensor_msgs::PointCloud2Ptr, std::string> filterCloud(
+  const sensor_msgs::PointCloud2& cloud, const CloudFilterOptions& options, PointCloudPool* pool)
+{
+  uint32_t x_offset, y_offset, z_offset;
+  if (!getFloatField(cloud, "x", x_offset) || !getFloatField(cloud, "y", y_offset) ||
+      !getFloatField(cloud, "z", z_offset))
+    return cras::make_unexpected(std::string("The cloud has no FLOAT32 fields x, y and z."));
+
+  const size_t num_points = static_cast<size_t>(cloud.height) * cloud.width;
+  if (num_points > 0 && (cloud.row_step < static_cast<size_t>(cloud.width) * cloud.point_step ||
+                         cloud.data.size() < static_cast<size_t>(cloud.height - 1) * cloud.row_step +
+                                             static_cast<size_t>(cloud.width) * cloud.point_step))
+    return cras::make_unexpected(std::string("The cloud has less data than its dimensions require."));
+
+  // Allocate for the worst case and shrink at the end. With the pool, the capacity of the buffer stays for reuse.
+  sensor_msgs::PointCloud2Ptr out;
+  if (pool != nullptr)
+    out = pool->acquire(num_points * cloud.point_step);
+  else
+  {
+    out.reset(new sensor_msgs::PointCloud2);
+    out->data.resize(num_points * cloud.point_step);
+  }
+  out->header = cloud.header;
+  out->fields = cloud.fields;
+  out->is_bigendian = cloud.is_bigendian;
+  out->point_step = cloud.point_step;
+  out->height = 1;
+
+  const auto& box = options.crop_box;
+  const bool voxelize = options.voxel_size > 0.0;
+  const double inv_voxel_size = voxelize ? 1.0 / options.voxel_size : 0.0;
+  // Reused by the following clouds decoded in this thread, so that its buckets are not allocated with each cloud.
+  thread_local std::unordered_set<uint64_t> voxels;
+  voxels.clear();
+  if (voxelize)
+    voxels.reserve(std::min<size_t>(num_points, 1u << 16));
+
+  size_t num_kept = 0;
+  auto dst = out->data.data();
+  for (size_t row = 0; row < cloud.height; ++row)
+  {
+    auto src = cloud.data.data() + row * cloud.row_step;
+    for (size_t col = 0; col < cloud.width; ++col, src += cloud.point_step)
+    {
+      const auto x = readFloat(src + x_offset);
+      const auto y = readFloat(src + y_offset);
+      const auto z = readFloat(src + z_offset);
+      if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z))
+        continue;
+      if (box && (x < box->min_x || x > box->max_x || y < box->min_y || y > box->max_y ||
+                  z < box->min_z || z > box->max_z))
+        continue;
+      if (voxelize && !voxels.insert(voxelKey(x, y, z, inv_voxel_size)).second)
+        continue;
+
+      memcpy(dst, src, cloud.point_step);
+      dst += cloud.point_step;
+      ++num_kept;
+    }
+  }
+
+  out->width = static_cast<uint32_t>(num_kept);
+  out->row_step = out->width * out->point_step;
+  out->data.resize(num_kept * cloud.point_step);
+  out->is_dense = true;
+  return out;
+}
+
+}
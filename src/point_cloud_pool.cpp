@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Pool of recycled PointCloud2 messages for decoders.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/point_cloud_pool.h>
+
+namespace point_cloud_transport
+{
+
+struct PointCloudPool::State
+{
+  explicit State(size_t max_size) : max_size(max_size)
+  {
+  }
+
+  const size_t max_size;
+  mutable std::mutex mutex;
+  std::vector<std::unique_ptr<sensor_msgs::PointCloud2>> free;
+  size_t num_reused {0};
+  size_t num_allocated {0};
+};
+
+//! \brief Deleter of pooled clouds. It returns the cloud to the pool, or frees it if the pool is gone or full.
+struct PointCloudPool::ReturnToPool
+{
+  std::weak_ptr<State> state;
+
+  void operator()(sensor_msgs::PointCloud2* cloud) const
+  {
+    std::unique_ptr<sensor_msgs::PointCloud2> owned(cloud);
+    const auto s = this->state.lock();
+    if (!s)
+      return;
+
+    std::lock_guard<std::mutex> lock(s->mutex);
+    if (s->free.size() < s->max_size)
+      s->free.push_back(std::move(owned));
+  }
+};
+
+PointCloudPool::PointCloudPool(size_t max_size) : state_(std::make_shared<State>(max_size))
+{
+}
+
+PointCloudPool::~PointCloudPool() = default;
+
+sensor_msgs::PointCloud2Ptr PointCloudPool::acquire(size_t data_size)
+{
+  std::unique_ptr<sensor_msgs::PointCloud2> cloud;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    auto& free = state_->free;
+    if (!free.empty())
+    {
+      // Prefer the smallest buffer large enough for the data; otherwise grow the largest one.
+      size_t best = 0;
+      for (size_t i = 1; i < free.size(); ++i)
+      {
+        const auto capacity = free[i]->data.capacity();
+        const auto best_capacity = free[best]->data.capacity();
+        const bool fits = capacity >= data_size;
+        const bool best_fits = best_capacity >= data_size;
+        if ((fits && (!best_fits || capacity < best_capacity)) || (!fits && !best_fits && capacity > best_capacity))
+          best = i;
+      }
+      cloud = std::move(free[best]);
+      free[best] = std::move(free.back());
+      free.pop_back();
+      ++state_->num_reused;
+    }
+    else
+    {
+      ++state_->num_allocated;
+    }
+  }
+
+  if (cloud)
+  {
+    // Reset everything except the data buffer, whose capacity is what we want to keep.
+    auto data = std::move(cloud->data);
+    *cloud = sensor_msgs::PointCloud2();
+    cloud->data = std::move(data);
+  }
+  else
+  {
+    cloud = std::make_unique<sensor_msgs::PointCloud2>();
+  }
+  cloud->data.resize(data_size);
+
+  return {cloud.release(), ReturnToPool{state_}};
+}
+
+sensor_msgs::PointCloud2Ptr PointCloudPool::acquire(uint32_t height, uint32_t width, uint32_t point_step)
+{
+  auto cloud = this->acquire(static_cast<size_t>(height) * width * point_step);
+  cloud->height = height;
+  cloud->width = width;
+  cloud->point_step = point_step;
+  cloud->row_step = width * point_step;
+  return cloud;
+}
+
+size_t PointCloudPool::getNumFree() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->free.size();
+}
+
+size_t PointCloudPool::getNumReused() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->num_reused;
+}
+
+size_t PointCloudPool::getNumAllocated() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->num_allocated;
+}
+
+}
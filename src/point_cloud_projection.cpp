@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Projection of point clouds to a subset of their fields.
+ */
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cras_cpp_common/expected.hpp>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_pool.h>
+#include <point_cloud_transport/point_cloud_projection.h>
+
+namespace point_cloud_transport
+{
+
+namespace
+{
+
+size_t getDatatypeSize(uint8_t datatype)
+{
+  switch (datatype)
+  {
+    case sensor_msgs::PointField::INT8:
+    case sensor_msgs::PointField::UINT8:
+      return 1;
+    case sensor_msgs::PointField::INT16:
+    case sensor_msgs::PointField::UINT16:
+      return 2;
+    case sensor_msgs::PointField::INT32:
+    case sensor_msgs::PointField::UINT32:
+    case sensor_msgs::PointField::FLOAT32:
+      return 4;
+    case sensor_msgs::PointField::FLOAT64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+//! \brief A contiguous block of bytes copied from each input point to each output point.
+struct CopyRun
+{
+  size_t src_offset;
+  size_t dst_offset;
+  size_t length;
+};
+
+//! \brief Copy one run from all points of one row. Fixed sizes let the compiler replace memcpy with plain moves.
+template<size_t Length>
+void copyRunFixed(const uint8_t* src, size_t src_step, uint8_t* dst, size_t dst_step, size_t num_points)
+{
+  for (size_t i = 0; i < num_points; ++i, src += src_step, dst += dst_step)
+    memcpy(dst, src, Length);
+}
+
+void copyRun(const uint8_t* src, size_t src_step, uint8_t* dst, size_t dst_step, size_t num_points, size_t length)
+{
+  switch (length)
+  {
+    case 4:
+      return copyRunFixed<4>(src, src_step, dst, dst_step, num_points);
+    case 8:
+      return copyRunFixed<8>(src, src_step, dst, dst_step, num_points);
+    case 12:
+      return copyRunFixed<12>(src, src_step, dst, dst_step, num_points);
+    case 16:
+      return copyRunFixed<16>(src, src_step, dst, dst_step, num_points);
+    default:
+      for (size_t i = 0; i < num_points; ++i, src += src_step, dst += dst_step)
+        memcpy(dst, src, length);
+  }
+}
+
+}
+
+cras::expected<sensor_msgs::PointCloud2Ptr, std::string> projectFields(
+  const sensor_msgs::PointCloud2& cloud, const std::vector<std::string>& fields, PointCloudPool* pool)
+{
+  std::vector<sensor_msgs::PointField> out_fields;
+  std::vector<CopyRun> runs;
+  size_t point_step = 0;
+  for (const auto& name : fields)
+  {
+    const sensor_msgs::PointField* field = nullptr;
+    for (const auto& f : cloud.fields)
+    {
+      if (f.name == name)
+      {
+        field = &f;
+        break;
+      }
+    }
+    if (field == nullptr)
+      return cras::make_unexpected("The cloud has no field named '" + name + "'.");
+
+    const auto size = getDatatypeSize(field->datatype) * field->count;
+    if (size == 0 || field->offset + size > cloud.point_step)
+      return cras::make_unexpected("Field '" + name + "' has invalid type, count or offset.");
+
+    if (!runs.empty() && runs.back().src_offset + runs.back().length == field->offset)
+      runs.back().length += size;
+    else
+      runs.push_back({field->offset, point_step, size});
+
+    out_fields.push_back(*field);
+    out_fields.back().offset = static_cast<uint32_t>(point_step);
+    point_step += size;
+  }
+
+  const size_t num_points = static_cast<size_t>(cloud.height) * cloud.width;
+  if (num_points > 0 && (cloud.row_step < static_cast<size_t>(cloud.width) * cloud.point_step ||
+                         cloud.data.size() < static_cast<size_t>(cloud.height - 1) * cloud.row_step +
+                                             static_cast<size_t>(cloud.width) * cloud.point_step))
+    return cras::make_unexpected(std::string("The cloud has less data than its dimensions require."));
+
+  sensor_msgs::PointCloud2Ptr out;
+  if (pool != nullptr)
+    out = pool->acquire(cloud.height, cloud.width, static_cast<uint32_t>(point_step));
+  else
+  {
+    out.reset(new sensor_msgs::PointCloud2);
+    out->height = cloud.height;
+    out->width = cloud.width;
+    out->point_step = static_cast<uint32_t>(point_step);
+    out->row_step = cloud.width * out->point_step;
+    out->data.resize(num_points * point_step);
+  }
+  out->header = cloud.header;
+  out->fields = std::move(out_fields);
+  out->is_bigendian = cloud.is_bigendian;
+  out->is_dense = cloud.is_dense;
+
+  if (num_points == 0)
+    return out;
+
+  if (runs.size() == 1 && runs[0].length == cloud.point_step && cloud.row_step == out->row_step)
+  {
+    // All fields in their original layout, so the data can be copied at once.
+    memcpy(out->data.data(), cloud.data.data(), out->data.size());
+    return out;
+  }
+
+  for (size_t row = 0; row < cloud.height; ++row)
+  {
+    const auto src = cloud.data.data() + row * cloud.row_step;
+    const auto dst = out->data.data() + row * out->row_step;
+    for (const auto& run : runs)
+      copyRun(src + run.src_offset, cloud.point_step, dst + run.dst_offset, point_step, cloud.width, run.length);
+  }
+
+  return out;
+}
+
+std::string getProjectionName(const std::vector<std::string>& fields)
+{
+  std::string name = "fields";
+  for (const auto& field : fields)
+  {
+    name += "_";
+    for (const auto c : field)
+      name += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+  }
+  return name;
+}
+
+}
@@ -0,0 +1,550 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Vectorized kernels for repacking the data of PointCloud2 messages, shared by the transport plugins.
+ *
+ * The SIMD variants of the kernels are compiled with per-function target attributes, so the library itself does not
+ * need to be built with e.g. -mavx2, and the variant is selected at runtime according to the CPU.
+ */
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cras_cpp_common/expected.hpp>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_repack.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define POINT_CLOUD_TRANSPORT_REPACK_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define POINT_CLOUD_TRANSPORT_REPACK_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace point_cloud_transport
+{
+
+namespace
+{
+
+SimdLevel detectSimdLevel()
+{
+#if defined(POINT_CLOUD_TRANSPORT_REPACK_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SimdLevel::AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return SimdLevel::SSE2;
+#elif defined(POINT_CLOUD_TRANSPORT_REPACK_NEON)
+  return SimdLevel::NEON;
+#endif
+  return SimdLevel::SCALAR;
+}
+
+const SimdLevel supportedSimdLevel = detectSimdLevel();
+std::atomic<SimdLevel> simdLevel {supportedSimdLevel};
+
+bool isHostBigEndian()
+{
+  const uint16_t one = 1;
+  uint8_t first;
+  memcpy(&first, &one, 1);
+  return first == 0;
+}
+
+// Scalar kernels
+
+template<size_t Size>
+void gatherFixed(const uint8_t* points, size_t num_points, size_t point_step, uint8_t* values)
+{
+  for (size_t i = 0; i < num_points; ++i, points += point_step, values += Size)
+    memcpy(values, points, Size);
+}
+
+template<size_t Size>
+void scatterFixed(const uint8_t* values, size_t num_points, size_t point_step, uint8_t* points)
+{
+  for (size_t i = 0; i < num_points; ++i, points += point_step, values += Size)
+    memcpy(points, values, Size);
+}
+
+void gatherScalar(const uint8_t* points, size_t num_points, size_t point_step, size_t value_size, uint8_t* values)
+{
+  switch (value_size)
+  {
+    case 1: return gatherFixed<1>(points, num_points, point_step, values);
+    case 2: return gatherFixed<2>(points, num_points, point_step, values);
+    case 4: return gatherFixed<4>(points, num_points, point_step, values);
+    case 8: return gatherFixed<8>(points, num_points, point_step, values);
+    case 12: return gatherFixed<12>(points, num_points, point_step, values);
+    case 16: return gatherFixed<16>(points, num_points, point_step, values);
+    default:
+      for (size_t i = 0; i < num_points; ++i, points += point_step, values += value_size)
+        memcpy(values, points, value_size);
+  }
+}
+
+template<typename T, T (*Swap)(T)>
+void swapFixed(uint8_t* data, size_t num_values)
+{
+  for (size_t i = 0; i < num_values; ++i, data += sizeof(T))
+  {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    value = Swap(value);
+    memcpy(data, &value, sizeof(T));
+  }
+}
+
+uint16_t swap16(uint16_t value)
+{
+  return __builtin_bswap16(value);
+}
+
+uint32_t swap32(uint32_t value)
+{
+  return __builtin_bswap32(value);
+}
+
+uint64_t swap64(uint64_t value)
+{
+  return __builtin_bswap64(value);
+}
+
+void swapBytesScalar(uint8_t* data, size_t num_values, size_t value_size)
+{
+  switch (value_size)
+  {
+    case 2: return swapFixed<uint16_t, swap16>(data, num_values);
+    case 4: return swapFixed<uint32_t, swap32>(data, num_values);
+    case 8: return swapFixed<uint64_t, swap64>(data, num_values);
+    default:
+      for (size_t i = 0; i < num_values; ++i, data += value_size)
+      {
+        for (size_t j = 0; j < value_size / 2; ++j)
+          std::swap(data[j], data[value_size - 1 - j]);
+      }
+  }
+}
+
+bool isFiniteScalar(const uint8_t* xyz)
+{
+  float v[3];
+  memcpy(v, xyz, sizeof(v));
+  return std::isfinite(v[0]) && std::isfinite(v[1]) && std::isfinite(v[2]);
+}
+
+//! \brief Copy the points passing the test, merging consecutive passing points into a single copy.
+template<typename IsFinite>
+size_t copyPointRuns(const uint8_t* points, size_t num_points, size_t point_step, size_t xyz_offset,
+                     uint8_t* output, const IsFinite& is_finite)
+{
+  size_t num_copied = 0;
+  size_t run_start = 0;
+  size_t run_length = 0;
+  for (size_t i = 0; i < num_points; ++i)
+  {
+    if (is_finite(points + i * point_step + xyz_offset, i))
+    {
+      if (run_length == 0)
+        run_start = i;
+      ++run_length;
+      continue;
+    }
+    if (run_length > 0)
+    {
+      memcpy(output + num_copied * point_step, points + run_start * point_step, run_length * point_step);
+      num_copied += run_length;
+      run_length = 0;
+    }
+  }
+  if (run_length > 0)
+  {
+    memcpy(output + num_copied * point_step, points + run_start * point_step, run_length * point_step);
+    num_copied += run_length;
+  }
+  return num_copied;
+}
+
+#if defined(POINT_CLOUD_TRANSPORT_REPACK_X86)
+
+// x86 kernels
+
+__attribute__((target("avx2")))
+void gather4Avx2(const uint8_t* points, size_t num_points, size_t point_step, uint8_t* values)
+{
+  const auto step = static_cast<int>(point_step);
+  const __m256i indices = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step));
+  size_t i = 0;
+  for (; i + 8 <= num_points; i += 8)
+  {
+    const auto v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(points + i * point_step), indices, 1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i * 4), v);
+  }
+  gatherFixed<4>(points + i * point_step, num_points - i, point_step, values + i * 4);
+}
+
+__attribute__((target("avx2")))
+void swapBytesAvx2(uint8_t* data, size_t num_values, size_t value_size)
+{
+  __m256i mask;
+  switch (value_size)
+  {
+    case 2:
+      mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                              1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+      break;
+    case 4:
+      mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                              3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+      break;
+    case 8:
+      mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                              7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+      break;
+    default:
+      return swapBytesScalar(data, num_values, value_size);
+  }
+  const size_t num_bytes = num_values * value_size;
+  size_t i = 0;
+  for (; i + 32 <= num_bytes; i += 32)
+  {
+    auto p = reinterpret_cast<__m256i*>(data + i);
+    _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), mask));
+  }
+  swapBytesScalar(data + i, (num_bytes - i) / value_size, value_size);
+}
+
+__attribute__((target("sse2")))
+void swapBytes16Sse2(uint8_t* data, size_t num_values)
+{
+  const size_t num_bytes = num_values * 2;
+  size_t i = 0;
+  for (; i + 16 <= num_bytes; i += 16)
+  {
+    auto p = reinterpret_cast<__m128i*>(data + i);
+    const auto v = _mm_loadu_si128(p);
+    _mm_storeu_si128(p, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+  }
+  swapBytesScalar(data + i, (num_bytes - i) / 2, 2);
+}
+
+__attribute__((target("avx2")))
+void quantizeAvx2(const float* values, size_t num_values, float scale, int32_t* quantized)
+{
+  const auto s = _mm256_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 8 <= num_values; i += 8)
+  {
+    const auto v = _mm256_mul_ps(_mm256_loadu_ps(values + i), s);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(quantized + i), _mm256_cvtps_epi32(v));
+  }
+  for (; i < num_values; ++i)
+    quantized[i] = static_cast<int32_t>(std::nearbyint(values[i] * scale));
+}
+
+__attribute__((target("sse2")))
+void quantizeSse2(const float* values, size_t num_values, float scale, int32_t* quantized)
+{
+  const auto s = _mm_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 4 <= num_values; i += 4)
+  {
+    const auto v = _mm_mul_ps(_mm_loadu_ps(values + i), s);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(quantized + i), _mm_cvtps_epi32(v));
+  }
+  for (; i < num_values; ++i)
+    quantized[i] = static_cast<int32_t>(std::nearbyint(values[i] * scale));
+}
+
+__attribute__((target("avx2")))
+void dequantizeAvx2(const int32_t* quantized, size_t num_values, float step, float* values)
+{
+  const auto s = _mm256_set1_ps(step);
+  size_t i = 0;
+  for (; i + 8 <= num_values; i += 8)
+  {
+    const auto v = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(quantized + i)));
+    _mm256_storeu_ps(values + i, _mm256_mul_ps(v, s));
+  }
+  for (; i < num_values; ++i)
+    values[i] = static_cast<float>(quantized[i]) * step;
+}
+
+__attribute__((target("sse2")))
+void dequantizeSse2(const int32_t* quantized, size_t num_values, float step, float* values)
+{
+  const auto s = _mm_set1_ps(step);
+  size_t i = 0;
+  for (; i + 4 <= num_values; i += 4)
+  {
+    const auto v = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(quantized + i)));
+    _mm_storeu_ps(values + i, _mm_mul_ps(v, s));
+  }
+  for (; i < num_values; ++i)
+    values[i] = static_cast<float>(quantized[i]) * step;
+}
+
+//! \brief Test 3 floats by a 16-byte load. The caller has to make sure the 4th float may be read.
+__attribute__((target("sse2")))
+bool isFiniteSse2(const uint8_t* xyz)
+{
+  const auto v = _mm_loadu_ps(reinterpret_cast<const float*>(xyz));
+  // x - x is 0 for finite x and NaN for infinities and NaNs.
+  const auto d = _mm_sub_ps(v, v);
+  return (_mm_movemask_ps(_mm_cmpord_ps(d, d)) & 0x7) == 0x7;
+}
+
+#elif defined(POINT_CLOUD_TRANSPORT_REPACK_NEON)
+
+// ARM kernels
+
+void swapBytesNeon(uint8_t* data, size_t num_values, size_t value_size)
+{
+  if (value_size != 2 && value_size != 4 && value_size != 8)
+    return swapBytesScalar(data, num_values, value_size);
+
+  const size_t num_bytes = num_values * value_size;
+  size_t i = 0;
+  for (; i + 16 <= num_bytes; i += 16)
+  {
+    const auto v = vld1q_u8(data + i);
+    vst1q_u8(data + i, value_size == 2 ? vrev16q_u8(v) : (value_size == 4 ? vrev32q_u8(v) : vrev64q_u8(v)));
+  }
+  swapBytesScalar(data + i, (num_bytes - i) / value_size, value_size);
+}
+
+void quantizeNeon(const float* values, size_t num_values, float scale, int32_t* quantized)
+{
+  size_t i = 0;
+  for (; i + 4 <= num_values; i += 4)
+    vst1q_s32(quantized + i, vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(values + i), scale)));
+  for (; i < num_values; ++i)
+    quantized[i] = static_cast<int32_t>(std::nearbyint(values[i] * scale));
+}
+
+void dequantizeNeon(const int32_t* quantized, size_t num_values, float step, float* values)
+{
+  size_t i = 0;
+  for (; i + 4 <= num_values; i += 4)
+    vst1q_f32(values + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(quantized + i)), step));
+  for (; i < num_values; ++i)
+    values[i] = static_cast<float>(quantized[i]) * step;
+}
+
+#endif
+
+const sensor_msgs::PointField* findField(const sensor_msgs::PointCloud2& cloud, const std::string& name)
+{
+  for (const auto& field : cloud.fields)
+  {
+    if (field.name == name)
+      return &field;
+  }
+  return nullptr;
+}
+
+bool hasEnoughData(const sensor_msgs::PointCloud2& cloud)
+{
+  if (cloud.height == 0 || cloud.width == 0)
+    return true;
+  const auto row_size = static_cast<size_t>(cloud.width) * cloud.point_step;
+  return cloud.row_step >= row_size &&
+      cloud.data.size() >= static_cast<size_t>(cloud.height - 1) * cloud.row_step + row_size;
+}
+
+}
+
+SimdLevel getSimdLevel()
+{
+  return simdLevel;
+}
+
+SimdLevel setSimdLevel(SimdLevel level)
+{
+  // NEON and the x86 levels are mutually exclusive, the x86 ones are ordered.
+  const bool supported = level == SimdLevel::SCALAR || level == supportedSimdLevel ||
+      (supportedSimdLevel == SimdLevel::AVX2 && level == SimdLevel::SSE2);
+  simdLevel = supported ? level : supportedSimdLevel;
+  return simdLevel;
+}
+
+std::string toString(SimdLevel level)
+{
+  switch (level)
+  {
+    case SimdLevel::SSE2:
+      return "sse2";
+    case SimdLevel::AVX2:
+      return "avx2";
+    case SimdLevel::NEON:
+      return "neon";
+    default:
+      return "scalar";
+  }
+}
+
+void gatherField(const uint8_t* points, size_t num_points, size_t point_step, size_t value_size, uint8_t* values)
+{
+#if defined(POINT_CLOUD_TRANSPORT_REPACK_X86)
+  // The gather indices are 32-bit.
+  if (simdLevel == SimdLevel::AVX2 && value_size == 4 && point_step <= INT32_MAX / 8)
+    return gather4Avx2(points, num_points, point_step, values);
+#endif
+  gatherScalar(points, num_points, point_step, value_size, values);
+}
+
+void scatterField(const uint8_t* values, size_t num_points, size_t value_size, size_t point_step, uint8_t* points)
+{
+  // There is no scatter instruction before AVX-512, so this relies on the fixed-size copies.
+  switch (value_size)
+  {
+    case 1: return scatterFixed<1>(values, num_points, point_step, points);
+    case 2: return scatterFixed<2>(values, num_points, point_step, points);
+    case 4: return scatterFixed<4>(values, num_points, point_step, points);
+    case 8: return scatterFixed<8>(values, num_points, point_step, points);
+    case 12: return scatterFixed<12>(values, num_points, point_step, points);
+    case 16: return scatterFixed<16>(values, num_points, point_step, points);
+    default:
+      for (size_t i = 0; i < num_points; ++i, points += point_step, values += value_size)
+        memcpy(points, values, value_size);
+  }
+}
+
+void swapBytes(uint8_t* data, size_t num_values, size_t value_size)
+{
+  if (value_size < 2)
+    return;
+#if defined(POINT_CLOUD_TRANSPORT_REPACK_X86)
+  if (simdLevel == SimdLevel::AVX2)
+    return swapBytesAvx2(data, num_values, value_size);
+  if (simdLevel == SimdLevel::SSE2 && value_size == 2)
+    return swapBytes16Sse2(data, num_values);
+#elif defined(POINT_CLOUD_TRANSPORT_REPACK_NEON)
+  if (simdLevel == SimdLevel::NEON)
+    return swapBytesNeon(data, num_values, value_size);
+#endif
+  swapBytesScalar(data, num_values, value_size);
+}
+
+void quantizeFloats(const float* values, size_t num_values, float scale, int32_t* quantized)
+{
+#if defined(POINT_CLOUD_TRANSPORT_REPACK_X86)
+  if (simdLevel == SimdLevel::AVX2)
+    return quantizeAvx2(values, num_values, scale, quantized);
+  if (simdLevel == SimdLevel::SSE2)
+    return quantizeSse2(values, num_values, scale, quantized);
+#elif defined(POINT_CLOUD_TRANSPORT_REPACK_NEON)
+  if (simdLevel == SimdLevel::NEON)
+    return quantizeNeon(values, num_values, scale, quantized);
+#endif
+  for (size_t i = 0; i < num_values; ++i)
+    quantized[i] = static_cast<int32_t>(std::nearbyint(values[i] * scale));
+}
+
+void dequantizeFloats(const int32_t* quantized, size_t num_values, float step, float* values)
+{
+#if defined(POINT_CLOUD_TRANSPORT_REPACK_X86)
+  if (simdLevel == SimdLevel::AVX2)
+    return dequantizeAvx2(quantized, num_values, step, values);
+  if (simdLevel == SimdLevel::SSE2)
+    return dequantizeSse2(quantized, num_values, step, values);
+#elif defined(POINT_CLOUD_TRANSPORT_REPACK_NEON)
+  if (simdLevel == SimdLevel::NEON)
+    return dequantizeNeon(quantized, num_values, step, values);
+#endif
+  for (size_t i = 0; i < num_values; ++i)
+    values[i] = static_cast<float>(quantized[i]) * step;
+}
+
+size_t copyFinitePoints(const uint8_t* points, size_t num_points, size_t point_step, size_t xyz_offset,
+                        uint8_t* output)
+{
+#if defined(POINT_CLOUD_TRANSPORT_REPACK_X86)
+  if (simdLevel != SimdLevel::SCALAR)
+  {
+    // The 16-byte load may read past the coordinates, but not past the end of the last point.
+    const bool whole_load = xyz_offset + 16 <= point_step;
+    return copyPointRuns(points, num_points, point_step, xyz_offset, output,
+                         [whole_load, num_points](const uint8_t* xyz, size_t i)
+                         {
+                           return (whole_load || i + 1 < num_points) ? isFiniteSse2(xyz) : isFiniteScalar(xyz);
+                         });
+  }
+#endif
+  return copyPointRuns(points, num_points, point_step, xyz_offset, output,
+                       [](const uint8_t* xyz, size_t) { return isFiniteScalar(xyz); });
+}
+
+cras::expected<std::vector<float>, std::string> extractFloatField(const sensor_msgs::PointCloud2& cloud,
+                                                                  const std::string& name)
+{
+  const auto field = findField(cloud, name);
+  if (field == nullptr)
+    return cras::make_unexpected("The cloud has no field named '" + name + "'.");
+  if (field->datatype != sensor_msgs::PointField::FLOAT32)
+    return cras::make_unexpected("Field '" + name + "' is not FLOAT32.");
+  const size_t value_size = 4 * static_cast<size_t>(field->count);
+  if (field->offset + value_size > cloud.point_step || !hasEnoughData(cloud))
+    return cras::make_unexpected(std::string("The cloud has less data than its dimensions require."));
+
+  std::vector<float> values(static_cast<size_t>(cloud.height) * cloud.width * field->count);
+  auto out = reinterpret_cast<uint8_t*>(values.data());
+  for (size_t row = 0; row < cloud.height; ++row)
+  {
+    gatherField(cloud.data.data() + row * cloud.row_step + field->offset, cloud.width, cloud.point_step, value_size,
+                out + row * cloud.width * value_size);
+  }
+  if (static_cast<bool>(cloud.is_bigendian) != isHostBigEndian())
+    swapBytes(out, values.size(), sizeof(float));
+  return values;
+}
+
+cras::expected<sensor_msgs::PointCloud2Ptr, std::string> removeNonFinitePoints(const sensor_msgs::PointCloud2& cloud)
+{
+  const auto x = findField(cloud, "x");
+  const auto y = findField(cloud, "y");
+  const auto z = findField(cloud, "z");
+  if (x == nullptr || y == nullptr || z == nullptr)
+    return cras::make_unexpected(std::string("The cloud does not have fields x, y and z."));
+  if (x->datatype != sensor_msgs::PointField::FLOAT32 || y->datatype != sensor_msgs::PointField::FLOAT32 ||
+      z->datatype != sensor_msgs::PointField::FLOAT32 || y->offset != x->offset + 4 || z->offset != x->offset + 8)
+    return cras::make_unexpected(std::string("Fields x, y and z have to be consecutive FLOAT32 fields."));
+  if (static_cast<bool>(cloud.is_bigendian) != isHostBigEndian())
+    return cras::make_unexpected(std::string("The cloud has a different byte order than this computer."));
+  if (x->offset + 12 > cloud.point_step || !hasEnoughData(cloud))
+    return cras::make_unexpected(std::string("The cloud has less data than its dimensions require."));
+
+  sensor_msgs::PointCloud2Ptr out(new sensor_msgs::PointCloud2);
+  out->header = cloud.header;
+  out->fields = cloud.fields;
+  out->is_bigendian = cloud.is_bigendian;
+  out->point_step = cloud.point_step;
+  out->height = 1;
+  out->data.resize(static_cast<size_t>(cloud.height) * cloud.width * cloud.point_step);
+
+  size_t num_points = 0;
+  for (size_t row = 0; row < cloud.height; ++row)
+  {
+    num_points += copyFinitePoints(cloud.data.data() + row * cloud.row_step, cloud.width, cloud.point_step,
+                                   x->offset, out->data.data() + num_points * cloud.point_step);
+  }
+  out->width = static_cast<uint32_t>(num_points);
+  out->row_step = out->width * out->point_step;
+  out->data.resize(num_points * cloud.point_step);
+  out->is_dense = true;
+  return out;
+}
+
+}
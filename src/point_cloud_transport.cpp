@@ -43,9 +43,8 @@
 #include <unordered_map>
 #include <vector>
 
-#include <boost/algorithm/string/erase.hpp>
 #include <boost/function.hpp>
-#include <boost/make_shared.hpp>
+#include <boost/pointer_cast.hpp>
 
 #include <pluginlib/class_loader.h>
 #include <pluginlib/exceptions.hpp>
@@ -54,6 +53,7 @@
 #include <sensor_msgs/PointCloud2.h>
 
 #include <point_cloud_transport/loader_fwds.h>
+#include <point_cloud_transport/loader_registry.h>
 #include <point_cloud_transport/point_cloud_transport.h>
 #include <point_cloud_transport/publisher_plugin.h>
 #include <point_cloud_transport/single_subscriber_publisher.h>
@@ -65,14 +65,8 @@ namespace point_cloud_transport
 
 struct PointCloudTransportLoader::Impl
 {
-  point_cloud_transport::PubLoaderPtr pub_loader_;
-  point_cloud_transport::SubLoaderPtr sub_loader_;
-
-  Impl() :
-      pub_loader_(boost::make_shared<PubLoader>("point_cloud_transport", "point_cloud_transport::PublisherPlugin")),
-      sub_loader_(boost::make_shared<SubLoader>("point_cloud_transport", "point_cloud_transport::SubscriberPlugin"))
-  {
-  }
+  //! \brief All loaders share the plugin loaders and descriptions of the process-wide registry.
+  LoaderRegistry& registry_ {LoaderRegistry::instance()};
 };
 
 struct PointCloudTransport::Impl
@@ -111,6 +105,16 @@ Publisher PointCloudTransport::advertise(const std::string& base_topic, uint32_t
   return {impl_->nh_, base_topic, queue_size, connect_cb, disconnect_cb, tracked_object, latch, getPublisherLoader()};
 }
 
+Publisher PointCloudTransport::advertise(const std::string& base_topic, uint32_t queue_size,
+                                         const point_cloud_transport::PublisherOptions& options,
+                                         const point_cloud_transport::SubscriberStatusCallback& connect_cb,
+                                         const point_cloud_transport::SubscriberStatusCallback& disconnect_cb,
+                                         const ros::VoidPtr& tracked_object, bool latch)
+{
+  return {impl_->nh_, base_topic, queue_size, connect_cb, disconnect_cb, tracked_object, latch, getPublisherLoader(),
+          options};
+}
+
 Subscriber PointCloudTransport::subscribe(
     const std::string& base_topic, uint32_t queue_size,
     const boost::function<void(const sensor_msgs::PointCloud2ConstPtr&)>& callback,
@@ -123,65 +127,43 @@ Subscriber PointCloudTransport::subscribe(
 
 std::vector<std::string> PointCloudTransportLoader::getDeclaredTransports() const
 {
-  auto transports = impl_->sub_loader_->getDeclaredClasses();
-
-  // Remove the "_sub" at the end of each class name.
-  for (auto& transport : transports)
-  {
-    transport = boost::erase_last_copy(transport, "_sub");
-  }
+  std::vector<std::string> transports;
+  for (const auto& plugin : impl_->registry_.getSubscriberPlugins())
+    transports.push_back(plugin.transport);
   return transports;
 }
 
 std::unordered_map<std::string, std::string> PointCloudTransportLoader::getLoadableTransports() const
 {
   std::unordered_map<std::string, std::string> loadableTransports;
-
-  for (const auto& transportPlugin : impl_->sub_loader_->getDeclaredClasses())
+  for (const auto& plugin : impl_->registry_.getSubscriberPlugins())
   {
-    // If the plugin loads without throwing an exception, add its transport name to the list of valid plugins,
-    // otherwise ignore it.
-    try
-    {
-      auto sub = impl_->sub_loader_->createInstance(transportPlugin);
-      // Remove the "_sub" at the end of each class name.
-      loadableTransports[boost::erase_last_copy(transportPlugin, "_sub")] = sub->getTransportName();
-    }
-    catch (const pluginlib::PluginlibException& e)
-    {
-    }
+    if (plugin.loadable)
+      loadableTransports[plugin.transport] = plugin.name;
   }
-
   return loadableTransports;
 }
 
 PubLoaderPtr PointCloudTransportLoader::getPublisherLoader() const
 {
-  return impl_->pub_loader_;
+  return impl_->registry_.getPublisherLoader();
 }
 
 SubLoaderPtr PointCloudTransportLoader::getSubscriberLoader() const
 {
-  return impl_->sub_loader_;
+  return impl_->registry_.getSubscriberLoader();
 }
 
-thread_local std::unique_ptr<point_cloud_transport::PointCloudTransportLoader> loader;
-
-}
-
-point_cloud_transport::PointCloudTransportLoader& getLoader()
-{
-  if (point_cloud_transport::loader == nullptr)
-    point_cloud_transport::loader = std::make_unique<point_cloud_transport::PointCloudTransportLoader>();
-  return *point_cloud_transport::loader;
 }
 
 void pointCloudTransportGetLoadableTransports(cras::allocator_t transportAllocator, cras::allocator_t nameAllocator)
 {
-  for (const auto& transport : getLoader().getLoadableTransports())
+  for (const auto& plugin : point_cloud_transport::LoaderRegistry::instance().getSubscriberPlugins())
   {
-    cras::outputString(transportAllocator, transport.first);
-    cras::outputString(nameAllocator, transport.second);
+    if (!plugin.loadable)
+      continue;
+    cras::outputString(transportAllocator, plugin.transport);
+    cras::outputString(nameAllocator, plugin.name);
   }
 }
 
@@ -192,25 +174,40 @@ void pointCloudTransportGetTopicsToPublish(const char* baseTopic,
                                            cras::allocator_t dataTypeAllocator,
                                            cras::allocator_t configTypeAllocator)
 {
-  auto pubLoader = getLoader().getPublisherLoader();
-  for (const auto& transportPlugin : pubLoader->getDeclaredClasses())
+  auto& registry = point_cloud_transport::LoaderRegistry::instance();
+  for (const auto& plugin : registry.getPublisherPlugins())
   {
-    try
+    if (!plugin.loadable || !plugin.single_topic)
+      continue;
+
+    std::string topic = baseTopic + plugin.topic_suffix;
+    if (!plugin.topic_has_suffix)
     {
-      auto pub = pubLoader->createInstance(transportPlugin);
-      auto singleTopicPub = boost::dynamic_pointer_cast<point_cloud_transport::SingleTopicPublisherPlugin>(pub);
-      if (singleTopicPub == nullptr)
+      // The plugin computes the topic in some other way, so we need to instantiate it.
+      try
+      {
+        const auto loader = registry.getPublisherLoader();
+        boost::shared_ptr<point_cloud_transport::PublisherPlugin> pub;
+        {
+          const auto lock = registry.lockLoaders();
+          pub = loader->createInstance(plugin.lookup_name);
+        }
+        auto singleTopicPub = boost::dynamic_pointer_cast<point_cloud_transport::SingleTopicPublisherPlugin>(pub);
+        if (singleTopicPub == nullptr)
+          continue;
+        topic = singleTopicPub->getTopicToAdvertise(baseTopic);
+      }
+      catch (const pluginlib::PluginlibException& e)
+      {
         continue;
-      // Remove the "_pub" at the end of each class name.
-      cras::outputString(transportAllocator, boost::erase_last_copy(transportPlugin, "_pub"));
-      cras::outputString(nameAllocator, singleTopicPub->getTransportName());
-      cras::outputString(topicAllocator, singleTopicPub->getTopicToAdvertise(baseTopic));
-      cras::outputString(dataTypeAllocator, singleTopicPub->getDataType());
-      cras::outputString(configTypeAllocator, singleTopicPub->getConfigDataType());
-    }
-    catch (const pluginlib::PluginlibException& e)
-    {
+      }
     }
+
+    cras::outputString(transportAllocator, plugin.transport);
+    cras::outputString(nameAllocator, plugin.name);
+    cras::outputString(topicAllocator, topic);
+    cras::outputString(dataTypeAllocator, plugin.data_type);
+    cras::outputString(configTypeAllocator, plugin.config_data_type);
   }
 }
 
@@ -221,29 +218,40 @@ void pointCloudTransportGetTopicToSubscribe(const char* baseTopic,
                                             cras::allocator_t dataTypeAllocator,
                                             cras::allocator_t configTypeAllocator)
 {
-  auto subLoader = getLoader().getSubscriberLoader();
-  for (const auto& transportPlugin : subLoader->getDeclaredClasses())
+  auto& registry = point_cloud_transport::LoaderRegistry::instance();
+  for (const auto& plugin : registry.getSubscriberPlugins())
   {
-    try
-    {
-      auto sub = subLoader->createInstance(transportPlugin);
-
-      const auto transportClass = boost::erase_last_copy(transportPlugin, "_sub");
-      if (transportClass != transport && sub->getTransportName() != transport)
-        continue;
-
-      auto singleTopicSub = boost::dynamic_pointer_cast<point_cloud_transport::SingleTopicSubscriberPlugin>(sub);
-      if (singleTopicSub == nullptr)
-        continue;
+    if (!plugin.loadable || !plugin.single_topic)
+      continue;
+    if (plugin.transport != transport && plugin.name != transport)
+      continue;
 
-      cras::outputString(nameAllocator, singleTopicSub->getTransportName());
-      cras::outputString(topicAllocator, singleTopicSub->getTopicToSubscribe(baseTopic));
-      cras::outputString(dataTypeAllocator, singleTopicSub->getDataType());
-      cras::outputString(configTypeAllocator, singleTopicSub->getConfigDataType());
-      return;
-    }
-    catch (const pluginlib::PluginlibException& e)
+    std::string topic = baseTopic + plugin.topic_suffix;
+    if (!plugin.topic_has_suffix)
     {
+      try
+      {
+        const auto loader = registry.getSubscriberLoader();
+        boost::shared_ptr<point_cloud_transport::SubscriberPlugin> sub;
+        {
+          const auto lock = registry.lockLoaders();
+          sub = loader->createInstance(plugin.lookup_name);
+        }
+        auto singleTopicSub = boost::dynamic_pointer_cast<point_cloud_transport::SingleTopicSubscriberPlugin>(sub);
+        if (singleTopicSub == nullptr)
+          continue;
+        topic = singleTopicSub->getTopicToSubscribe(baseTopic);
+      }
+      catch (const pluginlib::PluginlibException& e)
+      {
+        continue;
+      }
     }
+
+    cras::outputString(nameAllocator, plugin.name);
+    cras::outputString(topicAllocator, topic);
+    cras::outputString(dataTypeAllocator, plugin.data_type);
+    cras::outputString(configTypeAllocator, plugin.config_data_type);
+    return;
   }
 }
@@ -24,10 +24,22 @@ Example usage:
       rospy.logerr("Error decoding point cloud: " + err)
       return False
     # work with the PointCloud2 instance in variable raw2
+
+When encoding or decoding many clouds with the same transport, use a :class:`Codec`. It keeps the plugin, the config and
+the buffers between the calls:
+
+.. code-block:: python
+
+    from point_cloud_transport import Codec
+
+    codec = Codec("draco", {"encode_speed": 1})
+    for raw in clouds:
+      compressed, err = codec.encode(raw)
 """
 
-from point_cloud_transport.decoder import decode
-from point_cloud_transport.encoder import encode
+from point_cloud_transport.codec import Codec
+from point_cloud_transport.decoder import decode, decode_batch
+from point_cloud_transport.encoder import encode, encode_batch, transcode
 from point_cloud_transport.publisher import Publisher
 from point_cloud_transport.subscriber import Subscriber
 
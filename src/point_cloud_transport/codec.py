@@ -0,0 +1,283 @@
+# SPDX-License-Identifier: BSD-3-Clause
+# SPDX-FileCopyrightText: Czech Technical University in Prague
+
+"""Reusable codec for encoding or decoding many point clouds with the same transport."""
+
+from ctypes import c_bool, c_uint8, c_uint32, c_char_p, c_size_t, c_void_p, POINTER, byref
+
+import sys
+import threading
+
+from sensor_msgs.msg import PointCloud2, PointField
+
+from cras import get_msg_type
+from cras.ctypes_utils import Allocator, StringAllocator, LogMessagesAllocator, ScalarAllocator, get_ro_c_buffer, \
+    c_array
+from cras.string_utils import BufferStringIO
+
+from .common import _get_base_library
+from .decoder import _get_rw_c_buffer
+from .encoder import _serialize_config
+
+
+def _get_library():
+    library = _get_base_library()
+    # Add function signatures
+
+    library.pointCloudTransportCodecsCreateContext.restype = c_void_p
+    library.pointCloudTransportCodecsCreateContext.argtypes = [c_char_p]
+
+    library.pointCloudTransportCodecsDestroyContext.restype = None
+    library.pointCloudTransportCodecsDestroyContext.argtypes = [c_void_p]
+
+    library.pointCloudTransportCodecsContextSetConfig.restype = c_bool
+    library.pointCloudTransportCodecsContextSetConfig.argtypes = [
+        c_void_p, c_size_t, POINTER(c_uint8), Allocator.ALLOCATOR,
+    ]
+
+    library.pointCloudTransportCodecsContextEncodeInto.restype = c_bool
+    library.pointCloudTransportCodecsContextEncodeInto.argtypes = [
+        c_void_p,
+        c_uint32, c_uint32, c_size_t, POINTER(c_char_p), POINTER(c_uint32), POINTER(c_uint8), POINTER(c_uint32),
+        c_uint8, c_uint32, c_uint32, c_size_t, POINTER(c_uint8), c_uint8,
+        Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+        c_size_t, POINTER(c_uint8), POINTER(c_size_t),
+        Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+    ]
+
+    library.pointCloudTransportCodecsContextGetLastEncodedData.restype = c_bool
+    library.pointCloudTransportCodecsContextGetLastEncodedData.argtypes = [c_void_p, c_size_t, POINTER(c_uint8)]
+
+    library.pointCloudTransportCodecsContextDecodeInto.restype = c_bool
+    library.pointCloudTransportCodecsContextDecodeInto.argtypes = [
+        c_void_p,
+        c_char_p, c_char_p, c_size_t, POINTER(c_uint8),
+        POINTER(c_uint32), POINTER(c_uint32),
+        POINTER(c_size_t), Allocator.ALLOCATOR, Allocator.ALLOCATOR, Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+        POINTER(c_uint8), POINTER(c_uint32), POINTER(c_uint32),
+        c_size_t, POINTER(c_uint8), POINTER(c_size_t),
+        POINTER(c_uint8),
+        Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+    ]
+
+    library.pointCloudTransportCodecsContextGetLastDecodedData.restype = c_bool
+    library.pointCloudTransportCodecsContextGetLastDecodedData.argtypes = [c_void_p, c_size_t, POINTER(c_uint8)]
+
+    return library
+
+
+class Codec(object):
+    """Encoder or decoder of one transport that keeps its native state between the calls.
+
+    Unlike :func:`point_cloud_transport.encode` and :func:`point_cloud_transport.decode`, the plugin is looked up only
+    once, the config is serialized and parsed only when it changes (see :meth:`set_config`), and the buffers are reused
+    for all clouds. The calls are serialized, so e.g. :meth:`set_config` can be called from a dynamic reconfigure
+    callback while another thread encodes. For parallel encoding, create one codec per thread.
+
+    .. code-block:: python
+
+        codec = Codec("draco", {"encode_speed": 1})
+        compressed, err = codec.encode(raw)
+    """
+
+    def __init__(self, topic_or_codec, config=None):
+        """Create the codec.
+
+        :param str topic_or_codec: Name of the codec, or name of the topic the decoded clouds come from.
+        :param config: Configuration of the encoding or decoding process.
+        :type config: dict or dynamic_reconfigure.msg.Config or None
+        """
+        self._context = None
+        self._lock = threading.Lock()
+        self._lib = _get_library()
+        if self._lib is None:
+            raise RuntimeError("Could not load the codec library.")
+        self.topic_or_codec = topic_or_codec
+        self._context = self._lib.pointCloudTransportCodecsCreateContext(topic_or_codec.encode("utf-8"))
+        if self._context is None:
+            raise ValueError("Point cloud transport codec '%s' not found." % (topic_or_codec,))
+        # Output buffer for the encoded messages. It grows to the size of the largest encoded message.
+        self._compressed_buf = bytearray()
+        # Size of the last decoded cloud, used as the size of the output buffer for the next cloud.
+        self._last_raw_data_length = 0
+        if config is not None:
+            ok, err = self.set_config(config)
+            if not ok:
+                raise ValueError(err)
+
+    def __del__(self):
+        # The constructor may have failed before setting all attributes.
+        if getattr(self, "_context", None) is not None:
+            self.close()
+
+    def close(self):
+        """Free the native state of the codec. The codec can not be used afterwards."""
+        with self._lock:
+            if self._context is not None:
+                self._lib.pointCloudTransportCodecsDestroyContext(self._context)
+                self._context = None
+
+    def set_config(self, config):
+        """Set the configuration used by all following encodings or decodings.
+
+        Call this e.g. from the callback of the dynamic reconfigure server of the transport.
+
+        :param config: Configuration of the encoding or decoding process. `None` means the default config.
+        :type config: dict or dynamic_reconfigure.msg.Config or None
+        :return: Tuple of success and error string. On failure, the previous config is kept.
+        :rtype: (bool, str)
+        """
+        with self._lock:
+            if self._context is None:
+                return False, "The codec has been closed."
+            config_buf, config_buf_len = _serialize_config(config)
+            error_allocator = StringAllocator()
+            if not self._lib.pointCloudTransportCodecsContextSetConfig(
+                    self._context, c_size_t(config_buf_len), get_ro_c_buffer(config_buf), error_allocator.get_cfunc()):
+                return False, error_allocator.value
+            return True, ""
+
+    def encode(self, raw):
+        """Encode the given raw point cloud.
+
+        :param sensor_msgs.msg.PointCloud2 raw: The raw point cloud.
+        :return: Tuple of compressed cloud and error string. If the compression fails, cloud is `None` and error
+                 string is filled. If the encoder returned no message, both the cloud and the error are empty.
+        :rtype: (genpy.Message or None, str)
+        """
+        with self._lock:
+            if self._context is None:
+                return None, "The codec has been closed."
+
+            type_allocator = StringAllocator()
+            md5sum_allocator = StringAllocator()
+            error_allocator = StringAllocator()
+            log_allocator = LogMessagesAllocator()
+            compressed_data_length = c_size_t()
+
+            compressed_buf = self._compressed_buf
+            args = [
+                self._context,
+                raw.height, raw.width,
+                len(raw.fields),
+                c_array([f.name.encode("utf-8") for f in raw.fields], c_char_p),
+                c_array([f.offset for f in raw.fields], c_uint32),
+                c_array([f.datatype for f in raw.fields], c_uint8),
+                c_array([f.count for f in raw.fields], c_uint32),
+                raw.is_bigendian, raw.point_step, raw.row_step,
+                len(raw.data), get_ro_c_buffer(raw.data), raw.is_dense,
+                type_allocator.get_cfunc(), md5sum_allocator.get_cfunc(),
+                len(compressed_buf), _get_rw_c_buffer(compressed_buf), byref(compressed_data_length),
+                error_allocator.get_cfunc(), log_allocator.get_cfunc(),
+            ]
+            ret = self._lib.pointCloudTransportCodecsContextEncodeInto(*args)
+            del args  # Release the view of the buffer so that it can be resized.
+
+            log_allocator.print_log_messages()
+            if not ret:
+                return None, error_allocator.value
+            if len(type_allocator.values) == 0:
+                return None, ""
+
+            if compressed_data_length.value > len(compressed_buf):
+                # The message did not fit into the buffer, grow it and fetch the message without encoding it again.
+                self._compressed_buf = compressed_buf = bytearray(compressed_data_length.value)
+                if not self._lib.pointCloudTransportCodecsContextGetLastEncodedData(
+                        self._context, len(compressed_buf), _get_rw_c_buffer(compressed_buf)):
+                    return None, "Could not retrieve the encoded point cloud data."
+
+            msg_type = get_msg_type(type_allocator.value)
+            compressed = msg_type()
+            if md5sum_allocator.value != compressed._md5sum:
+                return None, "MD5 sum mismatch for %s: %s vs %s" % (
+                    type_allocator.value, md5sum_allocator.value, compressed._md5sum)
+            compressed.deserialize(compressed_buf[:compressed_data_length.value])
+            compressed.header = raw.header
+            return compressed, ""
+
+    def decode(self, compressed):
+        """Decode the given compressed point cloud.
+
+        :param genpy.Message compressed: The compressed point cloud.
+        :return: Tuple of raw cloud and error string. If the decoding fails, cloud is `None` and error string is
+                 filled. In Python 3, the data of the cloud are a `bytearray` the decoder wrote directly into.
+        :rtype: (sensor_msgs.msg.PointCloud2 or None, str)
+        """
+        with self._lock:
+            if self._context is None:
+                return None, "The codec has been closed."
+
+            field_names_allocator = StringAllocator()
+            field_offset_allocator = ScalarAllocator(c_uint32)
+            field_datatype_allocator = ScalarAllocator(c_uint8)
+            field_count_allocator = ScalarAllocator(c_uint32)
+            error_allocator = StringAllocator()
+            log_allocator = LogMessagesAllocator()
+
+            raw_height = c_uint32()
+            raw_width = c_uint32()
+            raw_is_big_endian = c_uint8()
+            raw_num_fields = c_size_t()
+            raw_point_step = c_uint32()
+            raw_row_step = c_uint32()
+            raw_is_dense = c_uint8()
+            raw_data_length = c_size_t()
+
+            # The data are returned to the caller, so a new buffer is needed for each cloud.
+            raw_data = bytearray(self._last_raw_data_length)
+
+            compressed_buf = BufferStringIO()
+            compressed.serialize(compressed_buf)
+            compressed_buf_len = compressed_buf.tell()
+            compressed_buf.seek(0)
+
+            args = [
+                self._context,
+                compressed._type.encode("utf-8"), compressed._md5sum.encode("utf-8"), compressed_buf_len,
+                get_ro_c_buffer(compressed_buf),
+                byref(raw_height), byref(raw_width),
+                byref(raw_num_fields), field_names_allocator.get_cfunc(), field_offset_allocator.get_cfunc(),
+                field_datatype_allocator.get_cfunc(), field_count_allocator.get_cfunc(),
+                byref(raw_is_big_endian), byref(raw_point_step), byref(raw_row_step),
+                len(raw_data), _get_rw_c_buffer(raw_data), byref(raw_data_length),
+                byref(raw_is_dense),
+                error_allocator.get_cfunc(), log_allocator.get_cfunc(),
+            ]
+            ret = self._lib.pointCloudTransportCodecsContextDecodeInto(*args)
+            del args  # Release the view of raw_data so that it can be resized.
+
+            log_allocator.print_log_messages()
+            if not ret:
+                return None, error_allocator.value
+
+            if raw_data_length.value > len(raw_data):
+                # The cloud did not fit into the buffer, fetch it from the library without decoding it again.
+                raw_data = bytearray(raw_data_length.value)
+                if not self._lib.pointCloudTransportCodecsContextGetLastDecodedData(
+                        self._context, len(raw_data), _get_rw_c_buffer(raw_data)):
+                    return None, "Could not retrieve the decoded point cloud data."
+            elif raw_data_length.value < len(raw_data):
+                del raw_data[raw_data_length.value:]
+            self._last_raw_data_length = raw_data_length.value
+
+            raw = PointCloud2()
+            if hasattr(compressed, 'header'):
+                raw.header = compressed.header
+            raw.height = raw_height.value
+            raw.width = raw_width.value
+            for i in range(raw_num_fields.value):
+                f = PointField()
+                f.name = field_names_allocator.values[i]
+                f.offset = field_offset_allocator.values[i]
+                f.datatype = field_datatype_allocator.values[i]
+                f.count = field_count_allocator.values[i]
+                raw.fields.append(f)
+            raw.is_bigendian = bool(raw_is_big_endian.value)
+            raw.point_step = raw_point_step.value
+            raw.row_step = raw_row_step.value
+            if sys.version_info[0] == 2:
+                raw.data = map(ord, bytes(raw_data))
+            else:
+                raw.data = raw_data
+            raw.is_dense = bool(raw_is_dense.value)
+            return raw, ""
@@ -3,18 +3,29 @@
 
 """Encoding and decoding of point clouds compressed with any point cloud transport."""
 
-from ctypes import c_bool, c_uint8, c_uint32, c_char_p, c_size_t, POINTER, byref, sizeof
+from ctypes import c_bool, c_uint8, c_uint32, c_char_p, c_size_t, c_void_p, POINTER, byref, cast, sizeof
+
+import sys
 
 from sensor_msgs.msg import PointCloud2, PointField
 
 from cras.ctypes_utils import Allocator, StringAllocator, BytesAllocator, LogMessagesAllocator, ScalarAllocator, \
-    get_ro_c_buffer
+    get_ro_c_buffer, c_array
 from cras.message_utils import dict_to_dynamic_config_msg
 from cras.string_utils import BufferStringIO
 
 from .common import _get_base_library
 
 
+def _get_rw_c_buffer(buf):
+    """Get a ctypes pointer to the memory of the given bytearray (without copying it).
+
+    :param bytearray buf: The buffer.
+    :return: Pointer to the start of the buffer.
+    """
+    return (c_uint8 * len(buf)).from_buffer(buf) if len(buf) > 0 else None
+
+
 def _get_library():
     library = _get_base_library()
     # Add function signatures
@@ -32,9 +43,45 @@ def _get_library():
         Allocator.ALLOCATOR, Allocator.ALLOCATOR,
     ]
 
+    library.pointCloudTransportCodecsDecodeInto.restype = c_bool
+    library.pointCloudTransportCodecsDecodeInto.argtypes = [
+        c_char_p,
+        c_char_p, c_char_p, c_size_t, POINTER(c_uint8),
+        POINTER(c_uint32), POINTER(c_uint32),
+        POINTER(c_size_t), Allocator.ALLOCATOR, Allocator.ALLOCATOR, Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+        POINTER(c_uint8), POINTER(c_uint32), POINTER(c_uint32),
+        c_size_t, POINTER(c_uint8), POINTER(c_size_t),
+        POINTER(c_uint8),
+        c_size_t, POINTER(c_uint8),
+        Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+    ]
+
+    library.pointCloudTransportCodecsDecodeBatch.restype = c_bool
+    library.pointCloudTransportCodecsDecodeBatch.argtypes = [
+        c_char_p, c_size_t,
+        POINTER(c_char_p), POINTER(c_char_p), POINTER(c_size_t), POINTER(c_void_p),
+        POINTER(c_uint32), POINTER(c_uint32),
+        POINTER(c_uint32), Allocator.ALLOCATOR, Allocator.ALLOCATOR, Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+        POINTER(c_uint8), POINTER(c_uint32), POINTER(c_uint32),
+        Allocator.ALLOCATOR,
+        POINTER(c_uint8),
+        POINTER(c_bool),
+        c_size_t, POINTER(c_uint8),
+        c_size_t,
+        Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+    ]
+
+    library.pointCloudTransportCodecsGetLastDecodedData.restype = c_bool
+    library.pointCloudTransportCodecsGetLastDecodedData.argtypes = [c_size_t, POINTER(c_uint8)]
+
     return library
 
 
+# Size of the last decoded cloud. Used as the size of the output buffer for the next cloud, so that the decoded data can
+# be written directly to it in most cases.
+_last_raw_data_length = 0
+
+
 def decode(compressed, topic_or_codec, config=None):
     """Decode the given compressed point cloud encoded with any codec into a raw point cloud.
 
@@ -43,6 +90,7 @@ def decode(compressed, topic_or_codec, config=None):
     :param config: Configuration of the decoding process.
     :type config: dict or dynamic_reconfigure.msg.Config or None
     :return: Tuple of raw cloud and error string. If the decoding fails, cloud is `None` and error string is filled.
+             In Python 3, the data of the cloud are a `bytearray` the decoder wrote directly into.
     :rtype: (sensor_msgs.msg.PointCloud2 or None, str)
     """
     codec = _get_library()
@@ -53,7 +101,6 @@ def decode(compressed, topic_or_codec, config=None):
     field_offset_allocator = ScalarAllocator(c_uint32)
     field_datatype_allocator = ScalarAllocator(c_uint8)
     field_count_allocator = ScalarAllocator(c_uint32)
-    data_allocator = BytesAllocator()
     error_allocator = StringAllocator()
     log_allocator = LogMessagesAllocator()
 
@@ -64,6 +111,10 @@ def decode(compressed, topic_or_codec, config=None):
     raw_point_step = c_uint32()
     raw_row_step = c_uint32()
     raw_is_dense = c_uint8()
+    raw_data_length = c_size_t()
+
+    global _last_raw_data_length
+    raw_data = bytearray(_last_raw_data_length)
 
     compressed_buf = BufferStringIO()
     compressed.serialize(compressed_buf)
@@ -83,15 +134,26 @@ def decode(compressed, topic_or_codec, config=None):
         byref(raw_height), byref(raw_width),
         byref(raw_num_fields), field_names_allocator.get_cfunc(), field_offset_allocator.get_cfunc(),
         field_datatype_allocator.get_cfunc(), field_count_allocator.get_cfunc(),
-        byref(raw_is_big_endian), byref(raw_point_step), byref(raw_row_step), data_allocator.get_cfunc(),
+        byref(raw_is_big_endian), byref(raw_point_step), byref(raw_row_step),
+        len(raw_data), _get_rw_c_buffer(raw_data), byref(raw_data_length),
         byref(raw_is_dense),
         c_size_t(config_buf_len), get_ro_c_buffer(config_buf),
         error_allocator.get_cfunc(), log_allocator.get_cfunc(),
     ]
-    ret = codec.pointCloudTransportCodecsDecode(*args)
+    ret = codec.pointCloudTransportCodecsDecodeInto(*args)
+    del args  # Release the view of raw_data so that it can be resized.
 
     log_allocator.print_log_messages()
     if ret:
+        if raw_data_length.value > len(raw_data):
+            # The cloud did not fit into the buffer, fetch it from the library without decoding it again.
+            raw_data = bytearray(raw_data_length.value)
+            if not codec.pointCloudTransportCodecsGetLastDecodedData(len(raw_data), _get_rw_c_buffer(raw_data)):
+                return None, "Could not retrieve the decoded point cloud data."
+        elif raw_data_length.value < len(raw_data):
+            del raw_data[raw_data_length.value:]
+        _last_raw_data_length = raw_data_length.value
+
         raw = PointCloud2()
         if hasattr(compressed, 'header'):
             raw.header = compressed.header
@@ -107,10 +169,117 @@ def decode(compressed, topic_or_codec, config=None):
         raw.is_bigendian = bool(raw_is_big_endian.value)
         raw.point_step = raw_point_step.value
         raw.row_step = raw_row_step.value
-        raw.data = data_allocator.value
-        import sys
         if sys.version_info[0] == 2:
-            raw.data = map(ord, raw.data)
+            raw.data = map(ord, bytes(raw_data))
+        else:
+            raw.data = raw_data
         raw.is_dense = bool(raw_is_dense.value)
         return raw, ""
     return None, error_allocator.value
+
+
+def decode_batch(compressed_clouds, topic_or_codec, config=None, num_threads=0):
+    """Decode the given compressed point clouds with the same codec and config, using multiple threads.
+
+    This is much faster than calling :func:`decode` for each of the clouds. All clouds should be of the same type.
+
+    :param compressed_clouds: The compressed point clouds.
+    :type compressed_clouds: list of genpy.Message
+    :param str topic_or_codec: Name of the topic the clouds come from or explicit name of the codec.
+    :param config: Configuration of the decoding process.
+    :type config: dict or dynamic_reconfigure.msg.Config or None
+    :param int num_threads: Number of threads to use. Zero means the number of CPU cores.
+    :return: Tuple of the list of results and an error string. Each result is a tuple like the one returned by
+             :func:`decode`. If the whole batch fails, the list is `None` and error string is filled.
+    :rtype: (list of (sensor_msgs.msg.PointCloud2 or None, str) or None, str)
+    """
+    codec = _get_library()
+    if codec is None:
+        return None, "Could not load the codec library."
+
+    num_clouds = len(compressed_clouds)
+
+    field_names_allocator = StringAllocator()
+    field_offset_allocator = ScalarAllocator(c_uint32)
+    field_datatype_allocator = ScalarAllocator(c_uint8)
+    field_count_allocator = ScalarAllocator(c_uint32)
+    data_allocator = BytesAllocator()
+    error_allocator = StringAllocator()
+    log_allocator = LogMessagesAllocator()
+
+    raw_height = (c_uint32 * num_clouds)()
+    raw_width = (c_uint32 * num_clouds)()
+    raw_num_fields = (c_uint32 * num_clouds)()
+    raw_is_big_endian = (c_uint8 * num_clouds)()
+    raw_point_step = (c_uint32 * num_clouds)()
+    raw_row_step = (c_uint32 * num_clouds)()
+    raw_is_dense = (c_uint8 * num_clouds)()
+    success = (c_bool * num_clouds)()
+
+    compressed_bufs = []
+    compressed_buf_lens = []
+    for compressed in compressed_clouds:
+        compressed_buf = BufferStringIO()
+        compressed.serialize(compressed_buf)
+        compressed_buf_lens.append(compressed_buf.tell())
+        compressed_buf.seek(0)
+        compressed_bufs.append(compressed_buf)
+    # Keep references to the buffers until the call finishes.
+    compressed_ptrs = [get_ro_c_buffer(b) for b in compressed_bufs]
+
+    config = dict_to_dynamic_config_msg(config)
+    config_buf = BufferStringIO()
+    config.serialize(config_buf)
+    config_buf_len = config_buf.tell()
+    config_buf.seek(0)
+
+    args = [
+        topic_or_codec.encode("utf-8"), num_clouds,
+        c_array([c._type.encode("utf-8") for c in compressed_clouds], c_char_p),
+        c_array([c._md5sum.encode("utf-8") for c in compressed_clouds], c_char_p),
+        c_array(compressed_buf_lens, c_size_t),
+        c_array([cast(p, c_void_p) for p in compressed_ptrs], c_void_p),
+        raw_height, raw_width,
+        raw_num_fields, field_names_allocator.get_cfunc(), field_offset_allocator.get_cfunc(),
+        field_datatype_allocator.get_cfunc(), field_count_allocator.get_cfunc(),
+        raw_is_big_endian, raw_point_step, raw_row_step, data_allocator.get_cfunc(),
+        raw_is_dense,
+        success,
+        c_size_t(config_buf_len), get_ro_c_buffer(config_buf),
+        num_threads,
+        error_allocator.get_cfunc(), log_allocator.get_cfunc(),
+    ]
+    ret = codec.pointCloudTransportCodecsDecodeBatch(*args)
+
+    log_allocator.print_log_messages()
+    if not ret:
+        return None, error_allocator.value
+
+    results = []
+    field_idx = 0
+    for i, compressed in enumerate(compressed_clouds):
+        if not success[i]:
+            results.append((None, error_allocator.values[i]))
+            continue
+        raw = PointCloud2()
+        if hasattr(compressed, 'header'):
+            raw.header = compressed.header
+        raw.height = raw_height[i]
+        raw.width = raw_width[i]
+        for _ in range(raw_num_fields[i]):
+            f = PointField()
+            f.name = field_names_allocator.values[field_idx]
+            f.offset = field_offset_allocator.values[field_idx]
+            f.datatype = field_datatype_allocator.values[field_idx]
+            f.count = field_count_allocator.values[field_idx]
+            raw.fields.append(f)
+            field_idx += 1
+        raw.is_bigendian = bool(raw_is_big_endian[i])
+        raw.point_step = raw_point_step[i]
+        raw.row_step = raw_row_step[i]
+        raw.data = data_allocator.values[i]
+        if sys.version_info[0] == 2:
+            raw.data = map(ord, raw.data)
+        raw.is_dense = bool(raw_is_dense[i])
+        results.append((raw, ""))
+    return results, ""
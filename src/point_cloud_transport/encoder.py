@@ -3,7 +3,7 @@
 
 """Encoding and decoding of point clouds compressed with any point cloud transport."""
 
-from ctypes import c_bool, c_uint8, c_uint32, c_char_p, c_size_t, POINTER
+from ctypes import c_bool, c_uint8, c_uint32, c_char_p, c_size_t, c_void_p, cast, POINTER
 
 from cras import get_msg_type
 from cras.ctypes_utils import Allocator, StringAllocator, BytesAllocator, LogMessagesAllocator, get_ro_c_buffer, c_array
@@ -27,9 +27,53 @@ def _get_library():
         Allocator.ALLOCATOR, Allocator.ALLOCATOR,
     ]
 
+    library.pointCloudTransportCodecsEncodeBatch.restype = c_bool
+    library.pointCloudTransportCodecsEncodeBatch.argtypes = [
+        c_char_p, c_size_t,
+        POINTER(c_uint32), POINTER(c_uint32), POINTER(c_size_t), POINTER(c_char_p), POINTER(c_uint32),
+        POINTER(c_uint8), POINTER(c_uint32),
+        POINTER(c_uint8), POINTER(c_uint32), POINTER(c_uint32), POINTER(c_size_t), POINTER(c_void_p),
+        POINTER(c_uint8),
+        Allocator.ALLOCATOR, Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+        POINTER(c_bool),
+        c_size_t, POINTER(c_uint8),
+        c_size_t,
+        Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+    ]
+
+    library.pointCloudTransportCodecsTranscode.restype = c_bool
+    library.pointCloudTransportCodecsTranscode.argtypes = [
+        c_char_p, c_char_p, c_char_p, c_size_t, POINTER(c_uint8),
+        c_char_p,
+        Allocator.ALLOCATOR, Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+        c_size_t, POINTER(c_uint8),
+        c_size_t, POINTER(c_uint8),
+        Allocator.ALLOCATOR, Allocator.ALLOCATOR,
+    ]
+
     return library
 
 
+def _serialize_config(config):
+    config = dict_to_dynamic_config_msg(config)
+    config_buf = BufferStringIO()
+    config.serialize(config_buf)
+    config_buf_len = config_buf.tell()
+    config_buf.seek(0)
+    return config_buf, config_buf_len
+
+
+def _deserialize_compressed(msg_type_name, md5sum, data, header):
+    msg_type = get_msg_type(msg_type_name)
+    compressed = msg_type()
+    if md5sum != compressed._md5sum:
+        return None, "MD5 sum mismatch for %s: %s vs %s" % (msg_type_name, md5sum, compressed._md5sum)
+    compressed.deserialize(data)
+    if header is not None:
+        compressed.header = header
+    return compressed, ""
+
+
 def encode(raw, topic_or_codec, config=None):
     """Encode the given raw image into a compressed image with a suitable codec.
 
@@ -45,11 +89,7 @@ def encode(raw, topic_or_codec, config=None):
     if codec is None:
         return None, "Could not load the codec library."
 
-    config = dict_to_dynamic_config_msg(config)
-    config_buf = BufferStringIO()
-    config.serialize(config_buf)
-    config_buf_len = config_buf.tell()
-    config_buf.seek(0)
+    config_buf, config_buf_len = _serialize_config(config)
 
     type_allocator = StringAllocator()
     md5sum_allocator = StringAllocator()
@@ -76,12 +116,134 @@ def encode(raw, topic_or_codec, config=None):
 
     log_allocator.print_log_messages()
     if ret:
-        msg_type = get_msg_type(type_allocator.value)
-        compressed = msg_type()
-        if md5sum_allocator.value != compressed._md5sum:
-            return None, "MD5 sum mismatch for %s: %s vs %s" % (
-                type_allocator.value, md5sum_allocator.value, compressed._md5sum)
-        compressed.deserialize(data_allocator.value)
-        compressed.header = raw.header
-        return compressed, ""
+        return _deserialize_compressed(type_allocator.value, md5sum_allocator.value, data_allocator.value, raw.header)
     return None, error_allocator.value
+
+
+def encode_batch(raws, topic_or_codec, config=None, num_threads=0):
+    """Encode the given raw point clouds with the same codec and config, using multiple threads.
+
+    This is much faster than calling :func:`encode` for each of the clouds.
+
+    :param raws: The raw point clouds.
+    :type raws: list of sensor_msgs.msg.PointCloud2
+    :param str topic_or_codec: Name of the topic where the clouds should be published or explicit name of the codec.
+    :param config: Configuration of the encoding process.
+    :type config: dict or dynamic_reconfigure.msg.Config or None
+    :param int num_threads: Number of threads to use. Zero means the number of CPU cores.
+    :return: Tuple of the list of results and an error string. Each result is a tuple like the one returned by
+             :func:`encode`. If the whole batch fails, the list is `None` and error string is filled.
+    :rtype: (list of (genpy.Message or None, str) or None, str)
+    """
+    codec = _get_library()
+    if codec is None:
+        return None, "Could not load the codec library."
+
+    config_buf, config_buf_len = _serialize_config(config)
+
+    type_allocator = StringAllocator()
+    md5sum_allocator = StringAllocator()
+    data_allocator = BytesAllocator()
+    error_allocator = StringAllocator()
+    log_allocator = LogMessagesAllocator()
+
+    fields = [f for raw in raws for f in raw.fields]
+    # Keep references to the data buffers until the call finishes.
+    data_buffers = [get_ro_c_buffer(raw.data) for raw in raws]
+    success = (c_bool * len(raws))()
+
+    args = [
+        topic_or_codec.encode("utf-8"), len(raws),
+        c_array([raw.height for raw in raws], c_uint32),
+        c_array([raw.width for raw in raws], c_uint32),
+        c_array([len(raw.fields) for raw in raws], c_size_t),
+        c_array([f.name.encode("utf-8") for f in fields], c_char_p),
+        c_array([f.offset for f in fields], c_uint32),
+        c_array([f.datatype for f in fields], c_uint8),
+        c_array([f.count for f in fields], c_uint32),
+        c_array([raw.is_bigendian for raw in raws], c_uint8),
+        c_array([raw.point_step for raw in raws], c_uint32),
+        c_array([raw.row_step for raw in raws], c_uint32),
+        c_array([len(raw.data) for raw in raws], c_size_t),
+        c_array([cast(b, c_void_p) for b in data_buffers], c_void_p),
+        c_array([raw.is_dense for raw in raws], c_uint8),
+        type_allocator.get_cfunc(), md5sum_allocator.get_cfunc(), data_allocator.get_cfunc(),
+        success,
+        c_size_t(config_buf_len), get_ro_c_buffer(config_buf),
+        num_threads,
+        error_allocator.get_cfunc(), log_allocator.get_cfunc(),
+    ]
+
+    ret = codec.pointCloudTransportCodecsEncodeBatch(*args)
+
+    log_allocator.print_log_messages()
+    if not ret:
+        return None, error_allocator.value
+
+    results = []
+    for i, raw in enumerate(raws):
+        if not success[i]:
+            results.append((None, error_allocator.values[i]))
+        elif len(type_allocator.values[i]) == 0:
+            results.append((None, ""))
+        else:
+            results.append(_deserialize_compressed(
+                type_allocator.values[i], md5sum_allocator.values[i], data_allocator.values[i], raw.header))
+    return results, ""
+
+
+def transcode(compressed, topic_or_codec, codec_name, config=None, decoder_config=None):
+    """Convert the given compressed point cloud to a different transport.
+
+    This is faster than calling :func:`point_cloud_transport.decode` and :func:`encode` because the raw cloud is never
+    converted to Python. If both transports are the same and `config` is empty, the cloud is returned without decoding.
+    Each message is converted on its own, so a chunk of a chunked transport becomes a message with just its points.
+
+    :param genpy.Message compressed: The compressed point cloud.
+    :param str topic_or_codec: Name of the topic this cloud comes from or explicit name of its codec.
+    :param str codec_name: Name of the codec to encode the cloud with.
+    :param config: Configuration of the encoding process.
+    :type config: dict or dynamic_reconfigure.msg.Config or None
+    :param decoder_config: Configuration of the decoding process.
+    :type decoder_config: dict or dynamic_reconfigure.msg.Config or None
+    :return: Tuple of compressed cloud and error string. If the transcoding fails, cloud is `None` and error string
+             is filled.
+    :rtype: (genpy.Message or None, str)
+    """
+    codec = _get_library()
+    if codec is None:
+        return None, "Could not load the codec library."
+
+    config_buf, config_buf_len = _serialize_config(config)
+    decoder_config_buf, decoder_config_buf_len = _serialize_config(decoder_config)
+
+    compressed_buf = BufferStringIO()
+    compressed.serialize(compressed_buf)
+    compressed_buf_len = compressed_buf.tell()
+    compressed_buf.seek(0)
+
+    type_allocator = StringAllocator()
+    md5sum_allocator = StringAllocator()
+    data_allocator = BytesAllocator()
+    error_allocator = StringAllocator()
+    log_allocator = LogMessagesAllocator()
+
+    args = [
+        topic_or_codec.encode("utf-8"),
+        compressed._type.encode("utf-8"), compressed._md5sum.encode("utf-8"), compressed_buf_len,
+        get_ro_c_buffer(compressed_buf),
+        codec_name.encode("utf-8"),
+        type_allocator.get_cfunc(), md5sum_allocator.get_cfunc(), data_allocator.get_cfunc(),
+        c_size_t(config_buf_len), get_ro_c_buffer(config_buf),
+        c_size_t(decoder_config_buf_len), get_ro_c_buffer(decoder_config_buf),
+        error_allocator.get_cfunc(), log_allocator.get_cfunc(),
+    ]
+
+    ret = codec.pointCloudTransportCodecsTranscode(*args)
+
+    log_allocator.print_log_messages()
+    if not ret:
+        return None, error_allocator.value
+    if not type_allocator.value:
+        return None, ""
+    return _deserialize_compressed(type_allocator.value, md5sum_allocator.value, data_allocator.value, None)
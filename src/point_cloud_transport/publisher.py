@@ -12,7 +12,7 @@ from cras import get_msg_type, get_cfg_module
 from cras.ctypes_utils import Allocator, StringAllocator
 
 from .common import _get_base_library, _TransportInfo
-from .encoder import encode
+from .codec import Codec
 
 
 def _get_library():
@@ -66,6 +66,7 @@ class Publisher(object):
         blacklist = set(rospy.get_param(self.base_topic + "/disable_pub_plugins", []))
 
         self.publishers = {}
+        self.codecs = {}
         self.config_servers = {}
         for transport in self.transports:
             if transport in blacklist:
@@ -73,25 +74,40 @@ class Publisher(object):
             topic_to_publish = self.transports[transport]
             self.publishers[transport] = rospy.Publisher(
                 topic_to_publish.topic, topic_to_publish.data_type, *args, **kwargs)
+            self.codecs[transport] = Codec(topic_to_publish.name)
             if topic_to_publish.config_data_type is not None:
                 self.config_servers[transport] = dynamic_reconfigure.server.Server(
-                    topic_to_publish.config_data_type, lambda conf, _: conf, namespace=topic_to_publish.topic)
+                    topic_to_publish.config_data_type, self._get_config_callback(self.codecs[transport]),
+                    namespace=topic_to_publish.topic)
+
+    @staticmethod
+    def _get_config_callback(codec):
+        def cb(config, _):
+            ok, err = codec.set_config(config)
+            if not ok:
+                rospy.logerr(err)
+            return config
+        return cb
 
     def get_num_subscribers(self):
-        sum([p.get_num_connections() for p in self.publishers.values()])
+        return sum([p.get_num_connections() for p in self.publishers.values()])
 
     def get_topic(self):
         return self.base_topic
 
     def publish(self, raw):
-        for transport, transport_info in self.transports.items():
-            config = self.config_servers[transport].config if transport in self.config_servers else None
-            compressed, err = encode(raw, transport_info.name, config)
+        for transport, publisher in self.publishers.items():
+            # Do not waste time encoding clouds nobody listens to.
+            if publisher.get_num_connections() == 0:
+                continue
+            compressed, err = self.codecs[transport].encode(raw)
             if compressed is not None:
-                self.publishers[transport].publish(compressed)
-            else:
+                publisher.publish(compressed)
+            elif err:
                 rospy.logerr(err)
 
     def shutdown(self):
         for publisher in self.publishers.values():
             publisher.unregister()
+        for codec in self.codecs.values():
+            codec.close()
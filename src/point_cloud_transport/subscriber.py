@@ -12,7 +12,7 @@ from cras import get_msg_type, get_cfg_module
 from cras.ctypes_utils import Allocator, StringAllocator
 
 from .common import _get_base_library, _TransportInfo
-from .decoder import decode
+from .codec import Codec
 
 
 def _get_library():
@@ -79,18 +79,24 @@ class Subscriber(object):
         if self.transport_info is None:
             raise RuntimeError("Point cloud transport '%s' not found." % (self.transport,))
 
-        self.subscriber = rospy.Subscriber(
-            self.transport_info.topic, self.transport_info.data_type, self.cb, *args, **kwargs)
+        self.codec = Codec(self.transport_info.name)
         if self.transport_info.config_data_type is not None:
             self.config_server = dynamic_reconfigure.server.Server(
-                self.transport_info.config_data_type, lambda conf, _: conf,
+                self.transport_info.config_data_type, self._config_cb,
                 namespace=rospy.names.ns_join(parameter_namespace, self.transport_info.name))
         else:
             self.config_server = None
+        self.subscriber = rospy.Subscriber(
+            self.transport_info.topic, self.transport_info.data_type, self.cb, *args, **kwargs)
+
+    def _config_cb(self, config, _):
+        ok, err = self.codec.set_config(config)
+        if not ok:
+            rospy.logerr(err)
+        return config
 
     def cb(self, msg):
-        config = self.config_server.config if self.config_server is not None else None
-        raw, err = decode(msg, self.transport_info.name, config)
+        raw, err = self.codec.decode(msg)
         if raw is not None:
             if self.callback_args is None:
                 self.callback(raw)
@@ -107,3 +113,4 @@ class Subscriber(object):
 
     def shutdown(self):
         self.subscriber.unregister()
+        self.codec.close()
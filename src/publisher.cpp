@@ -38,28 +38,90 @@
  *
  */
 
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/erase.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/bind.hpp>
 #include <boost/bind/placeholders.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <cras_cpp_common/optional.hpp>
+#include <dynamic_reconfigure/Config.h>
 #include <pluginlib/class_loader.h>
 #include <ros/forwards.h>
 #include <ros/node_handle.h>
+#include <ros/param.h>
+#include <ros/publisher.h>
+#include <ros/this_node.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <XmlRpcValue.h>
 
+#include <point_cloud_transport/adaptive_controller.h>
 #include <point_cloud_transport/exception.h>
+#include <point_cloud_transport/loader_registry.h>
+#include <point_cloud_transport/point_cloud_projection.h>
 #include <point_cloud_transport/publisher.h>
+#include <point_cloud_transport/publisher_options.h>
 #include <point_cloud_transport/publisher_plugin.h>
+#include <point_cloud_transport/rate_limiter.h>
 #include <point_cloud_transport/single_subscriber_publisher.h>
+#include <point_cloud_transport/thread_pool.h>
+#include <point_cloud_transport/TransportStatistics.h>
 
 namespace point_cloud_transport
 {
 
+//! \brief Counts down the encoders that have not yet finished publishing (for parallel encoding with waiting).
+struct PendingEncoders
+{
+  explicit PendingEncoders(size_t count) : count_(count)
+  {
+  }
+
+  void done()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--count_ == 0)
+      cv_.notify_all();
+  }
+
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return count_ == 0; });
+  }
+
+  size_t count_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+//! \brief Marks one encoder as done when the task holding it is destroyed, i.e. also when the task is dropped.
+struct PendingEncoderTicket
+{
+  explicit PendingEncoderTicket(const std::shared_ptr<PendingEncoders>& pending) : pending_(pending)
+  {
+  }
+
+  ~PendingEncoderTicket()
+  {
+    pending_->done();
+  }
+
+  const std::shared_ptr<PendingEncoders> pending_;
+};
+
 struct Publisher::Impl
 {
   Impl() : unadvertised_(false)
@@ -76,6 +138,8 @@ struct Publisher::Impl
     uint32_t count = 0;
     for (const auto& pub : publishers_)
       count += pub->getNumSubscribers();
+    for (const auto& pub : projection_pubs_)
+      count += pub.getNumSubscribers();
     return count;
   }
 
@@ -89,23 +153,287 @@ struct Publisher::Impl
     return !unadvertised_;
   }
 
+  typedef boost::shared_ptr<point_cloud_transport::PublisherPlugin> PluginPtr;
+  typedef std::function<void(const PluginPtr&)> PluginPublishFn;
+
+  //! \brief Publish using all transports that have a subscriber.
+  //! \param publish_fn The function publishing the cloud on the given plugin.
+  //! \param copy_fn If the function is going to be called after the call to publish() finishes, this function is
+  //!                used instead of publish_fn. It has to hold all the data it needs.
+  void publish(const PluginPublishFn& publish_fn, const std::function<PluginPublishFn()>& copy_fn) const
+  {
+    std::vector<size_t> active;
+    for (size_t i = 0; i < publishers_.size(); ++i)
+    {
+      if (publishers_[i]->getNumSubscribers() > 0 && rate_limiters_[i]->accept())
+        active.push_back(i);
+    }
+
+    const auto wait = waitForEncoders();
+    // Only the posting needs the lock. The strands drop the posted tasks if shutdown() destroys them meanwhile.
+    std::unique_lock<std::mutex> strands_lock(encode_strands_mutex_);
+    if (encode_strands_.empty() || (wait && active.size() <= 1))
+    {
+      strands_lock.unlock();
+      for (const auto i : active)
+        publish_fn(publishers_[i]);
+      return;
+    }
+
+    if (!wait)
+    {
+      if (active.empty())
+        return;
+      const auto fn = copy_fn();
+      for (const auto i : active)
+      {
+        const auto pub = publishers_[i];
+        if (!encode_strands_[i]->post([fn, pub] { fn(pub); }))
+        {
+          ROS_WARN_THROTTLE(5.0, "Transport %s of topic %s is not keeping up, dropping a point cloud.",
+                            pub->getTransportName().c_str(), base_topic_.c_str());
+        }
+      }
+      return;
+    }
+
+    // The caller's thread encodes the first transport, the other ones are encoded by the worker threads.
+    // The strands drop the tasks when they are shutting down (or when the queue overflows), and the dropped tasks
+    // never run. Each task holds a ticket that is released when the task finishes or is dropped, so that the wait
+    // below always ends.
+    auto pending = std::make_shared<PendingEncoders>(active.size() - 1);
+    for (size_t j = 1; j < active.size(); ++j)
+    {
+      const auto pub = publishers_[active[j]];
+      const auto ticket = std::make_shared<PendingEncoderTicket>(pending);
+      encode_strands_[active[j]]->post([&publish_fn, pub, ticket] { publish_fn(pub); });
+    }
+    strands_lock.unlock();
+
+    // The tasks reference publish_fn, so this function may not return before they finish.
+    try
+    {
+      publish_fn(publishers_[active[0]]);
+    }
+    catch (...)
+    {
+      pending->wait();
+      throw;
+    }
+    pending->wait();
+  }
+
+  //! \brief Project the cloud to each field subset that has subscribers and publish it via the nested publisher.
+  void publishProjections(const sensor_msgs::PointCloud2& message) const
+  {
+    for (size_t i = 0; i < projection_pubs_.size(); ++i)
+    {
+      if (projection_pubs_[i].getNumSubscribers() == 0)
+        continue;
+
+      const auto projected = projectFields(message, projection_fields_[i]);
+      if (!projected)
+      {
+        ROS_ERROR_THROTTLE(5.0, "Cannot publish projection %s of topic %s: %s",
+                           getProjectionName(projection_fields_[i]).c_str(), base_topic_.c_str(),
+                           projected.error().c_str());
+        continue;
+      }
+      projection_pubs_[i].publish(sensor_msgs::PointCloud2ConstPtr(projected.value()));
+    }
+  }
+
+  bool waitForEncoders() const
+  {
+    return options_.parallel_encode_wait && !options_.async_encode;
+  }
+
+  void startParallelEncoding()
+  {
+    if (options_.async_encode)
+    {
+      // Each transport gets its own thread by default so that a slow one can't delay the others.
+      auto num_threads = options_.parallel_encode_threads;
+      if (num_threads == 0)
+        num_threads = publishers_.size();
+
+      encode_pool_ = std::make_unique<ThreadPool>(num_threads);
+      for (size_t i = 0; i < publishers_.size(); ++i)
+      {
+        encode_strands_.push_back(std::make_unique<Strand>(
+          *encode_pool_, options_.async_encode_queue_size, options_.async_encode_overflow_policy));
+      }
+      return;
+    }
+
+    if (!options_.parallel_encode || publishers_.size() < 2)
+      return;
+
+    auto num_threads = options_.parallel_encode_threads;
+    if (num_threads == 0)
+      num_threads = std::min<size_t>(publishers_.size(), std::max(1u, std::thread::hardware_concurrency()));
+
+    encode_pool_ = std::make_unique<ThreadPool>(num_threads);
+    for (size_t i = 0; i < publishers_.size(); ++i)
+      encode_strands_.push_back(std::make_unique<Strand>(*encode_pool_));
+  }
+
+  size_t getNumDroppedClouds(const std::string& transport) const
+  {
+    size_t count = 0;
+    std::unique_lock<std::mutex> strands_lock(encode_strands_mutex_);
+    for (size_t i = 0; i < encode_strands_.size(); ++i)
+    {
+      if (transport.empty() || publishers_[i]->getTransportName() == transport)
+        count += encode_strands_[i]->getNumDropped();
+    }
+    strands_lock.unlock();
+    for (const auto& pub : projection_pubs_)
+      count += pub.getNumDroppedClouds(transport);
+    return count;
+  }
+
+  std::vector<TransportStatistics> getStatistics() const
+  {
+    std::vector<TransportStatistics> result;
+    const auto now = ros::Time::now();
+    for (size_t i = 0; i < publishers_.size(); ++i)
+    {
+      auto stats = publishers_[i]->getStatistics();
+      stats.header.stamp = now;
+      stats.node = ros::this_node::getName();
+      stats.topic = base_topic_;
+      {
+        std::lock_guard<std::mutex> strands_lock(encode_strands_mutex_);
+        if (i < encode_strands_.size())
+        {
+          stats.queue_depth = encode_strands_[i]->getQueueSize();
+          stats.num_dropped = encode_strands_[i]->getNumDropped();
+        }
+      }
+      result.push_back(stats);
+    }
+    for (const auto& pub : projection_pubs_)
+    {
+      const auto stats = pub.getStatistics();
+      result.insert(result.end(), stats.begin(), stats.end());
+    }
+    return result;
+  }
+
+  PluginPtr getPlugin(const std::string& transport) const
+  {
+    for (const auto& pub : publishers_)
+    {
+      if (pub->getTransportName() == transport)
+        return pub;
+    }
+    return nullptr;
+  }
+
+  bool setTransportConfig(const std::string& transport, const dynamic_reconfigure::Config& config)
+  {
+    const auto plugin = getPlugin(transport);
+    if (plugin == nullptr || !plugin->setConfig(config))
+      return false;
+    for (auto& pub : projection_pubs_)
+      pub.setTransportConfig(transport, config);
+    return true;
+  }
+
+  void startStatistics(ros::NodeHandle& nh)
+  {
+    if (options_.statistics_rate <= 0.0)
+      return;
+
+    for (const auto& pub : publishers_)
+    {
+      statistics_pubs_.push_back(nh.advertise<TransportStatistics>(
+        base_topic_ + "/" + pub->getTransportName() + "/statistics", 10));
+    }
+    statistics_timer_ = nh.createWallTimer(ros::WallDuration(1.0 / options_.statistics_rate),
+                                           [this](const ros::WallTimerEvent&) { this->publishStatistics(); });
+  }
+
+  void publishStatistics() const
+  {
+    const auto stats = getStatistics();
+    for (size_t i = 0; i < stats.size() && i < statistics_pubs_.size(); ++i)
+      statistics_pubs_[i].publish(stats[i]);
+  }
+
   void shutdown()
   {
     if (!unadvertised_)
     {
       unadvertised_ = true;
+      adaptive_controller_.reset();
+      for (auto& pub : projection_pubs_)
+        pub.shutdown();
+      projection_pubs_.clear();
+      statistics_timer_.stop();
+      for (auto& pub : statistics_pubs_)
+        pub.shutdown();
+      statistics_pubs_.clear();
+      // Finish the running encoders before shutting down the plugins. The strands are destroyed without the lock,
+      // because that waits for the running encoders.
+      decltype(encode_strands_) strands;
+      {
+        std::lock_guard<std::mutex> strands_lock(encode_strands_mutex_);
+        strands.swap(encode_strands_);
+      }
+      strands.clear();
+      encode_pool_.reset();
+      rate_request_pool_.reset();
       for (auto& pub : publishers_)
         pub->shutdown();
       publishers_.clear();
     }
   }
 
-  void subscriberCB(const point_cloud_transport::SingleSubscriberPublisher& plugin_pub,
+  //! \brief Name of the parameter by which the given subscriber requests a rate of the given transport.
+  std::string getRequestedRateParam(const std::string& transport, const std::string& subscriber) const
+  {
+    return getRequestedRateParamName(base_topic_, transport, subscriber);
+  }
+
+  void subscriberCB(size_t transport_index, bool connected,
+                    const point_cloud_transport::SingleSubscriberPublisher& plugin_pub,
                     const point_cloud_transport::SubscriberStatusCallback& user_cb)
   {
+    if (transport_index < rate_limiters_.size())
+    {
+      const auto& limiter = rate_limiters_[transport_index];
+      if (connected)
+      {
+        // Subscribers request their rate by a parameter (see TransportHints::maxRate()). Reading it needs a call to
+        // the master, so the subscriber gets all clouds until the request is read in the background.
+        const auto subscriber = plugin_pub.getSubscriberName();
+        limiter->addSubscriber(subscriber, 0.0);
+        if (rate_request_pool_)
+        {
+          const auto param = getRequestedRateParam(publishers_[transport_index]->getTransportName(), subscriber);
+          RateLimiter* const limiter_ptr = limiter.get();
+          rate_request_pool_->post([limiter_ptr, subscriber, param]
+          {
+            double requested_rate = 0.0;
+            if (ros::param::get(param, requested_rate))
+              limiter_ptr->setRequestedRate(subscriber, requested_rate);
+          });
+        }
+      }
+      else
+      {
+        limiter->removeSubscriber(plugin_pub.getSubscriberName());
+      }
+    }
+
+    if (!user_cb)
+      return;
+
     point_cloud_transport::SingleSubscriberPublisher ssp(
         plugin_pub.getSubscriberName(), getTopic(), boost::bind(&Publisher::Impl::getNumSubscribers, this),
-        plugin_pub.publish_fn_);
+        plugin_pub.publish_fn_, plugin_pub.publish_ptr_fn_);
     user_cb(ssp);
   }
 
@@ -113,21 +441,120 @@ struct Publisher::Impl
   PubLoaderPtr loader_;
   std::vector<boost::shared_ptr<point_cloud_transport::PublisherPlugin> > publishers_;
   bool unadvertised_;
+  point_cloud_transport::PublisherOptions options_;
+  std::unique_ptr<point_cloud_transport::ThreadPool> encode_pool_;
+  //! \brief Parallel to publishers_. Empty if parallel encoding is not used.
+  std::vector<std::unique_ptr<point_cloud_transport::Strand>> encode_strands_;
+  //! \brief Guards encode_strands_, which shutdown() clears while other threads publish or read the statistics.
+  mutable std::mutex encode_strands_mutex_;
+  //! \brief Parallel to publishers_.
+  std::vector<std::unique_ptr<RateLimiter>> rate_limiters_;
+  //! \brief Reads the rates requested by the connecting subscribers. Declared after rate_limiters_ so that it is
+  //!        destroyed before them.
+  std::unique_ptr<point_cloud_transport::ThreadPool> rate_request_pool_;
+  //! \brief Parallel to publishers_. Empty if the statistics are not published.
+  std::vector<ros::Publisher> statistics_pubs_;
+  ros::WallTimer statistics_timer_;
+  //! \brief The field subsets of options_.projections that are published.
+  std::vector<std::vector<std::string>> projection_fields_;
+  //! \brief Parallel to projection_fields_. Publishers of the projected clouds (they have no projections of their own).
+  std::vector<Publisher> projection_pubs_;
+  //! \brief Started if parameter `<base_topic>/adaptive/parameters` is set.
+  std::unique_ptr<AdaptiveController> adaptive_controller_;
 };
 
+namespace
+{
+
+//! \brief Parse the `projections` parameter (list of lists of field names, or list of comma-separated strings).
+bool parseProjections(XmlRpc::XmlRpcValue& param, std::vector<std::vector<std::string>>& projections)
+{
+  if (param.getType() != XmlRpc::XmlRpcValue::TypeArray)
+    return false;
+
+  std::vector<std::vector<std::string>> result;
+  for (int i = 0; i < param.size(); ++i)
+  {
+    std::vector<std::string> fields;
+    auto& item = param[i];
+    if (item.getType() == XmlRpc::XmlRpcValue::TypeString)
+    {
+      boost::split(fields, static_cast<std::string&>(item), boost::is_any_of(","));
+      for (auto& field : fields)
+        boost::trim(field);
+    }
+    else if (item.getType() == XmlRpc::XmlRpcValue::TypeArray)
+    {
+      for (int j = 0; j < item.size(); ++j)
+      {
+        if (item[j].getType() != XmlRpc::XmlRpcValue::TypeString)
+          return false;
+        fields.push_back(static_cast<std::string&>(item[j]));
+      }
+    }
+    else
+    {
+      return false;
+    }
+    result.push_back(fields);
+  }
+  projections = result;
+  return true;
+}
+
+}
+
 Publisher::Publisher() = default;
 
 Publisher::Publisher(ros::NodeHandle& nh, const std::string& base_topic, uint32_t queue_size,
                      const point_cloud_transport::SubscriberStatusCallback& connect_cb,
                      const point_cloud_transport::SubscriberStatusCallback& disconnect_cb,
                      const ros::VoidPtr& tracked_object, bool latch,
-                     const point_cloud_transport::PubLoaderPtr& loader)
+                     const point_cloud_transport::PubLoaderPtr& loader,
+                     const point_cloud_transport::PublisherOptions& options)
     : impl_(new Impl)
 {
   // Resolve the name explicitly because otherwise the compressed topics don't remap properly
   impl_->base_topic_ = nh.resolveName(base_topic);
   impl_->loader_ = loader;
 
+  impl_->options_ = options;
+  nh.param(impl_->base_topic_ + "/parallel_encode", impl_->options_.parallel_encode, options.parallel_encode);
+  int parallel_encode_threads;
+  nh.param(impl_->base_topic_ + "/parallel_encode_threads", parallel_encode_threads,
+           static_cast<int>(options.parallel_encode_threads));
+  impl_->options_.parallel_encode_threads = static_cast<size_t>(std::max(0, parallel_encode_threads));
+  nh.param(impl_->base_topic_ + "/parallel_encode_wait", impl_->options_.parallel_encode_wait,
+           options.parallel_encode_wait);
+
+  nh.param(impl_->base_topic_ + "/async_encode", impl_->options_.async_encode, options.async_encode);
+  int async_encode_queue_size;
+  nh.param(impl_->base_topic_ + "/async_encode_queue_size", async_encode_queue_size,
+           static_cast<int>(options.async_encode_queue_size));
+  impl_->options_.async_encode_queue_size = static_cast<size_t>(std::max(0, async_encode_queue_size));
+  std::string overflow_policy;
+  if (nh.getParam(impl_->base_topic_ + "/async_encode_overflow_policy", overflow_policy))
+  {
+    if (overflow_policy == "drop_oldest")
+      impl_->options_.async_encode_overflow_policy = QueueOverflowPolicy::DROP_OLDEST;
+    else if (overflow_policy == "drop_newest")
+      impl_->options_.async_encode_overflow_policy = QueueOverflowPolicy::DROP_NEWEST;
+    else if (overflow_policy == "block")
+      impl_->options_.async_encode_overflow_policy = QueueOverflowPolicy::BLOCK;
+    else
+      ROS_ERROR("Invalid value '%s' of parameter %s/async_encode_overflow_policy. Allowed values are drop_oldest, "
+                "drop_newest and block.", overflow_policy.c_str(), impl_->base_topic_.c_str());
+  }
+  nh.param(impl_->base_topic_ + "/statistics_rate", impl_->options_.statistics_rate, options.statistics_rate);
+  nh.param(impl_->base_topic_ + "/lazy_init", impl_->options_.lazy_init, options.lazy_init);
+  XmlRpc::XmlRpcValue projections;
+  if (nh.getParam(impl_->base_topic_ + "/projections", projections) &&
+      !parseProjections(projections, impl_->options_.projections))
+  {
+    ROS_ERROR("Invalid value of parameter %s/projections. It should be a list of lists of field names.",
+              impl_->base_topic_.c_str());
+  }
+
   // sequence container which encapsulates dynamic size arrays
   std::vector<std::string> blacklist_vec;
   // call to parameter server
@@ -136,18 +563,46 @@ Publisher::Publisher(ros::NodeHandle& nh, const std::string& base_topic, uint32_
   // set
   std::set<std::string> blacklist(blacklist_vec.begin(), blacklist_vec.end());
 
-  for (const auto& lookup_name : loader->getDeclaredClasses())
+  // If the allowlist is given, only the listed transports are loaded at all.
+  std::vector<std::string> whitelist_vec;
+  nh.getParam(impl_->base_topic_ + "/enable_pub_plugins", whitelist_vec);
+  std::set<std::string> whitelist(whitelist_vec.begin(), whitelist_vec.end());
+
+  // The subscribers can connect as soon as the first transport is advertised.
+  impl_->rate_request_pool_ = std::make_unique<ThreadPool>(1);
+
+  for (const auto& lookup_name : LoaderRegistry::instance().getDeclaredClasses(*loader))
   {
     const std::string transport_name = boost::erase_last_copy(lookup_name, "_pub");
     if (blacklist.find(transport_name) != blacklist.end())
       continue;
+    if (!whitelist.empty() && whitelist.find(transport_name) == whitelist.end())
+      continue;
 
     try
     {
-      auto pub = loader->createInstance(lookup_name);
+      boost::shared_ptr<PublisherPlugin> pub;
+      {
+        const auto loader_lock = LoaderRegistry::instance().lockLoaders();
+        pub = loader->createInstance(lookup_name);
+      }
+      pub->setLazyInit(impl_->options_.lazy_init);
+
+      TransportRateLimit rate_limit;
+      const auto limit_it = impl_->options_.rate_limits.find(transport_name);
+      if (limit_it != impl_->options_.rate_limits.end())
+        rate_limit = limit_it->second;
+      const auto transport_ns = impl_->base_topic_ + "/" + transport_name;
+      nh.param(transport_ns + "/max_rate", rate_limit.max_rate, rate_limit.max_rate);
+      int publish_every_n;
+      nh.param(transport_ns + "/publish_every_n", publish_every_n, static_cast<int>(rate_limit.publish_every_n));
+      rate_limit.publish_every_n = static_cast<size_t>(std::max(1, publish_every_n));
+
+      const auto transport_index = impl_->publishers_.size();
       impl_->publishers_.push_back(pub);
-      pub->advertise(nh, impl_->base_topic_, queue_size, rebindCB(connect_cb),
-                     rebindCB(disconnect_cb), tracked_object, latch);
+      impl_->rate_limiters_.push_back(std::make_unique<RateLimiter>(rate_limit));
+      pub->advertise(nh, impl_->base_topic_, queue_size, rebindCB(connect_cb, transport_index, true),
+                     rebindCB(disconnect_cb, transport_index, false), tracked_object, latch);
     }
     catch (const std::runtime_error& e)
     {
@@ -160,6 +615,30 @@ Publisher::Publisher(ros::NodeHandle& nh, const std::string& base_topic, uint32_
     throw point_cloud_transport::Exception("No plugins found! Does `rospack plugins --attrib=plugin "
                                             "point_cloud_transport` find any packages?");
   }
+
+  impl_->startParallelEncoding();
+  impl_->startStatistics(nh);
+
+  auto projection_options = impl_->options_;
+  projection_options.projections.clear();
+  for (const auto& fields : impl_->options_.projections)
+  {
+    if (fields.empty())
+      continue;
+    impl_->projection_fields_.push_back(fields);
+    // The constructor is private, so it can't be called by emplace_back().
+    impl_->projection_pubs_.push_back(Publisher(nh, impl_->base_topic_ + "/" + getProjectionName(fields), queue_size,
+                                                connect_cb, disconnect_cb, tracked_object, latch, loader,
+                                                projection_options));
+  }
+
+  if (nh.hasParam(impl_->base_topic_ + "/adaptive/parameters"))
+  {
+    // The controller is owned by impl_, so its publisher must not own impl_. Otherwise, impl_ would never be freed.
+    Publisher self;
+    self.impl_ = ImplPtr(impl_.get(), [](Impl*) {});
+    impl_->adaptive_controller_ = std::make_unique<AdaptiveController>(nh, self);
+  }
 }
 
 uint32_t Publisher::getNumSubscribers() const
@@ -184,13 +663,13 @@ void Publisher::publish(const sensor_msgs::PointCloud2& message) const
     return;
   }
 
-  for (const auto& pub : impl_->publishers_)
+  impl_->publish([&message](const Impl::PluginPtr& pub) { pub->publish(message); }, [&message]
   {
-    if (pub->getNumSubscribers() > 0)
-    {
-      pub->publish(message);
-    }
-  }
+    // The encoders will run after this call returns, so they need their own copy of the message.
+    const sensor_msgs::PointCloud2ConstPtr copy(new sensor_msgs::PointCloud2(message));
+    return Impl::PluginPublishFn([copy](const Impl::PluginPtr& pub) { pub->publish(copy); });
+  });
+  impl_->publishProjections(message);
 }
 
 void Publisher::publish(const sensor_msgs::PointCloud2ConstPtr& message) const
@@ -201,13 +680,50 @@ void Publisher::publish(const sensor_msgs::PointCloud2ConstPtr& message) const
     return;
   }
 
-  for (const auto& pub : impl_->publishers_)
+  impl_->publish([&message](const Impl::PluginPtr& pub) { pub->publish(message); }, [&message]
   {
-    if (pub->getNumSubscribers() > 0)
-    {
-      pub->publish(message);
-    }
-  }
+    const sensor_msgs::PointCloud2ConstPtr msg = message;
+    return Impl::PluginPublishFn([msg](const Impl::PluginPtr& pub) { pub->publish(msg); });
+  });
+  impl_->publishProjections(*message);
+}
+
+size_t Publisher::getNumDroppedClouds() const
+{
+  if (impl_ && impl_->isValid())
+    return impl_->getNumDroppedClouds("");
+  return 0;
+}
+
+size_t Publisher::getNumDroppedClouds(const std::string& transport) const
+{
+  if (impl_ && impl_->isValid())
+    return impl_->getNumDroppedClouds(transport);
+  return 0;
+}
+
+std::vector<TransportStatistics> Publisher::getStatistics() const
+{
+  if (impl_ && impl_->isValid())
+    return impl_->getStatistics();
+  return {};
+}
+
+cras::optional<dynamic_reconfigure::Config> Publisher::getTransportConfig(const std::string& transport) const
+{
+  if (!impl_ || !impl_->isValid())
+    return cras::nullopt;
+  const auto plugin = impl_->getPlugin(transport);
+  if (plugin == nullptr)
+    return cras::nullopt;
+  return plugin->getConfig();
+}
+
+bool Publisher::setTransportConfig(const std::string& transport, const dynamic_reconfigure::Config& config)
+{
+  if (impl_ && impl_->isValid())
+    return impl_->setTransportConfig(transport, config);
+  return false;
 }
 
 void Publisher::shutdown()
@@ -224,28 +740,25 @@ Publisher::operator void*() const
   return (impl_ && impl_->isValid()) ? reinterpret_cast<void*>(1) : nullptr;
 }
 
-void Publisher::weakSubscriberCb(const ImplWPtr& impl_wptr,
+void Publisher::weakSubscriberCb(const ImplWPtr& impl_wptr, size_t transport_index, bool connected,
                                  const point_cloud_transport::SingleSubscriberPublisher& plugin_pub,
                                  const point_cloud_transport::SubscriberStatusCallback& user_cb)
 {
   if (ImplPtr impl = impl_wptr.lock())
   {
-    impl->subscriberCB(plugin_pub, user_cb);
+    impl->subscriberCB(transport_index, connected, plugin_pub, user_cb);
   }
 }
 
-SubscriberStatusCallback Publisher::rebindCB(const point_cloud_transport::SubscriberStatusCallback& user_cb)
+SubscriberStatusCallback Publisher::rebindCB(const point_cloud_transport::SubscriberStatusCallback& user_cb,
+                                             size_t transport_index, bool connected)
 {
   // Note: the subscriber callback must be bound to the internal Impl object, not
   // 'this'. Due to copying behavior the Impl object may outlive the original Publisher
   // instance. But it should not outlive the last Publisher, so we use a weak_ptr.
-  if (user_cb)
-  {
-    ImplWPtr impl_wptr(impl_);
-    return boost::bind(&Publisher::weakSubscriberCb, impl_wptr, _1, user_cb);
-  }
-
-  return {};
+  // The callback is needed even without user_cb to track the rates requested by the subscribers.
+  ImplWPtr impl_wptr(impl_);
+  return boost::bind(&Publisher::weakSubscriberCb, impl_wptr, transport_index, connected, _1, user_cb);
 }
 
 }
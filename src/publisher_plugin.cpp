@@ -40,8 +40,10 @@
 
 #include <list>
 #include <string>
+#include <vector>
 
 #include <cras_cpp_common/expected.hpp>
+#include <cras_cpp_common/optional.hpp>
 #include <cras_cpp_common/xmlrpc_value_utils.hpp>
 #include <dynamic_reconfigure/Config.h>
 #include <ros/forwards.h>
@@ -51,6 +53,7 @@
 
 #include <point_cloud_transport/publisher_plugin.h>
 #include <point_cloud_transport/single_subscriber_publisher.h>
+#include <point_cloud_transport/TransportStatistics.h>
 
 namespace point_cloud_transport
 {
@@ -70,6 +73,16 @@ PublisherPlugin::EncodeResult PublisherPlugin::encode(const sensor_msgs::PointCl
   return this->encode(raw, configMsg);
 }
 
+std::vector<PublisherPlugin::EncodeResult> PublisherPlugin::encodeBatch(
+    const std::vector<sensor_msgs::PointCloud2ConstPtr>& raw, const dynamic_reconfigure::Config& config) const
+{
+  std::vector<EncodeResult> results;
+  results.reserve(raw.size());
+  for (const auto& cloud : raw)
+    results.push_back(this->encode(*cloud, config));
+  return results;
+}
+
 void PublisherPlugin::advertise(ros::NodeHandle& nh, const std::string& base_topic, uint32_t queue_size, bool latch)
 {
   advertiseImpl(nh, base_topic, queue_size, {}, {}, {}, latch);
@@ -88,6 +101,24 @@ void PublisherPlugin::publish(const sensor_msgs::PointCloud2ConstPtr& message) c
   publish(*message);
 }
 
+TransportStatistics PublisherPlugin::getStatistics() const
+{
+  TransportStatistics stats;
+  stats.transport = getTransportName();
+  stats.direction = TransportStatistics::ENCODER;
+  return stats;
+}
+
+cras::optional<dynamic_reconfigure::Config> PublisherPlugin::getConfig() const
+{
+  return cras::nullopt;
+}
+
+bool PublisherPlugin::setConfig(const dynamic_reconfigure::Config&)
+{
+  return false;
+}
+
 std::string PublisherPlugin::getLookupName(const std::string& transport_name)
 {
   return "point_cloud_transport/" + transport_name + "_pub";
@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Layout of the points and quantization of planes shared by the quantized publisher and subscriber.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <cras_cpp_common/optional.hpp>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_repack.h>
+#include <point_cloud_transport/quantized_coding.h>
+
+namespace point_cloud_transport
+{
+namespace quantized
+{
+
+namespace
+{
+
+size_t getFieldSize(const sensor_msgs::PointField& field)
+{
+  switch (field.datatype)
+  {
+    case sensor_msgs::PointField::INT8:
+    case sensor_msgs::PointField::UINT8:
+      return field.count;
+    case sensor_msgs::PointField::INT16:
+    case sensor_msgs::PointField::UINT16:
+      return 2 * field.count;
+    case sensor_msgs::PointField::INT32:
+    case sensor_msgs::PointField::UINT32:
+    case sensor_msgs::PointField::FLOAT32:
+      return 4 * field.count;
+    case sensor_msgs::PointField::FLOAT64:
+      return 8 * field.count;
+    default:
+      return 0;
+  }
+}
+
+bool isFloat(const sensor_msgs::PointField& field)
+{
+  return field.datatype == sensor_msgs::PointField::FLOAT32 && field.count == 1;
+}
+
+}
+
+cras::optional<PointLayout> getPointLayout(const std::vector<sensor_msgs::PointField>& fields, uint32_t point_step,
+                                           bool quantize_intensity)
+{
+  PointLayout layout;
+  bool found[3] = {false, false, false};
+  const char* names[3] = {"x", "y", "z"};
+  std::vector<ByteRun> runs;
+  for (const auto& field : fields)
+  {
+    const auto size = getFieldSize(field);
+    if (size == 0 || field.offset + size > point_step)
+      return cras::nullopt;
+
+    bool quantized = false;
+    for (size_t i = 0; i < 3; ++i)
+    {
+      if (!found[i] && field.name == names[i] && isFloat(field))
+      {
+        layout.xyz[i] = field.offset;
+        found[i] = quantized = true;
+      }
+    }
+    if (!quantized && quantize_intensity && !layout.intensity && field.name == "intensity" && isFloat(field))
+    {
+      layout.intensity = field.offset;
+      quantized = true;
+    }
+    if (!quantized)
+      runs.push_back({field.offset, static_cast<uint32_t>(size)});
+  }
+  if (!found[0] || !found[1] || !found[2])
+    return cras::nullopt;
+
+  // Merge adjacent and overlapping runs, so that each byte is stored once and the runs are as long as possible.
+  std::sort(runs.begin(), runs.end(), [](const ByteRun& a, const ByteRun& b) { return a.offset < b.offset; });
+  for (const auto& run : runs)
+  {
+    if (!layout.other.empty() && run.offset <= layout.other.back().offset + layout.other.back().length)
+    {
+      auto& last = layout.other.back();
+      last.length = std::max(last.length, run.offset + run.length - last.offset);
+    }
+    else
+    {
+      layout.other.push_back(run);
+    }
+  }
+
+  std::vector<uint8_t> covered(point_step, 0);
+  for (const auto offset : layout.xyz)
+    std::fill_n(covered.begin() + offset, sizeof(float), 1);
+  if (layout.intensity)
+    std::fill_n(covered.begin() + *layout.intensity, sizeof(float), 1);
+  for (const auto& run : layout.other)
+  {
+    std::fill_n(covered.begin() + run.offset, run.length, 1);
+    layout.other_size += run.length;
+  }
+  layout.has_padding = std::find(covered.begin(), covered.end(), 0) != covered.end();
+  return layout;
+}
+
+float getResolution(double max_error, double max_abs)
+{
+  // Half of the spacing of the floats the decoded values are rounded to.
+  const double float_rounding = (max_abs + max_error) * std::ldexp(1.0, -24);
+  // Rounding to the grid costs half of the step, the float computations relative to the origin stay below 1 % of it.
+  const double resolution = (max_error - float_rounding) / 0.52;
+  return resolution > 0.0 ? static_cast<float>(resolution) : 0.0f;
+}
+
+bool quantizePlane(float* values, size_t num_values, const std::vector<uint8_t>& valid, double resolution,
+                   int32_t& origin, int16_t* quantized)
+{
+  float min = std::numeric_limits<float>::infinity();
+  float max = -std::numeric_limits<float>::infinity();
+  for (size_t i = 0; i < num_values; ++i)
+  {
+    if (valid[i])
+    {
+      min = std::min(min, values[i]);
+      max = std::max(max, values[i]);
+    }
+    else
+    {
+      values[i] = 0.0f;  // Keep the quantization kernel away from NaNs and infinities.
+    }
+  }
+
+  origin = 0;
+  if (min > max)
+  {
+    std::fill(quantized, quantized + num_values, INVALID_VALUE);
+    return true;
+  }
+
+  // Leave a margin for the rounding.
+  const double scale = 1.0 / resolution;
+  if ((static_cast<double>(max) - min) * scale > 65532.0)
+    return false;
+  const double centre = std::round((static_cast<double>(min) + max) / 2 * scale);
+  if (std::abs(centre) > std::numeric_limits<int32_t>::max())
+    return false;
+  origin = static_cast<int32_t>(centre);
+
+  // Far from zero, floats are too coarse to hold the scaled values, so the origin is subtracted in double first.
+  const double origin_value = origin * resolution;
+  for (size_t i = 0; i < num_values; ++i)
+  {
+    if (valid[i])
+      values[i] = static_cast<float>(values[i] - origin_value);
+  }
+
+  std::vector<int32_t> ints(num_values);
+  quantizeFloats(values, num_values, static_cast<float>(scale), ints.data());
+
+  for (size_t i = 0; i < num_values; ++i)
+  {
+    if (!valid[i])
+    {
+      quantized[i] = INVALID_VALUE;
+      continue;
+    }
+    if (ints[i] < -std::numeric_limits<int16_t>::max() || ints[i] > std::numeric_limits<int16_t>::max())
+      return false;
+    quantized[i] = static_cast<int16_t>(ints[i]);
+  }
+  return true;
+}
+
+void dequantizePlane(const int16_t* quantized, size_t num_values, int32_t origin, float resolution, float* values)
+{
+  const std::vector<int32_t> ints(quantized, quantized + num_values);
+  dequantizeFloats(ints.data(), num_values, resolution, values);
+
+  // Must match the origin subtracted by quantizePlane().
+  const double origin_value = origin * static_cast<double>(resolution);
+  const auto nan = std::numeric_limits<float>::quiet_NaN();
+  for (size_t i = 0; i < num_values; ++i)
+    values[i] = quantized[i] == INVALID_VALUE ? nan : static_cast<float>(values[i] + origin_value);
+}
+
+}
+}
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin sending the coordinates as 16-bit fixed point numbers.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/point_cloud_repack.h>
+#include <point_cloud_transport/PointCloudQuantized.h>
+#include <point_cloud_transport/quantized_coding.h>
+#include <point_cloud_transport/quantized_publisher.h>
+#include <point_cloud_transport/QuantizedPublisherConfig.h>
+
+namespace point_cloud_transport
+{
+
+namespace
+{
+
+bool isHostBigEndian()
+{
+  const uint16_t one = 1;
+  return *reinterpret_cast<const uint8_t*>(&one) == 0;
+}
+
+//! \brief Copy a field (or a run of fields) of all points into a plane, row by row (the rows may be padded).
+void gatherPlane(const sensor_msgs::PointCloud2& cloud, size_t offset, size_t size, uint8_t* plane)
+{
+  const size_t width = cloud.width;
+  if (cloud.row_step == width * cloud.point_step)
+    return gatherField(cloud.data.data() + offset, cloud.height * width, cloud.point_step, size, plane);
+  for (size_t row = 0; row < cloud.height; ++row)
+    gatherField(cloud.data.data() + row * cloud.row_step + offset, width, cloud.point_step, size,
+                plane + row * width * size);
+}
+
+//! \brief Send the points as they are, without padding between the rows.
+void copyPoints(const sensor_msgs::PointCloud2& raw, PointCloudQuantized& msg)
+{
+  msg.quantized = false;
+  msg.intensity_resolution = 0;
+  msg.coordinates.clear();
+  msg.intensity.clear();
+  const size_t row_size = static_cast<size_t>(raw.width) * raw.point_step;
+  msg.data.resize(raw.height * row_size);
+  for (size_t row = 0; row < raw.height && row_size > 0; ++row)
+    memcpy(msg.data.data() + row * row_size, raw.data.data() + row * raw.row_step, row_size);
+}
+
+}
+
+std::string QuantizedPublisher::getTransportName() const
+{
+  return "quantized";
+}
+
+QuantizedPublisher::TypedEncodeResult QuantizedPublisher::encodeTyped(
+    const sensor_msgs::PointCloud2& raw, const QuantizedPublisherConfig& config) const
+{
+  const size_t num_points = static_cast<size_t>(raw.height) * raw.width;
+  if (num_points > 0 && (raw.row_step < static_cast<size_t>(raw.width) * raw.point_step ||
+                         raw.data.size() < static_cast<size_t>(raw.height - 1) * raw.row_step +
+                                           static_cast<size_t>(raw.width) * raw.point_step))
+    return cras::make_unexpected(std::string("The cloud has less data than its dimensions require."));
+
+  PointCloudQuantized msg;
+  msg.header = raw.header;
+  msg.height = raw.height;
+  msg.width = raw.width;
+  msg.fields = raw.fields;
+  msg.is_bigendian = raw.is_bigendian;
+  msg.point_step = raw.point_step;
+  msg.is_dense = raw.is_dense;
+
+  auto layout = quantized::getPointLayout(raw.fields, raw.point_step, config.intensity_resolution > 0);
+  if (!layout || static_cast<bool>(raw.is_bigendian) != isHostBigEndian())
+  {
+    copyPoints(raw, msg);
+    return msg;
+  }
+
+  std::vector<float> planes[3];
+  for (size_t i = 0; i < 3; ++i)
+  {
+    planes[i].resize(num_points);
+    gatherPlane(raw, layout->xyz[i], sizeof(float), reinterpret_cast<uint8_t*>(planes[i].data()));
+  }
+  std::vector<uint8_t> valid(num_points);
+  double max_abs = 0.0;
+  for (size_t i = 0; i < num_points; ++i)
+  {
+    valid[i] = std::isfinite(planes[0][i]) && std::isfinite(planes[1][i]) && std::isfinite(planes[2][i]);
+    if (valid[i])
+      max_abs = std::max({max_abs, std::abs(static_cast<double>(planes[0][i])),
+                          std::abs(static_cast<double>(planes[1][i])), std::abs(static_cast<double>(planes[2][i]))});
+  }
+
+  msg.resolution = quantized::getResolution(config.max_error, max_abs);
+  if (msg.resolution <= 0.0f)
+  {
+    copyPoints(raw, msg);
+    return msg;
+  }
+
+  msg.quantized = true;
+  msg.coordinates.resize(3 * num_points);
+  int32_t* origins[3] = {&msg.origin_x, &msg.origin_y, &msg.origin_z};
+  for (size_t i = 0; i < 3; ++i)
+  {
+    if (!quantized::quantizePlane(planes[i].data(), num_points, valid, msg.resolution, *origins[i],
+                                  msg.coordinates.data() + i * num_points))
+    {
+      copyPoints(raw, msg);
+      return msg;
+    }
+  }
+
+  if (layout->intensity)
+  {
+    std::vector<float> intensity(num_points);
+    gatherPlane(raw, *layout->intensity, sizeof(float), reinterpret_cast<uint8_t*>(intensity.data()));
+    std::vector<uint8_t> valid_intensity(num_points);
+    for (size_t i = 0; i < num_points; ++i)
+      valid_intensity[i] = std::isfinite(intensity[i]);
+    msg.intensity_resolution = static_cast<float>(config.intensity_resolution);
+    msg.intensity.resize(num_points);
+    if (!quantized::quantizePlane(intensity.data(), num_points, valid_intensity, msg.intensity_resolution,
+                                  msg.intensity_origin, msg.intensity.data()))
+    {
+      // The intensities span too many steps, so they are sent exactly with the other fields.
+      msg.intensity_resolution = 0;
+      msg.intensity_origin = 0;
+      msg.intensity.clear();
+      layout = quantized::getPointLayout(raw.fields, raw.point_step, false);
+    }
+  }
+
+  msg.data.resize(num_points * layout->other_size);
+  auto plane = msg.data.data();
+  for (const auto& run : layout->other)
+  {
+    gatherPlane(raw, run.offset, run.length, plane);
+    plane += num_points * run.length;
+  }
+  return msg;
+}
+
+}
@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin decoding clouds with quantized coordinates.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/point_cloud_repack.h>
+#include <point_cloud_transport/PointCloudQuantized.h>
+#include <point_cloud_transport/quantized_coding.h>
+#include <point_cloud_transport/quantized_subscriber.h>
+
+namespace point_cloud_transport
+{
+
+std::string QuantizedSubscriber::getTransportName() const
+{
+  return "quantized";
+}
+
+SubscriberPlugin::DecodeResult QuantizedSubscriber::decodeTyped(
+    const PointCloudQuantized& msg, const NoConfigConfig&) const
+{
+  const size_t num_points = static_cast<size_t>(msg.height) * msg.width;
+  const auto layout = quantized::getPointLayout(msg.fields, msg.point_step, msg.intensity_resolution != 0);
+  if (msg.quantized)
+  {
+    if (!layout)
+      return cras::make_unexpected(std::string("The quantized cloud has invalid fields."));
+    if (msg.coordinates.size() != 3 * num_points || msg.intensity.size() != (layout->intensity ? num_points : 0) ||
+        msg.data.size() != num_points * layout->other_size)
+      return cras::make_unexpected(std::string("The quantized cloud has wrong size of data."));
+  }
+  else if (msg.data.size() != num_points * msg.point_step)
+  {
+    return cras::make_unexpected(std::string("The cloud has wrong size of data."));
+  }
+
+  const auto cloud = this->allocateCloud(msg.height, msg.width, msg.point_step);
+  cloud->header = msg.header;
+  cloud->fields = msg.fields;
+  cloud->is_bigendian = msg.is_bigendian;
+  cloud->is_dense = msg.is_dense;
+
+  if (!msg.quantized)
+  {
+    if (!msg.data.empty())
+      memcpy(cloud->data.data(), msg.data.data(), msg.data.size());
+    return sensor_msgs::PointCloud2ConstPtr(cloud);
+  }
+
+  if (num_points == 0)
+    return sensor_msgs::PointCloud2ConstPtr(cloud);
+
+  // Clear the padding between the fields.
+  if (layout->has_padding)
+    memset(cloud->data.data(), 0, cloud->data.size());
+
+  std::vector<float> plane(num_points);
+  const int32_t origins[3] = {msg.origin_x, msg.origin_y, msg.origin_z};
+  for (size_t i = 0; i < 3; ++i)
+  {
+    quantized::dequantizePlane(msg.coordinates.data() + i * num_points, num_points, origins[i], msg.resolution,
+                               plane.data());
+    scatterField(reinterpret_cast<const uint8_t*>(plane.data()), num_points, sizeof(float), msg.point_step,
+                 cloud->data.data() + layout->xyz[i]);
+  }
+  if (layout->intensity)
+  {
+    quantized::dequantizePlane(msg.intensity.data(), num_points, msg.intensity_origin, msg.intensity_resolution,
+                               plane.data());
+    scatterField(reinterpret_cast<const uint8_t*>(plane.data()), num_points, sizeof(float), msg.point_step,
+                 cloud->data.data() + *layout->intensity);
+  }
+
+  auto data = msg.data.data();
+  for (const auto& run : layout->other)
+  {
+    scatterField(data, num_points, run.length, msg.point_step, cloud->data.data() + run.offset);
+    data += num_points * run.length;
+  }
+
+  return sensor_msgs::PointCloud2ConstPtr(cloud);
+}
+
+}
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Coding of the planes of range images shared by the range_image publisher and subscriber.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_repack.h>
+#include <point_cloud_transport/range_image_coding.h>
+
+namespace point_cloud_transport
+{
+namespace range_image
+{
+
+bool isCoordinate(const sensor_msgs::PointField& field)
+{
+  return field.name == "x" || field.name == "y" || field.name == "z";
+}
+
+size_t getFieldSize(const sensor_msgs::PointField& field)
+{
+  switch (field.datatype)
+  {
+    case sensor_msgs::PointField::INT8:
+    case sensor_msgs::PointField::UINT8:
+      return field.count;
+    case sensor_msgs::PointField::INT16:
+    case sensor_msgs::PointField::UINT16:
+      return 2 * field.count;
+    case sensor_msgs::PointField::INT32:
+    case sensor_msgs::PointField::UINT32:
+    case sensor_msgs::PointField::FLOAT32:
+      return 4 * field.count;
+    case sensor_msgs::PointField::FLOAT64:
+      return 8 * field.count;
+    default:
+      return 0;
+  }
+}
+
+PlaneCoding getPlaneCoding(const sensor_msgs::PointField& field, float intensity_resolution)
+{
+  if (field.count != 1)
+    return PlaneCoding::RAW;
+  switch (field.datatype)
+  {
+    case sensor_msgs::PointField::INT8:
+    case sensor_msgs::PointField::UINT8:
+    case sensor_msgs::PointField::INT16:
+    case sensor_msgs::PointField::UINT16:
+    case sensor_msgs::PointField::INT32:
+    case sensor_msgs::PointField::UINT32:
+      return PlaneCoding::DELTA;
+    case sensor_msgs::PointField::FLOAT32:
+      return (field.name == "intensity" && intensity_resolution > 0) ? PlaneCoding::QUANTIZED : PlaneCoding::RAW;
+    default:
+      return PlaneCoding::RAW;
+  }
+}
+
+void encodeDeltas(const std::vector<int64_t>& values, std::vector<uint8_t>& out)
+{
+  int64_t previous = 0;
+  for (const auto value : values)
+  {
+    // Wrapping subtraction, so that also the invalid value sentinels can be coded.
+    const auto diff = static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(previous));
+    previous = value;
+    auto zigzag = (static_cast<uint64_t>(diff) << 1) ^ static_cast<uint64_t>(diff >> 63);
+    while (zigzag >= 0x80)
+    {
+      out.push_back(static_cast<uint8_t>(zigzag | 0x80));
+      zigzag >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(zigzag));
+  }
+}
+
+bool decodeDeltas(const uint8_t*& data, const uint8_t* end, std::vector<int64_t>& values)
+{
+  uint64_t previous = 0;
+  for (auto& value : values)
+  {
+    uint64_t zigzag = 0;
+    for (unsigned shift = 0;; shift += 7)
+    {
+      if (data == end || shift > 63)
+        return false;
+      const auto byte = *data++;
+      zigzag |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+        break;
+    }
+    const auto diff = (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+    previous += diff;
+    value = static_cast<int64_t>(previous);
+  }
+  return true;
+}
+
+int64_t readInteger(const uint8_t* data, uint8_t datatype)
+{
+  switch (datatype)
+  {
+    case sensor_msgs::PointField::INT8:
+    {
+      int8_t v;
+      memcpy(&v, data, sizeof(v));
+      return v;
+    }
+    case sensor_msgs::PointField::UINT8:
+      return *data;
+    case sensor_msgs::PointField::INT16:
+    {
+      int16_t v;
+      memcpy(&v, data, sizeof(v));
+      return v;
+    }
+    case sensor_msgs::PointField::UINT16:
+    {
+      uint16_t v;
+      memcpy(&v, data, sizeof(v));
+      return v;
+    }
+    case sensor_msgs::PointField::INT32:
+    {
+      int32_t v;
+      memcpy(&v, data, sizeof(v));
+      return v;
+    }
+    case sensor_msgs::PointField::UINT32:
+    {
+      uint32_t v;
+      memcpy(&v, data, sizeof(v));
+      return v;
+    }
+    default:
+      return 0;
+  }
+}
+
+void writeInteger(uint8_t* data, uint8_t datatype, int64_t value)
+{
+  switch (datatype)
+  {
+    case sensor_msgs::PointField::INT8:
+    case sensor_msgs::PointField::UINT8:
+      *data = static_cast<uint8_t>(value);
+      break;
+    case sensor_msgs::PointField::INT16:
+    case sensor_msgs::PointField::UINT16:
+    {
+      const auto v = static_cast<uint16_t>(value);
+      memcpy(data, &v, sizeof(v));
+      break;
+    }
+    case sensor_msgs::PointField::INT32:
+    case sensor_msgs::PointField::UINT32:
+    {
+      const auto v = static_cast<uint32_t>(value);
+      memcpy(data, &v, sizeof(v));
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void gatherPlane(const sensor_msgs::PointCloud2& cloud, size_t offset, size_t value_size, uint8_t* plane)
+{
+  for (size_t row = 0; row < cloud.height; ++row)
+  {
+    gatherField(cloud.data.data() + row * cloud.row_step + offset, cloud.width, cloud.point_step, value_size,
+                plane + row * cloud.width * value_size);
+  }
+}
+
+void scatterPlane(const uint8_t* plane, size_t offset, size_t value_size, sensor_msgs::PointCloud2& cloud)
+{
+  for (size_t row = 0; row < cloud.height; ++row)
+  {
+    scatterField(plane + row * cloud.width * value_size, cloud.width, value_size, cloud.point_step,
+                 cloud.data.data() + row * cloud.row_step + offset);
+  }
+}
+
+}
+}
@@ -0,0 +1,337 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin sending organized clouds as range images.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <ros/serialization.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_repack.h>
+#include <point_cloud_transport/PointCloudRangeImage.h>
+#include <point_cloud_transport/range_image_coding.h>
+#include <point_cloud_transport/range_image_publisher.h>
+#include <point_cloud_transport/RangeImagePublisherConfig.h>
+
+namespace point_cloud_transport
+{
+
+using range_image::PlaneCoding;
+
+namespace
+{
+
+//! \brief The x, y and z coordinates of all points as planes.
+struct Coordinates
+{
+  std::vector<float> x, y, z;
+  //! \brief Whether the point has finite non-zero coordinates.
+  std::vector<bool> valid;
+  size_t num_nan {0};
+  size_t num_zero {0};
+};
+
+const sensor_msgs::PointField* findFloatField(const sensor_msgs::PointCloud2& cloud, const std::string& name)
+{
+  for (const auto& field : cloud.fields)
+  {
+    if (field.name == name)
+      return (field.datatype == sensor_msgs::PointField::FLOAT32 && field.count == 1) ? &field : nullptr;
+  }
+  return nullptr;
+}
+
+float circularMean(double sum_sin, double sum_cos)
+{
+  return static_cast<float>(std::atan2(sum_sin, sum_cos));
+}
+
+/**
+ * \brief Estimate the beam geometry of a spinning lidar and compute the ranges of the points.
+ *
+ * The direction of point (row, col) is modeled by elevation `elevations[row]` and azimuth
+ * `azimuths[col] + azimuth_offsets[row]`.
+ *
+ * \return Whether all valid points lie within the tolerance of the modeled directions.
+ */
+bool estimateGeometry(const Coordinates& xyz, size_t height, size_t width, double tolerance, PointCloudRangeImage& msg,
+                      std::vector<float>& ranges)
+{
+  const size_t num_points = height * width;
+  ranges.assign(num_points, 0.0f);
+  std::vector<float> azimuths(num_points, 0.0f);
+  msg.elevations.assign(height, 0.0f);
+  msg.azimuth_offsets.assign(height, 0.0f);
+  msg.azimuths.assign(width, 0.0f);
+
+  for (size_t row = 0; row < height; ++row)
+  {
+    double sum_elevation = 0;
+    size_t num_valid = 0;
+    for (size_t col = 0; col < width; ++col)
+    {
+      const size_t i = row * width + col;
+      if (!xyz.valid[i])
+        continue;
+      ranges[i] = std::sqrt(xyz.x[i] * xyz.x[i] + xyz.y[i] * xyz.y[i] + xyz.z[i] * xyz.z[i]);
+      azimuths[i] = std::atan2(xyz.y[i], xyz.x[i]);
+      sum_elevation += std::asin(xyz.z[i] / ranges[i]);
+      ++num_valid;
+    }
+    if (num_valid > 0)
+      msg.elevations[row] = static_cast<float>(sum_elevation / num_valid);
+  }
+
+  // Alternate the estimation of the column azimuths and the row offsets (lidars often have per-beam azimuth offsets).
+  for (size_t iteration = 0; iteration < 2; ++iteration)
+  {
+    std::vector<double> sum_sin(width, 0.0), sum_cos(width, 0.0);
+    for (size_t i = 0; i < num_points; ++i)
+    {
+      if (!xyz.valid[i])
+        continue;
+      const auto a = azimuths[i] - msg.azimuth_offsets[i / width];
+      sum_sin[i % width] += std::sin(a);
+      sum_cos[i % width] += std::cos(a);
+    }
+    for (size_t col = 0; col < width; ++col)
+      msg.azimuths[col] = circularMean(sum_sin[col], sum_cos[col]);
+
+    if (iteration == 1)
+      break;
+
+    for (size_t row = 0; row < height; ++row)
+    {
+      double s = 0, c = 0;
+      for (size_t col = 0; col < width; ++col)
+      {
+        const size_t i = row * width + col;
+        if (!xyz.valid[i])
+          continue;
+        s += std::sin(azimuths[i] - msg.azimuths[col]);
+        c += std::cos(azimuths[i] - msg.azimuths[col]);
+      }
+      msg.azimuth_offsets[row] = circularMean(s, c);
+    }
+  }
+
+  const auto tolerance2 = tolerance * tolerance;
+  for (size_t i = 0; i < num_points; ++i)
+  {
+    if (!xyz.valid[i])
+      continue;
+    const double elevation = msg.elevations[i / width];
+    const double azimuth = msg.azimuths[i % width] + msg.azimuth_offsets[i / width];
+    const double r = ranges[i];
+    const auto dx = r * std::cos(elevation) * std::cos(azimuth) - xyz.x[i];
+    const auto dy = r * std::cos(elevation) * std::sin(azimuth) - xyz.y[i];
+    const auto dz = r * std::sin(elevation) - xyz.z[i];
+    if (dx * dx + dy * dy + dz * dz > tolerance2)
+      return false;
+  }
+  return true;
+}
+
+//! \brief The largest magnitude of values quantized with the given resolution. Larger values can not be rounded to
+//!        integers safely, so clouds containing them are sent raw.
+double maxQuantizedValue(double resolution)
+{
+  return static_cast<double>(std::numeric_limits<int32_t>::max()) * resolution;
+}
+
+//! \brief Whether all finite values are smaller in magnitude than max_value.
+bool valuesFit(const float* values, size_t num_values, double max_value)
+{
+  for (size_t i = 0; i < num_values; ++i)
+  {
+    if (std::isfinite(values[i]) && std::abs(values[i]) >= max_value)
+      return false;
+  }
+  return true;
+}
+
+//! \brief Store the serialized cloud in mode MODE_RAW, dropping anything encoded so far.
+void encodeRaw(const sensor_msgs::PointCloud2& raw, PointCloudRangeImage& msg)
+{
+  msg.mode = PointCloudRangeImage::MODE_RAW;
+  msg.elevations.clear();
+  msg.azimuth_offsets.clear();
+  msg.azimuths.clear();
+  msg.geometry.clear();
+  msg.data.resize(ros::serialization::serializationLength(raw));
+  ros::serialization::OStream stream(msg.data.data(), msg.data.size());
+  ros::serialization::serialize(stream, raw);
+}
+
+void encodeCoordinates(const std::vector<float>& values, double resolution, std::vector<uint8_t>& out)
+{
+  std::vector<int64_t> quantized(values.size());
+  for (size_t i = 0; i < values.size(); ++i)
+  {
+    quantized[i] = std::isfinite(values[i]) ?
+        static_cast<int64_t>(std::llround(values[i] / resolution)) : range_image::INVALID_VALUE;
+  }
+  range_image::encodeDeltas(quantized, out);
+}
+
+bool isHostBigEndian()
+{
+  const uint16_t one = 1;
+  return *reinterpret_cast<const uint8_t*>(&one) == 0;
+}
+
+}
+
+std::string RangeImagePublisher::getTransportName() const
+{
+  return "range_image";
+}
+
+RangeImagePublisher::TypedEncodeResult RangeImagePublisher::encodeTyped(
+    const sensor_msgs::PointCloud2& raw, const RangeImagePublisherConfig& config) const
+{
+  const size_t num_points = static_cast<size_t>(raw.height) * raw.width;
+  if (num_points > 0 && (raw.row_step < static_cast<size_t>(raw.width) * raw.point_step ||
+                         raw.data.size() < static_cast<size_t>(raw.height - 1) * raw.row_step +
+                                           static_cast<size_t>(raw.width) * raw.point_step))
+    return cras::make_unexpected(std::string("The cloud has less data than its dimensions require."));
+
+  PointCloudRangeImage msg;
+  msg.header = raw.header;
+  msg.height = raw.height;
+  msg.width = raw.width;
+  msg.fields = raw.fields;
+  msg.is_bigendian = raw.is_bigendian;
+  msg.point_step = raw.point_step;
+  msg.row_step = raw.row_step;
+  msg.is_dense = raw.is_dense;
+  msg.resolution = static_cast<float>(config.range_resolution);
+  msg.intensity_resolution = static_cast<float>(config.intensity_resolution);
+
+  const auto x = findFloatField(raw, "x");
+  const auto y = findFloatField(raw, "y");
+  const auto z = findFloatField(raw, "z");
+  bool organized = raw.height > 1 && x != nullptr && y != nullptr && z != nullptr &&
+      static_cast<bool>(raw.is_bigendian) == isHostBigEndian();
+  for (const auto& field : raw.fields)
+  {
+    const auto size = range_image::getFieldSize(field);
+    organized = organized && size > 0 && field.offset + size <= raw.point_step;
+  }
+
+  if (!organized)
+  {
+    encodeRaw(raw, msg);
+    return msg;
+  }
+
+  Coordinates xyz;
+  xyz.x.resize(num_points);
+  xyz.y.resize(num_points);
+  xyz.z.resize(num_points);
+  range_image::gatherPlane(raw, x->offset, sizeof(float), reinterpret_cast<uint8_t*>(xyz.x.data()));
+  range_image::gatherPlane(raw, y->offset, sizeof(float), reinterpret_cast<uint8_t*>(xyz.y.data()));
+  range_image::gatherPlane(raw, z->offset, sizeof(float), reinterpret_cast<uint8_t*>(xyz.z.data()));
+  xyz.valid.resize(num_points);
+  for (size_t i = 0; i < num_points; ++i)
+  {
+    const bool finite = std::isfinite(xyz.x[i]) && std::isfinite(xyz.y[i]) && std::isfinite(xyz.z[i]);
+    const bool zero = xyz.x[i] == 0 && xyz.y[i] == 0 && xyz.z[i] == 0;
+    xyz.valid[i] = finite && !zero;
+    xyz.num_nan += finite ? 0 : 1;
+    xyz.num_zero += zero ? 1 : 0;
+  }
+  msg.invalid_is_nan = xyz.num_nan > 0 || xyz.num_zero == 0;
+
+  // The invalid points of range images are all decoded the same way, so they can't mix NaNs and zeros.
+  std::vector<float> ranges;
+  const auto max_range = maxQuantizedValue(config.range_resolution);
+  bool range_mode = (xyz.num_nan == 0 || xyz.num_zero == 0) &&
+      estimateGeometry(xyz, raw.height, raw.width, config.geometry_tolerance, msg, ranges);
+  for (size_t i = 0; range_mode && i < num_points; ++i)
+    range_mode = ranges[i] < max_range;
+
+  if (range_mode)
+  {
+    msg.mode = PointCloudRangeImage::MODE_RANGE;
+    std::vector<int32_t> quantized(num_points);
+    quantizeFloats(ranges.data(), num_points, static_cast<float>(1.0 / config.range_resolution), quantized.data());
+    std::vector<int64_t> values(num_points);
+    for (size_t i = 0; i < num_points; ++i)
+    {
+      // Zero is reserved for invalid points.
+      values[i] = xyz.valid[i] ? std::max<int64_t>(1, quantized[i]) : 0;
+    }
+    range_image::encodeDeltas(values, msg.geometry);
+  }
+  else if (!valuesFit(xyz.x.data(), num_points, max_range) || !valuesFit(xyz.y.data(), num_points, max_range) ||
+           !valuesFit(xyz.z.data(), num_points, max_range))
+  {
+    encodeRaw(raw, msg);
+    return msg;
+  }
+  else
+  {
+    msg.mode = PointCloudRangeImage::MODE_XYZ;
+    msg.elevations.clear();
+    msg.azimuth_offsets.clear();
+    msg.azimuths.clear();
+    encodeCoordinates(xyz.x, config.range_resolution, msg.geometry);
+    encodeCoordinates(xyz.y, config.range_resolution, msg.geometry);
+    encodeCoordinates(xyz.z, config.range_resolution, msg.geometry);
+  }
+
+  std::vector<uint8_t> plane;
+  std::vector<int64_t> values(num_points);
+  for (const auto& field : raw.fields)
+  {
+    if (range_image::isCoordinate(field))
+      continue;
+
+    const auto size = range_image::getFieldSize(field);
+    plane.resize(num_points * size);
+    range_image::gatherPlane(raw, field.offset, size, plane.data());
+    switch (range_image::getPlaneCoding(field, msg.intensity_resolution))
+    {
+      case PlaneCoding::DELTA:
+        for (size_t i = 0; i < num_points; ++i)
+          values[i] = range_image::readInteger(plane.data() + i * size, field.datatype);
+        range_image::encodeDeltas(values, msg.data);
+        break;
+      case PlaneCoding::QUANTIZED:
+      {
+        const auto floats = reinterpret_cast<const float*>(plane.data());
+        if (!valuesFit(floats, num_points, maxQuantizedValue(msg.intensity_resolution)))
+        {
+          encodeRaw(raw, msg);
+          return msg;
+        }
+        for (size_t i = 0; i < num_points; ++i)
+        {
+          values[i] = std::isfinite(floats[i]) ?
+              static_cast<int64_t>(std::llround(floats[i] / msg.intensity_resolution)) : range_image::INVALID_VALUE;
+        }
+        range_image::encodeDeltas(values, msg.data);
+        break;
+      }
+      case PlaneCoding::RAW:
+        msg.data.insert(msg.data.end(), plane.begin(), plane.end());
+        break;
+    }
+  }
+
+  return msg;
+}
+
+}
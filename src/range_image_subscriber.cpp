@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin decoding clouds sent as range images.
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <cras_cpp_common/string_utils.hpp>
+#include <ros/serialization.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/PointCloudRangeImage.h>
+#include <point_cloud_transport/range_image_coding.h>
+#include <point_cloud_transport/range_image_subscriber.h>
+
+namespace point_cloud_transport
+{
+
+using range_image::PlaneCoding;
+
+namespace
+{
+
+const sensor_msgs::PointField* findField(const PointCloudRangeImage& msg, const std::string& name)
+{
+  for (const auto& field : msg.fields)
+  {
+    if (field.name == name)
+      return &field;
+  }
+  return nullptr;
+}
+
+}
+
+std::string RangeImageSubscriber::getTransportName() const
+{
+  return "range_image";
+}
+
+SubscriberPlugin::DecodeResult RangeImageSubscriber::decodeTyped(
+    const PointCloudRangeImage& msg, const NoConfigConfig&) const
+{
+  if (msg.mode == PointCloudRangeImage::MODE_RAW)
+  {
+    const auto cloud = this->allocateCloud();
+    try
+    {
+      ros::serialization::IStream stream(const_cast<uint8_t*>(msg.data.data()), msg.data.size());
+      ros::serialization::deserialize(stream, *cloud);
+    }
+    catch (const ros::Exception& e)
+    {
+      return cras::make_unexpected(cras::format("Invalid raw cloud data: %s", e.what()));
+    }
+    cloud->header = msg.header;
+    return sensor_msgs::PointCloud2ConstPtr(cloud);
+  }
+
+  if (msg.mode != PointCloudRangeImage::MODE_RANGE && msg.mode != PointCloudRangeImage::MODE_XYZ)
+    return cras::make_unexpected(cras::format("Unknown range image mode %u.", msg.mode));
+
+  const size_t height = msg.height;
+  const size_t width = msg.width;
+  const size_t num_points = height * width;
+  if (msg.row_step < width * msg.point_step)
+    return cras::make_unexpected(std::string("Invalid row step."));
+  for (const auto& field : msg.fields)
+  {
+    const auto size = range_image::getFieldSize(field);
+    if (size == 0 || field.offset + size > msg.point_step)
+      return cras::make_unexpected(cras::format("Invalid field %s.", field.name.c_str()));
+  }
+  const auto x = findField(msg, "x");
+  const auto y = findField(msg, "y");
+  const auto z = findField(msg, "z");
+  if (x == nullptr || y == nullptr || z == nullptr)
+    return cras::make_unexpected(std::string("The range image has no fields x, y and z."));
+  // The coordinates are decoded as single floats.
+  for (const auto field : {x, y, z})
+  {
+    if (field->datatype != sensor_msgs::PointField::FLOAT32 || field->count != 1)
+      return cras::make_unexpected(cras::format("Field %s of the range image is not a single FLOAT32.",
+                                                field->name.c_str()));
+  }
+
+  const auto cloud = this->allocateCloud(height * msg.row_step);
+  // Clear the padding between the fields.
+  if (!cloud->data.empty())
+    memset(cloud->data.data(), 0, cloud->data.size());
+  cloud->header = msg.header;
+  cloud->height = msg.height;
+  cloud->width = msg.width;
+  cloud->fields = msg.fields;
+  cloud->is_bigendian = msg.is_bigendian;
+  cloud->point_step = msg.point_step;
+  cloud->row_step = msg.row_step;
+  cloud->is_dense = msg.is_dense;
+
+  const auto nan = std::numeric_limits<float>::quiet_NaN();
+  std::vector<float> px(num_points), py(num_points), pz(num_points);
+  std::vector<int64_t> values(num_points);
+  const uint8_t* geometry = msg.geometry.data();
+  const uint8_t* geometry_end = geometry + msg.geometry.size();
+  if (msg.mode == PointCloudRangeImage::MODE_RANGE)
+  {
+    if (msg.elevations.size() != height || msg.azimuth_offsets.size() != height || msg.azimuths.size() != width)
+      return cras::make_unexpected(std::string("The beam geometry does not match the size of the range image."));
+    if (!range_image::decodeDeltas(geometry, geometry_end, values))
+      return cras::make_unexpected(std::string("The range image has invalid ranges."));
+
+    // Precompute the sines and cosines, so that only the azimuth sums have to be expanded for each point.
+    std::vector<float> cos_col(width), sin_col(width);
+    for (size_t col = 0; col < width; ++col)
+    {
+      cos_col[col] = std::cos(msg.azimuths[col]);
+      sin_col[col] = std::sin(msg.azimuths[col]);
+    }
+    const float invalid = msg.invalid_is_nan ? nan : 0.0f;
+    for (size_t row = 0; row < height; ++row)
+    {
+      const float cos_el = std::cos(msg.elevations[row]);
+      const float sin_el = std::sin(msg.elevations[row]);
+      const float cos_off = std::cos(msg.azimuth_offsets[row]);
+      const float sin_off = std::sin(msg.azimuth_offsets[row]);
+      for (size_t col = 0; col < width; ++col)
+      {
+        const size_t i = row * width + col;
+        if (values[i] == 0)
+        {
+          px[i] = py[i] = pz[i] = invalid;
+          continue;
+        }
+        const float r = static_cast<float>(values[i]) * msg.resolution;
+        const float cos_az = cos_col[col] * cos_off - sin_col[col] * sin_off;
+        const float sin_az = sin_col[col] * cos_off + cos_col[col] * sin_off;
+        px[i] = r * cos_el * cos_az;
+        py[i] = r * cos_el * sin_az;
+        pz[i] = r * sin_el;
+      }
+    }
+  }
+  else
+  {
+    for (auto plane : {&px, &py, &pz})
+    {
+      if (!range_image::decodeDeltas(geometry, geometry_end, values))
+        return cras::make_unexpected(std::string("The range image has invalid coordinates."));
+      for (size_t i = 0; i < num_points; ++i)
+      {
+        (*plane)[i] = values[i] == range_image::INVALID_VALUE ? nan :
+            static_cast<float>(static_cast<double>(values[i]) * msg.resolution);
+      }
+    }
+  }
+  range_image::scatterPlane(reinterpret_cast<const uint8_t*>(px.data()), x->offset, sizeof(float), *cloud);
+  range_image::scatterPlane(reinterpret_cast<const uint8_t*>(py.data()), y->offset, sizeof(float), *cloud);
+  range_image::scatterPlane(reinterpret_cast<const uint8_t*>(pz.data()), z->offset, sizeof(float), *cloud);
+
+  const uint8_t* data = msg.data.data();
+  const uint8_t* data_end = data + msg.data.size();
+  std::vector<uint8_t> plane;
+  for (const auto& field : msg.fields)
+  {
+    if (range_image::isCoordinate(field))
+      continue;
+
+    const auto size = range_image::getFieldSize(field);
+    plane.resize(num_points * size);
+    switch (range_image::getPlaneCoding(field, msg.intensity_resolution))
+    {
+      case PlaneCoding::DELTA:
+        if (!range_image::decodeDeltas(data, data_end, values))
+          return cras::make_unexpected(cras::format("The range image has invalid field %s.", field.name.c_str()));
+        for (size_t i = 0; i < num_points; ++i)
+          range_image::writeInteger(plane.data() + i * size, field.datatype, values[i]);
+        break;
+      case PlaneCoding::QUANTIZED:
+      {
+        if (!range_image::decodeDeltas(data, data_end, values))
+          return cras::make_unexpected(cras::format("The range image has invalid field %s.", field.name.c_str()));
+        for (size_t i = 0; i < num_points; ++i)
+        {
+          const float value = values[i] == range_image::INVALID_VALUE ? nan :
+              static_cast<float>(static_cast<double>(values[i]) * msg.intensity_resolution);
+          memcpy(plane.data() + i * size, &value, sizeof(value));
+        }
+        break;
+      }
+      case PlaneCoding::RAW:
+        if (static_cast<size_t>(data_end - data) < plane.size())
+          return cras::make_unexpected(cras::format("The range image has invalid field %s.", field.name.c_str()));
+        if (!plane.empty())
+          memcpy(plane.data(), data, plane.size());
+        data += plane.size();
+        break;
+    }
+    range_image::scatterPlane(plane.data(), field.offset, size, *cloud);
+  }
+
+  return sensor_msgs::PointCloud2ConstPtr(cloud);
+}
+
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Rate limiting of the clouds published by one transport.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include <point_cloud_transport/publisher_options.h>
+#include <point_cloud_transport/rate_limiter.h>
+
+namespace point_cloud_transport
+{
+
+RateLimiter::RateLimiter(const TransportRateLimit& limit) : limit_(limit)
+{
+}
+
+void RateLimiter::addSubscriber(const std::string& subscriber, double requested_rate)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  requested_rates_.emplace(subscriber, requested_rate);
+}
+
+void RateLimiter::setRequestedRate(const std::string& subscriber, double requested_rate)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto range = requested_rates_.equal_range(subscriber);
+  for (auto it = range.first; it != range.second; ++it)
+    it->second = requested_rate;
+}
+
+void RateLimiter::removeSubscriber(const std::string& subscriber)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = requested_rates_.find(subscriber);
+  if (it != requested_rates_.end())
+    requested_rates_.erase(it);
+}
+
+bool RateLimiter::accept()
+{
+  return this->accept(Clock::now());
+}
+
+bool RateLimiter::accept(Clock::time_point now)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (limit_.publish_every_n > 1 && (counter_++ % limit_.publish_every_n) != 0)
+    return false;
+
+  const auto rate = getRateLocked();
+  if (rate <= 0.0)
+    return true;
+
+  if (now < next_)
+    return false;
+
+  // Schedule from the previous deadline so that jitter of the input does not lower the output rate, but do not let
+  // the output catch up after a pause.
+  const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+  next_ = (now - next_ < period) ? next_ + period : now + period;
+  return true;
+}
+
+double RateLimiter::getRate() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return getRateLocked();
+}
+
+double RateLimiter::getRateLocked() const
+{
+  if (requested_rates_.empty())
+    return limit_.max_rate;
+
+  double requested = 0.0;
+  for (const auto& subscriber : requested_rates_)
+  {
+    if (subscriber.second <= 0.0)
+      return limit_.max_rate;
+    requested = std::max(requested, subscriber.second);
+  }
+  return limit_.max_rate > 0.0 ? std::min(requested, limit_.max_rate) : requested;
+}
+
+}
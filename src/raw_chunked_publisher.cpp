@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin sending the raw clouds in chunks.
+ */
+
+#include <string>
+
+#include <ros/serialization.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/PointCloudChunk.h>
+#include <point_cloud_transport/raw_chunked_publisher.h>
+
+namespace point_cloud_transport
+{
+
+std::string RawChunkedPublisher::getTransportName() const
+{
+  return "chunked";
+}
+
+RawChunkedPublisher::TypedEncodeResult RawChunkedPublisher::encodeChunk(
+    const sensor_msgs::PointCloud2& chunk, const NoConfigConfig&) const
+{
+  PointCloudChunk msg;
+  msg.data.resize(ros::serialization::serializationLength(chunk));
+  ros::serialization::OStream stream(msg.data.data(), msg.data.size());
+  ros::serialization::serialize(stream, chunk);
+  return msg;
+}
+
+}
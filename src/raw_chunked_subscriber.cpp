@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin receiving the raw clouds in chunks.
+ */
+
+#include <string>
+
+#include <cras_cpp_common/string_utils.hpp>
+#include <ros/serialization.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/PointCloudChunk.h>
+#include <point_cloud_transport/raw_chunked_subscriber.h>
+
+namespace point_cloud_transport
+{
+
+std::string RawChunkedSubscriber::getTransportName() const
+{
+  return "chunked";
+}
+
+SubscriberPlugin::DecodeResult RawChunkedSubscriber::decodeChunk(
+    const PointCloudChunk& chunk, const NoConfigConfig&) const
+{
+  const auto cloud = this->allocateCloud();
+  try
+  {
+    ros::serialization::IStream stream(const_cast<uint8_t*>(chunk.data.data()), chunk.data.size());
+    ros::serialization::deserialize(stream, *cloud);
+  }
+  catch (const ros::Exception& e)
+  {
+    return cras::make_unexpected(cras::format("Invalid chunk data: %s", e.what()));
+  }
+  cloud->header = chunk.header;
+  return sensor_msgs::PointCloud2ConstPtr(cloud);
+}
+
+}
@@ -59,13 +59,17 @@ std::string RawPublisher::getTransportName() const
   return "raw";
 }
 
-void RawPublisher::publish(const sensor_msgs::PointCloud2ConstPtr& message) const
+void RawPublisher::publish(const sensor_msgs::PointCloud2& message, const RawPublisher::PublishFn& publish_fn) const
 {
-  getPublisher().publish(message);
+  // Nothing is encoded, but counting the messages and bytes is still useful.
+  recordEncoding({}, message, &message);
+  publish_fn(message);
 }
 
-void RawPublisher::publish(const sensor_msgs::PointCloud2& message, const RawPublisher::PublishFn& publish_fn) const
+void RawPublisher::publishPtr(const sensor_msgs::PointCloud2ConstPtr& message,
+                              const RawPublisher::PublishPtrFn& publish_fn) const
 {
+  recordEncoding({}, *message, message.get());
   publish_fn(message);
 }
 
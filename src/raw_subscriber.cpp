@@ -38,8 +38,11 @@
  *
  */
 
+#include <cstdint>
 #include <string>
 
+#include <cras_cpp_common/string_utils.hpp>
+#include <ros/serialization.h>
 #include <sensor_msgs/PointCloud2.h>
 
 #include <point_cloud_transport/raw_subscriber.h>
@@ -76,6 +79,24 @@ SubscriberPlugin::DecodeResult RawSubscriber::decodeTyped(const sensor_msgs::Poi
   return this->decodeTyped(compressedPtr, config);
 }
 
+SubscriberPlugin::DecodeResult RawSubscriber::decodeSerializedTyped(const uint8_t* data, size_t size,
+                                                                    const NoConfigConfig&) const
+{
+  // The serialized size bounds the size of the data, so a pooled cloud with enough capacity is picked and the data are
+  // deserialized into it without reallocation.
+  auto cloud = this->allocateCloud(size);
+  try
+  {
+    ros::serialization::IStream stream(const_cast<uint8_t*>(data), static_cast<uint32_t>(size));
+    ros::serialization::deserialize(stream, *cloud);
+  }
+  catch (const ros::Exception& e)
+  {
+    return cras::make_unexpected(cras::format("Invalid message passed to transport decoder: %s.", e.what()));
+  }
+  return sensor_msgs::PointCloud2ConstPtr(cloud);
+}
+
 bool RawSubscriber::matchesTopic(const std::string& topic, const std::string& datatype) const
 {
   return datatype == ros::message_traits::DataType<sensor_msgs::PointCloud2>::value();
@@ -0,0 +1,424 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Convert the point clouds stored in a bag file to a different transport.
+ *
+ * Usage: recompress_bag -t TRANSPORT [-c NAME=VALUE[,NAME=VALUE]...] [-T TOPIC]... [-j THREADS] [-q QUEUE]
+ *                       [-z none|bz2|lz4] INPUT_BAG OUTPUT_BAG
+ *
+ * -t  The transport to convert the clouds to (e.g. `draco` or `raw`).
+ * -c  Config of the encoder. Values are parsed as bool, int, double or string (in this order).
+ * -T  Convert only the given topic (can be repeated). All topics that some decoder accepts (raw and compressed clouds)
+ *     are converted by default.
+ * -j  Number of worker threads (default 0 = number of CPU cores).
+ * -q  Maximum number of messages being converted at once (default 4 per thread). The output keeps the order of the
+ *     input, so this bounds the memory used while waiting for a slow cloud.
+ * -z  Compression of the output bag (default none).
+ *
+ * The converted clouds are written to topic `<base_topic>/<transport>` (or `<base_topic>` for `raw`) with the original
+ * receive times. All other messages are copied as they are without deserializing them. Clouds that fail to convert are
+ * copied unchanged, and the tool then exits with status 2.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/pointer_cast.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cras_cpp_common/expected.hpp>
+#include <cras_cpp_common/string_utils.hpp>
+#include <dynamic_reconfigure/Config.h>
+#include <ros/datatypes.h>
+#include <ros/time.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <topic_tools/shape_shifter.h>
+
+#include <point_cloud_transport/point_cloud_codec.h>
+#include <point_cloud_transport/publisher_plugin.h>
+#include <point_cloud_transport/subscriber_plugin.h>
+#include <point_cloud_transport/thread_pool.h>
+
+using namespace point_cloud_transport;
+
+namespace
+{
+
+//! \brief A converted topic. Each has its own codec (so that stateful decoders do not mix the topics) and strand.
+struct CloudTopic
+{
+  explicit CloudTopic(ThreadPool& pool) : strand(new Strand(pool))
+  {
+  }
+
+  std::string output_topic;
+  PointCloudCodec codec;
+  std::unique_ptr<Strand> strand;
+};
+
+//! \brief A message waiting to be written to the output bag.
+struct Output
+{
+  std::string topic;
+  ros::Time time;
+  boost::shared_ptr<ros::M_string> connection_header;
+  //! \brief The input message. It is written if the message is not converted or the conversion fails.
+  topic_tools::ShapeShifter::ConstPtr original;
+  //! \brief The topic converting the message. Null if the message is copied.
+  CloudTopic* cloud_topic {nullptr};
+  std::future<PublisherPlugin::EncodeResult> converted;
+};
+
+struct Totals
+{
+  size_t num_messages {0};
+  size_t num_converted {0};
+  size_t num_failed {0};
+  size_t num_dropped {0};
+  size_t input_bytes {0};
+  size_t output_bytes {0};
+  size_t input_cloud_bytes {0};
+  size_t output_cloud_bytes {0};
+};
+
+bool parseConfig(const std::string& text, dynamic_reconfigure::Config& config)
+{
+  for (const auto& item : cras::split(text, ","))
+  {
+    const auto parts = cras::split(item, "=", 1);
+    if (parts.size() != 2 || parts[0].empty())
+      return false;
+    const auto& name = parts[0];
+    const auto& value = parts[1];
+
+    if (value == "true" || value == "false")
+    {
+      dynamic_reconfigure::BoolParameter param;
+      param.name = name;
+      param.value = value == "true";
+      config.bools.push_back(param);
+      continue;
+    }
+
+    char* end;
+    const long int_value = std::strtol(value.c_str(), &end, 10);
+    if (!value.empty() && *end == '\0')
+    {
+      dynamic_reconfigure::IntParameter param;
+      param.name = name;
+      param.value = static_cast<int>(int_value);
+      config.ints.push_back(param);
+      continue;
+    }
+
+    const double double_value = std::strtod(value.c_str(), &end);
+    if (!value.empty() && *end == '\0')
+    {
+      dynamic_reconfigure::DoubleParameter param;
+      param.name = name;
+      param.value = double_value;
+      config.doubles.push_back(param);
+      continue;
+    }
+
+    dynamic_reconfigure::StrParameter param;
+    param.name = name;
+    param.value = value;
+    config.strs.push_back(param);
+  }
+  return true;
+}
+
+/**
+ * \brief Find the base topic of a transport topic, e.g. `/points` for `/points/draco`.
+ */
+std::string getBaseTopic(const SubscriberPlugin& decoder, const std::string& topic)
+{
+  const auto single_topic = dynamic_cast<const SingleTopicSubscriberPlugin*>(&decoder);
+  const auto slash = topic.rfind('/');
+  if (single_topic == nullptr || slash == std::string::npos || slash == 0)
+    return topic;
+  const auto parent = topic.substr(0, slash);
+  return single_topic->getTopicToSubscribe(parent) == topic ? parent : topic;
+}
+
+/**
+ * \brief Set up conversion of the given topic.
+ * \return The topic, or null if no decoder accepts it.
+ */
+std::unique_ptr<CloudTopic> createCloudTopic(const std::string& topic, const std::string& datatype,
+                                             const std::string& transport, ThreadPool& pool)
+{
+  std::unique_ptr<CloudTopic> cloud_topic(new CloudTopic(pool));
+  const auto decoder = cloud_topic->codec.getDecoderByTopic(topic, datatype);
+  if (decoder == nullptr)
+    return nullptr;
+  const auto encoder = boost::dynamic_pointer_cast<SingleTopicPublisherPlugin>(
+    cloud_topic->codec.getEncoderByName(transport));
+  if (encoder == nullptr)
+    return nullptr;
+
+  cloud_topic->output_topic = encoder->getTopicToAdvertise(getBaseTopic(*decoder, topic));
+  return cloud_topic;
+}
+
+void writeOutput(rosbag::Bag& bag, Output& output, Totals& totals)
+{
+  if (output.cloud_topic == nullptr)
+  {
+    bag.write(output.topic, output.time, *output.original, output.connection_header);
+    totals.output_bytes += output.original->size();
+    return;
+  }
+
+  totals.input_cloud_bytes += output.original->size();
+  const auto converted = output.converted.get();
+  if (!converted)
+  {
+    fprintf(stderr, "Failed to convert message on topic %s at time %.9f, copying it: %s\n", output.topic.c_str(),
+            output.time.toSec(), converted.error().c_str());
+    ++totals.num_failed;
+    bag.write(output.topic, output.time, *output.original, output.connection_header);
+    totals.output_bytes += output.original->size();
+    totals.output_cloud_bytes += output.original->size();
+    return;
+  }
+  if (!converted.value())
+  {
+    // E.g. the decoder waits for a keyframe.
+    ++totals.num_dropped;
+    return;
+  }
+
+  const auto& msg = converted.value().value();
+  auto header = output.connection_header ? boost::make_shared<ros::M_string>(*output.connection_header) :
+      boost::make_shared<ros::M_string>();
+  (*header)["topic"] = output.cloud_topic->output_topic;
+  (*header)["type"] = msg.getDataType();
+  (*header)["md5sum"] = msg.getMD5Sum();
+  (*header)["message_definition"] = msg.getMessageDefinition();
+  bag.write(output.cloud_topic->output_topic, output.time, msg, header);
+  ++totals.num_converted;
+  totals.output_bytes += msg.size();
+  totals.output_cloud_bytes += msg.size();
+}
+
+double secondsSince(const std::chrono::steady_clock::time_point& start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printUsage(const char* program)
+{
+  fprintf(stderr, "Usage: %s -t TRANSPORT [-c NAME=VALUE[,NAME=VALUE]...] [-T TOPIC]... [-j THREADS] [-q QUEUE] "
+                  "[-z none|bz2|lz4] INPUT_BAG OUTPUT_BAG\n", program);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  std::string transport;
+  dynamic_reconfigure::Config config;
+  std::vector<std::string> topic_filter;
+  size_t num_threads = 0;
+  size_t queue_size = 0;
+  auto compression = rosbag::compression::Uncompressed;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help")
+    {
+      printUsage(argv[0]);
+      return 0;
+    }
+    if (arg.empty() || arg[0] != '-')
+    {
+      files.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= argc)
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+    const std::string value = argv[++i];
+    if (arg == "-t")
+    {
+      transport = value;
+    }
+    else if (arg == "-c")
+    {
+      if (!parseConfig(value, config))
+      {
+        fprintf(stderr, "Invalid config '%s'.\n", value.c_str());
+        return 1;
+      }
+    }
+    else if (arg == "-T")
+    {
+      topic_filter.push_back(value);
+    }
+    else if (arg == "-j")
+    {
+      num_threads = std::max(0l, std::strtol(value.c_str(), nullptr, 10));
+    }
+    else if (arg == "-q")
+    {
+      queue_size = std::max(0l, std::strtol(value.c_str(), nullptr, 10));
+    }
+    else if (arg == "-z")
+    {
+      if (value == "none")
+        compression = rosbag::compression::Uncompressed;
+      else if (value == "bz2")
+        compression = rosbag::compression::BZ2;
+      else if (value == "lz4")
+        compression = rosbag::compression::LZ4;
+      else
+      {
+        fprintf(stderr, "Unknown bag compression '%s'.\n", value.c_str());
+        return 1;
+      }
+    }
+    else
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (transport.empty() || files.size() != 2)
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  ThreadPool pool(num_threads);
+  if (queue_size == 0)
+    queue_size = 4 * pool.getNumThreads();
+
+  // Declared after the pool, so the strands are destroyed first.
+  std::map<std::string, std::unique_ptr<CloudTopic>> cloud_topics;
+  std::deque<Output> outputs;
+  Totals totals;
+  const auto start = std::chrono::steady_clock::now();
+
+  try
+  {
+    rosbag::Bag input(files[0], rosbag::bagmode::Read);
+    rosbag::Bag output(files[1], rosbag::bagmode::Write);
+    output.setCompression(compression);
+
+    rosbag::View view(input);
+    const auto total_messages = view.size();
+    auto last_report = start;
+
+    for (const auto& m : view)
+    {
+      Output out;
+      out.topic = m.getTopic();
+      out.time = m.getTime();
+      out.connection_header = m.getConnectionHeader();
+      // Reading the shapeshifter only copies the serialized message, it does not deserialize it.
+      out.original = m.instantiate<topic_tools::ShapeShifter>();
+      if (out.original == nullptr)
+        continue;
+      ++totals.num_messages;
+      totals.input_bytes += out.original->size();
+
+      const auto key = out.topic + " " + m.getDataType();
+      auto it = cloud_topics.find(key);
+      if (it == cloud_topics.end())
+      {
+        const bool selected = topic_filter.empty() ||
+            std::find(topic_filter.begin(), topic_filter.end(), out.topic) != topic_filter.end();
+        auto cloud_topic = selected ? createCloudTopic(out.topic, m.getDataType(), transport, pool) : nullptr;
+        if (cloud_topic != nullptr)
+          fprintf(stderr, "Converting %s to %s.\n", out.topic.c_str(), cloud_topic->output_topic.c_str());
+        it = cloud_topics.emplace(key, std::move(cloud_topic)).first;
+      }
+
+      if (it->second != nullptr)
+      {
+        const auto cloud_topic = it->second.get();
+        const auto promise = std::make_shared<std::promise<PublisherPlugin::EncodeResult>>();
+        out.cloud_topic = cloud_topic;
+        out.converted = promise->get_future();
+        const auto msg = out.original;
+        const auto topic = out.topic;
+        cloud_topic->strand->post([cloud_topic, promise, msg, topic, &transport, &config]()
+        {
+          // The output waits for the future, so it has to be set even if the codec throws.
+          try
+          {
+            promise->set_value(cloud_topic->codec.transcode(*msg, topic, transport, config));
+          }
+          catch (const std::exception& e)
+          {
+            promise->set_value(cras::make_unexpected(std::string(e.what())));
+          }
+          catch (...)
+          {
+            promise->set_value(cras::make_unexpected(std::string("Unknown error.")));
+          }
+        });
+      }
+      outputs.push_back(std::move(out));
+
+      while (outputs.size() > queue_size)
+      {
+        writeOutput(output, outputs.front(), totals);
+        outputs.pop_front();
+      }
+
+      const auto now = std::chrono::steady_clock::now();
+      if (std::chrono::duration<double>(now - last_report).count() > 5.0)
+      {
+        last_report = now;
+        fprintf(stderr, "%zu/%u messages, %.1f MB/s\n", totals.num_messages, total_messages,
+                totals.input_bytes / 1e6 / secondsSince(start));
+      }
+    }
+
+    while (!outputs.empty())
+    {
+      writeOutput(output, outputs.front(), totals);
+      outputs.pop_front();
+    }
+    output.close();
+  }
+  catch (const rosbag::BagException& e)
+  {
+    fprintf(stderr, "Failed to recompress bag file %s: %s\n", files[0].c_str(), e.what());
+    return 1;
+  }
+
+  const auto elapsed = secondsSince(start);
+  printf("Messages: %zu (%zu clouds converted, %zu failed and copied, %zu dropped by the codecs)\n",
+         totals.num_messages, totals.num_converted, totals.num_failed, totals.num_dropped);
+  const auto ratio = totals.output_cloud_bytes > 0 ?
+      static_cast<double>(totals.input_cloud_bytes) / totals.output_cloud_bytes : 0.0;
+  printf("Clouds: %.1f MB -> %.1f MB (ratio %.2f)\n", totals.input_cloud_bytes / 1e6, totals.output_cloud_bytes / 1e6,
+         ratio);
+  printf("Bag: %.1f MB -> %.1f MB in %.1f s (%.1f MB/s, %.1f messages/s)\n", totals.input_bytes / 1e6,
+         totals.output_bytes / 1e6, elapsed, totals.input_bytes / 1e6 / elapsed, totals.num_messages / elapsed);
+
+  return totals.num_failed > 0 ? 2 : 0;
+}
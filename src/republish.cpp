@@ -38,42 +38,368 @@
  *
  */
 
+#include <atomic>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 
 #include <boost/bind.hpp>
 #include <boost/bind/placeholders.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/pointer_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 
+#include <cras_cpp_common/string_utils.hpp>
+#include <cras_cpp_common/xmlrpc_value_utils.hpp>
+#include <dynamic_reconfigure/Config.h>
 #include <pluginlib/class_loader.h>
 #include <pluginlib/class_list_macros.hpp>
+#include <ros/advertise_options.h>
+#include <ros/console.h>
+#include <ros/node_handle.h>
+#include <ros/publisher.h>
+#include <ros/single_subscriber_publisher.h>
+#include <ros/subscriber.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <topic_tools/shape_shifter.h>
+#include <XmlRpcValue.h>
 
+#include <point_cloud_transport/loader_registry.h>
 #include <point_cloud_transport/point_cloud_transport.h>
 #include <point_cloud_transport/publisher.h>
 #include <point_cloud_transport/publisher_plugin.h>
 #include <point_cloud_transport/republish.h>
+#include <point_cloud_transport/single_subscriber_publisher.h>
 #include <point_cloud_transport/subscriber.h>
+#include <point_cloud_transport/subscriber_plugin.h>
+#include <point_cloud_transport/thread_pool.h>
 #include <point_cloud_transport/exception.h>
 
 namespace point_cloud_transport
 {
 
-void RepublishNodelet::onInit()
+/**
+ * \brief One republished topic of the multi-topic mode.
+ *
+ * The input is only subscribed while the output has subscribers. Decoding and encoding run in a strand of the shared
+ * worker pool, so the clouds of one topic keep their order while different topics use different workers. If the input
+ * and output transports are the same, the messages are relayed as they are, without decoding.
+ */
+struct RepublishNodelet::Pair : public boost::enable_shared_from_this<RepublishNodelet::Pair>
 {
-  if (this->getMyArgv().empty())
+  Pair(const ros::NodeHandle& nh, PointCloudTransport& pct, ThreadPool& pool, size_t worker_queue_size) :
+      nh(nh), pct(pct), strand(new Strand(pool, worker_queue_size, QueueOverflowPolicy::DROP_OLDEST))
   {
-    throw std::runtime_error("Usage: republish in_transport in:=<in_base_topic> [out_transport] out:=<out_base_topic>");
   }
 
-  std::string in_transport = this->getMyArgv()[0];
-  std::string in_topic = this->getNodeHandle().resolveName("in");
-  std::string out_topic = this->getNodeHandle().resolveName("out");
+  ~Pair()
+  {
+    // Wait for the running task before the publishers go away.
+    strand.reset();
+    sub.shutdown();
+    pct_sub.shutdown();
+    relay_pub.shutdown();
+    pub.shutdown();
+    if (pub_plugin)
+      pub_plugin->shutdown();
+  }
+
+  //! \brief Load the plugins and advertise the output. Has to be called after the pair is owned by a shared_ptr.
+  void init()
+  {
+    boost::weak_ptr<Pair> weak_this = this->shared_from_this();
+    const auto update = [weak_this](const SingleSubscriberPublisher&)
+    {
+      const auto pair = weak_this.lock();
+      if (pair)
+        pair->updateSubscription();
+    };
+
+    {
+      const auto loader_lock = LoaderRegistry::instance().lockLoaders();
+      const auto decoder_plugin = pct.getSubscriberLoader()->createInstance(
+        SubscriberPlugin::getLookupName(in_transport));
+      decoder = boost::dynamic_pointer_cast<SingleTopicSubscriberPlugin>(decoder_plugin);
+      if (relay() && !decoder)
+        throw std::runtime_error("Transport " + in_transport + " cannot be relayed, it uses multiple topics.");
+      // Decoders using multiple topics are driven by a Subscriber, which reads its config from dynamic reconfigure.
+      if (has_decoder_config && !decoder)
+        throw std::runtime_error("Key decoder_config can't be used with transport " + in_transport + ", it uses "
+                                 "multiple topics.");
+      if (!relay() && !out_transport.empty())
+        pub_plugin = pct.getPublisherLoader()->createInstance(PublisherPlugin::getLookupName(out_transport));
+    }
+
+    if (relay())
+    {
+      // The output can only be advertised when the md5sum and definition of the message are known.
+      updateSubscription();
+      return;
+    }
+
+    if (pub_plugin)
+      pub_plugin->advertise(nh, out_topic, out_queue_size, update, update, this->shared_from_this(), false);
+    else
+      pub = pct.advertise(out_topic, out_queue_size, update, update, this->shared_from_this());
+    updateSubscription();
+  }
+
+  bool relay() const
+  {
+    return in_transport == out_transport;
+  }
+
+  uint32_t getNumSubscribers() const
+  {
+    if (relay())
+      return relay_pub ? relay_pub.getNumSubscribers() : 0;
+    return pub_plugin ? pub_plugin->getNumSubscribers() : pub.getNumSubscribers();
+  }
+
+  //! \brief Subscribe the input if the output has subscribers (or is not advertised yet), unsubscribe otherwise.
+  void updateSubscription()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    const bool needed = (relay() && !relay_pub) || getNumSubscribers() > 0;
+    const bool subscribed = sub || pct_sub;
+    if (needed == subscribed)
+      return;
+
+    if (!needed)
+    {
+      ROS_DEBUG("Republisher of %s has no subscribers, unsubscribing %s.", out_topic.c_str(), in_topic.c_str());
+      // Shutting down waits for the running callbacks of the input, which may be waiting for the mutex.
+      auto old_sub = std::move(sub);
+      sub = {};
+      auto old_pct_sub = std::move(pct_sub);
+      pct_sub = {};
+      lock.unlock();
+      old_sub.shutdown();
+      old_pct_sub.shutdown();
+      return;
+    }
+
+    boost::weak_ptr<Pair> weak_this = this->shared_from_this();
+    if (decoder)
+    {
+      sub = nh.subscribe<topic_tools::ShapeShifter>(decoder->getTopicToSubscribe(in_topic), in_queue_size,
+        [weak_this](const topic_tools::ShapeShifter::ConstPtr& msg)
+        {
+          const auto pair = weak_this.lock();
+          if (pair)
+            pair->onMessage(msg);
+        });
+    }
+    else
+    {
+      // Decoders using multiple topics have to be driven by a Subscriber, so only the encoding uses the strand.
+      pct_sub = pct.subscribe(in_topic, in_queue_size,
+        [weak_this](const sensor_msgs::PointCloud2ConstPtr& cloud)
+        {
+          const auto pair = weak_this.lock();
+          if (pair)
+            pair->strand->post([pair_ptr = pair.get(), cloud]() { pair_ptr->publish(cloud); });
+        }, {}, TransportHints(in_transport));
+    }
+  }
+
+  void onMessage(const topic_tools::ShapeShifter::ConstPtr& msg)
+  {
+    if (relay())
+    {
+      // Once advertised, relay_pub does not change, so most messages do not need the mutex.
+      if (relay_advertised)
+        relay_pub.publish(*msg);
+      else
+        advertiseRelay(*msg).publish(*msg);
+      return;
+    }
+
+    // The tasks do not need to hold the pair, the strand is destroyed (and waits for its task) before the rest.
+    strand->post([this, msg]() { this->transcode(*msg); });
+  }
+
+  //! \brief Advertise the relayed output with the type of the given message unless it is already advertised.
+  //! \return The output publisher.
+  ros::Publisher advertiseRelay(const topic_tools::ShapeShifter& msg)
+  {
+    bool advertised {false};
+    ros::Publisher result;
+    {
+      // The callbacks of the input can run concurrently, so only the first one advertises.
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!relay_pub)
+      {
+        auto opts = this->getRelayOptions(msg);
+        relay_pub = nh.advertise(opts);
+        relay_advertised = true;
+        advertised = true;
+      }
+      result = relay_pub;
+    }
+    // Nobody could have subscribed yet, so the input is unsubscribed until somebody does.
+    if (advertised)
+      updateSubscription();
+    return result;
+  }
+
+  ros::AdvertiseOptions getRelayOptions(const topic_tools::ShapeShifter& msg)
+  {
+    boost::weak_ptr<Pair> weak_this = this->shared_from_this();
+    const auto update = [weak_this](const ros::SingleSubscriberPublisher&)
+    {
+      const auto pair = weak_this.lock();
+      if (pair)
+        pair->updateSubscription();
+    };
+
+    ros::AdvertiseOptions opts;
+    opts.topic = decoder->getTopicToSubscribe(out_topic);
+    opts.queue_size = out_queue_size;
+    opts.md5sum = msg.getMD5Sum();
+    opts.datatype = msg.getDataType();
+    opts.message_definition = msg.getMessageDefinition();
+    opts.connect_cb = update;
+    opts.disconnect_cb = update;
+    opts.tracked_object = this->shared_from_this();
+    return opts;
+  }
+
+  void transcode(const topic_tools::ShapeShifter& msg)
+  {
+    const auto res = decoder->decode(msg, decoder_config);
+    if (!res)
+    {
+      ROS_ERROR_THROTTLE(1.0, "Republisher of %s failed to decode cloud: %s", in_topic.c_str(), res.error().c_str());
+      return;
+    }
+    // Some decoders need more messages to produce a cloud.
+    if (!res.value())
+      return;
+    publish(res.value().value());
+  }
+
+  void publish(const sensor_msgs::PointCloud2ConstPtr& cloud)
+  {
+    if (pub_plugin)
+      pub_plugin->publish(cloud);
+    else
+      pub.publish(cloud);
+  }
+
+  std::string in_topic;
+  std::string out_topic;
+  std::string in_transport;
+  //! \brief The output transport. Empty means all transports.
+  std::string out_transport;
+  uint32_t in_queue_size {10};
+  uint32_t out_queue_size {10};
+  //! \brief Config of the decoder. Only decoders using a single topic can be configured.
+  dynamic_reconfigure::Config decoder_config;
+  bool has_decoder_config {false};
+
+  ros::NodeHandle nh;
+  PointCloudTransport& pct;
+  //! \brief The decoder of in_transport if it uses a single topic.
+  boost::shared_ptr<SingleTopicSubscriberPlugin> decoder;
+  ros::Subscriber sub;
+  Subscriber pct_sub;
+  Publisher pub;
+  boost::shared_ptr<PublisherPlugin> pub_plugin;
+  ros::Publisher relay_pub;
+  //! \brief Set after relay_pub is advertised, so that it can then be read without the mutex.
+  std::atomic<bool> relay_advertised {false};
+  //! \brief Guards the subscription of the input and the advertising of relay_pub.
+  std::mutex mutex;
+  std::unique_ptr<Strand> strand;
+};
+
+namespace
+{
+
+std::string getString(XmlRpc::XmlRpcValue& item, const std::string& key, const std::string& default_value)
+{
+  if (!item.hasMember(key))
+    return default_value;
+  if (item[key].getType() != XmlRpc::XmlRpcValue::TypeString)
+    throw std::runtime_error("Key " + key + " of parameter ~topics should be a string.");
+  return static_cast<std::string>(item[key]);
+}
+
+}
+
+void RepublishNodelet::initPairs(XmlRpc::XmlRpcValue& topics, size_t in_queue_size, size_t out_queue_size)
+{
+  if (topics.getType() != XmlRpc::XmlRpcValue::TypeArray)
+    throw std::runtime_error("Parameter ~topics should be a list of dicts with keys in, out, in_transport and "
+                             "out_transport.");
+
+  const auto params = this->params(this->getPrivateNodeHandle());
+  const auto num_threads = params->getParam("num_worker_threads", 0_sz, "threads");
+  const auto worker_queue_size = params->getParam("worker_queue_size", in_queue_size, "clouds");
+
+  this->pool = std::make_unique<ThreadPool>(num_threads);
+  for (int i = 0; i < topics.size(); ++i)
+  {
+    auto& item = topics[i];
+    if (item.getType() != XmlRpc::XmlRpcValue::TypeStruct || !item.hasMember("in") || !item.hasMember("out"))
+      throw std::runtime_error("Each item of parameter ~topics has to be a dict with at least keys in and out.");
+
+    auto pair = boost::make_shared<Pair>(this->getMTNodeHandle(), *this->pct, *this->pool, worker_queue_size);
+    pair->in_topic = this->getNodeHandle().resolveName(getString(item, "in", ""));
+    pair->out_topic = this->getNodeHandle().resolveName(getString(item, "out", ""));
+    pair->in_transport = getString(item, "in_transport", "raw");
+    pair->out_transport = getString(item, "out_transport", "");
+    pair->in_queue_size = static_cast<uint32_t>(in_queue_size);
+    pair->out_queue_size = static_cast<uint32_t>(out_queue_size);
+    if (item.hasMember("decoder_config"))
+    {
+      std::list<std::string> errors;
+      if (item["decoder_config"].getType() != XmlRpc::XmlRpcValue::TypeStruct ||
+          !cras::convert(item["decoder_config"], pair->decoder_config, true, &errors))
+        throw std::runtime_error("Key decoder_config of parameter ~topics should be a dict of decoder parameters. " +
+                                 cras::join(errors, " "));
+      pair->has_decoder_config = true;
+      if (pair->relay())
+        CRAS_WARN("The relayed topic %s is not decoded, so its decoder_config is ignored.", pair->in_topic.c_str());
+    }
+    pair->init();
+
+    CRAS_INFO("Republishing %s (%s) to %s (%s).", pair->in_topic.c_str(), pair->in_transport.c_str(),
+              pair->out_topic.c_str(), pair->out_transport.empty() ? "all transports" : pair->out_transport.c_str());
+    this->pairs.push_back(pair);
+  }
+}
 
+void RepublishNodelet::onInit()
+{
   const auto params = this->params(this->getPrivateNodeHandle());
   const auto in_queue_size = params->getParam("in_queue_size", 10_sz, "messages");
   const auto out_queue_size = params->getParam("out_queue_size", in_queue_size, "messages");
 
   this->pct = std::make_unique<PointCloudTransport>(this->getMTNodeHandle());
+
+  XmlRpc::XmlRpcValue topics;
+  if (this->getPrivateNodeHandle().getParam("topics", topics))
+  {
+    this->initPairs(topics, in_queue_size, out_queue_size);
+    return;
+  }
+
+  if (this->getMyArgv().empty())
+  {
+    throw std::runtime_error("Usage: republish in_transport in:=<in_base_topic> [out_transport] out:=<out_base_topic>"
+                             " or republish _topics:=<list of pairs>");
+  }
+
+  std::string in_transport = this->getMyArgv()[0];
+  std::string in_topic = this->getNodeHandle().resolveName("in");
+  std::string out_topic = this->getNodeHandle().resolveName("out");
+
   point_cloud_transport::TransportHints hints(in_transport, {}, this->getPrivateNodeHandle());
 
   // There might be exceptions thrown by the loaders. We want the propagate so that the nodelet loading fails.
@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Publisher plugin passing the cloud data to same-host subscribers via shared memory.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cras_cpp_common/optional.hpp>
+#include <ros/console.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/PointCloudShm.h>
+#include <point_cloud_transport/shm_publisher.h>
+#include <point_cloud_transport/shm_segment.h>
+#include <point_cloud_transport/ShmPublisherConfig.h>
+
+namespace point_cloud_transport
+{
+
+namespace
+{
+
+const char* const SEGMENT_PREFIX = "point_cloud_transport_";
+
+//! \brief Get a name for a new segment, unique among all segments created on this host.
+std::string getNewSegmentName()
+{
+  // The segments of crashed publishers would stay in /dev/shm until reboot.
+  static std::once_flag stale_segments_removed;
+  std::call_once(stale_segments_removed, []
+  {
+    const auto num_removed = ShmSegment::removeStaleSegments(SEGMENT_PREFIX);
+    if (num_removed > 0)
+      ROS_INFO("Removed %zu shared memory segments of point cloud publishers that no longer run.", num_removed);
+  });
+
+  static std::atomic<uint64_t> counter {0};
+  return "/" + std::string(SEGMENT_PREFIX) + std::to_string(getpid()) + "_" + std::to_string(counter++);
+}
+
+//! \brief Parse the octal permissions. Readers need read and write access, so only these bits are allowed.
+cras::optional<mode_t> parsePermissions(const std::string& permissions)
+{
+  char* end;
+  const auto mode = strtoul(permissions.c_str(), &end, 8);
+  if (permissions.empty() || *end != '\0' || (mode & ~0666ul) != 0 || (mode & 0600ul) != 0600ul)
+    return cras::nullopt;
+  return static_cast<mode_t>(mode);
+}
+
+}
+
+std::string ShmPublisher::getTransportName() const
+{
+  return "shm";
+}
+
+ShmPublisher::TypedEncodeResult ShmPublisher::encodeTyped(
+    const sensor_msgs::PointCloud2& raw, const ShmPublisherConfig& config) const
+{
+  PointCloudShm msg;
+  msg.header = raw.header;
+  msg.height = raw.height;
+  msg.width = raw.width;
+  msg.fields = raw.fields;
+  msg.is_bigendian = raw.is_bigendian;
+  msg.point_step = raw.point_step;
+  msg.row_step = raw.row_step;
+  msg.is_dense = raw.is_dense;
+  msg.host = ShmSegment::getHostName();
+  msg.size = raw.data.size();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const auto mode = parsePermissions(config.permissions);
+  if (!mode)
+    return cras::make_unexpected("Invalid permissions '" + config.permissions + "' of the shared memory segment. They "
+                                 "should be octal read and write bits including 0600, e.g. 0600 or 0660.");
+
+  const auto num_slots = static_cast<uint32_t>(config.num_slots);
+  if (!segment_ || segment_->getNumSlots() != num_slots || segment_->getSlotSize() < raw.data.size() ||
+      segment_mode_ != *mode)
+  {
+    // Leave some room so that slightly growing clouds do not replace the segment each time. Subscribers that have the
+    // old segment open can still read it until they open the new one.
+    const auto slot_size = std::max<uint64_t>(raw.data.size() + raw.data.size() / 4,
+                                              segment_ ? segment_->getSlotSize() : 0);
+    segment_.reset();
+    auto segment = ShmSegment::create(getNewSegmentName(), num_slots, slot_size, *mode);
+    if (!segment)
+      return cras::make_unexpected(segment.error());
+    segment_ = std::move(segment.value());
+    segment_mode_ = *mode;
+  }
+
+  const auto location = segment_->write(raw.data.data(), raw.data.size());
+  if (!location)
+  {
+    ROS_WARN_THROTTLE(5.0, "All %u shared memory slots of topic %s are being read, sending the cloud in the message. "
+                      "Consider increasing parameter num_slots.", num_slots, this->getTopic().c_str());
+    msg.data = raw.data;
+    return msg;
+  }
+
+  msg.segment = segment_->getName();
+  msg.slot = location->slot;
+  msg.generation = location->generation;
+  return msg;
+}
+
+void ShmPublisher::shutdown()
+{
+  SimplePublisherPlugin::shutdown();
+  std::lock_guard<std::mutex> lock(mutex_);
+  segment_.reset();
+}
+
+}
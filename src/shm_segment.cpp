@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Ring of slots in a POSIX shared memory segment, used by the shm transport.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cras_cpp_common/expected.hpp>
+#include <cras_cpp_common/optional.hpp>
+
+#include <point_cloud_transport/shm_segment.h>
+
+namespace point_cloud_transport
+{
+
+namespace
+{
+
+const uint64_t MAGIC = 0x6d68735f74637000ull;
+const uint32_t VERSION = 2;
+
+//! \brief Flag of the slot state while the slot is being written. The lower bits count the readers.
+const uint32_t WRITING = 0x80000000u;
+
+//! \brief Copying a slot takes milliseconds, so a reader that has not finished for this long has died while reading.
+const int64_t STALE_READ_TIMEOUT_NS = 1000000000;
+
+struct SegmentHeader
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t num_slots;
+  uint64_t slot_size;
+};
+
+//! \brief Round up to whole cache lines so that the slots do not share them.
+constexpr size_t align(size_t size)
+{
+  return (size + 63) / 64 * 64;
+}
+
+std::string errnoString(const std::string& what, const std::string& name)
+{
+  return what + " shared memory segment " + name + ": " + strerror(errno);
+}
+
+//! \brief Time of the monotonic clock, which is the same for all processes on the host.
+int64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! \brief Remove one reader from the slot state. Does nothing if the writer has reclaimed the slot from the readers.
+void releaseReader(std::atomic<uint32_t>& state)
+{
+  auto current = state.load(std::memory_order_relaxed);
+  while ((current & ~WRITING) != 0 &&
+         !state.compare_exchange_weak(current, current - 1, std::memory_order_release, std::memory_order_relaxed))
+  {
+  }
+}
+
+}
+
+struct ShmSegment::SlotHeader
+{
+  std::atomic<uint32_t> state;
+  //! \brief Zero while the slot is being written.
+  std::atomic<uint64_t> generation;
+  //! \brief When the last reader started reading (nowNs()).
+  std::atomic<int64_t> read_start;
+  uint64_t size;
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "The shm transport needs lock-free atomics to share them between processes.");
+
+ShmSegment::ShmSegment(const std::string& name, int fd, uint8_t* memory, size_t memory_size, bool owner) :
+    name_(name), fd_(fd), memory_(memory), memory_size_(memory_size), owner_(owner)
+{
+  const auto header = reinterpret_cast<const SegmentHeader*>(memory_);
+  num_slots_ = header->num_slots;
+  slot_size_ = header->slot_size;
+}
+
+ShmSegment::~ShmSegment()
+{
+  munmap(memory_, memory_size_);
+  close(fd_);
+  if (owner_)
+    shm_unlink(name_.c_str());
+}
+
+cras::expected<std::unique_ptr<ShmSegment>, std::string> ShmSegment::create(
+  const std::string& name, uint32_t num_slots, uint64_t slot_size, mode_t mode)
+{
+  slot_size = align(slot_size);
+  const size_t memory_size = align(sizeof(SegmentHeader)) + num_slots * (align(sizeof(SlotHeader)) + slot_size);
+
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, mode);
+  if (fd < 0)
+    return cras::make_unexpected(errnoString("Cannot create", name));
+  // shm_open() applies the umask.
+  if (fchmod(fd, mode) != 0)
+  {
+    const auto error = errnoString("Cannot set permissions of", name);
+    close(fd);
+    shm_unlink(name.c_str());
+    return cras::make_unexpected(error);
+  }
+  if (ftruncate(fd, static_cast<off_t>(memory_size)) != 0)
+  {
+    const auto error = errnoString("Cannot allocate", name);
+    close(fd);
+    shm_unlink(name.c_str());
+    return cras::make_unexpected(error);
+  }
+  const auto memory = mmap(nullptr, memory_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (memory == MAP_FAILED)
+  {
+    const auto error = errnoString("Cannot map", name);
+    close(fd);
+    shm_unlink(name.c_str());
+    return cras::make_unexpected(error);
+  }
+
+  const auto bytes = static_cast<uint8_t*>(memory);
+  auto header = new (bytes) SegmentHeader;
+  header->num_slots = num_slots;
+  header->slot_size = slot_size;
+  header->version = VERSION;
+  std::unique_ptr<ShmSegment> segment(new ShmSegment(name, fd, bytes, memory_size, true));
+  for (uint32_t i = 0; i < num_slots; ++i)
+  {
+    auto slot = new (&segment->getSlot(i)) SlotHeader;
+    slot->state.store(0);
+    slot->generation.store(0);
+    slot->read_start.store(0);
+    slot->size = 0;
+  }
+  // Readers check the magic number first, so they never see a half-initialized segment.
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = MAGIC;
+  return segment;
+}
+
+cras::expected<std::unique_ptr<ShmSegment>, std::string> ShmSegment::open(const std::string& name)
+{
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+    return cras::make_unexpected(errnoString("Cannot open", name));
+  struct stat info {};
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SegmentHeader))
+  {
+    close(fd);
+    return cras::make_unexpected("Shared memory segment " + name + " is too small.");
+  }
+  const auto memory_size = static_cast<size_t>(info.st_size);
+  // Readers need write access, too, to count themselves in the slot states.
+  const auto memory = mmap(nullptr, memory_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (memory == MAP_FAILED)
+  {
+    const auto error = errnoString("Cannot map", name);
+    close(fd);
+    return cras::make_unexpected(error);
+  }
+
+  const auto bytes = static_cast<uint8_t*>(memory);
+  const auto header = reinterpret_cast<const SegmentHeader*>(bytes);
+  const auto magic = header->magic;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (magic != MAGIC || header->version != VERSION ||
+      align(sizeof(SegmentHeader)) + header->num_slots * (align(sizeof(SlotHeader)) + header->slot_size) > memory_size)
+  {
+    munmap(memory, memory_size);
+    close(fd);
+    return cras::make_unexpected("Shared memory segment " + name + " is not a valid point cloud segment.");
+  }
+  return std::unique_ptr<ShmSegment>(new ShmSegment(name, fd, bytes, memory_size, false));
+}
+
+size_t ShmSegment::removeStaleSegments(const std::string& prefix)
+{
+  const auto dir = opendir("/dev/shm");
+  if (dir == nullptr)
+    return 0;
+
+  size_t num_removed = 0;
+  const auto own_pid = getpid();
+  while (const auto entry = readdir(dir))
+  {
+    const std::string name = entry->d_name;
+    if (name.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    char* end;
+    const auto pid = strtol(name.c_str() + prefix.size(), &end, 10);
+    if (end == name.c_str() + prefix.size() || *end != '_' || pid <= 0 || pid == own_pid)
+      continue;
+    // EPERM means that the process exists, but belongs to someone else.
+    if (kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH)
+      continue;
+    if (shm_unlink(("/" + name).c_str()) == 0)
+      ++num_removed;
+  }
+  closedir(dir);
+  return num_removed;
+}
+
+std::string ShmSegment::getHostName()
+{
+  char name[256] {};
+  if (gethostname(name, sizeof(name) - 1) != 0)
+    return {};
+  return name;
+}
+
+const std::string& ShmSegment::getName() const
+{
+  return name_;
+}
+
+uint32_t ShmSegment::getNumSlots() const
+{
+  return num_slots_;
+}
+
+uint64_t ShmSegment::getSlotSize() const
+{
+  return slot_size_;
+}
+
+ShmSegment::SlotHeader& ShmSegment::getSlot(uint32_t slot)
+{
+  return *reinterpret_cast<SlotHeader*>(memory_ + align(sizeof(SegmentHeader)) + slot * align(sizeof(SlotHeader)));
+}
+
+uint8_t* ShmSegment::getSlotData(uint32_t slot)
+{
+  return memory_ + align(sizeof(SegmentHeader)) + num_slots_ * align(sizeof(SlotHeader)) + slot * slot_size_;
+}
+
+cras::optional<ShmSegment::Location> ShmSegment::write(const uint8_t* data, size_t size)
+{
+  if (!owner_ || size > slot_size_)
+    return cras::nullopt;
+
+  for (uint32_t i = 0; i < num_slots_; ++i)
+  {
+    const auto index = (next_slot_ + i) % num_slots_;
+    auto& slot = getSlot(index);
+    auto state = slot.state.load(std::memory_order_acquire);
+    // A reader that died while reading never releases the slot, so the slot is taken from readers that take too long.
+    if (state != 0 && ((state & WRITING) != 0 ||
+                       nowNs() - slot.read_start.load(std::memory_order_relaxed) < STALE_READ_TIMEOUT_NS))
+      continue;
+    if (!slot.state.compare_exchange_strong(state, WRITING, std::memory_order_acquire))
+      continue;
+
+    // Readers that are still copying the slot see the change of the generation and discard the data.
+    slot.generation.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.size = size;
+    if (size > 0)
+      memcpy(getSlotData(index), data, size);
+    const auto generation = next_generation_++;
+    slot.generation.store(generation, std::memory_order_release);
+    // Readers that tried to read while writing have incremented the state, too, and decrement it again themselves.
+    slot.state.fetch_sub(WRITING, std::memory_order_release);
+
+    next_slot_ = (index + 1) % num_slots_;
+    return Location{index, generation};
+  }
+  return cras::nullopt;
+}
+
+bool ShmSegment::read(const Location& location, uint8_t* data, size_t size)
+{
+  if (location.slot >= num_slots_ || size > slot_size_)
+    return false;
+
+  auto& slot = getSlot(location.slot);
+  // Set before counting in, so that the writer never sees this reader with an old start time.
+  slot.read_start.store(nowNs(), std::memory_order_relaxed);
+  const auto state = slot.state.fetch_add(1, std::memory_order_acq_rel);
+  bool valid = (state & WRITING) == 0 &&
+      slot.generation.load(std::memory_order_acquire) == location.generation && slot.size == size;
+  if (valid && size > 0)
+  {
+    memcpy(data, getSlotData(location.slot), size);
+    // The writer may have taken the slot if this reader was too slow.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    valid = slot.generation.load(std::memory_order_relaxed) == location.generation;
+  }
+  releaseReader(slot.state);
+  return valid;
+}
+
+}
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Subscriber plugin reading the cloud data from shared memory.
+ */
+
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/PointCloudShm.h>
+#include <point_cloud_transport/shm_segment.h>
+#include <point_cloud_transport/shm_subscriber.h>
+
+namespace point_cloud_transport
+{
+
+std::string ShmSubscriber::getTransportName() const
+{
+  return "shm";
+}
+
+SubscriberPlugin::DecodeResult ShmSubscriber::decodeTyped(const PointCloudShm& msg, const NoConfigConfig&) const
+{
+  const size_t num_points = static_cast<size_t>(msg.height) * msg.width;
+  if (num_points > 0 && (msg.row_step < static_cast<size_t>(msg.width) * msg.point_step ||
+                         msg.size < static_cast<size_t>(msg.height - 1) * msg.row_step +
+                                    static_cast<size_t>(msg.width) * msg.point_step))
+    return cras::make_unexpected(std::string("The cloud has less data than its dimensions require."));
+
+  sensor_msgs::PointCloud2Ptr cloud;
+  if (msg.segment.empty())
+  {
+    if (msg.data.size() != msg.size)
+      return cras::make_unexpected(std::string("The message has a wrong amount of data."));
+    cloud = this->allocateCloud(msg.data.size());
+    if (!msg.data.empty())
+      memcpy(cloud->data.data(), msg.data.data(), msg.data.size());
+  }
+  else
+  {
+    if (msg.host != ShmSegment::getHostName())
+      return cras::make_unexpected("The cloud was published via shared memory on host " + msg.host + ", it can't be "
+                                   "received on another host. Use another transport.");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!segment_ || segment_->getName() != msg.segment)
+    {
+      // The publisher replaced the segment (or this is the first message), the old one is no longer written to.
+      segment_.reset();
+      auto segment = ShmSegment::open(msg.segment);
+      if (!segment)
+        return cras::make_unexpected(segment.error());
+      segment_ = std::move(segment.value());
+    }
+
+    cloud = this->allocateCloud(msg.size);
+    if (!segment_->read({msg.slot, msg.generation}, cloud->data.data(), msg.size))
+      return cras::make_unexpected("The shared memory slot of the cloud was reused before the cloud was received. "
+                                   "Increase parameter num_slots of the publisher.");
+  }
+
+  cloud->header = msg.header;
+  cloud->height = msg.height;
+  cloud->width = msg.width;
+  cloud->fields = msg.fields;
+  cloud->is_bigendian = msg.is_bigendian;
+  cloud->point_step = msg.point_step;
+  cloud->row_step = msg.row_step;
+  cloud->is_dense = msg.is_dense;
+  return cloud;
+}
+
+}
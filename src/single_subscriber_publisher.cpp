@@ -50,8 +50,9 @@ namespace point_cloud_transport
 
 SingleSubscriberPublisher::SingleSubscriberPublisher(
     const std::string& caller_id, const std::string& topic, const GetNumSubscribersFn& num_subscribers_fn,
-    const PublishFn& publish_fn)
-    : caller_id_(caller_id), topic_(topic), num_subscribers_fn_(num_subscribers_fn), publish_fn_(publish_fn)
+    const PublishFn& publish_fn, const PublishPtrFn& publish_ptr_fn)
+    : caller_id_(caller_id), topic_(topic), num_subscribers_fn_(num_subscribers_fn), publish_fn_(publish_fn),
+      publish_ptr_fn_(publish_ptr_fn)
 {
 }
 
@@ -77,7 +78,10 @@ void SingleSubscriberPublisher::publish(const sensor_msgs::PointCloud2& message)
 
 void SingleSubscriberPublisher::publish(const sensor_msgs::PointCloud2ConstPtr& message) const
 {
-  publish_fn_(*message);
+  if (publish_ptr_fn_)
+    publish_ptr_fn_(message);
+  else
+    publish_fn_(*message);
 }
 
 }
@@ -39,24 +39,36 @@
  */
 
 #include <algorithm>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 
+#include <cras_cpp_common/optional.hpp>
 #include <pluginlib/class_loader.h>
 #include <pluginlib/exceptions.hpp>
 #include <ros/forwards.h>
 #include <ros/names.h>
 #include <ros/node_handle.h>
+#include <ros/param.h>
+#include <ros/publisher.h>
+#include <ros/this_node.h>
 #include <sensor_msgs/PointCloud2.h>
 
 #include <point_cloud_transport/exception.h>
 #include <point_cloud_transport/loader_fwds.h>
+#include <point_cloud_transport/loader_registry.h>
+#include <point_cloud_transport/point_cloud_filter.h>
+#include <point_cloud_transport/point_cloud_projection.h>
+#include <point_cloud_transport/publisher_options.h>
 #include <point_cloud_transport/subscriber.h>
 #include <point_cloud_transport/subscriber_plugin.h>
 #include <point_cloud_transport/transport_hints.h>
+#include <point_cloud_transport/TransportStatistics.h>
 
 namespace point_cloud_transport
 {
@@ -74,22 +86,92 @@ struct Subscriber::Impl
 
   bool isValid() const
   {
+    std::lock_guard<std::mutex> lock(fallback_mutex_);
     return !unsubscribed_;
   }
 
   void shutdown()
   {
-    if (!unsubscribed_)
     {
+      // The fallback timer checks the flag under the same lock, so it creates no fallback after this block.
+      std::lock_guard<std::mutex> lock(fallback_mutex_);
+      if (unsubscribed_)
+        return;
       unsubscribed_ = true;
-      if (subscriber_)
-        subscriber_->shutdown();
+    }
+    statistics_timer_.stop();
+    statistics_pub_.shutdown();
+    fallback_timer_.stop();
+    {
+      std::lock_guard<std::mutex> lock(fallback_mutex_);
+      if (fallback_)
+        fallback_->shutdown();
+      fallback_.reset();
+    }
+    for (const auto& param : requested_rate_params_)
+      ros::param::del(param);
+    if (subscriber_)
+      subscriber_->shutdown();
+  }
+
+  TransportStatistics getStatistics() const
+  {
+    auto stats = subscriber_->getStatistics();
+    stats.header.stamp = ros::Time::now();
+    stats.node = ros::this_node::getName();
+    stats.topic = base_topic_;
+    return stats;
+  }
+
+  void startStatistics(ros::NodeHandle& nh, double rate)
+  {
+    if (rate <= 0.0)
+      return;
+
+    statistics_pub_ = nh.advertise<TransportStatistics>(
+      base_topic_ + "/" + subscriber_->getTransportName() + "/statistics", 10);
+    statistics_timer_ = nh.createWallTimer(ros::WallDuration(1.0 / rate), [this](const ros::WallTimerEvent&)
+    {
+      this->statistics_pub_.publish(this->getStatistics());
+    });
+  }
+
+  //! \brief Subscribe to the whole clouds while the projection is not served, and stop when it is served again.
+  void updateFallback()
+  {
+    std::lock_guard<std::mutex> lock(fallback_mutex_);
+    if (unsubscribed_)
+      return;
+    const bool served = subscriber_->getNumPublishers() > 0;
+    if (!served && !fallback_)
+    {
+      fallback_ = create_fallback_();
+    }
+    else if (served && fallback_)
+    {
+      ROS_INFO("[point_cloud_transport] Topic %s is served now, the whole clouds are no longer received.",
+               subscriber_->getTopic().c_str());
+      fallback_->shutdown();
+      fallback_.reset();
     }
   }
 
+  std::string base_topic_;
   point_cloud_transport::SubLoaderPtr loader_;
   boost::shared_ptr<SubscriberPlugin> subscriber_;
   bool unsubscribed_;
+  ros::Publisher statistics_pub_;
+  ros::WallTimer statistics_timer_;
+  //! \brief The parameters by which this node asks the publishers for a lower rate (empty if it does not ask).
+  std::vector<std::string> requested_rate_params_;
+
+  //! \brief If only some fields are wanted, this creates a subscriber of the whole clouds that projects them locally.
+  std::function<boost::shared_ptr<SubscriberPlugin>()> create_fallback_;
+  //! \brief The subscriber of the whole clouds while the projected topic is not served.
+  boost::shared_ptr<SubscriberPlugin> fallback_;
+  ros::WallTimer fallback_timer_;
+  //! \brief Protects fallback_ and unsubscribed_.
+  mutable std::mutex fallback_mutex_;
 };
 
 Subscriber::Subscriber() = default;
@@ -104,6 +186,7 @@ Subscriber::Subscriber(ros::NodeHandle& nh, const std::string& base_topic, uint3
   std::string lookup_name = SubscriberPlugin::getLookupName(transport_hints.getTransport());
   try
   {
+    const auto loader_lock = LoaderRegistry::instance().lockLoaders();
     impl_->subscriber_ = loader->createInstance(lookup_name);
   }
   catch (pluginlib::PluginlibException& e) {
@@ -118,7 +201,7 @@ Subscriber::Subscriber(ros::NodeHandle& nh, const std::string& base_topic, uint3
   if (found != std::string::npos) {
     std::string transport = clean_topic.substr(found+1);
     std::string plugin_name = SubscriberPlugin::getLookupName(transport);
-    std::vector<std::string> plugins = loader->getDeclaredClasses();
+    std::vector<std::string> plugins = LoaderRegistry::instance().getDeclaredClasses(*loader);
     if (std::find(plugins.begin(), plugins.end(), plugin_name) != plugins.end()) {
       std::string real_base_topic = clean_topic.substr(0, found);
       ROS_WARN("[point_cloud_transport] It looks like you are trying to subscribe directly to a "
@@ -129,9 +212,161 @@ Subscriber::Subscriber(ros::NodeHandle& nh, const std::string& base_topic, uint3
     }
   }
 
+  ros::NodeHandle param_nh(transport_hints.getParameterNH(), impl_->subscriber_->getTransportName());
+
+  // Crop and downsample the decoded clouds before the local projection, which might drop the coordinates.
+  auto filter = transport_hints.getCloudFilter();
+  std::vector<double> crop_box;
+  if (param_nh.getParam("crop_box", crop_box))
+  {
+    if (crop_box.size() == 6)
+      filter.crop_box = CropBox{crop_box[0], crop_box[1], crop_box[2], crop_box[3], crop_box[4], crop_box[5]};
+    else if (crop_box.empty())
+      filter.crop_box = cras::nullopt;
+    else
+    {
+      ROS_ERROR("Parameter %s/crop_box should be a list of min x, y, z and max x, y, z.",
+                param_nh.getNamespace().c_str());
+    }
+  }
+  param_nh.param("voxel_size", filter.voxel_size, filter.voxel_size);
+  auto plugin_hints = transport_hints;
+  plugin_hints.cloudFilter(filter);
+  const bool filtering = filter.isEnabled();
+  if (impl_->subscriber_->cropsWhileDecoding())
+    filter.crop_box = cras::nullopt;
+
+  typedef boost::function<void(const sensor_msgs::PointCloud2ConstPtr&)> Callback;
+
+  // The plugin sets its pool when subscribing, so it is looked up with each cloud.
+  const auto with_filter = [filter](const boost::weak_ptr<SubscriberPlugin>& plugin, const Callback& cb)
+  {
+    if (!filter.isEnabled())
+      return cb;
+    return Callback([cb, filter, plugin](const sensor_msgs::PointCloud2ConstPtr& cloud)
+    {
+      const auto locked_plugin = plugin.lock();
+      const auto filtered = filterCloud(*cloud, filter,
+                                        locked_plugin ? locked_plugin->getPointCloudPool().get() : nullptr);
+      if (!filtered)
+      {
+        ROS_ERROR_THROTTLE(5.0, "Cannot filter the received point cloud: %s", filtered.error().c_str());
+        return;
+      }
+      cb(filtered.value());
+    });
+  };
+
+  // The publisher reads the requested rate when this subscriber connects, so it has to be set before subscribing. A
+  // request left by a previous node with the same name (e.g. one that crashed) is removed.
+  double max_rate;
+  param_nh.param("max_rate", max_rate, transport_hints.getMaxRate());
+  const auto request_rate = [this, &nh, max_rate](const std::string& topic)
+  {
+    const auto param = getRequestedRateParamName(
+      nh.resolveName(topic), impl_->subscriber_->getTransportName(), ros::this_node::getName());
+    if (max_rate > 0.0)
+    {
+      impl_->requested_rate_params_.push_back(param);
+      ros::param::set(param, max_rate);
+    }
+    else if (ros::param::has(param))
+    {
+      ros::param::del(param);
+    }
+  };
+
+  // If only some fields are wanted, subscribe to the projection served by the publisher. While it is not served, the
+  // whole clouds are received and projected locally.
+  std::string subscribed_topic = base_topic;
+  auto subscribed_callback = callback;
+  std::vector<std::string> fields;
+  param_nh.param("fields", fields, transport_hints.getFields());
+  if (!fields.empty())
+  {
+    const auto project = [fields](const Callback& cb)
+    {
+      return Callback([cb, fields](const sensor_msgs::PointCloud2ConstPtr& cloud)
+      {
+        const auto projected = projectFields(*cloud, fields);
+        if (!projected)
+        {
+          ROS_ERROR_THROTTLE(5.0, "Cannot project the received point cloud: %s", projected.error().c_str());
+          return;
+        }
+        cb(projected.value());
+      });
+    };
+
+    // The filters need the coordinates, so they are received, too, and dropped after filtering.
+    auto subscribed_fields = fields;
+    if (filtering)
+    {
+      for (const auto& name : {"x", "y", "z"})
+      {
+        if (std::find(fields.begin(), fields.end(), name) == fields.end())
+          subscribed_fields.emplace_back(name);
+      }
+    }
+    if (subscribed_fields != fields)
+      subscribed_callback = project(callback);
+
+    subscribed_topic = nh.resolveName(base_topic) + "/" + getProjectionName(subscribed_fields);
+    request_rate(base_topic);
+    if (subscribed_fields != fields)
+    {
+      ROS_WARN("[point_cloud_transport] The crop box and voxel filters need fields x, y and z, so topic %s is "
+               "received and the coordinates are dropped after filtering.", subscribed_topic.c_str());
+    }
+
+    const auto full_topic = nh.resolveName(base_topic);
+    const boost::weak_ptr<SubscriberPlugin> projected_plugin = impl_->subscriber_;
+    impl_->create_fallback_ = [=]() mutable -> boost::shared_ptr<SubscriberPlugin>
+    {
+      ROS_WARN("[point_cloud_transport] Topic %s is not served, so whole clouds will be received from topic %s and "
+               "projected locally. Add the fields to parameter projections of the publisher to save the bandwidth.",
+               subscribed_topic.c_str(), full_topic.c_str());
+      boost::shared_ptr<SubscriberPlugin> fallback;
+      {
+        const auto loader_lock = LoaderRegistry::instance().lockLoaders();
+        fallback = loader->createInstance(lookup_name);
+      }
+      const auto filtered_callback = with_filter(fallback, project(callback));
+      const auto fallback_callback =
+        [filtered_callback, projected_plugin](const sensor_msgs::PointCloud2ConstPtr& cloud)
+      {
+        // Once the projected clouds arrive, the whole clouds are dropped until the fallback is shut down.
+        const auto locked_plugin = projected_plugin.lock();
+        if (locked_plugin && locked_plugin->getNumPublishers() > 0)
+          return;
+        filtered_callback(cloud);
+      };
+      fallback->subscribe(nh, full_topic, queue_size, fallback_callback, tracked_object, plugin_hints,
+                          allow_concurrent_callbacks);
+      return fallback;
+    };
+  }
+  request_rate(subscribed_topic);
+
   // Tell plugin to subscribe.
-  impl_->subscriber_->subscribe(nh, base_topic, queue_size, callback, tracked_object, transport_hints,
-                                allow_concurrent_callbacks);
+  impl_->subscriber_->subscribe(nh, subscribed_topic, queue_size, with_filter(impl_->subscriber_, subscribed_callback),
+                                tracked_object, plugin_hints, allow_concurrent_callbacks);
+
+  impl_->base_topic_ = nh.resolveName(base_topic);
+  double statistics_rate;
+  param_nh.param("statistics_rate", statistics_rate, transport_hints.getStatisticsRate());
+  impl_->startStatistics(nh, statistics_rate);
+
+  if (impl_->create_fallback_)
+  {
+    // The publisher of the projection can appear or disappear at any time, so the fallback follows it. The first check
+    // is done after the projected topic had time to connect. The timer is stopped before impl_ is destroyed.
+    const auto impl = impl_.get();
+    impl_->fallback_timer_ = nh.createWallTimer(ros::WallDuration(1.0), [impl](const ros::WallTimerEvent&)
+    {
+      impl->updateFallback();
+    });
+  }
 }
 
 std::string Subscriber::getTopic() const
@@ -155,6 +390,13 @@ std::string Subscriber::getTransport() const
   return {};
 }
 
+TransportStatistics Subscriber::getStatistics() const
+{
+  if (impl_)
+    return impl_->getStatistics();
+  return {};
+}
+
 void Subscriber::shutdown()
 {
   if (impl_)
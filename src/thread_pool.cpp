@@ -0,0 +1,344 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Simple worker pools used for running encoders and decoders outside of the caller's thread.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <ros/console.h>
+
+#include <point_cloud_transport/thread_pool.h>
+
+namespace point_cloud_transport
+{
+
+ThreadPool::ThreadPool(size_t num_threads)
+{
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  threads_.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; ++i)
+  {
+    threads_.emplace_back(&ThreadPool::run, this);
+    thread_ids_.push_back(threads_.back().get_id());
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  shutdown();
+}
+
+bool ThreadPool::post(const Task& task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_)
+      return false;
+    tasks_.push_back(task);
+  }
+  cv_.notify_one();
+  return true;
+}
+
+size_t ThreadPool::getNumThreads() const
+{
+  return threads_.size();
+}
+
+bool ThreadPool::isWorkerThread() const
+{
+  return std::find(thread_ids_.begin(), thread_ids_.end(), std::this_thread::get_id()) != thread_ids_.end();
+}
+
+void ThreadPool::shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_)
+      return;
+    stopping_ = true;
+  }
+  cv_.notify_all();
+
+  for (auto& thread : threads_)
+  {
+    if (thread.joinable())
+      thread.join();
+  }
+}
+
+void ThreadPool::run()
+{
+  while (true)
+  {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty())
+        return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    try
+    {
+      task();
+    }
+    catch (const std::exception& e)
+    {
+      ROS_ERROR("Task running in point_cloud_transport thread pool threw an exception: %s", e.what());
+    }
+    catch (...)
+    {
+      ROS_ERROR("Task running in point_cloud_transport thread pool threw an unknown exception.");
+    }
+  }
+}
+
+struct Strand::State
+{
+  State(ThreadPool& pool, size_t capacity, QueueOverflowPolicy policy) :
+    pool_(pool), capacity_(capacity), policy_(policy)
+  {
+  }
+
+  ThreadPool& pool_;
+  const size_t capacity_;
+  const QueueOverflowPolicy policy_;
+  size_t num_dropped_ {0};
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<ThreadPool::Task> tasks_;
+  bool running_ {false};
+  bool closed_ {false};
+};
+
+Strand::Strand(ThreadPool& pool, size_t capacity, QueueOverflowPolicy policy) :
+  state_(std::make_shared<State>(pool, capacity, policy))
+{
+}
+
+Strand::~Strand()
+{
+  std::unique_lock<std::mutex> lock(state_->mutex_);
+  state_->closed_ = true;
+  state_->tasks_.clear();
+  state_->cv_.notify_all();  // Wake up the threads blocked in post().
+  state_->cv_.wait(lock, [this] { return !state_->running_; });
+}
+
+bool Strand::post(const ThreadPool::Task& task)
+{
+  {
+    std::unique_lock<std::mutex> lock(state_->mutex_);
+    if (state_->capacity_ > 0 && state_->tasks_.size() >= state_->capacity_)
+    {
+      switch (state_->policy_)
+      {
+        case QueueOverflowPolicy::DROP_OLDEST:
+          state_->tasks_.pop_front();
+          ++state_->num_dropped_;
+          break;
+        case QueueOverflowPolicy::DROP_NEWEST:
+          ++state_->num_dropped_;
+          return false;
+        case QueueOverflowPolicy::BLOCK:
+          state_->cv_.wait(lock, [this] { return state_->closed_ || state_->tasks_.size() < state_->capacity_; });
+          break;
+      }
+    }
+    if (state_->closed_)
+      return false;
+    state_->tasks_.push_back(task);
+    if (state_->running_)
+      return true;
+    state_->running_ = true;
+  }
+
+  const auto state = state_;
+  if (!state_->pool_.post([state] { Strand::runNext(state); }))
+  {
+    Strand::finish(state_);
+    return false;
+  }
+  return true;
+}
+
+size_t Strand::getQueueSize() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex_);
+  return state_->tasks_.size();
+}
+
+size_t Strand::getNumDropped() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex_);
+  return state_->num_dropped_;
+}
+
+void Strand::runNext(const std::shared_ptr<State>& state)
+{
+  ThreadPool::Task task;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex_);
+    if (state->tasks_.empty())
+    {
+      state->running_ = false;
+      state->cv_.notify_all();
+      return;
+    }
+    task = std::move(state->tasks_.front());
+    state->tasks_.pop_front();
+    if (state->policy_ == QueueOverflowPolicy::BLOCK)
+      state->cv_.notify_all();
+  }
+
+  try
+  {
+    task();
+  }
+  catch (const std::exception& e)
+  {
+    ROS_ERROR("Task running in point_cloud_transport strand threw an exception: %s", e.what());
+  }
+  catch (...)
+  {
+    ROS_ERROR("Task running in point_cloud_transport strand threw an unknown exception.");
+  }
+
+  // Give tasks of other strands a chance to run before continuing with the next task of this strand.
+  bool has_more;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex_);
+    has_more = !state->tasks_.empty();
+    if (!has_more)
+    {
+      state->running_ = false;
+      state->cv_.notify_all();
+    }
+  }
+  if (has_more && !state->pool_.post([state] { Strand::runNext(state); }))
+    Strand::finish(state);
+}
+
+void Strand::finish(const std::shared_ptr<State>& state)
+{
+  // The pool is shutting down, so the remaining tasks would never run.
+  std::lock_guard<std::mutex> lock(state->mutex_);
+  state->num_dropped_ += state->tasks_.size();
+  state->tasks_.clear();
+  state->running_ = false;
+  state->cv_.notify_all();
+}
+
+OrderedExecutor::OrderedExecutor(size_t num_threads, size_t max_in_flight) : pool_(num_threads)
+{
+  max_in_flight_ = max_in_flight > 0 ? max_in_flight : 2 * pool_.getNumThreads();
+}
+
+OrderedExecutor::~OrderedExecutor()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  pool_.shutdown();
+}
+
+void OrderedExecutor::post(const Job& job)
+{
+  uint64_t seq;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return stopping_ || in_flight_ < max_in_flight_; });
+    if (stopping_)
+      return;
+    seq = next_seq_++;
+    ++in_flight_;
+  }
+
+  const bool posted = pool_.post([this, job, seq]
+  {
+    ThreadPool::Task completion;
+    try
+    {
+      completion = job();
+    }
+    catch (const std::exception& e)
+    {
+      ROS_ERROR("Job running in point_cloud_transport ordered executor threw an exception: %s", e.what());
+    }
+    catch (...)
+    {
+      ROS_ERROR("Job running in point_cloud_transport ordered executor threw an unknown exception.");
+    }
+    this->finish(seq, std::move(completion));
+  });
+  if (!posted)
+    finish(seq, {});
+}
+
+size_t OrderedExecutor::getNumInFlight() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return in_flight_;
+}
+
+bool OrderedExecutor::isWorkerThread() const
+{
+  return pool_.isWorkerThread();
+}
+
+void OrderedExecutor::finish(uint64_t seq, ThreadPool::Task&& completion)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  finished_[seq] = std::move(completion);
+  if (completing_)
+    return;  // The thread running the completions will also run this one when its turn comes.
+
+  completing_ = true;
+  while (!finished_.empty() && finished_.begin()->first == next_to_complete_)
+  {
+    auto task = std::move(finished_.begin()->second);
+    finished_.erase(finished_.begin());
+    ++next_to_complete_;
+
+    lock.unlock();
+    if (task)
+    {
+      try
+      {
+        task();
+      }
+      catch (const std::exception& e)
+      {
+        ROS_ERROR("Completion running in point_cloud_transport ordered executor threw an exception: %s", e.what());
+      }
+      catch (...)
+      {
+        ROS_ERROR("Completion running in point_cloud_transport ordered executor threw an unknown exception.");
+      }
+    }
+    lock.lock();
+
+    --in_flight_;
+    cv_.notify_all();
+  }
+  completing_ = false;
+}
+
+}
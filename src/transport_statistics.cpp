@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Collection of encoding and decoding statistics of transports.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <point_cloud_transport/TransportStatistics.h>
+#include <point_cloud_transport/transport_statistics.h>
+
+namespace point_cloud_transport
+{
+
+TransportStatisticsCollector::TransportStatisticsCollector(const std::string& transport, uint8_t direction) :
+  transport_(transport), direction_(direction), histogram_(getHistogramBounds().size() + 1, 0)
+{
+}
+
+void TransportStatisticsCollector::addProcessed(const Clock::duration& duration, size_t input_bytes,
+                                                size_t output_bytes)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++num_processed_;
+  input_bytes_ += input_bytes;
+  output_bytes_ += output_bytes;
+  addTime(duration);
+}
+
+void TransportStatisticsCollector::addFailed(const Clock::duration& duration)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++num_failed_;
+  addTime(duration);
+}
+
+void TransportStatisticsCollector::addTime(const Clock::duration& duration)
+{
+  const double seconds = std::chrono::duration<double>(duration).count();
+  total_time_ += seconds;
+  max_time_ = std::max(max_time_, seconds);
+
+  const auto& bounds = getHistogramBounds();
+  const size_t bin = std::lower_bound(bounds.begin(), bounds.end(), seconds) - bounds.begin();
+  ++histogram_[bin];
+}
+
+TransportStatistics TransportStatisticsCollector::getStatistics() const
+{
+  TransportStatistics stats;
+  stats.transport = transport_;
+  stats.direction = direction_;
+  stats.time_histogram_bounds = getHistogramBounds();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats.num_processed = num_processed_;
+  stats.num_failed = num_failed_;
+  stats.input_bytes = input_bytes_;
+  stats.output_bytes = output_bytes_;
+  const auto raw_bytes = direction_ == TransportStatistics::ENCODER ? input_bytes_ : output_bytes_;
+  const auto compressed_bytes = direction_ == TransportStatistics::ENCODER ? output_bytes_ : input_bytes_;
+  stats.compression_ratio = compressed_bytes > 0 ? static_cast<double>(raw_bytes) / compressed_bytes : 0.0;
+  stats.total_time = total_time_;
+  stats.max_time = max_time_;
+  stats.time_histogram_counts = histogram_;
+  return stats;
+}
+
+const std::vector<double>& TransportStatisticsCollector::getHistogramBounds()
+{
+  static const std::vector<double> bounds = {
+    0.0001, 0.0002, 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0
+  };
+  return bounds;
+}
+
+}
@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the splitting of clouds into chunks and their reassembly.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudChunk.h>
+#include <point_cloud_transport/raw_chunked_publisher.h>
+#include <point_cloud_transport/raw_chunked_subscriber.h>
+
+#include "test_utils.h"
+
+using point_cloud_transport::NoConfigConfig;
+using point_cloud_transport::PointCloudChunk;
+using point_cloud_transport::RawChunkedPublisher;
+using point_cloud_transport::RawChunkedSubscriber;
+using point_cloud_transport::test::makeField;
+using point_cloud_transport::test::Point;
+
+namespace
+{
+
+const std::vector<sensor_msgs::PointField> FIELDS = {
+  makeField("x", 0, sensor_msgs::PointField::FLOAT32),
+  makeField("y", 4, sensor_msgs::PointField::FLOAT32),
+  makeField("z", 8, sensor_msgs::PointField::FLOAT32),
+};
+
+//! \brief Splits clouds into chunk messages like the publisher does.
+class ChunkedPublisher : public RawChunkedPublisher
+{
+public:
+  std::vector<PointCloudChunk> split(const sensor_msgs::PointCloud2& raw, size_t chunk_size, uint32_t cloud_id) const
+  {
+    std::vector<PointCloudChunk> msgs;
+    const auto ranges = getChunkRanges(raw.height, raw.width, raw.point_step, chunk_size);
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+      sensor_msgs::PointCloud2 chunk;
+      extractChunk(raw, ranges[i].first, ranges[i].second, chunk);
+      auto msg = this->encodeChunk(chunk, NoConfigConfig());
+      EXPECT_TRUE(msg.has_value() && msg->has_value());
+      fillChunkInfo(msg->value(), raw, cloud_id, i, ranges.size(), ranges[i].first, ranges[i].second);
+      msgs.push_back(msg->value());
+    }
+    return msgs;
+  }
+};
+
+//! \brief Collects the clouds assembled by the subscriber.
+class ChunkedSubscriber : public RawChunkedSubscriber
+{
+public:
+  //! \brief Process the chunk.
+  //! \return The cloud it completed, or null.
+  sensor_msgs::PointCloud2ConstPtr receive(const PointCloudChunk& msg)
+  {
+    sensor_msgs::PointCloud2ConstPtr result;
+    this->callback(boost::make_shared<PointCloudChunk>(msg), [&result](const sensor_msgs::PointCloud2ConstPtr& cloud)
+    {
+      EXPECT_FALSE(result);
+      result = cloud;
+    });
+    return result;
+  }
+};
+
+sensor_msgs::PointCloud2 makeCloud(uint32_t height, uint32_t width, uint32_t row_padding = 0, uint8_t fill = 0xab)
+{
+  std::vector<Point> points(height * width);
+  for (size_t i = 0; i < points.size(); ++i)
+    points[i] = {static_cast<float>(i), -static_cast<float>(i), 0.5f};
+  auto cloud = point_cloud_transport::test::makeCloud(points, height, FIELDS, 12, row_padding, fill);
+  cloud.header.stamp.sec = 10;
+  return cloud;
+}
+
+}
+
+TEST(ChunkedTransport, ReassemblesOrganizedCloudOutOfOrder)  // NOLINT
+{
+  ChunkedPublisher pub;
+  ChunkedSubscriber sub;
+  const auto cloud = makeCloud(8, 10, 4);
+  // Two padded rows per chunk.
+  const auto chunks = pub.split(cloud, 2 * cloud.row_step, 0);
+  ASSERT_EQ(4u, chunks.size());
+  EXPECT_EQ(20u, chunks[1].num_points);
+  EXPECT_EQ(20u, chunks[1].first_point);
+
+  for (const size_t i : {2, 0, 3})
+    EXPECT_FALSE(sub.receive(chunks[i])) << "chunk " << i;
+  const auto assembled = sub.receive(chunks[1]);
+  ASSERT_TRUE(assembled);
+  EXPECT_EQ(cloud.header.frame_id, assembled->header.frame_id);
+  EXPECT_EQ(cloud.height, assembled->height);
+  EXPECT_EQ(cloud.width, assembled->width);
+  EXPECT_EQ(cloud.row_step, assembled->row_step);
+  EXPECT_EQ(cloud.data, assembled->data);
+}
+
+TEST(ChunkedTransport, ReassemblesUnorganizedCloud)  // NOLINT
+{
+  ChunkedPublisher pub;
+  ChunkedSubscriber sub;
+  const auto cloud = makeCloud(1, 25);
+  // 25 points by 10.
+  const auto chunks = pub.split(cloud, 10 * cloud.point_step + 5, 0);
+  ASSERT_EQ(3u, chunks.size());
+  EXPECT_EQ(5u, chunks[2].num_points);
+
+  EXPECT_FALSE(sub.receive(chunks[2]));
+  EXPECT_FALSE(sub.receive(chunks[1]));
+  // A repeated chunk does not count as a new one.
+  EXPECT_FALSE(sub.receive(chunks[1]));
+  const auto assembled = sub.receive(chunks[0]);
+  ASSERT_TRUE(assembled);
+  EXPECT_EQ(cloud.data, assembled->data);
+}
+
+TEST(ChunkedTransport, AssemblesInterleavedClouds)  // NOLINT
+{
+  ChunkedPublisher pub;
+  ChunkedSubscriber sub;
+  const auto first = makeCloud(4, 5);
+  auto second = makeCloud(4, 5);
+  second.data[0] ^= 0xff;
+  const auto first_chunks = pub.split(first, first.row_step, 0);
+  const auto second_chunks = pub.split(second, second.row_step, 1);
+  ASSERT_EQ(4u, first_chunks.size());
+
+  for (size_t i = 0; i + 1 < first_chunks.size(); ++i)
+  {
+    EXPECT_FALSE(sub.receive(second_chunks[i])) << "chunk " << i;
+    EXPECT_FALSE(sub.receive(first_chunks[i])) << "chunk " << i;
+  }
+  const auto assembled_first = sub.receive(first_chunks.back());
+  const auto assembled_second = sub.receive(second_chunks.back());
+  ASSERT_TRUE(assembled_first);
+  ASSERT_TRUE(assembled_second);
+  EXPECT_EQ(first.data, assembled_first->data);
+  EXPECT_EQ(second.data, assembled_second->data);
+}
+
+TEST(ChunkedTransport, DropsMismatchedChunks)  // NOLINT
+{
+  ChunkedPublisher pub;
+  ChunkedSubscriber sub;
+  const auto cloud = makeCloud(4, 5);
+  const auto chunks = pub.split(cloud, cloud.row_step, 0);
+  ASSERT_EQ(4u, chunks.size());
+
+  // The number of points does not match the decoded data.
+  auto wrong_size = chunks[0];
+  wrong_size.num_points = 4;
+  EXPECT_FALSE(sub.receive(wrong_size));
+  // The chunk index is out of range.
+  auto wrong_index = chunks[0];
+  wrong_index.chunk_index = 4;
+  EXPECT_FALSE(sub.receive(wrong_index));
+
+  // A chunk with a different point layout drops the cloud assembled so far.
+  EXPECT_FALSE(sub.receive(chunks[0]));
+  auto other_layout = makeCloud(4, 5);
+  other_layout.point_step = 16;
+  other_layout.row_step = 5 * 16;
+  other_layout.data.resize(4 * other_layout.row_step);
+  auto wrong_layout = pub.split(other_layout, other_layout.row_step, 0);
+  EXPECT_FALSE(sub.receive(wrong_layout[1]));
+  for (const size_t i : {1, 2, 3})
+    EXPECT_FALSE(sub.receive(chunks[i])) << "chunk " << i;
+
+  // The next cloud is assembled again.
+  const auto next_chunks = pub.split(cloud, cloud.row_step, 1);
+  for (size_t i = 0; i + 1 < next_chunks.size(); ++i)
+    EXPECT_FALSE(sub.receive(next_chunks[i]));
+  EXPECT_TRUE(sub.receive(next_chunks.back()));
+}
+
+TEST(ChunkedTransport, DropsOldIncompleteClouds)  // NOLINT
+{
+  ChunkedPublisher pub;
+  ChunkedSubscriber sub;
+  const auto cloud = makeCloud(2, 5);
+  std::vector<std::vector<PointCloudChunk>> clouds;
+  for (uint32_t id = 0; id < 3; ++id)
+    clouds.push_back(pub.split(cloud, cloud.row_step, id));
+
+  // By default, at most two clouds wait for their chunks, so the first one is dropped when the third one starts.
+  for (const auto& chunks : clouds)
+    EXPECT_FALSE(sub.receive(chunks[0]));
+  EXPECT_TRUE(sub.receive(clouds[1][1]));
+  EXPECT_TRUE(sub.receive(clouds[2][1]));
+  EXPECT_FALSE(sub.receive(clouds[0][1]));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
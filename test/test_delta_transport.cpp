@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the delta transport.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/delta_publisher.h>
+#include <point_cloud_transport/delta_subscriber.h>
+#include <point_cloud_transport/DeltaPublisherConfig.h>
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudDelta.h>
+
+#include "test_utils.h"
+
+using point_cloud_transport::DeltaPublisher;
+using point_cloud_transport::DeltaPublisherConfig;
+using point_cloud_transport::DeltaSubscriber;
+using point_cloud_transport::NoConfigConfig;
+using point_cloud_transport::PointCloudDelta;
+using point_cloud_transport::test::makeCloud;
+using point_cloud_transport::test::makeField;
+using point_cloud_transport::test::Point;
+
+namespace
+{
+
+const std::vector<sensor_msgs::PointField> FIELDS = {
+  makeField("x", 0, sensor_msgs::PointField::FLOAT32),
+  makeField("y", 4, sensor_msgs::PointField::FLOAT32),
+  makeField("z", 8, sensor_msgs::PointField::FLOAT32),
+  makeField("intensity", 12, sensor_msgs::PointField::FLOAT32),
+};
+
+/**
+ * \brief A sequence of organized clouds in which each cloud differs from the previous one in the given number of
+ *        points.
+ */
+std::vector<sensor_msgs::PointCloud2> makeSequence(size_t num_clouds, size_t num_changed = 1)
+{
+  std::vector<Point> points(100);
+  for (size_t i = 0; i < points.size(); ++i)
+    points[i] = {static_cast<float>(i), 1.0f, 2.0f, 3.0f};
+
+  std::vector<sensor_msgs::PointCloud2> clouds;
+  for (size_t c = 0; c < num_clouds; ++c)
+  {
+    for (size_t i = 0; i < num_changed; ++i)
+      points[(c * 7 + i * 13) % points.size()].x += 100.0f;
+    auto cloud = makeCloud(points, 10, FIELDS, 16);
+    cloud.header.seq = static_cast<uint32_t>(c);
+    clouds.push_back(cloud);
+  }
+  return clouds;
+}
+
+DeltaPublisherConfig makeConfig(int keyframe_interval)
+{
+  auto config = DeltaPublisherConfig::__getDefault__();
+  config.keyframe_interval = keyframe_interval;
+  config.max_changed_ratio = 0.5;
+  config.change_threshold = 0.0;
+  return config;
+}
+
+PointCloudDelta encode(const DeltaPublisher& pub, const sensor_msgs::PointCloud2& cloud,
+                       const DeltaPublisherConfig& config)
+{
+  const auto encoded = pub.encodeTyped(cloud, config);
+  EXPECT_TRUE(encoded.has_value() && encoded->has_value());
+  return encoded.has_value() && encoded->has_value() ? encoded->value() : PointCloudDelta();
+}
+
+}
+
+TEST(DeltaTransport, KeyframesAndDeltasFormAChain)  // NOLINT
+{
+  DeltaPublisher pub;
+  DeltaSubscriber sub;
+  const auto config = makeConfig(4);
+  const auto clouds = makeSequence(9);
+  uint32_t previous = 0;
+  for (size_t i = 0; i < clouds.size(); ++i)
+  {
+    SCOPED_TRACE("cloud " + std::to_string(i));
+    const auto msg = encode(pub, clouds[i], config);
+    if (i > 0)
+      EXPECT_EQ(previous + 1, msg.sequence);
+    previous = msg.sequence;
+    // Every keyframe_interval-th cloud is a keyframe, the ones between are deltas against the previous cloud.
+    EXPECT_EQ(i % 4 == 0, msg.keyframe);
+    if (msg.keyframe)
+    {
+      EXPECT_EQ(msg.sequence, msg.reference);
+      EXPECT_EQ(clouds[i].data, msg.data);
+    }
+    else
+    {
+      EXPECT_EQ(msg.sequence - 1, msg.reference);
+      EXPECT_EQ(16u, msg.data.size());
+    }
+
+    const auto decoded = sub.decodeTyped(msg, NoConfigConfig());
+    ASSERT_TRUE(decoded.has_value()) << decoded.error();
+    ASSERT_TRUE(decoded->has_value());
+    EXPECT_EQ(clouds[i].header.seq, decoded->value()->header.seq);
+    EXPECT_EQ(clouds[i].data, decoded->value()->data);
+
+    // A repeated message does not produce another cloud.
+    const auto repeated = sub.decodeTyped(msg, NoConfigConfig());
+    ASSERT_TRUE(repeated.has_value());
+    EXPECT_FALSE(repeated->has_value());
+  }
+}
+
+TEST(DeltaTransport, LostDeltaWaitsForKeyframe)  // NOLINT
+{
+  DeltaPublisher pub;
+  DeltaSubscriber sub;
+  const auto config = makeConfig(4);
+  const auto clouds = makeSequence(6);
+  std::vector<PointCloudDelta> msgs;
+  for (const auto& cloud : clouds)
+    msgs.push_back(encode(pub, cloud, config));
+
+  // A subscriber that connected in the middle of the chain waits for a keyframe.
+  auto decoded = sub.decodeTyped(msgs[1], NoConfigConfig());
+  ASSERT_TRUE(decoded.has_value());
+  EXPECT_FALSE(decoded->has_value());
+
+  decoded = sub.decodeTyped(msgs[0], NoConfigConfig());
+  ASSERT_TRUE(decoded.has_value() && decoded->has_value());
+  EXPECT_EQ(clouds[0].data, decoded->value()->data);
+
+  // Delta 1 is lost, so delta 2 can not be applied, and neither can delta 3.
+  for (const size_t i : {2, 3})
+  {
+    decoded = sub.decodeTyped(msgs[i], NoConfigConfig());
+    ASSERT_TRUE(decoded.has_value());
+    EXPECT_FALSE(decoded->has_value()) << "cloud " << i;
+  }
+
+  ASSERT_TRUE(msgs[4].keyframe);
+  for (const size_t i : {4, 5})
+  {
+    decoded = sub.decodeTyped(msgs[i], NoConfigConfig());
+    ASSERT_TRUE(decoded.has_value() && decoded->has_value()) << "cloud " << i;
+    EXPECT_EQ(clouds[i].data, decoded->value()->data) << "cloud " << i;
+  }
+}
+
+TEST(DeltaTransport, SendsKeyframeWhenMuchChanges)  // NOLINT
+{
+  DeltaPublisher pub;
+  const auto config = makeConfig(100);
+  // 60 of the 100 points change in each cloud, more than max_changed_ratio.
+  const auto clouds = makeSequence(3, 60);
+  for (const auto& cloud : clouds)
+    EXPECT_TRUE(encode(pub, cloud, config).keyframe);
+}
+
+TEST(DeltaTransport, SendsKeyframeWhenLayoutChanges)  // NOLINT
+{
+  DeltaPublisher pub;
+  DeltaSubscriber sub;
+  const auto config = makeConfig(100);
+  auto clouds = makeSequence(3);
+  // The same points with the rows split differently.
+  clouds[2].height = 20;
+  clouds[2].width = 5;
+  clouds[2].row_step = 5 * clouds[2].point_step;
+
+  for (size_t i = 0; i < clouds.size(); ++i)
+  {
+    const auto msg = encode(pub, clouds[i], config);
+    EXPECT_EQ(i != 1, msg.keyframe) << "cloud " << i;
+    const auto decoded = sub.decodeTyped(msg, NoConfigConfig());
+    ASSERT_TRUE(decoded.has_value() && decoded->has_value()) << "cloud " << i;
+    EXPECT_EQ(clouds[i].height, decoded->value()->height);
+    EXPECT_EQ(clouds[i].data, decoded->value()->data) << "cloud " << i;
+  }
+}
+
+TEST(DeltaTransport, RejectsMismatchedDelta)  // NOLINT
+{
+  DeltaPublisher pub;
+  DeltaSubscriber sub;
+  const auto config = makeConfig(100);
+  const auto clouds = makeSequence(3);
+  const auto keyframe = encode(pub, clouds[0], config);
+  auto delta = encode(pub, clouds[1], config);
+  ASSERT_FALSE(delta.keyframe);
+  ASSERT_TRUE(sub.decodeTyped(keyframe, NoConfigConfig()).has_value());
+
+  // The mask promises more points than the delta carries.
+  delta.data.clear();
+  EXPECT_FALSE(sub.decodeTyped(delta, NoConfigConfig()).has_value());
+
+  // The failed delta broke the chain, so the next one waits for a keyframe.
+  const auto next = encode(pub, clouds[2], config);
+  const auto decoded = sub.decodeTyped(next, NoConfigConfig());
+  ASSERT_TRUE(decoded.has_value());
+  EXPECT_FALSE(decoded->has_value());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
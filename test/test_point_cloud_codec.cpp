@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the C API of the codecs.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_codec.h>
+
+#include "test_utils.h"
+
+using point_cloud_transport::test::makeCloud;
+using point_cloud_transport::test::makeField;
+using point_cloud_transport::test::Point;
+
+namespace
+{
+
+const std::vector<sensor_msgs::PointField> FIELDS = {
+  makeField("x", 0, sensor_msgs::PointField::FLOAT32),
+  makeField("y", 4, sensor_msgs::PointField::FLOAT32),
+  makeField("z", 8, sensor_msgs::PointField::FLOAT32),
+  makeField("intensity", 12, sensor_msgs::PointField::FLOAT32),
+};
+
+//! \brief Kinds of the outputs of the C API functions, each collected by its own allocator.
+enum Output {TYPE, MD5SUM, DATA, ERROR, LOG, FIELD, NUM_OUTPUTS};
+
+//! \brief The buffers handed out by allocate<O>() (a deque does not move them when it grows).
+std::deque<std::vector<uint8_t>> outputs[NUM_OUTPUTS];
+
+template<Output O>
+void* allocate(size_t size)
+{
+  outputs[O].emplace_back(size);
+  return outputs[O].back().data();
+}
+
+void clearOutputs()
+{
+  for (auto& output : outputs)
+    output.clear();
+}
+
+std::string toString(const std::vector<uint8_t>& buffer)
+{
+  return buffer.empty() ? "" : std::string(reinterpret_cast<const char*>(buffer.data()));
+}
+
+//! \brief A sequence of clouds in which each cloud differs from the previous one in a single point.
+std::vector<sensor_msgs::PointCloud2> makeSequence(size_t num_clouds)
+{
+  std::vector<Point> points(200);
+  for (size_t i = 0; i < points.size(); ++i)
+    points[i] = {static_cast<float>(i), 1.0f, 2.0f, 3.0f};
+
+  std::vector<sensor_msgs::PointCloud2> clouds;
+  for (size_t c = 0; c < num_clouds; ++c)
+  {
+    points[c * 7 % points.size()].x += 100.0f;
+    clouds.push_back(makeCloud(points, 10, FIELDS, 16));
+  }
+  return clouds;
+}
+
+//! \brief The fields of a cloud in the form taken by the C API.
+struct RawFields
+{
+  explicit RawFields(const sensor_msgs::PointCloud2& cloud)
+  {
+    for (const auto& field : cloud.fields)
+    {
+      names.push_back(field.name.c_str());
+      offsets.push_back(field.offset);
+      datatypes.push_back(field.datatype);
+      counts.push_back(field.count);
+    }
+  }
+
+  std::vector<const char*> names;
+  std::vector<sensor_msgs::PointField::_offset_type> offsets;
+  std::vector<sensor_msgs::PointField::_datatype_type> datatypes;
+  std::vector<sensor_msgs::PointField::_count_type> counts;
+};
+
+//! \brief Encode the cloud by pointCloudTransportCodecsEncodeInto().
+bool encodeInto(const char* codec, const sensor_msgs::PointCloud2& cloud, std::vector<uint8_t>& compressed,
+                size_t& compressed_length)
+{
+  RawFields fields(cloud);
+  return pointCloudTransportCodecsEncodeInto(codec, cloud.height, cloud.width, fields.names.size(),
+    fields.names.data(), fields.offsets.data(), fields.datatypes.data(), fields.counts.data(), cloud.is_bigendian,
+    cloud.point_step, cloud.row_step, cloud.data.size(), cloud.data.data(), cloud.is_dense, &allocate<TYPE>,
+    &allocate<MD5SUM>, compressed.size(), compressed.data(), compressed_length, 0, nullptr, &allocate<ERROR>,
+    &allocate<LOG>);
+}
+
+//! \brief Decode the message by pointCloudTransportCodecsDecodeInto().
+bool decodeInto(const char* codec, const std::string& type, const std::string& md5sum,
+                const std::vector<uint8_t>& compressed, sensor_msgs::PointCloud2& cloud, size_t& data_length)
+{
+  uint32_t num_fields = 0;
+  return pointCloudTransportCodecsDecodeInto(codec, type.c_str(), md5sum.c_str(), compressed.size(),
+    compressed.data(), cloud.height, cloud.width, num_fields, &allocate<FIELD>, &allocate<FIELD>, &allocate<FIELD>,
+    &allocate<FIELD>, cloud.is_bigendian, cloud.point_step, cloud.row_step, cloud.data.size(), cloud.data.data(),
+    data_length, cloud.is_dense, 0, nullptr, &allocate<ERROR>, &allocate<LOG>);
+}
+
+
+//! \brief Encode the cloud by pointCloudTransportCodecsContextEncodeInto().
+bool encodeInto(point_cloud_transport::CodecContext* context, const sensor_msgs::PointCloud2& cloud,
+                std::vector<uint8_t>& compressed, size_t& compressed_length)
+{
+  RawFields fields(cloud);
+  return pointCloudTransportCodecsContextEncodeInto(context, cloud.height, cloud.width, fields.names.size(),
+    fields.names.data(), fields.offsets.data(), fields.datatypes.data(), fields.counts.data(), cloud.is_bigendian,
+    cloud.point_step, cloud.row_step, cloud.data.size(), cloud.data.data(), cloud.is_dense, &allocate<TYPE>,
+    &allocate<MD5SUM>, compressed.size(), compressed.data(), compressed_length, &allocate<ERROR>, &allocate<LOG>);
+}
+
+//! \brief Decode the message by pointCloudTransportCodecsContextDecodeInto().
+bool decodeInto(point_cloud_transport::CodecContext* context, const std::string& type, const std::string& md5sum,
+                const std::vector<uint8_t>& compressed, sensor_msgs::PointCloud2& cloud, size_t& data_length)
+{
+  uint32_t num_fields = 0;
+  return pointCloudTransportCodecsContextDecodeInto(context, type.c_str(), md5sum.c_str(), compressed.size(),
+    compressed.data(), cloud.height, cloud.width, num_fields, &allocate<FIELD>, &allocate<FIELD>, &allocate<FIELD>,
+    &allocate<FIELD>, cloud.is_bigendian, cloud.point_step, cloud.row_step, cloud.data.size(), cloud.data.data(),
+    data_length, cloud.is_dense, &allocate<ERROR>, &allocate<LOG>);
+}
+
+}
+
+TEST(PointCloudCodec, DeltaBatchRoundTrip)  // NOLINT
+{
+  const auto clouds = makeSequence(8);
+  const size_t n = clouds.size();
+
+  std::vector<sensor_msgs::PointCloud2::_height_type> height;
+  std::vector<sensor_msgs::PointCloud2::_width_type> width;
+  std::vector<size_t> num_fields;
+  std::vector<const char*> field_names;
+  std::vector<sensor_msgs::PointField::_offset_type> field_offsets;
+  std::vector<sensor_msgs::PointField::_datatype_type> field_datatypes;
+  std::vector<sensor_msgs::PointField::_count_type> field_counts;
+  std::vector<sensor_msgs::PointCloud2::_is_bigendian_type> is_bigendian;
+  std::vector<sensor_msgs::PointCloud2::_point_step_type> point_step;
+  std::vector<sensor_msgs::PointCloud2::_row_step_type> row_step;
+  std::vector<size_t> data_length;
+  std::vector<const uint8_t*> data;
+  std::vector<sensor_msgs::PointCloud2::_is_dense_type> is_dense;
+  for (const auto& cloud : clouds)
+  {
+    height.push_back(cloud.height);
+    width.push_back(cloud.width);
+    num_fields.push_back(cloud.fields.size());
+    for (const auto& field : cloud.fields)
+    {
+      field_names.push_back(field.name.c_str());
+      field_offsets.push_back(field.offset);
+      field_datatypes.push_back(field.datatype);
+      field_counts.push_back(field.count);
+    }
+    is_bigendian.push_back(cloud.is_bigendian);
+    point_step.push_back(cloud.point_step);
+    row_step.push_back(cloud.row_step);
+    data_length.push_back(cloud.data.size());
+    data.push_back(cloud.data.data());
+    is_dense.push_back(cloud.is_dense);
+  }
+
+  // With more threads than clouds, a stateless batch would be split into single clouds. The default keyframe interval
+  // is longer than the batch.
+  clearOutputs();
+  std::unique_ptr<bool[]> success(new bool[n]);
+  ASSERT_TRUE(pointCloudTransportCodecsEncodeBatch("delta", n, height.data(), width.data(), num_fields.data(),
+    field_names.data(), field_offsets.data(), field_datatypes.data(), field_counts.data(), is_bigendian.data(),
+    point_step.data(), row_step.data(), data_length.data(), data.data(), is_dense.data(), &allocate<TYPE>,
+    &allocate<MD5SUM>, &allocate<DATA>, success.get(), 0, nullptr, 16, &allocate<ERROR>, &allocate<LOG>))
+    << toString(outputs[ERROR].back());
+
+  ASSERT_EQ(n, outputs[DATA].size());
+  const auto types = outputs[TYPE];
+  const auto md5sums = outputs[MD5SUM];
+  const auto compressed = outputs[DATA];
+  for (size_t i = 0; i < n; ++i)
+    ASSERT_TRUE(success[i]) << "cloud " << i << ": " << toString(outputs[ERROR][i]);
+  EXPECT_EQ("point_cloud_transport/PointCloudDelta", toString(types[0]));
+  // The first cloud is a keyframe and the following ones are deltas with a single changed point.
+  for (size_t i = 1; i < n; ++i)
+    EXPECT_LT(compressed[i].size(), compressed[0].size() / 4) << "cloud " << i;
+
+  std::vector<const char*> compressed_type;
+  std::vector<const char*> compressed_md5sum;
+  std::vector<size_t> compressed_length;
+  std::vector<const uint8_t*> compressed_data;
+  for (size_t i = 0; i < n; ++i)
+  {
+    compressed_type.push_back(reinterpret_cast<const char*>(types[i].data()));
+    compressed_md5sum.push_back(reinterpret_cast<const char*>(md5sums[i].data()));
+    compressed_length.push_back(compressed[i].size());
+    compressed_data.push_back(compressed[i].data());
+  }
+
+  clearOutputs();
+  std::vector<sensor_msgs::PointCloud2::_height_type> out_height(n);
+  std::vector<sensor_msgs::PointCloud2::_width_type> out_width(n);
+  std::vector<uint32_t> out_num_fields(n);
+  std::vector<sensor_msgs::PointCloud2::_is_bigendian_type> out_is_bigendian(n);
+  std::vector<sensor_msgs::PointCloud2::_point_step_type> out_point_step(n);
+  std::vector<sensor_msgs::PointCloud2::_row_step_type> out_row_step(n);
+  std::vector<sensor_msgs::PointCloud2::_is_dense_type> out_is_dense(n);
+  ASSERT_TRUE(pointCloudTransportCodecsDecodeBatch("delta", n, compressed_type.data(), compressed_md5sum.data(),
+    compressed_length.data(), compressed_data.data(), out_height.data(), out_width.data(), out_num_fields.data(),
+    &allocate<FIELD>, &allocate<FIELD>, &allocate<FIELD>, &allocate<FIELD>, out_is_bigendian.data(),
+    out_point_step.data(), out_row_step.data(), &allocate<DATA>, out_is_dense.data(), success.get(), 0, nullptr, 16,
+    &allocate<ERROR>, &allocate<LOG>))
+    << toString(outputs[ERROR].back());
+
+  ASSERT_EQ(n, outputs[DATA].size());
+  for (size_t i = 0; i < n; ++i)
+  {
+    ASSERT_TRUE(success[i]) << "cloud " << i << ": " << toString(outputs[ERROR][i]);
+    EXPECT_EQ(clouds[i].height, out_height[i]);
+    EXPECT_EQ(clouds[i].width, out_width[i]);
+    EXPECT_EQ(FIELDS.size(), out_num_fields[i]);
+    EXPECT_EQ(clouds[i].point_step, out_point_step[i]);
+    EXPECT_EQ(clouds[i].data, outputs[DATA][i]) << "cloud " << i;
+  }
+}
+
+TEST(PointCloudCodec, IntoRetainsMessagesNotFittingTheBuffer)  // NOLINT
+{
+  const auto cloud = makeSequence(1)[0];
+
+  // A buffer large enough for the message is filled directly.
+  clearOutputs();
+  std::vector<uint8_t> expected(2 * cloud.data.size());
+  size_t expected_length = 0;
+  ASSERT_TRUE(encodeInto("raw", cloud, expected, expected_length)) << toString(outputs[ERROR].back());
+  ASSERT_GT(expected_length, cloud.data.size());
+  expected.resize(expected_length);
+  uint8_t byte = 0;
+  EXPECT_FALSE(pointCloudTransportCodecsGetLastEncodedData(1, &byte));
+
+  // A small buffer is left untouched and the message waits until the caller grows the buffer.
+  clearOutputs();
+  std::vector<uint8_t> compressed(10);
+  size_t compressed_length = 0;
+  ASSERT_TRUE(encodeInto("raw", cloud, compressed, compressed_length)) << toString(outputs[ERROR].back());
+  EXPECT_EQ(expected_length, compressed_length);
+  EXPECT_EQ(std::vector<uint8_t>(10), compressed);
+  const auto type = toString(outputs[TYPE].back());
+  const auto md5sum = toString(outputs[MD5SUM].back());
+  compressed.resize(compressed_length);
+  EXPECT_FALSE(pointCloudTransportCodecsGetLastEncodedData(compressed_length - 1, compressed.data()));
+  ASSERT_TRUE(pointCloudTransportCodecsGetLastEncodedData(compressed.size(), compressed.data()));
+  EXPECT_EQ(expected, compressed);
+  // The message is handed out only once.
+  EXPECT_FALSE(pointCloudTransportCodecsGetLastEncodedData(compressed.size(), compressed.data()));
+
+  clearOutputs();
+  sensor_msgs::PointCloud2 decoded;
+  decoded.data.resize(10);
+  size_t data_length = 0;
+  ASSERT_TRUE(decodeInto("raw", type, md5sum, compressed, decoded, data_length)) << toString(outputs[ERROR].back());
+  EXPECT_EQ(cloud.data.size(), data_length);
+  EXPECT_EQ(cloud.height, decoded.height);
+  EXPECT_EQ(cloud.width, decoded.width);
+  EXPECT_EQ(cloud.point_step, decoded.point_step);
+  EXPECT_EQ(std::vector<uint8_t>(10), decoded.data);
+  decoded.data.resize(data_length);
+  EXPECT_FALSE(pointCloudTransportCodecsGetLastDecodedData(data_length - 1, decoded.data.data()));
+  ASSERT_TRUE(pointCloudTransportCodecsGetLastDecodedData(decoded.data.size(), decoded.data.data()));
+  EXPECT_EQ(cloud.data, decoded.data);
+  EXPECT_FALSE(pointCloudTransportCodecsGetLastDecodedData(decoded.data.size(), decoded.data.data()));
+
+  // A failed call drops the retained message.
+  clearOutputs();
+  decoded.data.resize(10);
+  ASSERT_TRUE(decodeInto("raw", type, md5sum, compressed, decoded, data_length));
+  EXPECT_FALSE(decodeInto("raw", "point_cloud_transport/Unknown", md5sum, compressed, decoded, data_length));
+  EXPECT_EQ(0u, data_length);
+  decoded.data.resize(cloud.data.size());
+  EXPECT_FALSE(pointCloudTransportCodecsGetLastDecodedData(decoded.data.size(), decoded.data.data()));
+}
+
+TEST(PointCloudCodec, ContextsRetainTheirOwnMessages)  // NOLINT
+{
+  EXPECT_EQ(nullptr, pointCloudTransportCodecsCreateContext("nonexistent"));
+  std::unique_ptr<point_cloud_transport::CodecContext, void(*)(point_cloud_transport::CodecContext*)> contexts[] = {
+    {pointCloudTransportCodecsCreateContext("raw"), &pointCloudTransportCodecsDestroyContext},
+    {pointCloudTransportCodecsCreateContext("raw"), &pointCloudTransportCodecsDestroyContext},
+  };
+  ASSERT_NE(nullptr, contexts[0]);
+  ASSERT_NE(nullptr, contexts[1]);
+  const auto clouds = makeSequence(2);
+
+  // Neither message fits, so each context keeps its own one and the global functions have none.
+  clearOutputs();
+  std::vector<uint8_t> compressed[2];
+  for (size_t i = 0; i < 2; ++i)
+  {
+    compressed[i].resize(10);
+    size_t length = 0;
+    ASSERT_TRUE(encodeInto(contexts[i].get(), clouds[i], compressed[i], length)) << toString(outputs[ERROR].back());
+    ASSERT_GT(length, compressed[i].size());
+    EXPECT_EQ(std::vector<uint8_t>(10), compressed[i]);
+    compressed[i].resize(length);
+  }
+  const auto type = toString(outputs[TYPE].back());
+  const auto md5sum = toString(outputs[MD5SUM].back());
+  EXPECT_FALSE(pointCloudTransportCodecsGetLastEncodedData(compressed[0].size(), compressed[0].data()));
+  for (const size_t i : {1, 0})
+  {
+    EXPECT_FALSE(pointCloudTransportCodecsContextGetLastEncodedData(
+      contexts[i].get(), compressed[i].size() - 1, compressed[i].data()));
+    ASSERT_TRUE(pointCloudTransportCodecsContextGetLastEncodedData(
+      contexts[i].get(), compressed[i].size(), compressed[i].data()));
+    EXPECT_FALSE(pointCloudTransportCodecsContextGetLastEncodedData(
+      contexts[i].get(), compressed[i].size(), compressed[i].data()));
+  }
+
+  clearOutputs();
+  sensor_msgs::PointCloud2 decoded[2];
+  for (size_t i = 0; i < 2; ++i)
+  {
+    decoded[i].data.resize(10);
+    size_t data_length = 0;
+    ASSERT_TRUE(decodeInto(contexts[i].get(), type, md5sum, compressed[i], decoded[i], data_length))
+      << toString(outputs[ERROR].back());
+    EXPECT_EQ(clouds[i].data.size(), data_length);
+    EXPECT_EQ(clouds[i].width, decoded[i].width);
+    EXPECT_EQ(std::vector<uint8_t>(10), decoded[i].data);
+    decoded[i].data.resize(data_length);
+  }
+  EXPECT_FALSE(pointCloudTransportCodecsGetLastDecodedData(decoded[0].data.size(), decoded[0].data.data()));
+  for (const size_t i : {1, 0})
+  {
+    EXPECT_FALSE(pointCloudTransportCodecsContextGetLastDecodedData(
+      contexts[i].get(), decoded[i].data.size() - 1, decoded[i].data.data()));
+    ASSERT_TRUE(pointCloudTransportCodecsContextGetLastDecodedData(
+      contexts[i].get(), decoded[i].data.size(), decoded[i].data.data()));
+    EXPECT_EQ(clouds[i].data, decoded[i].data) << "cloud " << i;
+    EXPECT_FALSE(pointCloudTransportCodecsContextGetLastDecodedData(
+      contexts[i].get(), decoded[i].data.size(), decoded[i].data.data()));
+  }
+}
+
+TEST(PointCloudCodec, CachesPluginInstances)  // NOLINT
+{
+  point_cloud_transport::PointCloudCodec codec;
+  const auto encoder = codec.getEncoderByName("raw");
+  ASSERT_NE(nullptr, encoder);
+  EXPECT_EQ(encoder, codec.getEncoderByName("point_cloud_transport/raw"));
+  EXPECT_EQ(encoder, codec.getEncoderByTopic("/points", "sensor_msgs/PointCloud2"));
+
+  const auto decoder = codec.getDecoderByName("delta");
+  ASSERT_NE(nullptr, decoder);
+  // The second lookup by the same topic is answered by the cache of topics.
+  for (size_t i = 0; i < 2; ++i)
+  {
+    EXPECT_EQ(decoder, codec.getDecoderByTopic("/points/delta", "point_cloud_transport/PointCloudDelta"));
+    EXPECT_EQ(nullptr, codec.getDecoderByTopic("/points/delta", "std_msgs/String"));
+    EXPECT_EQ(nullptr, codec.getDecoderByName("nonexistent"));
+  }
+
+  // Each codec has its own instances, as stateful plugins must not share their state.
+  point_cloud_transport::PointCloudCodec other;
+  EXPECT_NE(decoder, other.getDecoderByName("delta"));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the cropping and voxel downsampling of clouds.
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_filter.h>
+#include <point_cloud_transport/point_cloud_pool.h>
+
+#include "test_utils.h"
+
+using point_cloud_transport::CloudFilterOptions;
+using point_cloud_transport::CropBox;
+using point_cloud_transport::test::getPoint;
+using point_cloud_transport::test::makeField;
+using point_cloud_transport::test::Point;
+
+namespace
+{
+
+//! \brief Float x, y, z and uint32 id.
+const std::vector<sensor_msgs::PointField> FIELDS = {
+  makeField("x", 0, sensor_msgs::PointField::FLOAT32),
+  makeField("y", 4, sensor_msgs::PointField::FLOAT32),
+  makeField("z", 8, sensor_msgs::PointField::FLOAT32),
+  makeField("id", 12, sensor_msgs::PointField::UINT32),
+};
+
+Point makePoint(float x, float y, float z, uint32_t id)
+{
+  Point p;
+  p.x = x;
+  p.y = y;
+  p.z = z;
+  p.id = id;
+  return p;
+}
+
+sensor_msgs::PointCloud2 makeCloud(const std::vector<Point>& points, uint32_t height = 1, uint32_t row_padding = 0)
+{
+  return point_cloud_transport::test::makeCloud(points, height, FIELDS, 16, row_padding, 0xEE);
+}
+
+//! \brief Ids of the points of the filtered cloud, checking its layout on the way.
+std::vector<uint32_t> filter(const sensor_msgs::PointCloud2& cloud, const CloudFilterOptions& options,
+                             point_cloud_transport::PointCloudPool* pool = nullptr)
+{
+  const auto filtered = point_cloud_transport::filterCloud(cloud, options, pool);
+  EXPECT_TRUE(filtered.has_value()) << filtered.error();
+  if (!filtered.has_value())
+    return {};
+
+  const auto& out = **filtered;
+  EXPECT_EQ(cloud.header.frame_id, out.header.frame_id);
+  EXPECT_EQ(cloud.fields.size(), out.fields.size());
+  EXPECT_EQ(1u, out.height);
+  EXPECT_EQ(cloud.point_step, out.point_step);
+  EXPECT_EQ(out.width * out.point_step, out.row_step);
+  EXPECT_TRUE(out.is_dense);
+  EXPECT_EQ(static_cast<size_t>(out.row_step), out.data.size());
+
+  std::vector<uint32_t> ids;
+  for (size_t i = 0; i < out.width; ++i)
+    ids.push_back(getPoint(out, i).id);
+  return ids;
+}
+
+CropBox makeBox(double min_x, double min_y, double min_z, double max_x, double max_y, double max_z)
+{
+  CropBox box;
+  box.min_x = min_x;
+  box.min_y = min_y;
+  box.min_z = min_z;
+  box.max_x = max_x;
+  box.max_y = max_y;
+  box.max_z = max_z;
+  return box;
+}
+
+}
+
+TEST(PointCloudFilter, NoFilterDropsNonFinitePoints)  // NOLINT
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float inf = std::numeric_limits<float>::infinity();
+  const auto cloud = makeCloud({makePoint(1, 2, 3, 0), makePoint(nan, 0, 0, 1), makePoint(0, inf, 0, 2),
+                                makePoint(0, 0, -inf, 3), makePoint(-1, -2, -3, 4), makePoint(0, 0, 0, 5)}, 2, 8);
+  CloudFilterOptions options;
+  EXPECT_FALSE(options.isEnabled());
+  EXPECT_EQ(std::vector<uint32_t>({0, 4, 5}), filter(cloud, options));
+}
+
+TEST(PointCloudFilter, CropBox)  // NOLINT
+{
+  const auto cloud = makeCloud({makePoint(0, 0, 0, 0), makePoint(1, 1, 1, 1), makePoint(1.001f, 0, 0, 2),
+                                makePoint(-1, -1, -1, 3), makePoint(0.5f, -0.5f, 2, 4),
+                                makePoint(0.5f, 0.5f, 0.5f, 5)});
+  CloudFilterOptions options;
+  options.crop_box = makeBox(-1, -1, -1, 1, 1, 1);
+  EXPECT_TRUE(options.isEnabled());
+  // Points on the boundary are inside.
+  EXPECT_EQ(std::vector<uint32_t>({0, 1, 3, 5}), filter(cloud, options));
+
+  options.crop_box = makeBox(0.25, -1, 0.25, 10, 10, 10);
+  EXPECT_EQ(std::vector<uint32_t>({1, 4, 5}), filter(cloud, options));
+}
+
+TEST(PointCloudFilter, VoxelKeepsFirstPointOfEachVoxel)  // NOLINT
+{
+  const auto cloud = makeCloud({makePoint(0.1f, 0.1f, 0.1f, 0), makePoint(0.9f, 0.9f, 0.9f, 1),
+                                makePoint(1.1f, 0.1f, 0.1f, 2), makePoint(-0.1f, 0.1f, 0.1f, 3),
+                                makePoint(1.9f, 0.5f, 0.5f, 4), makePoint(-0.9f, 0.9f, 0.9f, 5),
+                                makePoint(0.5f, 0.5f, -0.5f, 6)});
+  CloudFilterOptions options;
+  options.voxel_size = 1.0;
+  EXPECT_TRUE(options.isEnabled());
+  // Negative coordinates fall into their own voxels (the indices are floored, not truncated).
+  EXPECT_EQ(std::vector<uint32_t>({0, 2, 3, 6}), filter(cloud, options));
+
+  options.voxel_size = 0.5;
+  EXPECT_EQ(std::vector<uint32_t>({0, 1, 2, 3, 4, 5, 6}), filter(cloud, options));
+}
+
+TEST(PointCloudFilter, VoxelOfFarPoints)  // NOLINT
+{
+  // The voxel indices of these points do not fit into 64 bits, so they are clamped to the outermost voxels.
+  const float far = 3e38f;
+  const auto cloud = makeCloud({makePoint(far, 0, 0, 0), makePoint(-far, 0, 0, 1), makePoint(0, 0, 0, 2),
+                                makePoint(far, 0, 0, 3)});
+  CloudFilterOptions options;
+  options.voxel_size = 1e-3;
+  EXPECT_EQ(std::vector<uint32_t>({0, 1, 2}), filter(cloud, options));
+}
+
+TEST(PointCloudFilter, CropAndVoxel)  // NOLINT
+{
+  std::vector<Point> points;
+  for (uint32_t i = 0; i < 1000; ++i)
+    points.push_back(makePoint(static_cast<float>(i % 10) * 0.3f, static_cast<float>(i / 10 % 10) * 0.3f,
+                               static_cast<float>(i / 100) * 0.3f, i));
+  const auto cloud = makeCloud(points, 10);
+
+  CloudFilterOptions options;
+  options.crop_box = makeBox(0, 0, 0, 1.0, 1.0, 1.0);
+  options.voxel_size = 0.6;
+  // Coordinates 0, 0.3, 0.6 and 0.9 are in the box, 0 and 0.3 fall into voxel 0, 0.6 and 0.9 into voxel 1.
+  const auto ids = filter(cloud, options);
+  EXPECT_EQ(8u, ids.size());
+  EXPECT_EQ(0u, ids[0]);
+
+  // The thread-local voxel set is cleared between the clouds.
+  EXPECT_EQ(ids, filter(cloud, options));
+
+  const auto pool = std::make_shared<point_cloud_transport::PointCloudPool>(1);
+  EXPECT_EQ(ids, filter(cloud, options, pool.get()));
+  EXPECT_EQ(ids, filter(cloud, options, pool.get()));
+}
+
+TEST(PointCloudFilter, EmptyCloud)  // NOLINT
+{
+  CloudFilterOptions options;
+  options.voxel_size = 0.1;
+  EXPECT_TRUE(filter(makeCloud({}), options).empty());
+}
+
+TEST(PointCloudFilter, Errors)  // NOLINT
+{
+  auto cloud = makeCloud({makePoint(1, 2, 3, 0), makePoint(4, 5, 6, 1)});
+  CloudFilterOptions options;
+  options.voxel_size = 0.1;
+
+  auto broken = cloud;
+  broken.data.resize(broken.data.size() - 1);
+  EXPECT_FALSE(point_cloud_transport::filterCloud(broken, options).has_value());
+
+  broken = cloud;
+  broken.fields[2].datatype = sensor_msgs::PointField::FLOAT64;
+  EXPECT_FALSE(point_cloud_transport::filterCloud(broken, options).has_value());
+
+  broken = cloud;
+  broken.fields.erase(broken.fields.begin());
+  EXPECT_FALSE(point_cloud_transport::filterCloud(broken, options).has_value());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
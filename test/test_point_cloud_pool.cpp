@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the pool of recycled output clouds.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <point_cloud_transport/point_cloud_pool.h>
+
+#include "test_utils.h"
+
+using point_cloud_transport::PointCloudPool;
+
+TEST(PointCloudPool, RecyclesReleasedClouds)  // NOLINT
+{
+  PointCloudPool pool(2);
+  auto cloud = pool.acquire(1000);
+  EXPECT_EQ(1000u, cloud->data.size());
+  const auto buffer = cloud->data.data();
+  EXPECT_EQ(0u, pool.getNumFree());
+
+  cloud.reset();
+  EXPECT_EQ(1u, pool.getNumFree());
+
+  // A smaller cloud reuses the buffer.
+  cloud = pool.acquire(500);
+  EXPECT_EQ(buffer, cloud->data.data());
+  EXPECT_EQ(500u, cloud->data.size());
+  EXPECT_EQ(1u, pool.getNumReused());
+  EXPECT_EQ(1u, pool.getNumAllocated());
+}
+
+TEST(PointCloudPool, ResetsAllButTheData)  // NOLINT
+{
+  PointCloudPool pool;
+  auto cloud = pool.acquire(2, 3, 4);
+  EXPECT_EQ(2u, cloud->height);
+  EXPECT_EQ(3u, cloud->width);
+  EXPECT_EQ(4u, cloud->point_step);
+  EXPECT_EQ(12u, cloud->row_step);
+  EXPECT_EQ(24u, cloud->data.size());
+  cloud->header.frame_id = "lidar";
+  cloud->fields.push_back(point_cloud_transport::test::makeField("x", 0, sensor_msgs::PointField::FLOAT32));
+  cloud->is_dense = true;
+  cloud.reset();
+
+  cloud = pool.acquire(8);
+  EXPECT_EQ(1u, pool.getNumReused());
+  EXPECT_TRUE(cloud->header.frame_id.empty());
+  EXPECT_TRUE(cloud->fields.empty());
+  EXPECT_EQ(0u, cloud->height);
+  EXPECT_EQ(0u, cloud->width);
+  EXPECT_EQ(0u, cloud->point_step);
+  EXPECT_FALSE(cloud->is_dense);
+  EXPECT_EQ(8u, cloud->data.size());
+}
+
+TEST(PointCloudPool, PicksTheSmallestSufficientBuffer)  // NOLINT
+{
+  PointCloudPool pool(3);
+  auto small = pool.acquire(100);
+  auto medium = pool.acquire(1000);
+  auto large = pool.acquire(10000);
+  const auto small_buffer = small->data.data();
+  const auto medium_buffer = medium->data.data();
+  small.reset();
+  medium.reset();
+  large.reset();
+
+  auto cloud = pool.acquire(500);
+  EXPECT_EQ(medium_buffer, cloud->data.data());
+  cloud.reset();
+
+  cloud = pool.acquire(50);
+  EXPECT_EQ(small_buffer, cloud->data.data());
+  cloud.reset();
+
+  // No buffer fits, so the largest one is grown.
+  cloud = pool.acquire(20000);
+  EXPECT_EQ(20000u, cloud->data.size());
+  EXPECT_EQ(2u, pool.getNumFree());
+  cloud.reset();
+  // Only the grown buffer fits.
+  cloud = pool.acquire(5000);
+  EXPECT_NE(small_buffer, cloud->data.data());
+  EXPECT_NE(medium_buffer, cloud->data.data());
+}
+
+TEST(PointCloudPool, KeepsAtMostMaxSizeClouds)  // NOLINT
+{
+  PointCloudPool pool(2);
+  std::vector<sensor_msgs::PointCloud2Ptr> clouds;
+  for (size_t i = 0; i < 5; ++i)
+    clouds.push_back(pool.acquire(10));
+  clouds.clear();
+  EXPECT_EQ(2u, pool.getNumFree());
+  EXPECT_EQ(5u, pool.getNumAllocated());
+}
+
+TEST(PointCloudPool, CloudsOutliveThePool)  // NOLINT
+{
+  sensor_msgs::PointCloud2Ptr cloud;
+  {
+    PointCloudPool pool;
+    cloud = pool.acquire(100);
+  }
+  cloud->data[99] = 1;
+  // Releasing the cloud after the pool is gone just frees it (checked by sanitizers).
+  cloud.reset();
+}
+
+TEST(PointCloudPool, ThreadSafe)  // NOLINT
+{
+  PointCloudPool pool(4);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t)
+  {
+    threads.emplace_back([&pool, t]
+    {
+      for (size_t i = 0; i < 1000; ++i)
+      {
+        const auto cloud = pool.acquire((t + 1) * (i % 10 + 1));
+        cloud->data.back() = static_cast<uint8_t>(i);
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(4000u, pool.getNumReused() + pool.getNumAllocated());
+  EXPECT_LE(pool.getNumFree(), 4u);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
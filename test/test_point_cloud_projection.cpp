@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the projection of clouds to a subset of their fields.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_pool.h>
+#include <point_cloud_transport/point_cloud_projection.h>
+
+#include "test_utils.h"
+
+using point_cloud_transport::test::getPointData;
+using point_cloud_transport::test::makeCloud;
+using point_cloud_transport::test::makeField;
+
+namespace
+{
+
+//! \brief Float x, y, z, 4 bytes of padding, float intensity, uint16 ring and double time.
+const std::vector<sensor_msgs::PointField> FIELDS = {
+  makeField("x", 0, sensor_msgs::PointField::FLOAT32),
+  makeField("y", 4, sensor_msgs::PointField::FLOAT32),
+  makeField("z", 8, sensor_msgs::PointField::FLOAT32),
+  makeField("intensity", 16, sensor_msgs::PointField::FLOAT32),
+  makeField("ring", 20, sensor_msgs::PointField::UINT16),
+  makeField("time", 24, sensor_msgs::PointField::FLOAT64),
+};
+
+/**
+ * \brief Cloud with 32-byte points of FIELDS, and optionally padded rows. The byte at offset k of point i is
+ *        (i * 32 + k) % 251.
+ */
+sensor_msgs::PointCloud2 makePatternCloud(uint32_t height, uint32_t width, uint32_t row_padding = 0)
+{
+  auto cloud = makeCloud(height, width, FIELDS, 32, row_padding, 0xEE);
+  cloud.is_dense = true;
+  for (size_t i = 0; i < static_cast<size_t>(height) * width; ++i)
+  {
+    const auto data = getPointData(cloud, i);
+    for (size_t k = 0; k < cloud.point_step; ++k)
+      data[k] = static_cast<uint8_t>((i * 32 + k) % 251);
+  }
+  return cloud;
+}
+
+size_t getFieldSize(const sensor_msgs::PointField& field)
+{
+  return point_cloud_transport::test::getDatatypeSize(field.datatype) * field.count;
+}
+
+//! \brief The bytes of the given field of point i of the cloud.
+std::vector<uint8_t> getBytes(const sensor_msgs::PointCloud2& cloud, size_t i, const std::string& name)
+{
+  for (const auto& field : cloud.fields)
+  {
+    if (field.name != name)
+      continue;
+    const auto data = getPointData(cloud, i) + field.offset;
+    return {data, data + getFieldSize(field)};
+  }
+  ADD_FAILURE() << "No field " << name;
+  return {};
+}
+
+void checkProjection(const sensor_msgs::PointCloud2& cloud, const std::vector<std::string>& fields,
+                     uint32_t point_step, point_cloud_transport::PointCloudPool* pool = nullptr)
+{
+  const auto projected = point_cloud_transport::projectFields(cloud, fields, pool);
+  ASSERT_TRUE(projected.has_value()) << projected.error();
+  const auto& out = **projected;
+  EXPECT_EQ(cloud.header.frame_id, out.header.frame_id);
+  EXPECT_EQ(cloud.height, out.height);
+  EXPECT_EQ(cloud.width, out.width);
+  EXPECT_EQ(point_step, out.point_step);
+  EXPECT_EQ(cloud.width * point_step, out.row_step);
+  EXPECT_EQ(cloud.is_dense, out.is_dense);
+  ASSERT_EQ(static_cast<size_t>(out.height) * out.row_step, out.data.size());
+
+  ASSERT_EQ(fields.size(), out.fields.size());
+  uint32_t offset = 0;
+  for (size_t f = 0; f < fields.size(); ++f)
+  {
+    EXPECT_EQ(fields[f], out.fields[f].name);
+    EXPECT_EQ(offset, out.fields[f].offset);
+    offset += static_cast<uint32_t>(getFieldSize(out.fields[f]));
+  }
+  EXPECT_EQ(point_step, offset);
+
+  for (size_t i = 0; i < static_cast<size_t>(cloud.height) * cloud.width; ++i)
+  {
+    for (const auto& name : fields)
+      EXPECT_EQ(getBytes(cloud, i, name), getBytes(out, i, name)) << "point " << i << " field " << name;
+  }
+}
+
+}
+
+TEST(PointCloudProjection, AdjacentFields)  // NOLINT
+{
+  checkProjection(makePatternCloud(3, 7), {"x", "y", "z"}, 12);
+}
+
+TEST(PointCloudProjection, ScatteredAndReorderedFields)  // NOLINT
+{
+  checkProjection(makePatternCloud(3, 7), {"ring", "x", "time", "intensity"}, 18);
+  checkProjection(makePatternCloud(1, 1), {"z", "y"}, 8);
+}
+
+TEST(PointCloudProjection, PaddedRows)  // NOLINT
+{
+  checkProjection(makePatternCloud(4, 5, 13), {"x", "y", "z", "intensity"}, 16);
+  checkProjection(makePatternCloud(4, 5, 13), {"x", "y", "z", "intensity", "ring", "time"}, 26);
+}
+
+TEST(PointCloudProjection, AllFieldsInOrder)  // NOLINT
+{
+  // The padding between the fields is dropped, too.
+  checkProjection(makePatternCloud(2, 9), {"x", "y", "z", "intensity", "ring", "time"}, 26);
+}
+
+TEST(PointCloudProjection, EmptyCloud)  // NOLINT
+{
+  checkProjection(makePatternCloud(0, 0), {"x", "y", "z"}, 12);
+  checkProjection(makePatternCloud(5, 0), {"intensity"}, 4);
+}
+
+TEST(PointCloudProjection, Pool)  // NOLINT
+{
+  const auto pool = std::make_shared<point_cloud_transport::PointCloudPool>(1);
+  checkProjection(makePatternCloud(3, 7), {"x", "z"}, 8, pool.get());
+  checkProjection(makePatternCloud(2, 3), {"ring"}, 2, pool.get());
+}
+
+TEST(PointCloudProjection, Errors)  // NOLINT
+{
+  auto cloud = makePatternCloud(2, 3);
+  EXPECT_FALSE(point_cloud_transport::projectFields(cloud, {"x", "rgb"}).has_value());
+
+  cloud.data.resize(cloud.data.size() - 1);
+  EXPECT_FALSE(point_cloud_transport::projectFields(cloud, {"x"}).has_value());
+
+  cloud = makePatternCloud(2, 3);
+  cloud.fields.push_back(makeField("beyond", 30, sensor_msgs::PointField::FLOAT32));
+  EXPECT_FALSE(point_cloud_transport::projectFields(cloud, {"beyond"}).has_value());
+  cloud.fields.push_back(makeField("unknown", 0, 42));
+  EXPECT_FALSE(point_cloud_transport::projectFields(cloud, {"unknown"}).has_value());
+}
+
+TEST(PointCloudProjection, GetProjectionName)  // NOLINT
+{
+  EXPECT_EQ("fields_x_y_z", point_cloud_transport::getProjectionName({"x", "y", "z"}));
+  EXPECT_EQ("fields_normal_x_a_b", point_cloud_transport::getProjectionName({"normal_x", "a-b"}));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests comparing the vectorized repacking kernels with plain loops.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_repack.h>
+
+#include "test_utils.h"
+
+using point_cloud_transport::SimdLevel;
+using point_cloud_transport::test::makeCloud;
+using point_cloud_transport::test::makeField;
+
+namespace
+{
+
+//! \brief Odd lengths around the vector widths, so that both the vector loops and their tails are exercised.
+const size_t LENGTHS[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 1001};
+
+/**
+ * \brief Runs the test with each instruction set supported by this CPU (the scalar one included) and restores the
+ *        original one afterwards.
+ */
+class Repack : public testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    original_ = point_cloud_transport::getSimdLevel();
+    for (const auto level : {SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::NEON})
+    {
+      if (point_cloud_transport::setSimdLevel(level) == level)
+        levels_.push_back(level);
+    }
+    point_cloud_transport::setSimdLevel(original_);
+  }
+
+  void TearDown() override
+  {
+    point_cloud_transport::setSimdLevel(original_);
+  }
+
+  SimdLevel original_ {SimdLevel::SCALAR};
+  std::vector<SimdLevel> levels_;
+};
+
+std::vector<uint8_t> randomBytes(size_t size, uint32_t seed)
+{
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<uint8_t> bytes(size);
+  for (auto& b : bytes)
+    b = static_cast<uint8_t>(byte(gen));
+  return bytes;
+}
+
+void setFloats(uint8_t* data, float x, float y, float z)
+{
+  const float xyz[3] = {x, y, z};
+  memcpy(data, xyz, sizeof(xyz));
+}
+
+}
+
+TEST_F(Repack, GatherField)  // NOLINT
+{
+  for (const auto level : levels_)
+  {
+    point_cloud_transport::setSimdLevel(level);
+    for (const size_t point_step : {4, 12, 16, 22, 36})
+    {
+      for (const size_t value_size : {1, 2, 4, 8, 12})
+      {
+        if (value_size > point_step)
+          continue;
+        const size_t offset = point_step - value_size;
+        for (const auto num_points : LENGTHS)
+        {
+          SCOPED_TRACE(toString(level) + " step " + std::to_string(point_step) + " size " +
+                       std::to_string(value_size) + " points " + std::to_string(num_points));
+          // The buffer ends right after the last value, so reads past it are caught by sanitizers.
+          const auto points = randomBytes(num_points * point_step, 1);
+          std::vector<uint8_t> expected(num_points * value_size);
+          for (size_t i = 0; i < num_points; ++i)
+            memcpy(expected.data() + i * value_size, points.data() + i * point_step + offset, value_size);
+
+          std::vector<uint8_t> values(num_points * value_size);
+          point_cloud_transport::gatherField(points.data() + offset, num_points, point_step, value_size,
+                                             values.data());
+          EXPECT_EQ(expected, values);
+        }
+      }
+    }
+  }
+}
+
+TEST_F(Repack, ScatterField)  // NOLINT
+{
+  for (const auto level : levels_)
+  {
+    point_cloud_transport::setSimdLevel(level);
+    for (const size_t point_step : {4, 12, 16, 22, 36})
+    {
+      for (const size_t value_size : {1, 2, 3, 4, 8, 12, 16})
+      {
+        if (value_size > point_step)
+          continue;
+        for (const auto num_points : LENGTHS)
+        {
+          SCOPED_TRACE(toString(level) + " step " + std::to_string(point_step) + " size " +
+                       std::to_string(value_size) + " points " + std::to_string(num_points));
+          const auto values = randomBytes(num_points * value_size, 2);
+          auto expected = randomBytes(num_points * point_step, 3);
+          auto points = expected;
+          for (size_t i = 0; i < num_points; ++i)
+            memcpy(expected.data() + i * point_step, values.data() + i * value_size, value_size);
+
+          point_cloud_transport::scatterField(values.data(), num_points, value_size, point_step, points.data());
+          EXPECT_EQ(expected, points);
+        }
+      }
+    }
+  }
+}
+
+TEST_F(Repack, SwapBytes)  // NOLINT
+{
+  for (const auto level : levels_)
+  {
+    point_cloud_transport::setSimdLevel(level);
+    for (const size_t value_size : {1, 2, 4, 8})
+    {
+      for (const auto num_values : LENGTHS)
+      {
+        SCOPED_TRACE(toString(level) + " size " + std::to_string(value_size) + " values " +
+                     std::to_string(num_values));
+        auto data = randomBytes(num_values * value_size, 4);
+        auto expected = data;
+        for (size_t i = 0; i < num_values; ++i)
+          std::reverse(expected.begin() + i * value_size, expected.begin() + (i + 1) * value_size);
+
+        point_cloud_transport::swapBytes(data.data(), num_values, value_size);
+        EXPECT_EQ(expected, data);
+      }
+    }
+  }
+}
+
+TEST_F(Repack, QuantizeFloats)  // NOLINT
+{
+  std::mt19937 gen(5);
+  std::uniform_real_distribution<float> value(-1000.0f, 1000.0f);
+  for (const auto level : levels_)
+  {
+    point_cloud_transport::setSimdLevel(level);
+    for (const auto num_values : LENGTHS)
+    {
+      SCOPED_TRACE(toString(level) + " values " + std::to_string(num_values));
+      std::vector<float> values(num_values);
+      for (auto& v : values)
+        v = value(gen);
+      const float scale = 7.3f;
+      std::vector<int32_t> expected(num_values);
+      for (size_t i = 0; i < num_values; ++i)
+        expected[i] = static_cast<int32_t>(std::nearbyint(values[i] * scale));
+
+      std::vector<int32_t> quantized(num_values);
+      point_cloud_transport::quantizeFloats(values.data(), num_values, scale, quantized.data());
+      EXPECT_EQ(expected, quantized);
+    }
+
+    // Halves are rounded to even.
+    SCOPED_TRACE(toString(level));
+    const std::vector<float> halves = {0.5f, 1.5f, 2.5f, -0.5f, -1.5f, -2.5f, 3.5f, -3.5f, 4.5f};
+    const std::vector<int32_t> rounded = {0, 2, 2, 0, -2, -2, 4, -4, 4};
+    std::vector<int32_t> quantized(halves.size());
+    point_cloud_transport::quantizeFloats(halves.data(), halves.size(), 1.0f, quantized.data());
+    EXPECT_EQ(rounded, quantized);
+  }
+}
+
+TEST_F(Repack, DequantizeFloats)  // NOLINT
+{
+  std::mt19937 gen(6);
+  std::uniform_int_distribution<int32_t> value(-100000, 100000);
+  for (const auto level : levels_)
+  {
+    point_cloud_transport::setSimdLevel(level);
+    for (const auto num_values : LENGTHS)
+    {
+      SCOPED_TRACE(toString(level) + " values " + std::to_string(num_values));
+      std::vector<int32_t> quantized(num_values);
+      for (auto& q : quantized)
+        q = value(gen);
+      const float step = 0.001f;
+      std::vector<float> expected(num_values);
+      for (size_t i = 0; i < num_values; ++i)
+        expected[i] = static_cast<float>(quantized[i]) * step;
+
+      std::vector<float> values(num_values);
+      point_cloud_transport::dequantizeFloats(quantized.data(), num_values, step, values.data());
+      EXPECT_EQ(expected, values);
+    }
+  }
+}
+
+TEST_F(Repack, CopyFinitePoints)  // NOLINT
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float inf = std::numeric_limits<float>::infinity();
+  for (const auto level : levels_)
+  {
+    point_cloud_transport::setSimdLevel(level);
+    // With the coordinates at the end of a 12-byte point, the vector load of the last point would read past the data.
+    for (const size_t point_step : {12, 16, 20, 32})
+    {
+      for (const size_t xyz_offset : {size_t(0), point_step - 12})
+      {
+        for (const auto num_points : LENGTHS)
+        {
+          SCOPED_TRACE(toString(level) + " step " + std::to_string(point_step) + " offset " +
+                       std::to_string(xyz_offset) + " points " + std::to_string(num_points));
+          auto points = randomBytes(num_points * point_step, 7);
+          std::vector<uint8_t> expected;
+          for (size_t i = 0; i < num_points; ++i)
+          {
+            const auto point = points.data() + i * point_step;
+            const float c = static_cast<float>(i);
+            switch (i % 7)
+            {
+              case 1: setFloats(point + xyz_offset, nan, c, c); break;
+              case 3: setFloats(point + xyz_offset, c, -inf, c); break;
+              case 4: setFloats(point + xyz_offset, c, c, nan); break;
+              case 5: setFloats(point + xyz_offset, inf, nan, -inf); break;
+              default: setFloats(point + xyz_offset, c, -c, 0.5f * c); break;
+            }
+            if (i % 7 != 1 && i % 7 != 3 && i % 7 != 4 && i % 7 != 5)
+              expected.insert(expected.end(), point, point + point_step);
+          }
+
+          std::vector<uint8_t> output(num_points * point_step);
+          const auto num_copied = point_cloud_transport::copyFinitePoints(points.data(), num_points, point_step,
+                                                                          xyz_offset, output.data());
+          ASSERT_EQ(expected.size() / point_step, num_copied);
+          output.resize(num_copied * point_step);
+          EXPECT_EQ(expected, output);
+        }
+      }
+    }
+  }
+}
+
+TEST_F(Repack, ExtractFloatFieldSwapsByteOrder)  // NOLINT
+{
+  const auto field = makeField("intensity", 4, sensor_msgs::PointField::FLOAT32);
+  auto cloud = makeCloud(3, 5, {field}, 8, 4);  // Padded rows.
+  cloud.data = randomBytes(cloud.data.size(), 8);
+
+  const uint16_t one = 1;
+  const bool host_big_endian = *reinterpret_cast<const uint8_t*>(&one) == 0;
+  cloud.is_bigendian = !host_big_endian;
+  std::vector<float> expected;
+  for (size_t row = 0; row < cloud.height; ++row)
+  {
+    for (size_t col = 0; col < cloud.width; ++col)
+    {
+      const auto data = cloud.data.data() + row * cloud.row_step + col * cloud.point_step + field.offset;
+      uint8_t swapped[4] = {data[3], data[2], data[1], data[0]};
+      float value;
+      memcpy(&value, swapped, sizeof(value));
+      expected.push_back(value);
+    }
+  }
+
+  for (const auto level : levels_)
+  {
+    SCOPED_TRACE(toString(level));
+    point_cloud_transport::setSimdLevel(level);
+    const auto values = point_cloud_transport::extractFloatField(cloud, "intensity");
+    ASSERT_TRUE(values.has_value()) << values.error();
+    ASSERT_EQ(expected.size(), values->size());
+    EXPECT_EQ(0, memcmp(expected.data(), values->data(), expected.size() * sizeof(float)));
+  }
+
+  EXPECT_FALSE(point_cloud_transport::extractFloatField(cloud, "x").has_value());
+  cloud.data.resize((cloud.height - 1) * cloud.row_step + cloud.width * cloud.point_step - 1);
+  EXPECT_FALSE(point_cloud_transport::extractFloatField(cloud, "intensity").has_value());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the quantized transport.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/point_cloud_repack.h>
+#include <point_cloud_transport/PointCloudQuantized.h>
+#include <point_cloud_transport/quantized_coding.h>
+#include <point_cloud_transport/quantized_publisher.h>
+#include <point_cloud_transport/quantized_subscriber.h>
+#include <point_cloud_transport/QuantizedPublisherConfig.h>
+
+#include "test_utils.h"
+
+using point_cloud_transport::PointCloudQuantized;
+using point_cloud_transport::QuantizedPublisher;
+using point_cloud_transport::QuantizedPublisherConfig;
+using point_cloud_transport::QuantizedSubscriber;
+using point_cloud_transport::test::getPoint;
+using point_cloud_transport::test::makeCloud;
+using point_cloud_transport::test::makeField;
+using point_cloud_transport::test::Point;
+
+namespace
+{
+
+//! \brief Float x, y, z, intensity, 4 bytes of padding and uint16 ring.
+const std::vector<sensor_msgs::PointField> FIELDS = {
+  makeField("x", 0, sensor_msgs::PointField::FLOAT32),
+  makeField("y", 4, sensor_msgs::PointField::FLOAT32),
+  makeField("z", 8, sensor_msgs::PointField::FLOAT32),
+  makeField("intensity", 12, sensor_msgs::PointField::FLOAT32),
+  makeField("ring", 20, sensor_msgs::PointField::UINT16),
+};
+const uint32_t POINT_STEP = 24;
+
+//! \brief Random points in a box of the given size centered at the given point. Every 17th point is NaN.
+std::vector<Point> randomPoints(size_t num_points, float cx, float cy, float cz, float size)
+{
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> offset(-size / 2, size / 2);
+  std::uniform_real_distribution<float> intensity(0.0f, 100.0f);
+  std::vector<Point> points(num_points);
+  for (size_t i = 0; i < num_points; ++i)
+  {
+    auto& p = points[i];
+    p.x = cx + offset(gen);
+    p.y = cy + offset(gen);
+    p.z = cz + offset(gen);
+    p.intensity = intensity(gen);
+    p.ring = static_cast<uint16_t>(i % 128);
+    if (i % 17 == 5)
+      p.y = std::numeric_limits<float>::quiet_NaN();
+  }
+  return points;
+}
+
+/**
+ * \brief Encode and decode the points and check that the coordinates are within the error and the other fields exact.
+ * \return The encoded message.
+ */
+PointCloudQuantized roundTrip(const std::vector<Point>& points, uint32_t height, const QuantizedPublisherConfig& config)
+{
+  const auto cloud = makeCloud(points, height, FIELDS, POINT_STEP, 0, 0xAB);
+  const auto result = point_cloud_transport::test::roundTrip(QuantizedPublisher(), QuantizedSubscriber(), cloud,
+                                                             config);
+  if (!result.encoded || !result.decoded)
+    return result.encoded ? *result.encoded : PointCloudQuantized();
+
+  const auto& out = *result.decoded;
+  EXPECT_EQ(cloud.row_step, out.row_step);
+  EXPECT_EQ(cloud.data.size(), out.data.size());
+  if (cloud.data.size() != out.data.size())
+    return *result.encoded;
+
+  const bool quantized = result.encoded->quantized;
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    const auto in = getPoint(cloud, i);
+    const auto res = getPoint(out, i);
+    EXPECT_EQ(in.ring, res.ring) << "point " << i;
+    if (!quantized)
+    {
+      EXPECT_EQ(0, memcmp(cloud.data.data() + i * cloud.point_step, out.data.data() + i * out.point_step, 16));
+      continue;
+    }
+    if (std::isnan(in.y))
+    {
+      EXPECT_TRUE(std::isnan(res.x) && std::isnan(res.y) && std::isnan(res.z)) << "point " << i;
+      continue;
+    }
+    EXPECT_LE(std::abs(static_cast<double>(in.x) - res.x), config.max_error) << "point " << i << " x " << in.x;
+    EXPECT_LE(std::abs(static_cast<double>(in.y) - res.y), config.max_error) << "point " << i << " y " << in.y;
+    EXPECT_LE(std::abs(static_cast<double>(in.z) - res.z), config.max_error) << "point " << i << " z " << in.z;
+    if (config.intensity_resolution > 0)
+      EXPECT_LE(std::abs(in.intensity - res.intensity), config.intensity_resolution / 2 + 1e-4) << "point " << i;
+    else
+      EXPECT_EQ(in.intensity, res.intensity) << "point " << i;
+  }
+  return *result.encoded;
+}
+
+QuantizedPublisherConfig makeConfig(double max_error, double intensity_resolution = 0.0)
+{
+  auto config = QuantizedPublisherConfig::__getDefault__();
+  config.max_error = max_error;
+  config.intensity_resolution = intensity_resolution;
+  return config;
+}
+
+}
+
+TEST(QuantizedTransport, NearOrigin)  // NOLINT
+{
+  const auto msg = roundTrip(randomPoints(1000, 1.0f, -2.0f, 0.5f, 40.0f), 10, makeConfig(0.0005));
+  EXPECT_TRUE(msg.quantized);
+  EXPECT_EQ(3 * 1000u, msg.coordinates.size());
+  EXPECT_TRUE(msg.intensity.empty());
+}
+
+TEST(QuantizedTransport, QuantizedIntensity)  // NOLINT
+{
+  const auto msg = roundTrip(randomPoints(1000, 0.0f, 0.0f, 0.0f, 10.0f), 1, makeConfig(0.001, 0.1));
+  EXPECT_TRUE(msg.quantized);
+  EXPECT_EQ(1000u, msg.intensity.size());
+}
+
+TEST(QuantizedTransport, FarFromOrigin)  // NOLINT
+{
+  // At 5 km, floats are spaced by about 0.5 mm, so the scaled values no longer fit the float precision.
+  auto points = randomPoints(1000, 5000.0f, -4000.0f, 100.0f, 20.0f);
+  points[0].x = 5000.0007f;
+  points[1].x = 4990.0007f;
+  const auto msg = roundTrip(points, 1, makeConfig(0.0005));
+  EXPECT_TRUE(msg.quantized);
+  EXPECT_LT(msg.resolution, 2 * 0.0005f);
+}
+
+TEST(QuantizedTransport, FarFromOriginCoarse)  // NOLINT
+{
+  for (const float centre : {1000.0f, 20000.0f, -123456.0f, 1e6f})
+  {
+    SCOPED_TRACE(centre);
+    roundTrip(randomPoints(200, centre, centre, -centre, 50.0f), 1, makeConfig(0.05));
+  }
+}
+
+TEST(QuantizedTransport, TooFarForTheError)  // NOLINT
+{
+  // Float spacing at 1e7 is 1 m, so 1 mm can not be kept and the points are sent exactly.
+  const auto msg = roundTrip(randomPoints(100, 1e7f, 0.0f, 0.0f, 1.0f), 1, makeConfig(0.001));
+  EXPECT_FALSE(msg.quantized);
+}
+
+TEST(QuantizedTransport, TooWide)  // NOLINT
+{
+  const auto msg = roundTrip(randomPoints(100, 0.0f, 0.0f, 0.0f, 1000.0f), 1, makeConfig(0.0005));
+  EXPECT_FALSE(msg.quantized);
+}
+
+TEST(QuantizedTransport, AllSimdLevels)  // NOLINT
+{
+  using point_cloud_transport::SimdLevel;
+  const auto original = point_cloud_transport::getSimdLevel();
+  for (const auto level : {SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::NEON})
+  {
+    if (point_cloud_transport::setSimdLevel(level) != level)
+      continue;
+    SCOPED_TRACE(toString(level));
+    // Odd sizes leave tails after the vector loops.
+    for (const size_t num_points : {1, 7, 33, 1001})
+    {
+      SCOPED_TRACE(num_points);
+      EXPECT_TRUE(roundTrip(randomPoints(num_points, 3.0f, 1.0f, -2.0f, 30.0f), 1, makeConfig(0.0005, 0.1)).quantized);
+    }
+  }
+  point_cloud_transport::setSimdLevel(original);
+}
+
+TEST(QuantizedTransport, QuantizePlaneErrorBound)  // NOLINT
+{
+  std::mt19937 gen(1);
+  for (const double centre : {0.0, 3.3, -250.0, 2000.0, 5000.0007})
+  {
+    SCOPED_TRACE(centre);
+    const double max_error = 0.0005;
+    std::uniform_real_distribution<double> offset(-10.0, 10.0);
+    std::vector<float> values(1001);
+    for (auto& v : values)
+      v = static_cast<float>(centre + offset(gen));
+    const auto original = values;
+    const std::vector<uint8_t> valid(values.size(), 1);
+
+    const auto resolution = point_cloud_transport::quantized::getResolution(max_error, std::abs(centre) + 10.0);
+    ASSERT_GT(resolution, 0.0f);
+    int32_t origin;
+    std::vector<int16_t> quantized(values.size());
+    ASSERT_TRUE(point_cloud_transport::quantized::quantizePlane(
+      values.data(), values.size(), valid, resolution, origin, quantized.data()));
+
+    std::vector<float> decoded(values.size());
+    point_cloud_transport::quantized::dequantizePlane(
+      quantized.data(), quantized.size(), origin, resolution, decoded.data());
+    for (size_t i = 0; i < values.size(); ++i)
+      EXPECT_LE(std::abs(static_cast<double>(original[i]) - decoded[i]), max_error) << original[i];
+  }
+
+  // Floats are spaced by almost 8 mm at 65 km.
+  EXPECT_EQ(0.0f, point_cloud_transport::quantized::getResolution(0.0005, 65000.0));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the range image transport.
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/PointCloudRangeImage.h>
+#include <point_cloud_transport/range_image_coding.h>
+#include <point_cloud_transport/range_image_publisher.h>
+#include <point_cloud_transport/range_image_subscriber.h>
+#include <point_cloud_transport/RangeImagePublisherConfig.h>
+
+#include "test_utils.h"
+
+using point_cloud_transport::NoConfigConfig;
+using point_cloud_transport::PointCloudRangeImage;
+using point_cloud_transport::RangeImagePublisher;
+using point_cloud_transport::RangeImagePublisherConfig;
+using point_cloud_transport::RangeImageSubscriber;
+using point_cloud_transport::test::getPoint;
+using point_cloud_transport::test::makeField;
+using point_cloud_transport::test::Point;
+
+namespace
+{
+
+//! \brief Float x, y, z, intensity, uint16 ring, 2 bytes of padding, float time and 4 bytes of padding.
+const std::vector<sensor_msgs::PointField> FIELDS = {
+  makeField("x", 0, sensor_msgs::PointField::FLOAT32),
+  makeField("y", 4, sensor_msgs::PointField::FLOAT32),
+  makeField("z", 8, sensor_msgs::PointField::FLOAT32),
+  makeField("intensity", 12, sensor_msgs::PointField::FLOAT32),
+  makeField("ring", 16, sensor_msgs::PointField::UINT16),
+  makeField("time", 20, sensor_msgs::PointField::FLOAT32),
+};
+const uint32_t POINT_STEP = 28;
+
+sensor_msgs::PointCloud2 makeCloud(const std::vector<Point>& points, uint32_t height)
+{
+  return point_cloud_transport::test::makeCloud(points, height, FIELDS, POINT_STEP);
+}
+
+/**
+ * \brief A scan of a spinning lidar with the given number of beams and columns. Every 13th point has no return.
+ * \param[in] jitter Random displacement of the points (m), so that they do not lie on the beams.
+ * \param[in] invalid Value of the coordinates of the points without return.
+ */
+std::vector<Point> makeScan(size_t height, size_t width, double jitter = 0.0,
+                            float invalid = std::numeric_limits<float>::quiet_NaN())
+{
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<double> noise(-jitter, jitter);
+  std::uniform_real_distribution<float> intensity(0.0f, 255.0f);
+  std::vector<Point> points(height * width);
+  for (size_t row = 0; row < height; ++row)
+  {
+    const double elevation = (-15.0 + 2.0 * row) * M_PI / 180.0;
+    // Per-beam azimuth offset as in real lidars.
+    const double offset = 0.002 * (row % 4);
+    for (size_t col = 0; col < width; ++col)
+    {
+      const size_t i = row * width + col;
+      const double azimuth = -M_PI + 2 * M_PI * (col + 0.5) / width + offset;
+      const double range = 12.0 + 5.0 * std::sin(3 * azimuth) + 0.1 * row;
+      auto& p = points[i];
+      p.x = static_cast<float>(range * std::cos(elevation) * std::cos(azimuth) + noise(gen));
+      p.y = static_cast<float>(range * std::cos(elevation) * std::sin(azimuth) + noise(gen));
+      p.z = static_cast<float>(range * std::sin(elevation) + noise(gen));
+      p.intensity = intensity(gen);
+      p.ring = static_cast<uint16_t>(row);
+      p.time = 1e-4f * static_cast<float>(col);
+      if (i % 13 == 7)
+        p.x = p.y = p.z = invalid;
+    }
+  }
+  return points;
+}
+
+RangeImagePublisherConfig makeConfig(double range_resolution, double geometry_tolerance,
+                                     double intensity_resolution = 0.0)
+{
+  auto config = RangeImagePublisherConfig::__getDefault__();
+  config.range_resolution = range_resolution;
+  config.geometry_tolerance = geometry_tolerance;
+  config.intensity_resolution = intensity_resolution;
+  return config;
+}
+
+bool isValid(const Point& p)
+{
+  return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z) && !(p.x == 0 && p.y == 0 && p.z == 0);
+}
+
+/**
+ * \brief Encode and decode the points and check the decoded cloud.
+ * \param[in] max_error Maximum distance of the decoded points from the original ones.
+ * \return The encoded message.
+ */
+PointCloudRangeImage roundTrip(const std::vector<Point>& points, uint32_t height,
+                               const RangeImagePublisherConfig& config, double max_error)
+{
+  const auto cloud = makeCloud(points, height);
+  const auto result = point_cloud_transport::test::roundTrip(RangeImagePublisher(), RangeImageSubscriber(), cloud,
+                                                             config);
+  if (!result.encoded || !result.decoded)
+    return result.encoded ? *result.encoded : PointCloudRangeImage();
+
+  const auto& out = *result.decoded;
+  // Raw clouds are sent exactly, including the invalid points.
+  if (result.encoded->mode == PointCloudRangeImage::MODE_RAW)
+  {
+    EXPECT_EQ(cloud.data, out.data);
+    return *result.encoded;
+  }
+
+  const auto invalid_is_nan = result.encoded->invalid_is_nan;
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    const auto in = getPoint(cloud, i);
+    const auto res = getPoint(out, i);
+    EXPECT_EQ(in.ring, res.ring) << "point " << i;
+    EXPECT_EQ(in.time, res.time) << "point " << i;
+    if (config.intensity_resolution > 0)
+      EXPECT_LE(std::abs(in.intensity - res.intensity), config.intensity_resolution / 2 + 1e-4) << "point " << i;
+    else
+      EXPECT_EQ(in.intensity, res.intensity) << "point " << i;
+
+    if (!isValid(in))
+    {
+      if (invalid_is_nan)
+        EXPECT_TRUE(std::isnan(res.x) && std::isnan(res.y) && std::isnan(res.z)) << "point " << i;
+      else
+        EXPECT_TRUE(res.x == 0 && res.y == 0 && res.z == 0) << "point " << i;
+      continue;
+    }
+    const double dx = static_cast<double>(in.x) - res.x;
+    const double dy = static_cast<double>(in.y) - res.y;
+    const double dz = static_cast<double>(in.z) - res.z;
+    EXPECT_LE(std::sqrt(dx * dx + dy * dy + dz * dz), max_error) << "point " << i;
+  }
+  return *result.encoded;
+}
+
+}
+
+TEST(RangeImageTransport, RegularScanSendsRanges)  // NOLINT
+{
+  const auto config = makeConfig(0.001, 0.005);
+  const auto points = makeScan(16, 512);
+  // The documented bound, with a margin for the rounding of the decoded coordinates to floats.
+  const auto msg = roundTrip(points, 16, config, config.geometry_tolerance + config.range_resolution / 2 + 1e-5);
+  EXPECT_EQ(PointCloudRangeImage::MODE_RANGE, msg.mode);
+  EXPECT_TRUE(msg.invalid_is_nan);
+  EXPECT_EQ(16u, msg.elevations.size());
+  EXPECT_EQ(16u, msg.azimuth_offsets.size());
+  EXPECT_EQ(512u, msg.azimuths.size());
+}
+
+TEST(RangeImageTransport, QuantizedIntensity)  // NOLINT
+{
+  const auto config = makeConfig(0.001, 0.005, 0.5);
+  const auto msg = roundTrip(makeScan(8, 100), 8, config,
+                             config.geometry_tolerance + config.range_resolution / 2 + 1e-5);
+  EXPECT_EQ(PointCloudRangeImage::MODE_RANGE, msg.mode);
+}
+
+TEST(RangeImageTransport, InvalidPointsAsZeros)  // NOLINT
+{
+  const auto config = makeConfig(0.001, 0.005);
+  const auto msg = roundTrip(makeScan(8, 64, 0.0, 0.0f), 8, config,
+                             config.geometry_tolerance + config.range_resolution / 2 + 1e-5);
+  EXPECT_EQ(PointCloudRangeImage::MODE_RANGE, msg.mode);
+  EXPECT_FALSE(msg.invalid_is_nan);
+}
+
+TEST(RangeImageTransport, IrregularGeometrySendsCoordinates)  // NOLINT
+{
+  // The points are farther from the beams than the tolerance, so the coordinates are quantized directly.
+  const auto config = makeConfig(0.001, 0.005);
+  const auto msg = roundTrip(makeScan(16, 128, 0.05), 16, config, std::sqrt(3.0) * config.range_resolution / 2 + 1e-5);
+  EXPECT_EQ(PointCloudRangeImage::MODE_XYZ, msg.mode);
+  EXPECT_TRUE(msg.azimuths.empty());
+}
+
+TEST(RangeImageTransport, FarCoordinatesAreSentRaw)  // NOLINT
+{
+  // A coordinate of 1e7 m is more than 2^31 steps of 1 mm, so it can not be quantized.
+  auto points = makeScan(16, 128, 0.05);
+  points[100].x = 1e7f;
+  const auto msg = roundTrip(points, 16, makeConfig(0.001, 0.005), 0.0);
+  EXPECT_EQ(PointCloudRangeImage::MODE_RAW, msg.mode);
+  EXPECT_TRUE(msg.geometry.empty());
+}
+
+TEST(RangeImageTransport, UnorganizedCloudIsSentRaw)  // NOLINT
+{
+  const auto msg = roundTrip(makeScan(1, 300), 1, makeConfig(0.001, 0.005), 0.0);
+  EXPECT_EQ(PointCloudRangeImage::MODE_RAW, msg.mode);
+}
+
+TEST(RangeImageTransport, RejectsCorruptedData)  // NOLINT
+{
+  const auto cloud = makeCloud(makeScan(4, 32), 4);
+  RangeImagePublisher pub;
+  RangeImageSubscriber sub;
+  const auto encoded = pub.encodeTyped(cloud, makeConfig(0.001, 0.005));
+  ASSERT_TRUE(encoded.has_value() && encoded->has_value());
+
+  auto msg = encoded->value();
+  msg.geometry.resize(msg.geometry.size() / 2);
+  EXPECT_FALSE(sub.decodeTyped(msg, NoConfigConfig()).has_value());
+
+  msg = encoded->value();
+  msg.data.resize(msg.data.size() - 1);
+  EXPECT_FALSE(sub.decodeTyped(msg, NoConfigConfig()).has_value());
+
+  // Only single FLOAT32 coordinates can be decoded.
+  msg = encoded->value();
+  msg.fields[0].datatype = sensor_msgs::PointField::FLOAT64;
+  EXPECT_FALSE(sub.decodeTyped(msg, NoConfigConfig()).has_value());
+}
+
+TEST(RangeImageCoding, Deltas)  // NOLINT
+{
+  const std::vector<int64_t> values = {0, 1, -1, 1000, -1000000, std::numeric_limits<int64_t>::max(),
+                                       std::numeric_limits<int64_t>::min(), 0, 42, 42, 41};
+  std::vector<uint8_t> coded;
+  point_cloud_transport::range_image::encodeDeltas(values, coded);
+
+  std::vector<int64_t> decoded(values.size());
+  const uint8_t* data = coded.data();
+  ASSERT_TRUE(point_cloud_transport::range_image::decodeDeltas(data, coded.data() + coded.size(), decoded));
+  EXPECT_EQ(values, decoded);
+  EXPECT_EQ(coded.data() + coded.size(), data);
+
+  data = coded.data();
+  EXPECT_FALSE(point_cloud_transport::range_image::decodeDeltas(data, coded.data() + coded.size() - 1, decoded));
+}
+
+TEST(RangeImageCoding, Integers)  // NOLINT
+{
+  uint8_t buffer[8];
+  for (const auto datatype : {sensor_msgs::PointField::INT8, sensor_msgs::PointField::INT16,
+                              sensor_msgs::PointField::INT32})
+  {
+    point_cloud_transport::range_image::writeInteger(buffer, datatype, -5);
+    EXPECT_EQ(-5, point_cloud_transport::range_image::readInteger(buffer, datatype));
+  }
+  for (const auto datatype : {sensor_msgs::PointField::UINT8, sensor_msgs::PointField::UINT16,
+                              sensor_msgs::PointField::UINT32})
+  {
+    point_cloud_transport::range_image::writeInteger(buffer, datatype, 200);
+    EXPECT_EQ(200, point_cloud_transport::range_image::readInteger(buffer, datatype));
+  }
+  point_cloud_transport::range_image::writeInteger(buffer, sensor_msgs::PointField::UINT32, 4000000000ll);
+  EXPECT_EQ(4000000000ll, point_cloud_transport::range_image::readInteger(buffer, sensor_msgs::PointField::UINT32));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
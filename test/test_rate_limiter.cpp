@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the rate limiting of published clouds.
+ */
+
+#include <chrono>
+#include <cstddef>
+
+#include <gtest/gtest.h>
+
+#include <point_cloud_transport/publisher_options.h>
+#include <point_cloud_transport/rate_limiter.h>
+
+using point_cloud_transport::RateLimiter;
+using point_cloud_transport::TransportRateLimit;
+
+namespace
+{
+
+TransportRateLimit makeLimit(double max_rate, size_t publish_every_n = 1)
+{
+  TransportRateLimit limit;
+  limit.max_rate = max_rate;
+  limit.publish_every_n = publish_every_n;
+  return limit;
+}
+
+/**
+ * \brief Offer clouds coming with the given rate for the given duration.
+ * \return Number of the accepted clouds.
+ */
+size_t countAccepted(RateLimiter& limiter, RateLimiter::Clock::time_point& now, double input_rate, double duration)
+{
+  const auto period = std::chrono::duration_cast<RateLimiter::Clock::duration>(
+    std::chrono::duration<double>(1.0 / input_rate));
+  size_t accepted = 0;
+  for (size_t i = 0; i < static_cast<size_t>(input_rate * duration); ++i, now += period)
+    accepted += limiter.accept(now) ? 1 : 0;
+  return accepted;
+}
+
+}
+
+TEST(RateLimiter, Unlimited)  // NOLINT
+{
+  RateLimiter limiter(makeLimit(0.0));
+  EXPECT_EQ(0.0, limiter.getRate());
+  auto now = RateLimiter::Clock::now();
+  EXPECT_EQ(100u, countAccepted(limiter, now, 100.0, 1.0));
+}
+
+TEST(RateLimiter, MaxRate)  // NOLINT
+{
+  RateLimiter limiter(makeLimit(10.0));
+  EXPECT_EQ(10.0, limiter.getRate());
+  auto now = RateLimiter::Clock::now();
+  EXPECT_EQ(10u, countAccepted(limiter, now, 100.0, 1.0));
+  // Input slower than the limit passes whole.
+  EXPECT_EQ(20u, countAccepted(limiter, now, 5.0, 4.0));
+}
+
+TEST(RateLimiter, JitterDoesNotLowerTheRate)  // NOLINT
+{
+  RateLimiter limiter(makeLimit(10.0));
+  auto now = RateLimiter::Clock::now();
+  size_t accepted = 0;
+  // Clouds at 30 Hz arriving alternately 5 ms early and late.
+  for (int i = 0; i < 300; ++i)
+  {
+    const auto jitter = std::chrono::milliseconds(i % 2 == 0 ? -5 : 5);
+    accepted += limiter.accept(now + std::chrono::microseconds(33333 * i) + jitter) ? 1 : 0;
+  }
+  EXPECT_NEAR(100.0, static_cast<double>(accepted), 2.0);
+}
+
+TEST(RateLimiter, NoCatchUpAfterPause)  // NOLINT
+{
+  RateLimiter limiter(makeLimit(10.0));
+  auto now = RateLimiter::Clock::now();
+  EXPECT_EQ(10u, countAccepted(limiter, now, 100.0, 1.0));
+  now += std::chrono::seconds(5);
+  EXPECT_EQ(10u, countAccepted(limiter, now, 100.0, 1.0));
+}
+
+TEST(RateLimiter, PublishEveryN)  // NOLINT
+{
+  RateLimiter limiter(makeLimit(0.0, 3));
+  auto now = RateLimiter::Clock::now();
+  EXPECT_TRUE(limiter.accept(now));
+  EXPECT_FALSE(limiter.accept(now));
+  EXPECT_FALSE(limiter.accept(now));
+  EXPECT_TRUE(limiter.accept(now));
+  EXPECT_EQ(33u, countAccepted(limiter, now, 100.0, 1.0));
+
+  // Both limits apply.
+  RateLimiter both(makeLimit(5.0, 2));
+  EXPECT_EQ(5u, countAccepted(both, now, 100.0, 1.0));
+}
+
+TEST(RateLimiter, RequestedRates)  // NOLINT
+{
+  RateLimiter limiter(makeLimit(20.0));
+  limiter.addSubscriber("/a", 5.0);
+  EXPECT_EQ(5.0, limiter.getRate());
+
+  // The fastest subscriber wins.
+  limiter.addSubscriber("/b", 8.0);
+  EXPECT_EQ(8.0, limiter.getRate());
+  auto now = RateLimiter::Clock::now();
+  EXPECT_EQ(8u, countAccepted(limiter, now, 100.0, 1.0));
+
+  // The maximum rate caps the requests.
+  limiter.setRequestedRate("/b", 50.0);
+  EXPECT_EQ(20.0, limiter.getRate());
+
+  // A subscriber without a request wants all clouds (up to the maximum rate).
+  limiter.setRequestedRate("/b", 0.0);
+  EXPECT_EQ(20.0, limiter.getRate());
+
+  limiter.removeSubscriber("/b");
+  EXPECT_EQ(5.0, limiter.getRate());
+  limiter.removeSubscriber("/a");
+  EXPECT_EQ(20.0, limiter.getRate());
+
+  RateLimiter unlimited(makeLimit(0.0));
+  unlimited.addSubscriber("/a", 5.0);
+  EXPECT_EQ(5.0, unlimited.getRate());
+  unlimited.addSubscriber("/b", 0.0);
+  EXPECT_EQ(0.0, unlimited.getRate());
+}
+
+TEST(RateLimiter, OneEntryPerConnection)  // NOLINT
+{
+  RateLimiter limiter(makeLimit(0.0));
+  // Two connections of the same subscriber (e.g. over two transports of one topic).
+  limiter.addSubscriber("/a", 5.0);
+  limiter.addSubscriber("/a", 5.0);
+  limiter.setRequestedRate("/a", 2.0);
+  EXPECT_EQ(2.0, limiter.getRate());
+  limiter.removeSubscriber("/a");
+  EXPECT_EQ(2.0, limiter.getRate());
+  limiter.removeSubscriber("/a");
+  EXPECT_EQ(0.0, limiter.getRate());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the shared memory segments of the shm transport.
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <point_cloud_transport/shm_segment.h>
+
+using point_cloud_transport::ShmSegment;
+
+namespace
+{
+
+//! \brief A segment name unique to this process and test.
+std::string segmentName(const std::string& test)
+{
+  return "/point_cloud_transport_test_" + std::to_string(getpid()) + "_" + test;
+}
+
+std::vector<uint8_t> makeData(size_t size, uint8_t seed)
+{
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; ++i)
+    data[i] = static_cast<uint8_t>(seed + i * 7);
+  return data;
+}
+
+}
+
+TEST(ShmSegment, WritesAndReads)  // NOLINT
+{
+  auto writer = ShmSegment::create(segmentName("rw"), 2, 1000);
+  ASSERT_TRUE(writer.has_value()) << writer.error();
+  auto reader = ShmSegment::open(segmentName("rw"));
+  ASSERT_TRUE(reader.has_value()) << reader.error();
+  EXPECT_EQ(2u, (*reader)->getNumSlots());
+  EXPECT_GE((*reader)->getSlotSize(), 1000u);
+
+  const auto data = makeData(1000, 1);
+  const auto location = (*writer)->write(data.data(), data.size());
+  ASSERT_TRUE(location.has_value());
+  std::vector<uint8_t> out(data.size());
+  EXPECT_TRUE((*reader)->read(*location, out.data(), out.size()));
+  EXPECT_EQ(data, out);
+
+  // Only the creator writes, and the data have to fit into a slot.
+  EXPECT_FALSE((*reader)->write(data.data(), data.size()).has_value());
+  const auto big = makeData((*writer)->getSlotSize() + 1, 2);
+  EXPECT_FALSE((*writer)->write(big.data(), big.size()).has_value());
+
+  // The size of the data is checked, too.
+  EXPECT_FALSE((*reader)->read(*location, out.data(), out.size() - 1));
+  EXPECT_FALSE((*reader)->read({5, location->generation}, out.data(), out.size()));
+}
+
+TEST(ShmSegment, ReusesSlotsRoundRobin)  // NOLINT
+{
+  auto writer = ShmSegment::create(segmentName("reuse"), 2, 100);
+  ASSERT_TRUE(writer.has_value()) << writer.error();
+  auto reader = ShmSegment::open(segmentName("reuse"));
+  ASSERT_TRUE(reader.has_value()) << reader.error();
+
+  std::vector<ShmSegment::Location> locations;
+  for (uint8_t i = 0; i < 3; ++i)
+  {
+    const auto data = makeData(100, i);
+    const auto location = (*writer)->write(data.data(), data.size());
+    ASSERT_TRUE(location.has_value());
+    locations.push_back(*location);
+  }
+  EXPECT_EQ(0u, locations[0].slot);
+  EXPECT_EQ(1u, locations[1].slot);
+  EXPECT_EQ(0u, locations[2].slot);
+  EXPECT_LT(locations[0].generation, locations[2].generation);
+
+  // The first data were overwritten, so reading them fails instead of returning the newer ones.
+  std::vector<uint8_t> out(100);
+  EXPECT_FALSE((*reader)->read(locations[0], out.data(), out.size()));
+  for (const size_t i : {1, 2})
+  {
+    EXPECT_TRUE((*reader)->read(locations[i], out.data(), out.size())) << "write " << i;
+    EXPECT_EQ(makeData(100, static_cast<uint8_t>(i)), out) << "write " << i;
+  }
+}
+
+TEST(ShmSegment, ReclaimsSlotOfDeadReader)  // NOLINT
+{
+  // Large slots, so that the reader spends nearly all its time copying and most likely dies while reading.
+  const size_t size = 8 * 1024 * 1024;
+  // The name contains the PID, so it has to be made before forking.
+  const auto name = segmentName("dead");
+  auto writer = ShmSegment::create(name, 1, size);
+  ASSERT_TRUE(writer.has_value()) << writer.error();
+  const auto data = makeData(size, 3);
+  const auto location = (*writer)->write(data.data(), data.size());
+  ASSERT_TRUE(location.has_value());
+
+  int started[2];
+  ASSERT_EQ(0, pipe(started));
+  const auto pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+  {
+    close(started[0]);
+    auto reader = ShmSegment::open(name);
+    std::vector<uint8_t> out(size);
+    const char byte = 0;
+    if (!reader.has_value() || write(started[1], &byte, 1) != 1)
+      _exit(1);
+    while (true)
+      (*reader)->read(*location, out.data(), out.size());
+  }
+  close(started[1]);
+  char byte;
+  const auto num_read = read(started[0], &byte, 1);
+  close(started[0]);
+  ASSERT_EQ(1, num_read);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+
+  // The writer takes the slot back once the dead reader has been reading for too long.
+  cras::optional<ShmSegment::Location> new_location;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!new_location && std::chrono::steady_clock::now() < deadline)
+  {
+    new_location = (*writer)->write(data.data(), data.size());
+    if (!new_location)
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  ASSERT_TRUE(new_location.has_value());
+  EXPECT_EQ(0u, new_location->slot);
+  EXPECT_GT(new_location->generation, location->generation);
+
+  // Readers can use the slot again.
+  auto reader = ShmSegment::open(name);
+  ASSERT_TRUE(reader.has_value()) << reader.error();
+  std::vector<uint8_t> out(size);
+  EXPECT_TRUE((*reader)->read(*new_location, out.data(), out.size()));
+  EXPECT_FALSE((*reader)->read(*location, out.data(), out.size()));
+}
+
+TEST(ShmSegment, RemovesSegmentsOfDeadProcesses)  // NOLINT
+{
+  // A PID that surely does not exist any more.
+  const auto pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+    _exit(0);
+  waitpid(pid, nullptr, 0);
+
+  const std::string prefix = "point_cloud_transport_stale_test_";
+  const auto stale_name = "/" + prefix + std::to_string(pid) + "_0";
+  const auto own_name = "/" + prefix + std::to_string(getpid()) + "_0";
+  auto stale = ShmSegment::create(stale_name, 1, 10);
+  ASSERT_TRUE(stale.has_value()) << stale.error();
+  auto own = ShmSegment::create(own_name, 1, 10);
+  ASSERT_TRUE(own.has_value()) << own.error();
+
+  EXPECT_EQ(1u, ShmSegment::removeStaleSegments(prefix));
+  EXPECT_FALSE(ShmSegment::open(stale_name).has_value());
+  EXPECT_TRUE(ShmSegment::open(own_name).has_value());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
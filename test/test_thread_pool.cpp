@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Unit tests for the worker pools and the overflow policies of strands.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <point_cloud_transport/thread_pool.h>
+
+using point_cloud_transport::OrderedExecutor;
+using point_cloud_transport::QueueOverflowPolicy;
+using point_cloud_transport::Strand;
+using point_cloud_transport::ThreadPool;
+
+namespace
+{
+
+//! \brief Blocks the tasks calling wait() until open() is called.
+class Gate
+{
+public:
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return open_; });
+  }
+
+  void open()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_ = true;
+    cv_.notify_all();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool open_ {false};
+};
+
+//! \brief Records the order in which the tasks ran.
+class Log
+{
+public:
+  void add(int value)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    values_.push_back(value);
+  }
+
+  std::vector<int> get()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return values_;
+  }
+
+private:
+  std::mutex mutex_;
+  std::vector<int> values_;
+};
+
+//! \brief Increments the counter when destroyed, i.e. also when the task holding it is dropped.
+struct DestructionCounter
+{
+  explicit DestructionCounter(std::atomic<int>& counter) : counter_(counter)
+  {
+  }
+
+  ~DestructionCounter()
+  {
+    ++counter_;
+  }
+
+  std::atomic<int>& counter_;
+};
+
+/**
+ * \brief Post a task blocking the strand until the gate opens, and wait until it is running, so that the following
+ *        tasks wait in the queue.
+ */
+void blockStrand(Strand& strand, Gate& gate, Log& log)
+{
+  auto started = std::make_shared<std::promise<void>>();
+  auto future = started->get_future();
+  ASSERT_TRUE(strand.post([&gate, &log, started] { started->set_value(); gate.wait(); log.add(0); }));
+  ASSERT_EQ(std::future_status::ready, future.wait_for(std::chrono::seconds(10)));
+}
+
+//! \brief Post a task that waits for the previous tasks of the strand and then finishes.
+void drain(Strand& strand)
+{
+  auto done = std::make_shared<std::promise<void>>();
+  auto future = done->get_future();
+  ASSERT_TRUE(strand.post([done] { done->set_value(); }));
+  ASSERT_EQ(std::future_status::ready, future.wait_for(std::chrono::seconds(10)));
+}
+
+}
+
+TEST(ThreadPool, RunsAllTasks)  // NOLINT
+{
+  std::atomic<int> count {0};
+  {
+    ThreadPool pool(4);
+    EXPECT_EQ(4u, pool.getNumThreads());
+    for (int i = 0; i < 1000; ++i)
+      EXPECT_TRUE(pool.post([&count] { ++count; }));
+  }
+  // The destructor finishes the posted tasks.
+  EXPECT_EQ(1000, count);
+}
+
+TEST(ThreadPool, SurvivesThrowingTasks)  // NOLINT
+{
+  std::atomic<int> count {0};
+  ThreadPool pool(1);
+  pool.post([] { throw std::runtime_error("task failed"); });
+  pool.post([] { throw 42; });
+  pool.post([&count] { ++count; });
+  pool.shutdown();
+  EXPECT_EQ(1, count);
+}
+
+TEST(ThreadPool, IgnoresTasksAfterShutdown)  // NOLINT
+{
+  ThreadPool pool(2);
+  pool.shutdown();
+  EXPECT_FALSE(pool.post([] {}));
+}
+
+TEST(ThreadPool, KnowsItsWorkerThreads)  // NOLINT
+{
+  ThreadPool pool(2);
+  EXPECT_FALSE(pool.isWorkerThread());
+  std::promise<bool> in_worker;
+  pool.post([&pool, &in_worker] { in_worker.set_value(pool.isWorkerThread()); });
+  EXPECT_TRUE(in_worker.get_future().get());
+  // The pool does not change the IDs while joining, so this can be called by a task running during the shutdown.
+  pool.shutdown();
+  EXPECT_FALSE(pool.isWorkerThread());
+}
+
+TEST(Strand, RunsTasksInOrderOneByOne)  // NOLINT
+{
+  ThreadPool pool(4);
+  Strand strand(pool);
+  Log log;
+  std::atomic<int> running {0};
+  std::atomic<bool> overlapped {false};
+  for (int i = 0; i < 200; ++i)
+  {
+    strand.post([&, i]
+    {
+      if (running++ > 0)
+        overlapped = true;
+      log.add(i);
+      --running;
+    });
+  }
+  drain(strand);
+
+  const auto values = log.get();
+  ASSERT_EQ(200u, values.size());
+  for (int i = 0; i < 200; ++i)
+    EXPECT_EQ(i, values[i]);
+  EXPECT_FALSE(overlapped);
+  EXPECT_EQ(0u, strand.getNumDropped());
+}
+
+TEST(Strand, DropOldest)  // NOLINT
+{
+  ThreadPool pool(2);
+  Strand strand(pool, 2, QueueOverflowPolicy::DROP_OLDEST);
+  Gate gate;
+  Log log;
+  std::atomic<int> destroyed {0};
+  blockStrand(strand, gate, log);
+
+  for (int i = 1; i <= 5; ++i)
+  {
+    auto counter = std::make_shared<DestructionCounter>(destroyed);
+    EXPECT_TRUE(strand.post([&log, i, counter] { log.add(i); }));
+  }
+  // The running task does not count into the queue.
+  EXPECT_EQ(2u, strand.getQueueSize());
+  EXPECT_EQ(3u, strand.getNumDropped());
+  // The dropped tasks are destroyed without running.
+  EXPECT_EQ(3, destroyed);
+
+  gate.open();
+  // The draining task would drop task 4 while the strand is full.
+  while (strand.getQueueSize() > 0)
+    std::this_thread::yield();
+  drain(strand);
+  EXPECT_EQ(std::vector<int>({0, 4, 5}), log.get());
+  EXPECT_EQ(5, destroyed);
+}
+
+TEST(Strand, DropNewest)  // NOLINT
+{
+  ThreadPool pool(2);
+  Strand strand(pool, 2, QueueOverflowPolicy::DROP_NEWEST);
+  Gate gate;
+  Log log;
+  blockStrand(strand, gate, log);
+
+  EXPECT_TRUE(strand.post([&log] { log.add(1); }));
+  EXPECT_TRUE(strand.post([&log] { log.add(2); }));
+  EXPECT_FALSE(strand.post([&log] { log.add(3); }));
+  EXPECT_FALSE(strand.post([&log] { log.add(4); }));
+  EXPECT_EQ(2u, strand.getQueueSize());
+  EXPECT_EQ(2u, strand.getNumDropped());
+
+  gate.open();
+  // The strand would drop the draining task while it is full.
+  while (strand.getQueueSize() > 0)
+    std::this_thread::yield();
+  drain(strand);
+  EXPECT_EQ(std::vector<int>({0, 1, 2}), log.get());
+}
+
+TEST(Strand, Block)  // NOLINT
+{
+  ThreadPool pool(2);
+  Strand strand(pool, 1, QueueOverflowPolicy::BLOCK);
+  Gate gate;
+  Log log;
+  blockStrand(strand, gate, log);
+
+  EXPECT_TRUE(strand.post([&log] { log.add(1); }));
+  std::atomic<bool> posted {false};
+  std::thread poster([&]
+  {
+    strand.post([&log] { log.add(2); });
+    posted = true;
+  });
+
+  // The queue is full, so the poster waits.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_FALSE(posted);
+  EXPECT_EQ(1u, strand.getQueueSize());
+
+  gate.open();
+  poster.join();
+  EXPECT_TRUE(posted);
+  drain(strand);
+  EXPECT_EQ(std::vector<int>({0, 1, 2}), log.get());
+  EXPECT_EQ(0u, strand.getNumDropped());
+}
+
+TEST(Strand, DestructionDropsWaitingTasks)  // NOLINT
+{
+  ThreadPool pool(2);
+  Gate gate;
+  Log log;
+  std::atomic<int> destroyed {0};
+  std::thread opener;
+  {
+    Strand strand(pool);
+    blockStrand(strand, gate, log);
+    for (int i = 1; i <= 3; ++i)
+    {
+      auto counter = std::make_shared<DestructionCounter>(destroyed);
+      strand.post([&log, i, counter] { log.add(i); });
+    }
+    // The destructor waits for the running task, so it has to be released from another thread.
+    opener = std::thread([&gate] { std::this_thread::sleep_for(std::chrono::milliseconds(50)); gate.open(); });
+  }
+  opener.join();
+  EXPECT_EQ(std::vector<int>({0}), log.get());
+  EXPECT_EQ(3, destroyed);
+}
+
+TEST(OrderedExecutor, CompletesInOrder)  // NOLINT
+{
+  Log log;
+  {
+    OrderedExecutor executor(4, 8);
+    for (int i = 0; i < 100; ++i)
+    {
+      executor.post([&log, i]() -> ThreadPool::Task
+      {
+        // Later jobs tend to finish first.
+        std::this_thread::sleep_for(std::chrono::microseconds((100 - i) * 10));
+        if (i == 50)
+          throw std::runtime_error("job failed");
+        return [&log, i] { log.add(i); };
+      });
+      EXPECT_LE(executor.getNumInFlight(), 8u);
+    }
+  }
+
+  const auto values = log.get();
+  ASSERT_EQ(99u, values.size());
+  for (size_t i = 0; i < values.size(); ++i)
+    EXPECT_EQ(static_cast<int>(i < 50 ? i : i + 1), values[i]);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,276 @@
+#pragma once
+
+// SPDX-License-Identifier: BSD-3-Clause
+// SPDX-FileCopyrightText: Czech Technical University in Prague
+
+/**
+ * \file
+ * \brief Clouds and transport round trips shared by the unit tests.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cras_cpp_common/optional.hpp>
+#include <gtest/gtest.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <point_cloud_transport/NoConfigConfig.h>
+#include <point_cloud_transport/simple_publisher_plugin.h>
+
+namespace point_cloud_transport
+{
+namespace test
+{
+
+/**
+ * \brief Values of the fields a test point can have. A cloud made by makeCloud() stores only the fields of its layout
+ *        (converted to their datatypes); getPoint() reads the missing ones as zeros.
+ */
+struct Point
+{
+  float x {0}, y {0}, z {0}, intensity {0};
+  uint16_t ring {0};
+  double time {0};
+  uint32_t id {0};
+};
+
+inline sensor_msgs::PointField makeField(const std::string& name, uint32_t offset, uint8_t datatype,
+                                         uint32_t count = 1)
+{
+  sensor_msgs::PointField field;
+  field.name = name;
+  field.offset = offset;
+  field.datatype = datatype;
+  field.count = count;
+  return field;
+}
+
+//! \brief Size of one value of the given datatype.
+inline size_t getDatatypeSize(uint8_t datatype)
+{
+  switch (datatype)
+  {
+    case sensor_msgs::PointField::INT8:
+    case sensor_msgs::PointField::UINT8:
+      return 1;
+    case sensor_msgs::PointField::INT16:
+    case sensor_msgs::PointField::UINT16:
+      return 2;
+    case sensor_msgs::PointField::FLOAT64:
+      return 8;
+    default:
+      return 4;
+  }
+}
+
+//! \brief Write the value converted to the given datatype.
+inline void writeValue(uint8_t* data, uint8_t datatype, double value)
+{
+  const auto write = [data](auto v) { memcpy(data, &v, sizeof(v)); };
+  switch (datatype)
+  {
+    case sensor_msgs::PointField::INT8: write(static_cast<int8_t>(value)); break;
+    case sensor_msgs::PointField::UINT8: write(static_cast<uint8_t>(value)); break;
+    case sensor_msgs::PointField::INT16: write(static_cast<int16_t>(value)); break;
+    case sensor_msgs::PointField::UINT16: write(static_cast<uint16_t>(value)); break;
+    case sensor_msgs::PointField::INT32: write(static_cast<int32_t>(value)); break;
+    case sensor_msgs::PointField::UINT32: write(static_cast<uint32_t>(value)); break;
+    case sensor_msgs::PointField::FLOAT64: write(value); break;
+    default: write(static_cast<float>(value)); break;
+  }
+}
+
+//! \brief Read a value of the given datatype.
+inline double readValue(const uint8_t* data, uint8_t datatype)
+{
+  const auto read = [data](auto v) { memcpy(&v, data, sizeof(v)); return static_cast<double>(v); };
+  switch (datatype)
+  {
+    case sensor_msgs::PointField::INT8: return read(int8_t());
+    case sensor_msgs::PointField::UINT8: return read(uint8_t());
+    case sensor_msgs::PointField::INT16: return read(int16_t());
+    case sensor_msgs::PointField::UINT16: return read(uint16_t());
+    case sensor_msgs::PointField::INT32: return read(int32_t());
+    case sensor_msgs::PointField::UINT32: return read(uint32_t());
+    case sensor_msgs::PointField::FLOAT64: return read(double());
+    default: return read(float());
+  }
+}
+
+//! \brief Data of point i of the cloud (rows may be padded).
+inline const uint8_t* getPointData(const sensor_msgs::PointCloud2& cloud, size_t i)
+{
+  return cloud.data.data() + (i / cloud.width) * cloud.row_step + (i % cloud.width) * cloud.point_step;
+}
+
+inline uint8_t* getPointData(sensor_msgs::PointCloud2& cloud, size_t i)
+{
+  return cloud.data.data() + (i / cloud.width) * cloud.row_step + (i % cloud.width) * cloud.point_step;
+}
+
+/**
+ * \brief A cloud with the given layout whose data bytes are all set to fill.
+ * \param[in] height Height of the cloud.
+ * \param[in] width Width of the cloud.
+ * \param[in] fields The fields of the points.
+ * \param[in] point_step Size of one point.
+ * \param[in] row_padding Bytes added to the end of each row.
+ * \param[in] fill Value of the data bytes.
+ */
+inline sensor_msgs::PointCloud2 makeCloud(uint32_t height, uint32_t width,
+                                          const std::vector<sensor_msgs::PointField>& fields, uint32_t point_step,
+                                          uint32_t row_padding = 0, uint8_t fill = 0)
+{
+  sensor_msgs::PointCloud2 cloud;
+  cloud.header.frame_id = "lidar";
+  cloud.height = height;
+  cloud.width = width;
+  cloud.fields = fields;
+  cloud.point_step = point_step;
+  cloud.row_step = width * point_step + row_padding;
+  cloud.is_dense = false;
+  cloud.data.resize(static_cast<size_t>(height) * cloud.row_step, fill);
+  return cloud;
+}
+
+//! \brief The value of the field with the given name, or false if Point has no such field.
+inline bool getValue(const Point& p, const std::string& name, double& value)
+{
+  if (name == "x")
+    value = p.x;
+  else if (name == "y")
+    value = p.y;
+  else if (name == "z")
+    value = p.z;
+  else if (name == "intensity")
+    value = p.intensity;
+  else if (name == "ring")
+    value = p.ring;
+  else if (name == "time")
+    value = p.time;
+  else if (name == "id")
+    value = p.id;
+  else
+    return false;
+  return true;
+}
+
+//! \brief Set the field with the given name (if Point has it).
+inline void setValue(Point& p, const std::string& name, double value)
+{
+  if (name == "x")
+    p.x = static_cast<float>(value);
+  else if (name == "y")
+    p.y = static_cast<float>(value);
+  else if (name == "z")
+    p.z = static_cast<float>(value);
+  else if (name == "intensity")
+    p.intensity = static_cast<float>(value);
+  else if (name == "ring")
+    p.ring = static_cast<uint16_t>(value);
+  else if (name == "time")
+    p.time = value;
+  else if (name == "id")
+    p.id = static_cast<uint32_t>(value);
+}
+
+//! \brief Write the fields of point i of the cloud.
+inline void setPoint(sensor_msgs::PointCloud2& cloud, size_t i, const Point& p)
+{
+  const auto data = getPointData(cloud, i);
+  double value;
+  for (const auto& field : cloud.fields)
+  {
+    if (getValue(p, field.name, value))
+      writeValue(data + field.offset, field.datatype, value);
+  }
+}
+
+//! \brief Read point i of the cloud.
+inline Point getPoint(const sensor_msgs::PointCloud2& cloud, size_t i)
+{
+  Point p;
+  const auto data = getPointData(cloud, i);
+  for (const auto& field : cloud.fields)
+    setValue(p, field.name, readValue(data + field.offset, field.datatype));
+  return p;
+}
+
+/**
+ * \brief A cloud of the points with the given layout.
+ * \param[in] points The points, row after row. The width of the cloud is their number divided by height.
+ * \param[in] height Height of the cloud.
+ * \param[in] fields The fields of the points.
+ * \param[in] point_step Size of one point.
+ * \param[in] row_padding Bytes added to the end of each row.
+ * \param[in] fill Value of the bytes not covered by the fields.
+ */
+inline sensor_msgs::PointCloud2 makeCloud(const std::vector<Point>& points, uint32_t height,
+                                          const std::vector<sensor_msgs::PointField>& fields, uint32_t point_step,
+                                          uint32_t row_padding = 0, uint8_t fill = 0)
+{
+  const auto width = height == 0 ? 0 : static_cast<uint32_t>(points.size() / height);
+  auto cloud = makeCloud(height, width, fields, point_step, row_padding, fill);
+  for (size_t i = 0; i < points.size(); ++i)
+    setPoint(cloud, i, points[i]);
+  return cloud;
+}
+
+//! \brief Results of encoding a cloud and decoding it again.
+template<class M>
+struct RoundTrip
+{
+  //! \brief The encoded message (empty if the encoder failed or returned nothing).
+  cras::optional<M> encoded;
+  //! \brief The decoded cloud (null if the decoder failed or returned nothing).
+  sensor_msgs::PointCloud2ConstPtr decoded;
+};
+
+//! \brief Type of the messages of the given publisher plugin (only for decltype()).
+template<class M, class Config>
+M getMessageType(const SimplePublisherPlugin<M, Config>&);
+
+/**
+ * \brief Encode the cloud with the publisher and decode the result with the subscriber.
+ *
+ * Failures of the encoder or decoder and a decoded cloud whose layout differs from the original one are reported as
+ * test failures.
+ */
+template<class Publisher, class Subscriber, class Config, class SubscriberConfig = NoConfigConfig>
+RoundTrip<decltype(getMessageType(std::declval<Publisher>()))> roundTrip(
+    const Publisher& pub, const Subscriber& sub, const sensor_msgs::PointCloud2& cloud, const Config& config,
+    const SubscriberConfig& subscriber_config = SubscriberConfig())
+{
+  RoundTrip<decltype(getMessageType(std::declval<Publisher>()))> result;
+  const auto encoded = pub.encodeTyped(cloud, config);
+  EXPECT_TRUE(encoded.has_value()) << (encoded.has_value() ? "" : encoded.error());
+  if (!encoded.has_value() || !encoded->has_value())
+    return result;
+  result.encoded = encoded->value();
+
+  const auto decoded = sub.decodeTyped(*result.encoded, subscriber_config);
+  EXPECT_TRUE(decoded.has_value()) << (decoded.has_value() ? "" : decoded.error());
+  if (!decoded.has_value() || !decoded->has_value())
+    return result;
+
+  const auto& out = *decoded->value();
+  EXPECT_EQ(cloud.header.frame_id, out.header.frame_id);
+  EXPECT_EQ(cloud.height, out.height);
+  EXPECT_EQ(cloud.width, out.width);
+  EXPECT_EQ(cloud.point_step, out.point_step);
+  EXPECT_EQ(cloud.fields.size(), out.fields.size());
+  EXPECT_GE(out.data.size(), static_cast<size_t>(out.height) * out.row_step);
+  if (cloud.height == out.height && cloud.width == out.width && cloud.point_step == out.point_step &&
+      out.data.size() >= static_cast<size_t>(out.height) * out.row_step)
+    result.decoded = decoded->value();
+  return result;
+}
+
+}
+}